@@ -1,9 +1,48 @@
 /* $Id: ast.c,v 1.9 2023/02/21 03:17:40 leavens Exp $ */
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
 #include "utilities.h"
+#include "hash.h"
 #include "ast.h"
+#include "mem.h"
 
-// Return a (pointer to a) fresh AST
+// Whether the current thread is sharing expression nodes
+// (see ast_share_begin)
+static _Thread_local bool sharing = false;
+// The current thread's store (see ast_use_store)
+static _Thread_local ast_store *store = NULL;
+// The current thread's table of shared expression nodes
+// (open addressing, with num_slots a power of 2)
+static _Thread_local AST **shared = NULL;
+static _Thread_local size_t num_slots = 0;
+static _Thread_local size_t num_shared = 0;
+// Whether the last expression built made a new node
+static _Thread_local bool last_fresh = false;
+// The file locations of the expression occurrences built
+// since the last expression parent (in the order they were built,
+// which is the order a walk finishes them)
+static _Thread_local file_location *pending = NULL;
+static _Thread_local size_t num_pending = 0;
+static _Thread_local size_t pending_cap = 0;
+
+// An expression parent built while sharing, with the file locations
+// of the expression occurrences under it
+typedef struct {
+    const AST *parent;
+    file_location *locs;
+} parent_locs;
+
+// The side table of the file locations of shared expressions
+// (open addressing, keyed by parent, with num_parent_slots a power of 2),
+// for all threads, so it is only used with parents_lock held
+static pthread_mutex_t parents_lock = PTHREAD_MUTEX_INITIALIZER;
+static parent_locs *parents = NULL;
+static size_t num_parent_slots = 0;
+static size_t num_parents = 0;
+
+// Return a (pointer to a) fresh AST from the current thread's store
 // and fill in its file_location with the given file name (fn),
 // line number (ln) and column number (col).
 // Also initializes the next pointer to NULL.
@@ -11,10 +50,7 @@
 // print an error on stderr and exit with a failure code.
 static AST *ast_allocate(const char *fn, unsigned int ln, unsigned int col)
 {
-    AST *ret = (AST *) malloc(sizeof(AST));
-    if (ret == NULL) {
-	bail_with_error("No space to create const_def AST!");
-    }
+    AST *ret = (AST *) pool_alloc(&store->nodes);
     ret->file_loc.filename = fn;
     ret->file_loc.line = ln;
     ret->file_loc.column = col;
@@ -22,6 +58,326 @@ static AST *ast_allocate(const char *fn, unsigned int ln, unsigned int col)
     return ret;
 }
 
+// Return the hash of the contents of the expression node exp
+// (its children are shared, so they are hashed by address)
+static size_t expr_hash(const AST *exp)
+{
+    switch (exp->type_tag) {
+    case bin_expr_ast: {
+	const void *key[3] = { exp->data.bin_expr.leftexp,
+			       exp->data.bin_expr.rightexp,
+			       (const void *) (uintptr_t)
+			       exp->data.bin_expr.arith_op };
+	return (size_t) xxh64(key, sizeof(key), bin_expr_ast);
+    }
+    case ident_ast:
+	return (size_t) xxh64(exp->data.ident.name,
+			      strlen(exp->data.ident.name), ident_ast);
+    default:
+	return (size_t) xxh64(&exp->data.number.value,
+			      sizeof(exp->data.number.value), number_ast);
+    }
+}
+
+// Return true just when the expression nodes e1 and e2
+// have the same contents
+static bool same_expr(const AST *e1, const AST *e2)
+{
+    if (e1->type_tag != e2->type_tag) {
+	return false;
+    }
+    switch (e1->type_tag) {
+    case bin_expr_ast:
+	return e1->data.bin_expr.leftexp == e2->data.bin_expr.leftexp
+	    && e1->data.bin_expr.rightexp == e2->data.bin_expr.rightexp
+	    && e1->data.bin_expr.arith_op == e2->data.bin_expr.arith_op;
+    case ident_ast:
+	return strcmp(e1->data.ident.name, e2->data.ident.name) == 0;
+    default:
+	return e1->data.number.value == e2->data.number.value;
+    }
+}
+
+// Double the number of slots in the current thread's table
+// of shared expression nodes
+static void grow_shared()
+{
+    size_t new_slots = (num_slots == 0) ? 1024 : 2 * num_slots;
+    AST **table = (AST **) mem_calloc(mem_ast, new_slots, sizeof(AST *));
+    if (table == NULL) {
+	bail_with_error("No space to share expressions!");
+    }
+    for (size_t i = 0; i < num_slots; i++) {
+	if (shared[i] != NULL) {
+	    size_t k = expr_hash(shared[i]) & (new_slots - 1);
+	    while (table[k] != NULL) {
+		k = (k + 1) & (new_slots - 1);
+	    }
+	    table[k] = shared[i];
+	}
+    }
+    mem_free(shared);
+    shared = table;
+    num_slots = new_slots;
+}
+
+// Record floc as the file location of the next expression occurrence
+// under the next expression parent
+static void add_pending(file_location floc)
+{
+    if (num_pending == pending_cap) {
+	pending_cap = (pending_cap == 0) ? 64 : 2 * pending_cap;
+	pending = (file_location *) mem_realloc(mem_ast, pending, pending_cap
+					    * sizeof(file_location));
+	if (pending == NULL) {
+	    bail_with_error("No space to share expressions!");
+	}
+    }
+    pending[num_pending++] = floc;
+}
+
+// Requires: key is an expression node (on the stack) with all but its next
+// field filled in.
+// Return a (pointer to an) AST with the contents of key: if sharing,
+// the shared node with those contents (made if there is none yet),
+// otherwise a fresh copy of key
+static AST *expr_node(const AST *key)
+{
+    if (!sharing) {
+	AST *ret = ast_allocate(key->file_loc.filename, key->file_loc.line,
+				key->file_loc.column);
+	ret->type_tag = key->type_tag;
+	ret->data = key->data;
+	return ret;
+    }
+    add_pending(key->file_loc);
+    if (2 * (num_shared + 1) > num_slots) {
+	grow_shared();
+    }
+    size_t k = expr_hash(key) & (num_slots - 1);
+    while (shared[k] != NULL) {
+	if (same_expr(shared[k], key)) {
+	    last_fresh = false;
+	    return shared[k];
+	}
+	k = (k + 1) & (num_slots - 1);
+    }
+    AST *ret = ast_allocate(key->file_loc.filename, key->file_loc.line,
+			    key->file_loc.column);
+    ret->type_tag = key->type_tag;
+    ret->data = key->data;
+    shared[k] = ret;
+    num_shared++;
+    last_fresh = true;
+    return ret;
+}
+
+// Double the number of slots in the side table of expression locations
+// (with parents_lock held)
+static void grow_parents()
+{
+    size_t new_slots = (num_parent_slots == 0) ? 1024 : 2 * num_parent_slots;
+    parent_locs *table = (parent_locs *) mem_calloc(mem_ast, new_slots,
+						 sizeof(parent_locs));
+    if (table == NULL) {
+	pthread_mutex_unlock(&parents_lock);
+	bail_with_error("No space to share expressions!");
+    }
+    for (size_t i = 0; i < num_parent_slots; i++) {
+	if (parents[i].parent != NULL) {
+	    size_t k = xxh64(&parents[i].parent, sizeof(AST *), 0)
+		& (new_slots - 1);
+	    while (table[k].parent != NULL) {
+		k = (k + 1) & (new_slots - 1);
+	    }
+	    table[k] = parents[i];
+	}
+    }
+    mem_free(parents);
+    parents = table;
+    num_parent_slots = new_slots;
+}
+
+// Requires: parent is an expression parent that was just built
+// If sharing, move the file locations of the expression occurrences
+// built since the last expression parent to the side table, under parent
+static void take_pending(const AST *parent)
+{
+    if (!sharing || num_pending == 0) {
+	return;
+    }
+    file_location *locs = (file_location *) mem_alloc(mem_ast, num_pending
+						   * sizeof(file_location));
+    if (locs == NULL) {
+	bail_with_error("No space to share expressions!");
+    }
+    memcpy(locs, pending, num_pending * sizeof(file_location));
+    num_pending = 0;
+    if (store->num_parents == store->parents_cap) {
+	store->parents_cap = (store->parents_cap == 0)
+	    ? 64 : 2 * store->parents_cap;
+	store->parents = (const AST **) mem_realloc(
+	    mem_ast, store->parents, store->parents_cap * sizeof(AST *));
+	if (store->parents == NULL) {
+	    mem_free(locs);
+	    bail_with_error("No space to share expressions!");
+	}
+    }
+    store->parents[store->num_parents++] = parent;
+    pthread_mutex_lock(&parents_lock);
+    if (2 * (num_parents + 1) > num_parent_slots) {
+	grow_parents();
+    }
+    size_t k = xxh64(&parent, sizeof(AST *), 0) & (num_parent_slots - 1);
+    while (parents[k].parent != NULL) {
+	k = (k + 1) & (num_parent_slots - 1);
+    }
+    parents[k].parent = parent;
+    parents[k].locs = locs;
+    num_parents++;
+    pthread_mutex_unlock(&parents_lock);
+}
+
+// Start sharing expression nodes in the current thread (see ast.h)
+void ast_share_begin()
+{
+    ast_share_end();
+    sharing = true;
+}
+
+// Stop sharing expression nodes in the current thread (see ast.h)
+void ast_share_end()
+{
+    mem_free(shared);
+    shared = NULL;
+    num_slots = 0;
+    num_shared = 0;
+    mem_free(pending);
+    pending = NULL;
+    num_pending = 0;
+    pending_cap = 0;
+    sharing = false;
+}
+
+// Requires: exp is the expression the current thread built last
+// Make floc the file location of that occurrence of exp
+void ast_relocate(AST *exp, file_location floc)
+{
+    if (!sharing) {
+	exp->file_loc = floc;
+	return;
+    }
+    pending[num_pending - 1] = floc;
+    if (last_fresh) {
+	exp->file_loc = floc;
+    }
+}
+
+// Return the file locations of the expression occurrences under parent
+// (see ast.h), or NULL if they were not recorded
+const file_location *ast_expr_locations(const AST *parent)
+{
+    const file_location *ret = NULL;
+    pthread_mutex_lock(&parents_lock);
+    if (num_parents > 0) {
+	size_t k = xxh64(&parent, sizeof(AST *), 0) & (num_parent_slots - 1);
+	while (parents[k].parent != NULL) {
+	    if (parents[k].parent == parent) {
+		ret = parents[k].locs;
+		break;
+	    }
+	    k = (k + 1) & (num_parent_slots - 1);
+	}
+    }
+    pthread_mutex_unlock(&parents_lock);
+    return ret;
+}
+
+// Make s an empty store (see ast.h)
+void ast_store_init(ast_store *s)
+{
+    pool_init(&s->nodes, mem_ast, sizeof(AST));
+    s->names = NULL;
+    s->num_names = 0;
+    s->names_cap = 0;
+    s->parents = NULL;
+    s->num_parents = 0;
+    s->parents_cap = 0;
+}
+
+// Make s the current thread's store, returning the one before (see ast.h)
+ast_store *ast_use_store(ast_store *s)
+{
+    ast_store *old = store;
+    store = s;
+    return old;
+}
+
+// Make the current thread's store own name (see ast.h)
+void ast_store_adopt(char *name)
+{
+    if (store->num_names == store->names_cap) {
+	store->names_cap = (store->names_cap == 0) ? 256 : 2 * store->names_cap;
+	store->names = (char **) mem_realloc(
+	    mem_ast, store->names, store->names_cap * sizeof(char *));
+	if (store->names == NULL) {
+	    mem_free(name);
+	    bail_with_error("No space for the names of an AST!");
+	}
+    }
+    store->names[store->num_names++] = name;
+}
+
+// Take parent out of the side table of file locations, freeing its
+// locations (with parents_lock held)
+static void remove_parent(const AST *parent)
+{
+    size_t mask = num_parent_slots - 1;
+    size_t i = xxh64(&parent, sizeof(AST *), 0) & mask;
+    while (parents[i].parent != parent) {
+	i = (i + 1) & mask;
+    }
+    mem_free(parents[i].locs);
+    // move up the entries after it that would no longer be found
+    // (those whose hash slot is not between the hole and them)
+    for (size_t j = (i + 1) & mask; parents[j].parent != NULL;
+	 j = (j + 1) & mask) {
+	size_t k = xxh64(&parents[j].parent, sizeof(AST *), 0) & mask;
+	bool reachable = (i < j) ? (i < k && k <= j) : (i < k || k <= j);
+	if (!reachable) {
+	    parents[i] = parents[j];
+	    i = j;
+	}
+    }
+    parents[i].parent = NULL;
+    parents[i].locs = NULL;
+    num_parents--;
+}
+
+// Free everything s owns, making it empty (see ast.h)
+void ast_store_release(ast_store *s)
+{
+    if (s->num_parents > 0) {
+	pthread_mutex_lock(&parents_lock);
+	for (size_t i = 0; i < s->num_parents; i++) {
+	    remove_parent(s->parents[i]);
+	}
+	if (num_parents == 0) {
+	    mem_free(parents);
+	    parents = NULL;
+	    num_parent_slots = 0;
+	}
+	pthread_mutex_unlock(&parents_lock);
+    }
+    mem_free(s->parents);
+    for (size_t i = 0; i < s->num_names; i++) {
+	mem_free(s->names[i]);
+    }
+    mem_free(s->names);
+    pool_release(&s->nodes);
+    ast_store_init(s);
+}
+
 // Return a (pointer to a) fresh AST for a program, whose first token
 // starts in the given file (fn), line (ln), and column (col),
 // and which contains the given ASTs for const-decls (cds), var-decls (vds)
@@ -66,6 +422,7 @@ AST *ast_assign_stmt(token t, const char *ident, AST *exp)
     ret->type_tag = assign_ast;
     ret->data.assign_stmt.name = ident;
     ret->data.assign_stmt.exp = exp;
+    take_pending(ret);
     return ret;
 }
 
@@ -119,6 +476,7 @@ AST *ast_write_stmt(token t, AST *exp)
     AST *ret = ast_allocate(t.filename, t.line, t.column);
     ret->type_tag = write_ast;
     ret->data.write_stmt.exp = exp;
+    take_pending(ret);
     return ret;
 }
 
@@ -137,6 +495,7 @@ AST *ast_odd_cond(token t, AST *exp)
     AST *ret = ast_allocate(t.filename, t.line, t.column);
     ret->type_tag = odd_cond_ast;
     ret->data.odd_cond.exp = exp;
+    take_pending(ret);
     return ret;
 }
 
@@ -150,6 +509,7 @@ AST *ast_bin_cond(token t, AST *e1, rel_op relop, AST *e2)
     ret->data.bin_cond.leftexp = e1;
     ret->data.bin_cond.relop = relop;
     ret->data.bin_cond.rightexp = e2;
+    take_pending(ret);
     return ret;
 }
 
@@ -163,37 +523,40 @@ AST *ast_op_expr(token t, bin_arith_op op, AST *e2)
     return ret;
 }
 
-// Return a (pointer to a) fresh AST for a binary expression
-// with left expresion AST e1, binary artihmetic operator arith_op,
-// and right expression AST e2.
+// Return a (pointer to a) fresh (or, if sharing, shared) AST
+// for a binary expression with left expresion AST e1,
+// binary artihmetic operator arith_op, and right expression AST e2.
 AST *ast_bin_expr(token t, AST *e1, bin_arith_op arith_op, AST *e2)
 {
-    AST *ret = ast_allocate(t.filename, t.line, t.column);
-    ret->type_tag = bin_expr_ast;
-    ret->data.bin_expr.leftexp = e1;
-    ret->data.bin_expr.arith_op = arith_op;
-    ret->data.bin_expr.rightexp = e2;
-    return ret;
+    AST key;
+    key.file_loc = token2file_loc(t);
+    key.type_tag = bin_expr_ast;
+    key.data.bin_expr.leftexp = e1;
+    key.data.bin_expr.arith_op = arith_op;
+    key.data.bin_expr.rightexp = e2;
+    return expr_node(&key);
 }
 
-// Return a (pointer to a) fresh AST for an identref expression
-// with the given name.
+// Return a (pointer to a) fresh (or, if sharing, shared) AST
+// for an identref expression with the given name.
 AST *ast_ident(token t, const char *name)
 {
-    AST *ret = ast_allocate(t.filename, t.line, t.column);
-    ret->type_tag = ident_ast;
-    ret->data.ident.name = name;
-    return ret;
+    AST key;
+    key.file_loc = token2file_loc(t);
+    key.type_tag = ident_ast;
+    key.data.ident.name = name;
+    return expr_node(&key);
 }
 
-// Return a (pointer to a) fresh AST for an (signed) number expression
-// with the given value
+// Return a (pointer to a) fresh (or, if sharing, shared) AST
+// for an (signed) number expression with the given value
 AST *ast_number(token t, short int value)
 {
-    AST *ret = ast_allocate(t.filename, t.line, t.column);
-    ret->type_tag = number_ast;
-    ret->data.number.value = value;
-    return ret;
+    AST key;
+    key.file_loc = token2file_loc(t);
+    key.type_tag = number_ast;
+    key.data.number.value = value;
+    return expr_node(&key);
 }
 
 // Return an AST list that is empty
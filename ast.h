@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include "token.h"
 #include "file_location.h"
+#include "pool.h"
 // types of ASTs (type tags)
 typedef enum {
     program_ast, const_decl_ast, var_decl_ast, // proc_decl_ast,
@@ -13,6 +14,9 @@ typedef enum {
     ident_ast, number_ast
 } AST_type;
 
+// Number of AST type tags (for tables indexed by AST_type)
+#define NUM_AST_TYPES (number_ast + 1)
+
 // forward declaration, so can use the type AST* below
 typedef struct AST_s AST;
 // lists of ASTs
@@ -154,6 +158,42 @@ typedef struct AST_s {
     } data;
 } AST;
 
+// An AST store owns the AST nodes built while it is the current thread's
+// store (see ast_use_store), the names given to it (see ast_store_adopt)
+// and the file locations recorded for its nodes while sharing
+// (see ast_share_begin), and frees them all at once when it is released,
+// as the nodes of an AST (which may be a DAG) are not freed one by one.
+typedef struct {
+    pool nodes;             // of AST
+    char **names;           // the names it owns
+    size_t num_names;
+    size_t names_cap;
+    const AST **parents;    // its nodes in the side table of file locations
+    size_t num_parents;
+    size_t parents_cap;
+} ast_store;
+
+// Make s an empty store
+extern void ast_store_init(ast_store *s);
+
+// Make s the store that the AST nodes the current thread builds from now on
+// come from (or, if s is NULL, make the thread have no store),
+// and return the thread's store before this call (NULL if none)
+extern ast_store *ast_use_store(ast_store *s);
+
+// Requires: the current thread has a store and name is a block from mem.h
+// Make the current thread's store own name, so name is freed
+// when the store is released (e.g., the text of a token whose name
+// is kept in the AST)
+extern void ast_store_adopt(char *name);
+
+// Requires: s is not any thread's store
+// Free all the nodes, names and file locations s owns, making s empty
+extern void ast_store_release(ast_store *s);
+
+// The functions below that build ASTs require the current thread
+// to have a store, which the AST is allocated from.
+
 // Return a (pointer to a) fresh AST for a program, whose first token
 // starts in the given file (fn), line (ln), and column (col),
 // and which contains the given ASTs for const-decls (cds), var-decls (vds)
@@ -209,19 +249,49 @@ extern AST *ast_bin_cond(token t, AST *e1, rel_op relop, AST *e2);
 // and a (right) expression e2
 extern AST *ast_op_expr(token t, bin_arith_op op, AST *e2);
 
-// Return a (pointer to a) fresh AST for a binary expression
-// with left expresion AST e1, binary artihmetic operator arith_op,
-// and right expression AST e2.
+// Return a (pointer to a) fresh (or, if sharing, shared) AST
+// for a binary expression with left expresion AST e1,
+// binary artihmetic operator arith_op, and right expression AST e2.
 extern AST *ast_bin_expr(token t, AST *e1, bin_arith_op arith_op, AST *e2);
 
-// Return a (pointer to a) fresh AST for an ident expression
-// with the given name.
+// Return a (pointer to a) fresh (or, if sharing, shared) AST
+// for an ident expression with the given name.
 extern AST *ast_ident(token t, const char *name);
 
-// Return a (pointer to a) fresh AST for an (signed) number expression
-// with the given value
+// Return a (pointer to a) fresh (or, if sharing, shared) AST
+// for an (signed) number expression with the given value
 extern AST *ast_number(token t, short int value);
 
+// Sharing (hash-consing) of expressions:
+// while the current thread is sharing, ast_bin_expr, ast_ident,
+// and ast_number return the same node for structurally equal expressions,
+// so equal expressions are equal pointers, and the AST is a DAG
+// (which walks still see as a tree). Each shared node's file_loc is that
+// of its first occurrence; the file locations of all the occurrences
+// are kept in a side table, under the expression parent (the assign,
+// write, odd_cond, or bin_cond AST) they are in.
+// The ASTs built while sharing are freed only with their store.
+
+// Start sharing expression nodes in the current thread,
+// with none shared yet
+extern void ast_share_begin();
+
+// Stop sharing expression nodes in the current thread
+// (the nodes and their file locations are kept in their store)
+extern void ast_share_end();
+
+// Requires: exp is the expression the current thread built last
+// Make floc the file location of that occurrence of exp
+// (e.g., the location of the parenthesis before it)
+extern void ast_relocate(AST *exp, file_location floc);
+
+// Requires: parent is an assign, write, odd_cond, or bin_cond AST
+// Return the file locations of the expression nodes under parent,
+// in the order a walk of parent (see ast_walk.h) finishes them,
+// if parent was built while sharing; otherwise return NULL
+// (and each expression node's own file_loc is right)
+extern const file_location *ast_expr_locations(const AST *parent);
+
 // Return an AST list that is empty
 extern AST_list ast_list_empty_list();
 
@@ -0,0 +1,604 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "utilities.h"
+#include "hash.h"
+#include "ast.h"
+#include "ast_file.h"
+#include "mem.h"
+
+// Initial number of nodes and bytes of strings a writer has room for
+#define INITIAL_NODES 1024
+#define INITIAL_STRINGS 4096
+
+// The children a type of node has: bit k of kids is set
+// if it may have a kth child, and of required_kids if it must;
+// named is true if it has a name, and ops is the number of operators
+// its op may be (0 if it has none)
+typedef struct {
+    uint8_t kids;
+    uint8_t required_kids;
+    bool named;
+    uint8_t ops;
+} node_shape;
+
+static const node_shape shapes[NUM_AST_TYPES] = {
+    [program_ast] = { 7, 4, false, 0 },
+    [const_decl_ast] = { 0, 0, true, 0 },
+    [var_decl_ast] = { 0, 0, true, 0 },
+    [assign_ast] = { 1, 1, true, 0 },
+    [begin_ast] = { 1, 0, false, 0 },
+    [if_ast] = { 7, 7, false, 0 },
+    [while_ast] = { 3, 3, false, 0 },
+    [read_ast] = { 0, 0, true, 0 },
+    [write_ast] = { 1, 1, false, 0 },
+    [skip_ast] = { 0, 0, false, 0 },
+    [odd_cond_ast] = { 1, 1, false, 0 },
+    [bin_cond_ast] = { 3, 3, false, 6 },
+    [op_expr_ast] = { 1, 1, false, 4 },
+    [bin_expr_ast] = { 3, 3, false, 4 },
+    [ident_ast] = { 0, 0, true, 0 },
+    [number_ast] = { 0, 0, false, 0 },
+};
+
+// The state of writing a binary AST file:
+// the nodes and strings so far, and a hash table of the strings'
+// offsets (AST_FILE_NO_NAME in an empty slot), so each is written once,
+// and the file locations of the expressions under the current
+// expression parent, if they are shared (see ast_expr_locations)
+typedef struct {
+    ast_file_node *nodes;
+    size_t num_nodes;
+    size_t nodes_cap;
+    char *strings;
+    size_t strings_size;
+    size_t strings_cap;
+    uint32_t *slots;
+    size_t num_slots;        // a power of 2
+    size_t num_names;
+    const file_location *locs;
+    size_t locs_done;       // how many of the expressions are written
+} ast_writer;
+
+// Double the number of slots in w's hash table of strings
+static void grow_slots(ast_writer *w)
+{
+    size_t num_slots = (w->num_slots == 0) ? 256 : 2 * w->num_slots;
+    uint32_t *slots = (uint32_t *) mem_alloc(
+	mem_ast, num_slots * sizeof(uint32_t));
+    if (slots == NULL) {
+	bail_with_error("No space to write an AST file!");
+    }
+    for (size_t i = 0; i < num_slots; i++) {
+	slots[i] = AST_FILE_NO_NAME;
+    }
+    for (size_t i = 0; i < w->num_slots; i++) {
+	uint32_t off = w->slots[i];
+	if (off != AST_FILE_NO_NAME) {
+	    const char *s = w->strings + off;
+	    size_t k = xxh64(s, strlen(s), 0) & (num_slots - 1);
+	    while (slots[k] != AST_FILE_NO_NAME) {
+		k = (k + 1) & (num_slots - 1);
+	    }
+	    slots[k] = off;
+	}
+    }
+    mem_free(w->slots);
+    w->slots = slots;
+    w->num_slots = num_slots;
+}
+
+// Return the offset of name in w's strings, adding it if it is not there
+static uint32_t put_name(ast_writer *w, const char *name)
+{
+    if (2 * (w->num_names + 1) > w->num_slots) {
+	grow_slots(w);
+    }
+    size_t len = strlen(name);
+    size_t k = xxh64(name, len, 0) & (w->num_slots - 1);
+    while (w->slots[k] != AST_FILE_NO_NAME) {
+	if (strcmp(w->strings + w->slots[k], name) == 0) {
+	    return w->slots[k];
+	}
+	k = (k + 1) & (w->num_slots - 1);
+    }
+    if (w->strings_size + len + 1 >= AST_FILE_NO_NAME) {
+	bail_with_error("Too many names for an AST file");
+    }
+    if (w->strings_size + len + 1 > w->strings_cap) {
+	while (w->strings_size + len + 1 > w->strings_cap) {
+	    w->strings_cap *= 2;
+	}
+	w->strings = (char *) mem_realloc(mem_ast, w->strings, w->strings_cap);
+	if (w->strings == NULL) {
+	    bail_with_error("No space to write an AST file!");
+	}
+    }
+    uint32_t off = (uint32_t) w->strings_size;
+    memcpy(w->strings + off, name, len + 1);
+    w->strings_size += len + 1;
+    w->slots[k] = off;
+    w->num_names++;
+    return off;
+}
+
+static size_t put_node(ast_writer *w, AST *ast);
+
+// Requires: !ast_list_is_empty(lst)
+// Add the nodes of the list lst (and their children) to w,
+// linking each to the next, and return the index of the first
+static size_t put_list(ast_writer *w, AST_list lst)
+{
+    size_t first = put_node(w, ast_list_first(lst));
+    size_t prev = first;
+    for (lst = ast_list_rest(lst); !ast_list_is_empty(lst);
+	 lst = ast_list_rest(lst)) {
+	size_t i = put_node(w, ast_list_first(lst));
+	w->nodes[prev].next = (int32_t) (i - prev);
+	prev = i;
+    }
+    return first;
+}
+
+// Make the kth child of the node at index i in w the node for ast
+// (or nothing, if ast is NULL)
+static void put_kid(ast_writer *w, size_t i, unsigned int k, AST *ast)
+{
+    if (ast != NULL) {
+	size_t kid = put_node(w, ast);
+	w->nodes[i].kids[k] = (int32_t) (kid - i);
+    }
+}
+
+// Make the kth child of the node at index i in w the list lst
+// (or nothing, if lst is empty)
+static void put_list_kid(ast_writer *w, size_t i, unsigned int k,
+			 AST_list lst)
+{
+    if (!ast_list_is_empty(lst)) {
+	size_t kid = put_list(w, lst);
+	w->nodes[i].kids[k] = (int32_t) (kid - i);
+    }
+}
+
+// Requires: ast is an expression parent
+// Start writing the expressions under ast
+static void put_expr_parent(ast_writer *w, AST *ast)
+{
+    w->locs = ast_expr_locations(ast);
+    w->locs_done = 0;
+}
+
+// Requires: the node at index i in w is an expression, whose children
+// (if any) are written
+// Give that node the file location of its occurrence, if it is shared
+static void put_expr_location(ast_writer *w, size_t i)
+{
+    if (w->locs != NULL) {
+	w->nodes[i].line = w->locs[w->locs_done].line;
+	w->nodes[i].column = w->locs[w->locs_done].column;
+    }
+    w->locs_done++;
+}
+
+// Add the node for ast (and its children, but not the rest of its list)
+// to w and return its index
+static size_t put_node(ast_writer *w, AST *ast)
+{
+    if (w->num_nodes == w->nodes_cap) {
+	if (w->nodes_cap >= INT32_MAX / 2) {
+	    bail_with_error("Too many AST nodes for an AST file");
+	}
+	w->nodes_cap *= 2;
+	w->nodes = (ast_file_node *) mem_realloc(mem_ast, w->nodes, w->nodes_cap
+					     * sizeof(ast_file_node));
+	if (w->nodes == NULL) {
+	    bail_with_error("No space to write an AST file!");
+	}
+    }
+    size_t i = w->num_nodes++;
+    ast_file_node *n = &w->nodes[i];
+    memset(n, 0, sizeof(*n));
+    n->type = (uint8_t) ast->type_tag;
+    n->name = AST_FILE_NO_NAME;
+    n->line = ast->file_loc.line;
+    n->column = ast->file_loc.column;
+    // n may move as children are added, so it is not used below
+    switch (ast->type_tag) {
+    case program_ast:
+	put_list_kid(w, i, 0, ast->data.program.cds);
+	put_list_kid(w, i, 1, ast->data.program.vds);
+	put_kid(w, i, 2, ast->data.program.stmt);
+	break;
+    case const_decl_ast:
+	w->nodes[i].name = put_name(w, ast->data.const_decl.name);
+	w->nodes[i].value = ast->data.const_decl.num_val;
+	break;
+    case var_decl_ast:
+	w->nodes[i].name = put_name(w, ast->data.var_decl.name);
+	break;
+    case assign_ast:
+	w->nodes[i].name = put_name(w, ast->data.assign_stmt.name);
+	put_expr_parent(w, ast);
+	put_kid(w, i, 0, ast->data.assign_stmt.exp);
+	break;
+    case begin_ast:
+	put_list_kid(w, i, 0, ast->data.begin_stmt.stmts);
+	break;
+    case if_ast:
+	put_kid(w, i, 0, ast->data.if_stmt.cond);
+	put_kid(w, i, 1, ast->data.if_stmt.thenstmt);
+	put_kid(w, i, 2, ast->data.if_stmt.elsestmt);
+	break;
+    case while_ast:
+	put_kid(w, i, 0, ast->data.while_stmt.cond);
+	put_kid(w, i, 1, ast->data.while_stmt.stmt);
+	break;
+    case read_ast:
+	w->nodes[i].name = put_name(w, ast->data.read_stmt.name);
+	break;
+    case write_ast:
+	put_expr_parent(w, ast);
+	put_kid(w, i, 0, ast->data.write_stmt.exp);
+	break;
+    case skip_ast:
+	break;
+    case odd_cond_ast:
+	put_expr_parent(w, ast);
+	put_kid(w, i, 0, ast->data.odd_cond.exp);
+	break;
+    case bin_cond_ast:
+	w->nodes[i].op = (uint8_t) ast->data.bin_cond.relop;
+	put_expr_parent(w, ast);
+	put_kid(w, i, 0, ast->data.bin_cond.leftexp);
+	put_kid(w, i, 1, ast->data.bin_cond.rightexp);
+	break;
+    case op_expr_ast:
+	w->nodes[i].op = (uint8_t) ast->data.op_expr.arith_op;
+	put_kid(w, i, 0, ast->data.op_expr.exp);
+	break;
+    case bin_expr_ast:
+	w->nodes[i].op = (uint8_t) ast->data.bin_expr.arith_op;
+	put_kid(w, i, 0, ast->data.bin_expr.leftexp);
+	put_kid(w, i, 1, ast->data.bin_expr.rightexp);
+	put_expr_location(w, i);
+	break;
+    case ident_ast:
+	w->nodes[i].name = put_name(w, ast->data.ident.name);
+	put_expr_location(w, i);
+	break;
+    case number_ast:
+	w->nodes[i].value = ast->data.number.value;
+	put_expr_location(w, i);
+	break;
+    default:
+	bail_with_error("Unknown AST type (%d) in ast_file_write",
+			ast->type_tag);
+	break;
+    }
+    return i;
+}
+
+// Write the AST of the program progast to a binary AST file named fname.
+// If the file cannot be written, bail with an error message.
+void ast_file_write(AST *progast, const char *fname)
+{
+    ast_writer w;
+    w.nodes_cap = INITIAL_NODES;
+    w.nodes = (ast_file_node *) mem_alloc(
+	mem_ast, w.nodes_cap * sizeof(ast_file_node));
+    w.num_nodes = 0;
+    w.strings_cap = INITIAL_STRINGS;
+    w.strings = (char *) mem_alloc(mem_ast, w.strings_cap);
+    w.strings_size = 0;
+    w.slots = NULL;
+    w.num_slots = 0;
+    w.num_names = 0;
+    w.locs = NULL;
+    w.locs_done = 0;
+    if (w.nodes == NULL || w.strings == NULL) {
+	bail_with_error("No space to write an AST file!");
+    }
+    ast_file_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, AST_FILE_MAGIC, sizeof(h.magic));
+    h.version = AST_FILE_VERSION;
+    h.filename = put_name(&w, progast->file_loc.filename);
+    put_node(&w, progast);
+    h.num_nodes = (uint32_t) w.num_nodes;
+    h.strings_size = (uint32_t) w.strings_size;
+
+    FILE *fp = fopen(fname, "wb");
+    if (fp == NULL) {
+	bail_with_error("Cannot create %s", fname);
+    }
+    fwrite(&h, sizeof(h), 1, fp);
+    fwrite(w.nodes, sizeof(ast_file_node), w.num_nodes, fp);
+    fwrite(w.strings, 1, w.strings_size, fp);
+    bool failed = ferror(fp);
+    if (fclose(fp) != 0 || failed) {
+	bail_with_error("Cannot write %s", fname);
+    }
+    mem_free(w.nodes);
+    mem_free(w.strings);
+    mem_free(w.slots);
+}
+
+// A binary AST file opened for reading
+struct ast_file_s {
+    const char *data;
+    size_t len;
+    bool mapped;            // is data a mapping (to unmap when closed)?
+    const ast_file_header *header;
+    const ast_file_node *nodes;
+    const char *strings;
+};
+
+// Is the relative index rel of a child (or next node)
+// of the node at index i in a file of num_nodes nodes valid?
+static bool valid_link(int32_t rel, size_t i, size_t num_nodes)
+{
+    return rel == 0 || (rel > 0 && (size_t) rel < num_nodes - i);
+}
+
+// Is the node at index i of the nodes of a file with header h
+// (and num_nodes nodes) well formed?
+static bool valid_node(const ast_file_header *h, const ast_file_node *nodes,
+		       size_t i)
+{
+    const ast_file_node *n = &nodes[i];
+    if (n->type >= NUM_AST_TYPES || !valid_link(n->next, i, h->num_nodes)) {
+	return false;
+    }
+    const node_shape *s = &shapes[n->type];
+    for (unsigned int k = 0; k < 3; k++) {
+	bool has = n->kids[k] != 0;
+	if (!valid_link(n->kids[k], i, h->num_nodes)
+	    || (has && !(s->kids & (1 << k)))
+	    || (!has && (s->required_kids & (1 << k)))) {
+	    return false;
+	}
+    }
+    if (s->named) {
+	if (n->name >= h->strings_size) {
+	    return false;
+	}
+    } else if (n->name != AST_FILE_NO_NAME) {
+	return false;
+    }
+    return n->op < ((s->ops == 0) ? 1 : s->ops);
+}
+
+// Return NULL if the len bytes at data are a well formed binary AST file,
+// and otherwise what is wrong with them
+static const char *check_contents(const char *data, size_t len)
+{
+    const ast_file_header *h = (const ast_file_header *) data;
+    if (len < sizeof(ast_file_header)
+	|| memcmp(h->magic, AST_FILE_MAGIC, sizeof(h->magic)) != 0) {
+	return "is not a binary AST file";
+    }
+    if (h->version != AST_FILE_VERSION) {
+	return "has an unknown binary AST file version";
+    }
+    uint64_t size = sizeof(ast_file_header)
+	+ (uint64_t) h->num_nodes * sizeof(ast_file_node) + h->strings_size;
+    if (size != len) {
+	return "has the wrong size for its binary AST file header";
+    }
+    const ast_file_node *nodes =
+	(const ast_file_node *) (data + sizeof(ast_file_header));
+    const char *strings = (const char *) (nodes + h->num_nodes);
+    bool ok = h->num_nodes > 0 && h->strings_size > 0
+	&& strings[h->strings_size - 1] == '\0'
+	&& h->filename < h->strings_size
+	&& nodes[0].type == program_ast;
+    for (size_t i = 0; ok && i < h->num_nodes; i++) {
+	ok = valid_node(h, nodes, i);
+    }
+    return ok ? NULL : "is not a well formed binary AST file";
+}
+
+// Requires: data has len bytes, which stay unchanged until f is closed,
+//           and check_contents(data, len) == NULL
+// Return the binary AST file whose contents are the len bytes at data
+static ast_file *ast_file_make(const char *data, size_t len, bool mapped)
+{
+    ast_file *f = (ast_file *) mem_alloc(mem_ast, sizeof(ast_file));
+    if (f == NULL) {
+	bail_with_error("No space to read a binary AST file!");
+    }
+    f->data = data;
+    f->len = len;
+    f->mapped = mapped;
+    f->header = (const ast_file_header *) data;
+    f->nodes = (const ast_file_node *) (data + sizeof(ast_file_header));
+    f->strings = (const char *) (f->nodes + f->header->num_nodes);
+    return f;
+}
+
+// Requires: data has len bytes, which stay unchanged until f is closed
+// Return the binary AST file whose contents are the len bytes at data
+// (using name in messages), like ast_file_open
+ast_file *ast_file_open_buffer(const char *name, const void *data,
+			       size_t len)
+{
+    const char *problem = check_contents((const char *) data, len);
+    if (problem != NULL) {
+	bail_with_error("%s %s", name, problem);
+    }
+    return ast_file_make((const char *) data, len, false);
+}
+
+// Requires: fname is the name of a readable file
+// Map the binary AST file named fname into memory and return it,
+// after checking that it is well formed.
+// If it is not, or cannot be mapped, bail with an error message.
+ast_file *ast_file_open(const char *fname)
+{
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) {
+	bail_with_error("Invalid file name");
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+	close(fd);
+	bail_with_error("Cannot get the size of %s", fname);
+    }
+    size_t len = (size_t) st.st_size;
+    if (len < sizeof(ast_file_header)) {
+	close(fd);
+	bail_with_error("%s is not a binary AST file", fname);
+    }
+    void *data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+	bail_with_error("Cannot map %s into memory", fname);
+    }
+    const char *problem = check_contents((const char *) data, len);
+    if (problem != NULL) {
+	munmap(data, len);
+	bail_with_error("%s %s", fname, problem);
+    }
+    return ast_file_make((const char *) data, len, true);
+}
+
+// Return the number of nodes in f
+size_t ast_file_num_nodes(const ast_file *f)
+{
+    return f->header->num_nodes;
+}
+
+// Return f's node for the program (its first node)
+const ast_file_node *ast_file_root(const ast_file *f)
+{
+    return &f->nodes[0];
+}
+
+// Requires: n is a node of f and k < 3
+// Return the kth child of n in f (or NULL if it has none)
+const ast_file_node *ast_file_child(const ast_file *f,
+				    const ast_file_node *n, unsigned int k)
+{
+    return (n->kids[k] == 0) ? NULL : n + n->kids[k];
+}
+
+// Requires: n is a node of f
+// Return the node after n in its list in f (or NULL if there is none)
+const ast_file_node *ast_file_next(const ast_file *f, const ast_file_node *n)
+{
+    return (n->next == 0) ? NULL : n + n->next;
+}
+
+// Requires: n is a node of f
+// Return the name of n in f (or NULL if it has none)
+const char *ast_file_name(const ast_file *f, const ast_file_node *n)
+{
+    return (n->name == AST_FILE_NO_NAME) ? NULL : f->strings + n->name;
+}
+
+// Return an AST for the program in f. Its nodes are in one block
+// that starts at the program's node (so it is freed by freeing that),
+// and its names and file name point into f,
+// so they are only valid until f is closed.
+// If there is no space, bail with an error message.
+AST *ast_file_load(const ast_file *f)
+{
+    size_t num_nodes = f->header->num_nodes;
+    AST *block = (AST *) mem_alloc(mem_ast, num_nodes * sizeof(AST));
+    if (block == NULL) {
+	bail_with_error("No space to load an AST!");
+    }
+    const char *fname = f->strings + f->header->filename;
+    for (size_t i = 0; i < num_nodes; i++) {
+	const ast_file_node *n = &f->nodes[i];
+	AST *ast = &block[i];
+	AST *kid[3];
+	for (unsigned int k = 0; k < 3; k++) {
+	    kid[k] = (n->kids[k] == 0) ? NULL : ast + n->kids[k];
+	}
+	const char *name = ast_file_name(f, n);
+	ast->file_loc.filename = fname;
+	ast->file_loc.line = n->line;
+	ast->file_loc.column = n->column;
+	ast->next = (n->next == 0) ? NULL : ast + n->next;
+	ast->type_tag = (AST_type) n->type;
+	switch (ast->type_tag) {
+	case program_ast:
+	    ast->data.program.cds = kid[0];
+	    ast->data.program.vds = kid[1];
+	    ast->data.program.stmt = kid[2];
+	    break;
+	case const_decl_ast:
+	    ast->data.const_decl.name = name;
+	    ast->data.const_decl.num_val = n->value;
+	    break;
+	case var_decl_ast:
+	    ast->data.var_decl.name = name;
+	    break;
+	case assign_ast:
+	    ast->data.assign_stmt.name = name;
+	    ast->data.assign_stmt.exp = kid[0];
+	    break;
+	case begin_ast:
+	    ast->data.begin_stmt.stmts = kid[0];
+	    break;
+	case if_ast:
+	    ast->data.if_stmt.cond = kid[0];
+	    ast->data.if_stmt.thenstmt = kid[1];
+	    ast->data.if_stmt.elsestmt = kid[2];
+	    break;
+	case while_ast:
+	    ast->data.while_stmt.cond = kid[0];
+	    ast->data.while_stmt.stmt = kid[1];
+	    break;
+	case read_ast:
+	    ast->data.read_stmt.name = name;
+	    break;
+	case write_ast:
+	    ast->data.write_stmt.exp = kid[0];
+	    break;
+	case skip_ast:
+	    break;
+	case odd_cond_ast:
+	    ast->data.odd_cond.exp = kid[0];
+	    break;
+	case bin_cond_ast:
+	    ast->data.bin_cond.leftexp = kid[0];
+	    ast->data.bin_cond.relop = (rel_op) n->op;
+	    ast->data.bin_cond.rightexp = kid[1];
+	    break;
+	case op_expr_ast:
+	    ast->data.op_expr.arith_op = (bin_arith_op) n->op;
+	    ast->data.op_expr.exp = kid[0];
+	    break;
+	case bin_expr_ast:
+	    ast->data.bin_expr.leftexp = kid[0];
+	    ast->data.bin_expr.arith_op = (bin_arith_op) n->op;
+	    ast->data.bin_expr.rightexp = kid[1];
+	    break;
+	case ident_ast:
+	    ast->data.ident.name = name;
+	    break;
+	case number_ast:
+	    ast->data.number.value = n->value;
+	    break;
+	}
+    }
+    return block;
+}
+
+// Close f (unmapping it, if it was mapped)
+void ast_file_close(ast_file *f)
+{
+    if (f->mapped) {
+	munmap((void *) f->data, f->len);
+    }
+    mem_free(f);
+}
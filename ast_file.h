@@ -0,0 +1,116 @@
+#ifndef _AST_FILE_H
+#define _AST_FILE_H
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+
+// A binary AST file holds the AST of a (checked) program, so tools
+// can load it without lexing, parsing, and checking the source again.
+// The file is read in place (e.g., from a mapping of the file),
+// so loading it does not copy any names.
+//
+// Format (all numbers are in the byte order of the machine that wrote
+// the file, so a file from another byte order has a bad version):
+//    header          an ast_file_header (32 bytes)
+//    nodes           num_nodes ast_file_node records (32 bytes each),
+//                    in preorder, so the program's node is the first
+//    strings         strings_size bytes of null-terminated names,
+//                    each name appearing once (the file name is first)
+// A node refers to its children and to the next node in its list
+// by their index minus its own index, which is always positive,
+// (or 0 if there is none), and to its name by its offset in the strings.
+
+#define AST_FILE_MAGIC "PL0A"
+#define AST_FILE_VERSION 1
+
+// Name offset of a node that has no name
+#define AST_FILE_NO_NAME UINT32_MAX
+
+typedef struct {
+    char magic[4];          // AST_FILE_MAGIC
+    uint32_t version;       // AST_FILE_VERSION
+    uint32_t num_nodes;
+    uint32_t strings_size;
+    uint32_t filename;      // offset of the source file's name
+    uint32_t unused[3];
+} ast_file_header;
+
+// The children of each type of node are:
+//    program          kids: const decls, var decls, statement
+//    const_decl       name and value
+//    var_decl         name
+//    assign           name; kids: expression
+//    begin            kids: statements
+//    if               kids: condition, then statement, else statement
+//    while            kids: condition, statement
+//    read             name
+//    write            kids: expression
+//    odd_cond         kids: expression
+//    bin_cond         op (a rel_op); kids: left and right expressions
+//    op_expr          op (a bin_arith_op); kids: expression
+//    bin_expr         op (a bin_arith_op); kids: left and right expressions
+//    ident            name
+//    number           value
+// where a list (e.g., of statements) is given by its first node.
+typedef struct {
+    uint8_t type;           // its AST_type
+    uint8_t op;
+    int16_t value;
+    uint32_t name;          // offset of its name (or AST_FILE_NO_NAME)
+    uint32_t line;
+    uint32_t column;
+    int32_t next;           // relative index of the next node in its list
+    int32_t kids[3];        // relative indexes of its children
+} ast_file_node;
+
+// A binary AST file opened for reading
+typedef struct ast_file_s ast_file;
+
+// Write the AST of the program progast to a binary AST file named fname.
+// If the file cannot be written, bail with an error message.
+extern void ast_file_write(AST *progast, const char *fname);
+
+// Requires: fname is the name of a readable file
+// Map the binary AST file named fname into memory and return it,
+// after checking that it is well formed.
+// If it is not, or cannot be mapped, bail with an error message.
+extern ast_file *ast_file_open(const char *fname);
+
+// Requires: data has len bytes, which stay unchanged until f is closed
+// Return the binary AST file whose contents are the len bytes at data
+// (using name in messages), like ast_file_open
+extern ast_file *ast_file_open_buffer(const char *name, const void *data,
+				      size_t len);
+
+// Return the number of nodes in f
+extern size_t ast_file_num_nodes(const ast_file *f);
+
+// Return f's node for the program (its first node)
+extern const ast_file_node *ast_file_root(const ast_file *f);
+
+// Requires: n is a node of f and k < 3
+// Return the kth child of n in f (or NULL if it has none)
+extern const ast_file_node *ast_file_child(const ast_file *f,
+					   const ast_file_node *n,
+					   unsigned int k);
+
+// Requires: n is a node of f
+// Return the node after n in its list in f (or NULL if there is none)
+extern const ast_file_node *ast_file_next(const ast_file *f,
+					  const ast_file_node *n);
+
+// Requires: n is a node of f
+// Return the name of n in f (or NULL if it has none)
+extern const char *ast_file_name(const ast_file *f, const ast_file_node *n);
+
+// Return an AST for the program in f. Its nodes are in one block
+// that starts at the program's node (so it is freed by freeing that),
+// and its names and file name point into f,
+// so they are only valid until f is closed.
+// If there is no space, bail with an error message.
+extern AST *ast_file_load(const ast_file *f);
+
+// Close f (unmapping it, if it was mapped)
+extern void ast_file_close(ast_file *f);
+
+#endif
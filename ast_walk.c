@@ -0,0 +1,241 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include "ast.h"
+#include "utilities.h"
+#include "ast_walk.h"
+#include "mem.h"
+
+// Initial number of frames in a walker's stack
+#define INITIAL_WALK_STACK 64
+
+// A unit of pending work: either a visit of ast (when fn == NULL)
+// or a call of fn on ast
+typedef struct {
+    ast_visit_fn fn;
+    AST *ast;
+    int level;
+    unsigned int flags;
+} walk_frame;
+
+// A walker's stack of frames. The stacks of the current thread's walks
+// that have not ended are kept in a list, innermost first, so they can
+// be freed if an error skips the ends of their walks (see ast_walk_unwind).
+typedef struct walk_stack_s {
+    struct walk_stack_s *outer;
+    walk_frame frames[];
+} walk_stack;
+
+// The stacks of the current thread's walks that have not ended
+static _Thread_local walk_stack *open_stacks = NULL;
+static _Thread_local unsigned int num_open = 0;
+
+// Invariant: 0 <= top <= capacity and frames == stack->frames
+struct ast_walker_s {
+    const ast_visitor *visitor;
+    void *ctx;
+    walk_stack *stack;
+    walk_frame *frames;
+    size_t top;
+    size_t capacity;
+    bool skip_children;
+};
+
+// Push a frame on the stack of w, growing the stack if needed.
+// If there is no space, print an error on stderr and exit.
+static void walk_push(ast_walker *w, ast_visit_fn fn, AST *ast,
+		      int level, unsigned int flags)
+{
+    if (w->top == w->capacity) {
+	size_t newcap = 2 * w->capacity;
+	// the link to w's stack in the list of open stacks
+	walk_stack **link = &open_stacks;
+	while (*link != w->stack) {
+	    link = &(*link)->outer;
+	}
+	walk_stack *ns = (walk_stack *) mem_realloc(mem_ast, w->stack,
+				sizeof(walk_stack) + newcap * sizeof(walk_frame));
+	if (ns == NULL) {
+	    bail_with_error("No space to grow the AST walker's stack!");
+	}
+	*link = ns;
+	w->stack = ns;
+	w->frames = ns->frames;
+	w->capacity = newcap;
+    }
+    walk_frame *f = &w->frames[w->top++];
+    f->fn = fn;
+    f->ast = ast;
+    f->level = level;
+    f->flags = flags;
+}
+
+// Reverse the frames of w from index mark to the top,
+// so that work scheduled in order is popped in that order.
+static void walk_reverse_from(ast_walker *w, size_t mark)
+{
+    size_t lo = mark;
+    size_t hi = w->top;
+    while (hi - lo > 1) {
+	hi--;
+	walk_frame tmp = w->frames[lo];
+	w->frames[lo] = w->frames[hi];
+	w->frames[hi] = tmp;
+	lo++;
+    }
+}
+
+// Schedule visits of each element of the AST list lst
+static void walk_push_list(ast_walker *w, AST_list lst, int level)
+{
+    while (!ast_list_is_empty(lst)) {
+	walk_push(w, NULL, ast_list_first(lst), level, 0);
+	lst = ast_list_rest(lst);
+    }
+}
+
+// Schedule visits of the children of ast, in source order,
+// each with the given level and flags 0
+static void walk_push_children(ast_walker *w, AST *ast, int level)
+{
+    switch (ast->type_tag) {
+    case program_ast:
+	walk_push_list(w, ast->data.program.cds, level);
+	walk_push_list(w, ast->data.program.vds, level);
+	walk_push(w, NULL, ast->data.program.stmt, level, 0);
+	break;
+    case assign_ast:
+	walk_push(w, NULL, ast->data.assign_stmt.exp, level, 0);
+	break;
+    case begin_ast:
+	walk_push_list(w, ast->data.begin_stmt.stmts, level);
+	break;
+    case if_ast:
+	walk_push(w, NULL, ast->data.if_stmt.cond, level, 0);
+	walk_push(w, NULL, ast->data.if_stmt.thenstmt, level, 0);
+	walk_push(w, NULL, ast->data.if_stmt.elsestmt, level, 0);
+	break;
+    case while_ast:
+	walk_push(w, NULL, ast->data.while_stmt.cond, level, 0);
+	walk_push(w, NULL, ast->data.while_stmt.stmt, level, 0);
+	break;
+    case write_ast:
+	walk_push(w, NULL, ast->data.write_stmt.exp, level, 0);
+	break;
+    case odd_cond_ast:
+	walk_push(w, NULL, ast->data.odd_cond.exp, level, 0);
+	break;
+    case bin_cond_ast:
+	walk_push(w, NULL, ast->data.bin_cond.leftexp, level, 0);
+	walk_push(w, NULL, ast->data.bin_cond.rightexp, level, 0);
+	break;
+    case op_expr_ast:
+	walk_push(w, NULL, ast->data.op_expr.exp, level, 0);
+	break;
+    case bin_expr_ast:
+	walk_push(w, NULL, ast->data.bin_expr.leftexp, level, 0);
+	walk_push(w, NULL, ast->data.bin_expr.rightexp, level, 0);
+	break;
+    default:
+	// const_decl, var_decl, read, skip, ident, and number have no children
+	break;
+    }
+}
+
+// Walk the AST root with the callbacks in the visitor v,
+// starting with the given level and flags.
+// The context ctx is made available to the callbacks by ast_walk_context.
+void ast_walk(AST *root, const ast_visitor *v, void *ctx,
+	      int level, unsigned int flags)
+{
+    ast_walker w;
+    w.visitor = v;
+    w.ctx = ctx;
+    w.top = 0;
+    w.capacity = INITIAL_WALK_STACK;
+    w.skip_children = false;
+    w.stack = (walk_stack *) mem_alloc(
+	mem_ast, sizeof(walk_stack) + w.capacity * sizeof(walk_frame));
+    if (w.stack == NULL) {
+	bail_with_error("No space for the AST walker's stack!");
+    }
+    w.frames = w.stack->frames;
+    w.stack->outer = open_stacks;
+    open_stacks = w.stack;
+    num_open++;
+
+    walk_push(&w, NULL, root, level, flags);
+    while (w.top > 0) {
+	walk_frame f = w.frames[--w.top];
+	size_t mark = w.top;
+	if (f.fn != NULL) {
+	    f.fn(&w, f.ast, f.level, f.flags);
+	} else {
+	    AST_type tag = f.ast->type_tag;
+	    if (v->post[tag] != NULL) {
+		// pushed first, so it runs after everything scheduled below
+		walk_push(&w, v->post[tag], f.ast, f.level, f.flags);
+		mark = w.top;
+	    }
+	    w.skip_children = false;
+	    if (v->pre[tag] != NULL) {
+		v->pre[tag](&w, f.ast, f.level, f.flags);
+	    }
+	    if (w.top == mark && !w.skip_children) {
+		walk_push_children(&w, f.ast, f.level + 1);
+	    }
+	}
+	walk_reverse_from(&w, mark);
+    }
+    open_stacks = w.stack->outer;
+    num_open--;
+    mem_free(w.stack);
+}
+
+// Return the number of the current thread's walks that have not ended
+unsigned int ast_walk_depth()
+{
+    return num_open;
+}
+
+// Free the stacks of the current thread's walks that have not ended
+// until only depth are left (see ast_walk.h)
+void ast_walk_unwind(unsigned int depth)
+{
+    while (num_open > depth) {
+	walk_stack *s = open_stacks;
+	open_stacks = s->outer;
+	num_open--;
+	mem_free(s);
+    }
+}
+
+// Return the context pointer given to ast_walk for the walk w
+void *ast_walk_context(ast_walker *w)
+{
+    return w->ctx;
+}
+
+// Requires: called from a callback of the walk w.
+// Schedule a visit of ast (with the given level and flags)
+// after the work already scheduled by the current callback.
+void ast_walk_visit(ast_walker *w, AST *ast, int level, unsigned int flags)
+{
+    walk_push(w, NULL, ast, level, flags);
+}
+
+// Requires: called from a callback of the walk w.
+// Schedule a call of fn on ast (with the given level and flags)
+// after the work already scheduled by the current callback.
+void ast_walk_action(ast_walker *w, ast_visit_fn fn, AST *ast,
+		     int level, unsigned int flags)
+{
+    walk_push(w, fn, ast, level, flags);
+}
+
+// Requires: called from a pre callback of the walk w.
+// Do not visit the children of the current node
+// (its post callback is still called).
+void ast_walk_skip_children(ast_walker *w)
+{
+    w->skip_children = true;
+}
@@ -0,0 +1,67 @@
+#ifndef _AST_WALK_H
+#define _AST_WALK_H
+#include <stdbool.h>
+#include "ast.h"
+
+// An AST walker visits the nodes of an AST using an explicit stack
+// (on the heap), so the C stack does not grow with the depth of the AST.
+// Each pass supplies an ast_visitor, which is a table of callbacks
+// indexed by AST_type: pre[t] is called when a node with tag t is entered
+// and post[t] is called after all of that node's children are done.
+// NULL entries are simply skipped.
+//
+// Each visit carries two pass-defined values, a level (e.g., an indentation
+// or nesting level) and some flags, which are given when the visit
+// is scheduled and passed back to the callbacks.
+//
+// If a pre callback schedules work (using ast_walk_visit or ast_walk_action)
+// then only that work is done for the node's children, in the order
+// it was scheduled. Otherwise the node's children are visited
+// in source order with level+1 and flags 0.
+
+typedef struct ast_walker_s ast_walker;
+
+// Type of the callbacks used by a walk
+typedef void (*ast_visit_fn)(ast_walker *w, AST *ast, int level,
+			     unsigned int flags);
+
+// Table of callbacks, indexed by AST_type
+typedef struct {
+    ast_visit_fn pre[NUM_AST_TYPES];
+    ast_visit_fn post[NUM_AST_TYPES];
+} ast_visitor;
+
+// Walk the AST root with the callbacks in the visitor v,
+// starting with the given level and flags.
+// The context ctx is made available to the callbacks by ast_walk_context.
+extern void ast_walk(AST *root, const ast_visitor *v, void *ctx,
+		     int level, unsigned int flags);
+
+// Return the context pointer given to ast_walk for the walk w
+extern void *ast_walk_context(ast_walker *w);
+
+// Requires: called from a callback of the walk w.
+// Schedule a visit of ast (with the given level and flags)
+// after the work already scheduled by the current callback.
+extern void ast_walk_visit(ast_walker *w, AST *ast, int level,
+			   unsigned int flags);
+
+// Requires: called from a callback of the walk w.
+// Schedule a call of fn on ast (with the given level and flags)
+// after the work already scheduled by the current callback.
+extern void ast_walk_action(ast_walker *w, ast_visit_fn fn, AST *ast,
+			    int level, unsigned int flags);
+
+// Requires: called from a pre callback of the walk w.
+// Do not visit the children of the current node
+// (its post callback is still called).
+extern void ast_walk_skip_children(ast_walker *w);
+
+// Return the number of the current thread's walks that have not ended
+extern unsigned int ast_walk_depth();
+
+// Free the stacks of the current thread's walks that have not ended
+// until only depth are left (e.g., after an error skipped their ends)
+extern void ast_walk_unwind(unsigned int depth);
+
+#endif
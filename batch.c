@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "utilities.h"
+#include "sink.h"
+#include "driver.h"
+#include "thread_pool.h"
+#include "batch.h"
+#include "mem.h"
+
+// What compiling one file produced
+typedef struct {
+    const char *fname;
+    sink *out;          // unparsed program
+    sink *diagnostics;  // error messages
+    bool failed;
+} batch_result;
+
+// Compile the file of the job'th result in the array results,
+// catching any error so the other files can still be compiled.
+static void compile_one(size_t job, void *results)
+{
+    batch_result *r = &((batch_result *) results)[job];
+    r->out = sink_string();
+    r->diagnostics = sink_string();
+    r->failed = !driver_try_compile(r->fname, NULL, 0,
+				    r->out, r->diagnostics);
+}
+
+// Compile each of the nfiles files named in fnames (see driver.h)
+// using nthreads threads.
+// Each file's output and error messages are collected separately
+// and then printed (on stdout and stderr) in the order of fnames,
+// so the result does not depend on the number of threads.
+// An error in one file does not stop the others from being compiled.
+// Return the number of files that had errors.
+size_t batch_compile(const char **fnames, size_t nfiles,
+		     unsigned int nthreads)
+{
+    batch_result *results
+	= (batch_result *) mem_alloc(mem_driver, nfiles * sizeof(batch_result));
+    if (results == NULL) {
+	bail_with_error("No space for batch results!");
+    }
+    for (size_t i = 0; i < nfiles; i++) {
+	results[i].fname = fnames[i];
+    }
+
+    pool_run(nfiles, nthreads, compile_one, results);
+
+    size_t failures = 0;
+    for (size_t i = 0; i < nfiles; i++) {
+	batch_result *r = &results[i];
+	fwrite(sink_contents(r->out), 1, sink_length(r->out), stdout);
+	fflush(stdout);
+	fwrite(sink_contents(r->diagnostics), 1,
+	       sink_length(r->diagnostics), stderr);
+	fflush(stderr);
+	if (r->failed) {
+	    failures++;
+	}
+	sink_close(r->out);
+	sink_close(r->diagnostics);
+    }
+    mem_free(results);
+    return failures;
+}
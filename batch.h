@@ -0,0 +1,15 @@
+#ifndef _BATCH_H
+#define _BATCH_H
+#include <stddef.h>
+
+// Compile each of the nfiles files named in fnames (see driver.h)
+// using nthreads threads.
+// Each file's output and error messages are collected separately
+// and then printed (on stdout and stderr) in the order of fnames,
+// so the result does not depend on the number of threads.
+// An error in one file does not stop the others from being compiled.
+// Return the number of files that had errors.
+extern size_t batch_compile(const char **fnames, size_t nfiles,
+			    unsigned int nthreads);
+
+#endif
@@ -0,0 +1,270 @@
+// Time the compiler's subsystems one at a time, without file I/O:
+//   lex      lexer_next over the source in memory
+//   parse    parseProgram over a token array lexed beforehand
+//   symtab   scope_insert and scope_lookup of synthetic names
+//   unparse  unparseProgram into a null sink
+// Each benchmark is run some times to warm up and then timed repeatedly,
+// and the median, 95th percentile, mean, and standard deviation
+// of the repetitions' times are reported.
+//
+// Usage: microbench [-w warmups] [-r reps] [-n names] [benchmark ...] file.pl0
+// (running all the benchmarks if none are named).
+// Each parse repetition builds a new AST that is not freed,
+// so very many repetitions over a large program use a lot of memory.
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "utilities.h"
+#include "token.h"
+#include "lexer.h"
+#include "token_array.h"
+#include "parser.h"
+#include "ast.h"
+#include "id_attrs.h"
+#include "file_location.h"
+#include "symbol_table.h"
+#include "unparser.h"
+#include "sink.h"
+#include "mem.h"
+
+// Default numbers of warm-up and timed repetitions
+#define DEFAULT_WARMUPS 3
+#define DEFAULT_REPS 20
+// Default number of names for the symbol table benchmark
+#define DEFAULT_NAMES 1000
+
+// What the benchmarks work on
+typedef struct {
+    const char *fname;
+    char *source;        // the file's contents
+    size_t source_len;
+    token_array *tokens; // the file's tokens
+    size_t num_tokens;
+    AST *progast;        // the file's AST
+    ast_store store;     // progast's nodes
+    char **names;        // synthetic names for the symbol table
+    size_t num_names;
+    sink *null_out;
+} bench_input;
+
+// A benchmark: run does one repetition and returns the number of items
+// (tokens, operations, ...) it processed
+typedef struct {
+    const char *name;
+    const char *unit;
+    size_t (*run)(bench_input *in);
+} benchmark;
+
+// Return the current time in seconds
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+// Lex the whole source, freeing each token's text
+static size_t run_lex(bench_input *in)
+{
+    FILE *fp = fmemopen(in->source, in->source_len, "r");
+    if (fp == NULL) {
+	bail_with_error("Cannot read %s from memory", in->fname);
+    }
+    lexer_open_stream(fp, in->fname);
+    size_t n = 0;
+    token t;
+    do {
+	t = lexer_next();
+	mem_free(t.text);
+	n++;
+    } while (t.typ != eofsym);
+    lexer_close();
+    return n;
+}
+
+// Parse the tokens lexed beforehand (freeing the AST)
+static size_t run_parse(bench_input *in)
+{
+    ast_store s;
+    ast_store_init(&s);
+    ast_store *outer = ast_use_store(&s);
+    parser_open_array(in->tokens);
+    parseProgram();
+    parser_close();
+    ast_use_store(outer);
+    ast_store_release(&s);
+    return in->num_tokens;
+}
+
+// Declare each synthetic name, then look each of them up
+static size_t run_symtab(bench_input *in)
+{
+    file_location floc;
+    floc.filename = in->fname;
+    floc.line = 1;
+    floc.column = 1;
+    scope_initialize();
+    for (size_t i = 0; i < in->num_names; i++) {
+	scope_insert(in->names[i], create_id_attrs(floc, variable, i));
+    }
+    for (size_t i = 0; i < in->num_names; i++) {
+	if (scope_lookup(in->names[i]) == NULL) {
+	    bail_with_error("Name %s was not found", in->names[i]);
+	}
+    }
+    return 2 * in->num_names;
+}
+
+// Unparse the AST into a null sink
+static size_t run_unparse(bench_input *in)
+{
+    unparseProgram(in->null_out, in->progast);
+    sink_flush(in->null_out);
+    return in->num_tokens;
+}
+
+static const benchmark benchmarks[] = {
+    { "lex", "tokens", run_lex },
+    { "parse", "tokens", run_parse },
+    { "symtab", "ops", run_symtab },
+    { "unparse", "tokens", run_unparse },
+};
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+// Read the input file, lex it into an array, parse it,
+// and make the synthetic names
+static void prepare(bench_input *in, const char *fname, size_t num_names)
+{
+    in->fname = fname;
+    in->source = read_whole_file(fname, &in->source_len);
+    if (in->source == NULL) {
+	bail_with_error("Cannot read %s", fname);
+    }
+
+    in->tokens = token_array_lex(fname);
+    in->num_tokens = token_array_length(in->tokens);
+    ast_store_init(&in->store);
+    ast_use_store(&in->store);
+    parser_open_array(in->tokens);
+    in->progast = parseProgram();
+    parser_close();
+    ast_use_store(NULL);
+
+    in->num_names = num_names;
+    in->names = (char **) malloc(num_names * sizeof(char *));
+    if (in->names == NULL) {
+	bail_with_error("No space for names!");
+    }
+    for (size_t i = 0; i < num_names; i++) {
+	char buf[32];
+	snprintf(buf, sizeof(buf), "name%zu", i);
+	in->names[i] = strdup(buf);
+    }
+    in->null_out = sink_null();
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x < y) ? -1 : (x > y);
+}
+
+// Run the benchmark b (warmups times untimed, then reps times timed)
+// and print its statistics
+static void run_benchmark(const benchmark *b, bench_input *in,
+			  int warmups, int reps)
+{
+    for (int i = 0; i < warmups; i++) {
+	b->run(in);
+    }
+    double *times = (double *) malloc(reps * sizeof(double));
+    if (times == NULL) {
+	bail_with_error("No space for times!");
+    }
+    size_t items = 0;
+    double sum = 0.0;
+    for (int i = 0; i < reps; i++) {
+	double start = now();
+	items = b->run(in);
+	times[i] = now() - start;
+	sum += times[i];
+    }
+    double mean = sum / reps;
+    double var = 0.0;
+    for (int i = 0; i < reps; i++) {
+	var += (times[i] - mean) * (times[i] - mean);
+    }
+    double stddev = (reps > 1) ? sqrt(var / (reps - 1)) : 0.0;
+    qsort(times, reps, sizeof(double), compare_doubles);
+    double median = (reps % 2 == 1) ? times[reps / 2]
+	: (times[reps / 2 - 1] + times[reps / 2]) / 2;
+    double p95 = times[(int) ceil(0.95 * reps) - 1];
+    printf("%-8s %10.3f %10.3f %10.3f %10.3f %12.0f %s/s\n", b->name,
+	   median * 1e3, p95 * 1e3, mean * 1e3, stddev * 1e3,
+	   items / median, b->unit);
+    free(times);
+}
+
+static void usage(const char *cmdname)
+{
+    fprintf(stderr, "Usage: %s [-w warmups] [-r reps] [-n names]"
+	    " [lex|parse|symtab|unparse ...] file.pl0\n", cmdname);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    int warmups = DEFAULT_WARMUPS;
+    int reps = DEFAULT_REPS;
+    long names = DEFAULT_NAMES;
+    bool chosen[NUM_BENCHMARKS] = { false };
+    bool any_chosen = false;
+    const char *fname = NULL;
+
+    for (int i = 1; i < argc; i++) {
+	if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+	    warmups = atoi(argv[++i]);
+	} else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+	    reps = atoi(argv[++i]);
+	} else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+	    names = atol(argv[++i]);
+	} else if (argv[i][0] == '-') {
+	    usage(argv[0]);
+	} else {
+	    bool found = false;
+	    for (size_t b = 0; b < NUM_BENCHMARKS; b++) {
+		if (strcmp(argv[i], benchmarks[b].name) == 0) {
+		    chosen[b] = true;
+		    any_chosen = found = true;
+		}
+	    }
+	    if (!found) {
+		fname = argv[i];
+	    }
+	}
+    }
+    if (fname == NULL || warmups < 0 || reps < 1
+	|| names < 1) {
+	usage(argv[0]);
+    }
+
+    bench_input in;
+    prepare(&in, fname, (size_t) names);
+    printf("%s: %zu bytes, %zu tokens, %ld names; %d warm-ups, %d reps\n",
+	   fname, in.source_len, in.num_tokens, names, warmups, reps);
+    printf("%-8s %10s %10s %10s %10s %12s\n", "bench", "median ms",
+	   "p95 ms", "mean ms", "stddev ms", "rate");
+    for (size_t b = 0; b < NUM_BENCHMARKS; b++) {
+	if (!any_chosen || chosen[b]) {
+	    run_benchmark(&benchmarks[b], &in, warmups, reps);
+	}
+    }
+    sink_close(in.null_out);
+    ast_store_release(&in.store);
+    token_array_free(in.tokens);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,51 @@
+#!/bin/sh
+# Compare compiling a large generated program with the lexer and parser
+# interleaved (the default), with the lexer on its own thread
+# (--pipeline), and with the whole file lexed first (--prelex).
+# The pipeline can only be faster with at least two processors;
+# with one, the lexer's and parser's threads take turns, and it is slower.
+# Usage: bench/pipeline_bench.sh [statements] [runs]
+# (default 200000 statements, about 6 MB, and 5 runs of each mode).
+# Set COMPILER to use a compiler other than ./compiler.
+
+COMPILER=${COMPILER:-./compiler}
+GEN=${GEN:-bench/pl0gen}
+N=${1:-200000}
+RUNS=${2:-5}
+WORK=bench/work
+FILE=$WORK/pipeline.pl0
+
+# print the current time in nanoseconds
+now() {
+    date +%s%N
+}
+
+mkdir -p $WORK
+$GEN mixed -n $N > $FILE || exit 1
+CPUS=$(nproc 2>/dev/null || echo '?')
+echo "$FILE: $(wc -c < $FILE) bytes, $CPUS processors"
+if test "$CPUS" = 1; then
+    echo "note: with only one processor, --pipeline cannot overlap lexing"
+    echo "      and parsing, so it only adds the cost of passing tokens"
+    echo "      between threads (run this on two or more to measure the overlap)"
+fi
+
+for mode in default --pipeline --prelex; do
+    opt=$mode
+    if test $mode = default; then
+	opt=""
+    fi
+    # the fastest of the runs, in milliseconds
+    best=""
+    i=0
+    while test $i -lt $RUNS; do
+	start=$(now)
+	$COMPILER $opt $FILE >/dev/null 2>&1
+	ms=$(( ($(now) - start) / 1000000 ))
+	if test -z "$best" || test $ms -lt $best; then
+	    best=$ms
+	fi
+	i=$((i + 1))
+    done
+    printf "%-10s %6d ms\n" $mode $best
+done
@@ -0,0 +1,322 @@
+// Generate a synthetic PL/0 program on stdout, for benchmarking.
+// The program depends only on the options (including the seed),
+// so the same command always produces the same program.
+//
+// Usage: pl0gen [-s seed] [-c consts] [-v vars] [-n stmts] [-d depth]
+//               [-p nest-percent] [-e terms] [-k comment-percent]
+//               [shape]
+// where shape (decls, nested, exprs, comments, or mixed) sets defaults
+// for the options that follow it, and the other options are:
+//   -s  seed for the pseudo-random number generator
+//   -c  number of constants declared
+//   -v  number of variables declared
+//   -n  number of statements (approximately)
+//   -d  maximum nesting depth of begin, if, and while statements
+//   -p  percent of statements that are compound (when depth allows)
+//   -e  maximum number of terms in an expression
+//   -k  percent of statements preceded by a comment line
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// Largest number literal generated (numbers must fit in a short)
+#define MAX_LITERAL 1000
+// Number of names declared on one line
+#define NAMES_PER_LINE 8
+
+// Options that control the generated program
+typedef struct {
+    uint64_t seed;
+    int consts;
+    int vars;
+    int stmts;
+    int depth;
+    int nest_pct;
+    int terms;
+    int comment_pct;
+} gen_options;
+
+static gen_options opts;
+// State of the pseudo-random number generator
+static uint64_t rng_state;
+// Number of statements that may still be generated
+static int stmts_left;
+
+static const char *comment_words[] = {
+    "compute", "the", "next", "value", "of", "each", "counter",
+    "loop", "until", "done", "check", "bounds", "then", "write", "result"
+};
+#define NUM_COMMENT_WORDS (sizeof(comment_words) / sizeof(comment_words[0]))
+
+// Return the next pseudo-random number (splitmix64)
+static uint64_t next_random()
+{
+    uint64_t z = (rng_state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Return a pseudo-random number in 0 .. n-1 (n > 0)
+static int below(int n)
+{
+    return (int) (next_random() % (uint64_t) n);
+}
+
+// Print indentation for the given nesting level
+static void indent(int level)
+{
+    printf("%*s", 2 * level, "");
+}
+
+// Print a name or a number (which may have a sign)
+static void print_operand()
+{
+    int names = opts.consts + opts.vars;
+    if (names == 0 || below(4) == 0) {
+	printf("%s%d", (below(8) == 0) ? "-" : "", below(MAX_LITERAL));
+    } else {
+	int i = below(names);
+	if (i < opts.consts) {
+	    printf("c%d", i);
+	} else {
+	    printf("v%d", i - opts.consts);
+	}
+    }
+}
+
+// Print a variable's name
+static void print_variable()
+{
+    printf("v%d", below(opts.vars));
+}
+
+// Print an expression with 1 to max_terms terms
+// (some of them parenthesized, up to the given depth of parentheses)
+static void print_expression(int max_terms, int parens)
+{
+    static const char ops[] = "+-*/";
+    int n = 1 + below(max_terms);
+    for (int i = 0; i < n; i++) {
+	if (i > 0) {
+	    printf(" %c ", ops[below(4)]);
+	}
+	if (parens > 0 && below(6) == 0) {
+	    printf("(");
+	    // keep nested expressions smaller, so the size stays linear
+	    print_expression(1 + max_terms / 8, parens - 1);
+	    printf(")");
+	} else {
+	    print_operand();
+	}
+    }
+}
+
+// Print a condition
+static void print_condition()
+{
+    static const char *rels[] = { "=", "<>", "<", "<=", ">", ">=" };
+    if (below(6) == 0) {
+	printf("odd ");
+	print_expression(opts.terms, 2);
+    } else {
+	print_expression(opts.terms, 2);
+	printf(" %s ", rels[below(6)]);
+	print_expression(opts.terms, 2);
+    }
+}
+
+// Print a comment line (ending in a newline) at the given level
+static void print_comment(int level)
+{
+    indent(level);
+    printf("#");
+    int n = 3 + below(10);
+    for (int i = 0; i < n; i++) {
+	printf(" %s", comment_words[below(NUM_COMMENT_WORDS)]);
+    }
+    printf("\n");
+}
+
+static void print_stmt(int level, int depth);
+
+// Print a begin statement with statements nested in it
+static void print_begin(int level, int depth)
+{
+    printf("begin\n");
+    int n = 1 + below(4);
+    for (int i = 0; i < n; i++) {
+	if (i > 0) {
+	    printf(";\n");
+	}
+	print_stmt(level + 1, depth + 1);
+	if (stmts_left <= 0) {
+	    break;
+	}
+    }
+    printf("\n");
+    indent(level);
+    printf("end");
+}
+
+// Print a statement at the given indentation level and nesting depth
+// (not starting with indentation, and without a newline at the end)
+static void print_stmt(int level, int depth)
+{
+    stmts_left--;
+    if (below(100) < opts.comment_pct) {
+	printf("\n");
+	print_comment(level);
+    }
+    indent(level);
+    if (depth < opts.depth && stmts_left > 0 && below(100) < opts.nest_pct) {
+	switch (below(3)) {
+	case 0:
+	    print_begin(level, depth);
+	    break;
+	case 1:
+	    printf("if ");
+	    print_condition();
+	    printf(" then\n");
+	    print_stmt(level + 1, depth + 1);
+	    printf("\n");
+	    indent(level);
+	    printf("else\n");
+	    print_stmt(level + 1, depth + 1);
+	    break;
+	default:
+	    printf("while ");
+	    print_condition();
+	    printf(" do\n");
+	    print_stmt(level + 1, depth + 1);
+	    break;
+	}
+    } else if (opts.vars == 0) {
+	printf("write ");
+	print_expression(opts.terms, 3);
+    } else {
+	int r = below(10);
+	if (r < 6) {
+	    print_variable();
+	    printf(" := ");
+	    print_expression(opts.terms, 3);
+	} else if (r < 8) {
+	    printf("write ");
+	    print_expression(opts.terms, 3);
+	} else if (r < 9) {
+	    printf("read ");
+	    print_variable();
+	} else {
+	    printf("skip");
+	}
+    }
+}
+
+// Print the declarations of n names with the given prefix,
+// after the given keyword (each constant gets a value if is_const)
+static void print_decls(const char *keyword, const char *prefix,
+			int n, int is_const)
+{
+    for (int i = 0; i < n; i++) {
+	if (i % NAMES_PER_LINE == 0) {
+	    printf((i == 0) ? "%s " : ",\n    ", keyword);
+	} else {
+	    printf(", ");
+	}
+	printf("%s%d", prefix, i);
+	if (is_const) {
+	    printf(" = %d", below(MAX_LITERAL));
+	}
+    }
+    if (n > 0) {
+	printf(";\n");
+    }
+}
+
+// Set the options to the defaults for the given shape.
+// Return 0 if there is no such shape.
+static int set_shape(const char *shape)
+{
+    gen_options base = { opts.seed, 20, 40, 2000, 8, 20, 6, 5 };
+    opts = base;
+    if (strcmp(shape, "mixed") == 0) {
+	return 1;
+    } else if (strcmp(shape, "decls") == 0) {
+	opts.consts = 2000;
+	opts.vars = 2000;
+	return 1;
+    } else if (strcmp(shape, "nested") == 0) {
+	opts.depth = 200;
+	opts.nest_pct = 90;
+	return 1;
+    } else if (strcmp(shape, "exprs") == 0) {
+	opts.terms = 200;
+	opts.stmts = 500;
+	return 1;
+    } else if (strcmp(shape, "comments") == 0) {
+	opts.comment_pct = 90;
+	return 1;
+    }
+    return 0;
+}
+
+static void usage(const char *cmdname)
+{
+    fprintf(stderr, "Usage: %s [-s seed] [-c consts] [-v vars] [-n stmts]"
+	    " [-d depth] [-p nest-percent] [-e terms] [-k comment-percent]"
+	    " [decls|nested|exprs|comments|mixed]\n", cmdname);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    opts.seed = 1;
+    set_shape("mixed");
+    for (int i = 1; i < argc; i++) {
+	const char *arg = argv[i];
+	if (arg[0] != '-') {
+	    if (!set_shape(arg)) {
+		usage(argv[0]);
+	    }
+	    continue;
+	}
+	if (strlen(arg) != 2 || i + 1 >= argc) {
+	    usage(argv[0]);
+	}
+	long val = atol(argv[++i]);
+	if (val < 0) {
+	    usage(argv[0]);
+	}
+	switch (arg[1]) {
+	case 's': opts.seed = (uint64_t) val; break;
+	case 'c': opts.consts = (int) val; break;
+	case 'v': opts.vars = (int) val; break;
+	case 'n': opts.stmts = (int) val; break;
+	case 'd': opts.depth = (int) val; break;
+	case 'p': opts.nest_pct = (int) val; break;
+	case 'e': opts.terms = (val < 1) ? 1 : (int) val; break;
+	case 'k': opts.comment_pct = (int) val; break;
+	default: usage(argv[0]);
+	}
+    }
+    rng_state = opts.seed;
+    stmts_left = (opts.stmts < 1) ? 1 : opts.stmts;
+    printf("# generated by pl0gen -s %llu -c %d -v %d -n %d -d %d -p %d"
+	   " -e %d -k %d\n", (unsigned long long) opts.seed, opts.consts,
+	   opts.vars, opts.stmts, opts.depth, opts.nest_pct, opts.terms,
+	   opts.comment_pct);
+    print_decls("const", "c", opts.consts, 1);
+    print_decls("var", "v", opts.vars, 0);
+    printf("begin\n");
+    int first = 1;
+    while (stmts_left > 0) {
+	if (!first) {
+	    printf(";\n");
+	}
+	first = 0;
+	print_stmt(1, 1);
+    }
+    printf("\nend.\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,53 @@
+#!/bin/sh
+# Generate synthetic workloads with bench/pl0gen, compile each one
+# with compiler --stats=csv, and append a line per workload to a CSV file
+# (default bench/results.csv), so results can be compared across commits.
+# Usage: bench/run_bench.sh [results.csv]
+# Set COMPILER to use a compiler other than ./compiler,
+# REPS to the number of times each workload is compiled in one run
+# (default 5), and SIZE to scale the number of statements (default 1).
+
+COMPILER=${COMPILER:-./compiler}
+GEN=${GEN:-bench/pl0gen}
+RESULTS=${1:-bench/results.csv}
+REPS=${REPS:-5}
+SIZE=${SIZE:-1}
+WORK=bench/work
+
+mkdir -p $WORK
+COMMIT=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+DATE=$(date -u +%Y-%m-%dT%H:%M:%SZ)
+
+# workload name and pl0gen arguments
+set -- \
+    "mixed:mixed -n $((20000 * SIZE))" \
+    "decls:decls -n $((2000 * SIZE))" \
+    "nested:nested -n $((20000 * SIZE))" \
+    "exprs:exprs -n $((500 * SIZE))" \
+    "comments:comments -n $((20000 * SIZE))"
+
+for w in "$@"; do
+    name=${w%%:*}
+    args=${w#*:}
+    file=$WORK/$name.pl0
+    $GEN $args > $file || exit 1
+    bytes=$(wc -c < $file)
+    files=""
+    i=0
+    while test $i -lt $REPS; do
+	files="$files $file"
+	i=$((i + 1))
+    done
+    # the compiler's output is not wanted, just the statistics
+    $COMPILER -j 1 --stats=csv $files 2>$WORK/$name.csv >/dev/null
+    if test ! -s "$RESULTS"; then
+	echo "commit,date,workload,bytes,$(head -1 $WORK/$name.csv)" > "$RESULTS"
+    fi
+    echo "$COMMIT,$DATE,$name,$bytes,$(tail -1 $WORK/$name.csv)" >> "$RESULTS"
+    # show the rates, found by their names in the header
+    awk -F, -v name=$name 'NR == 1 { for (i = 1; i <= NF; i++) col[$i] = i }
+	NR == 2 { printf "%-9s %10s tokens/s %10s nodes/s %10s lookups/s\n",
+		  name, $col["tokens_per_sec"], $col["nodes_per_sec"],
+		  $col["lookups_per_sec"] }' $WORK/$name.csv
+done
+echo "results appended to $RESULTS"
@@ -0,0 +1,66 @@
+#!/bin/sh
+# Compare the latency of cold compiler runs with requests
+# to a compile server (compiler --serve).
+# Usage: bench/serve_latency.sh file.pl0 [requests]
+# Set COMPILER to use a compiler other than ./compiler.
+
+COMPILER=${COMPILER:-./compiler}
+FILE=$1
+N=${2:-200}
+SOCK=${TMPDIR:-/tmp}/pl0-bench-$$.sock
+
+if test -z "$FILE"; then
+    echo "Usage: $0 file.pl0 [requests]" >&2
+    exit 1
+fi
+
+# print the current time in nanoseconds
+now() {
+    date +%s%N
+}
+
+# print the mean time per request in microseconds, given start, end, count
+per_request() {
+    echo $(( ($2 - $1) / ($3 * 1000) ))
+}
+
+$COMPILER --serve="$SOCK" &
+SERVER=$!
+while test ! -S "$SOCK"; do
+    sleep 0.05
+done
+
+start=$(now)
+i=0
+while test $i -lt $N; do
+    $COMPILER "$FILE" >/dev/null 2>&1
+    i=$((i + 1))
+done
+cold=$(per_request $start $(now) $N)
+
+start=$(now)
+i=0
+while test $i -lt $N; do
+    $COMPILER --client="$SOCK" "$FILE" >/dev/null 2>&1
+    i=$((i + 1))
+done
+client=$(per_request $start $(now) $N)
+
+# one connection carrying all the requests (as an editor plugin would)
+set --
+i=0
+while test $i -lt $N; do
+    set -- "$@" "$FILE"
+    i=$((i + 1))
+done
+start=$(now)
+$COMPILER --client="$SOCK" "$@" >/dev/null 2>&1
+warm=$(per_request $start $(now) $N)
+
+$COMPILER --shutdown="$SOCK"
+wait $SERVER
+
+echo "requests: $N of $FILE"
+echo "cold process per request:      $cold us"
+echo "client process per request:    $client us"
+echo "persistent connection request: $warm us"
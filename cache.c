@@ -0,0 +1,401 @@
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "hash.h"
+#include "sink.h"
+#include "cache.h"
+#include "mem.h"
+
+// "PL0C" as a little-endian number, at the start of each entry
+#define CACHE_MAGIC 0x43304c50
+// Version of the entry format (change it when the format changes)
+#define CACHE_FORMAT_VERSION 1
+// Suffix of the names of entry files
+#define CACHE_SUFFIX ".pl0c"
+// Prefix of the names of temporary files (being written)
+#define CACHE_TEMP_PREFIX ".tmp-"
+// Age (in seconds) after which a temporary file is taken to be abandoned
+#define CACHE_STALE_TEMP_SECONDS 3600
+// Number of chars in a path to an entry (or temporary file) in a directory
+#define CACHE_PATH_EXTRA 40
+// Number of stores after which the directory is scanned again
+// (to count the entries that other processes stored)
+#define CACHE_RESCAN_STORES 256
+// Percentage of the maximum size that eviction goes down to,
+// so a full cache is not scanned again on the next store
+#define CACHE_EVICT_TO_PERCENT 75
+
+// Identifies this build of the compiler,
+// since an entry made by another build might not be what it would produce
+static const char build_stamp[] = __DATE__ " " __TIME__;
+
+// Start of an entry file, followed by nsections sections
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t check;
+    uint32_t status;  // 1 if there were no errors, 0 otherwise
+    uint32_t nsections;
+} cache_header;
+
+// Start of a section, followed by len bytes of data
+typedef struct {
+    uint32_t kind;    // a cache_section_kind
+    uint32_t unused;
+    uint64_t len;
+} cache_section;
+
+// An entry file found while scanning a cache directory
+typedef struct {
+    char *name;
+    off_t size;
+    struct timespec mtime;
+} cache_file;
+
+// The bytes the entries in usage_dir took when it was last scanned
+// plus the bytes of the entries stored since then, and the number of those
+// stores, guarded by usage_lock (usage_dir is NULL until the first scan)
+static pthread_mutex_t usage_lock = PTHREAD_MUTEX_INITIALIZER;
+static const char *usage_dir = NULL;
+static size_t usage_bytes = 0;
+static unsigned int stores_since_scan = 0;
+
+// Return the key for the source code src (with len bytes)
+// in the file named fname, compiled with the given flags
+// (a string describing all options that affect the output)
+cache_key cache_make_key(const char *fname, const char *src, size_t len,
+			 const char *flags)
+{
+    uint64_t seed = xxh64(build_stamp, strlen(build_stamp), 0);
+    seed = xxh64(flags, strlen(flags), seed);
+    seed = xxh64(fname, strlen(fname) + 1, seed);
+    cache_key ret;
+    ret.name = xxh64(src, len, seed);
+    ret.check = xxh64(src, len, seed ^ 0x9E3779B97F4A7C15ULL);
+    return ret;
+}
+
+// Put the path of the entry file for key in dir into path
+// (which has room for strlen(dir) + CACHE_PATH_EXTRA chars)
+static void entry_path(char *path, const char *dir, cache_key key)
+{
+    sprintf(path, "%s/%016llx%s", dir, (unsigned long long) key.name,
+	    CACHE_SUFFIX);
+}
+
+// Return a fresh buffer big enough for a path in dir
+static char *path_buffer(const char *dir)
+{
+    return (char *) mem_alloc(mem_driver, strlen(dir) + CACHE_PATH_EXTRA);
+}
+
+// Read the whole file named path into a fresh buffer,
+// putting its size in *len. Return NULL if that is not possible.
+static char *read_entry(const char *path, size_t *len)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+	return NULL;
+    }
+    struct stat st;
+    char *buf = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+	buf = (char *) mem_alloc(mem_driver, (size_t) st.st_size);
+    }
+    if (buf != NULL) {
+	size_t got = 0;
+	while (got < (size_t) st.st_size) {
+	    ssize_t r = read(fd, buf + got, (size_t) st.st_size - got);
+	    if (r <= 0) {
+		break;
+	    }
+	    got += (size_t) r;
+	}
+	if (got != (size_t) st.st_size) {
+	    mem_free(buf);
+	    buf = NULL;
+	}
+	*len = got;
+    }
+    close(fd);
+    return buf;
+}
+
+// Look for the entry with the given key in the cache directory dir.
+// If it is there, write its output and diagnostics to out and diagnostics,
+// put its status (true for no errors) in *ok, mark it as recently used,
+// and return true. Otherwise return false.
+bool cache_lookup(const char *dir, cache_key key,
+		  sink *out, sink *diagnostics, bool *ok)
+{
+    char *path = path_buffer(dir);
+    if (path == NULL) {
+	return false;
+    }
+    entry_path(path, dir, key);
+    size_t len;
+    char *buf = read_entry(path, &len);
+    if (buf == NULL) {
+	mem_free(path);
+	return false;
+    }
+
+    // check the whole entry before writing anything
+    bool valid = len >= sizeof(cache_header);
+    cache_header hdr;
+    if (valid) {
+	memcpy(&hdr, buf, sizeof(hdr));
+	valid = hdr.magic == CACHE_MAGIC
+	    && hdr.version == CACHE_FORMAT_VERSION
+	    && hdr.check == key.check;
+    }
+    size_t pos = sizeof(cache_header);
+    for (uint32_t i = 0; valid && i < hdr.nsections; i++) {
+	cache_section sec;
+	valid = len - pos >= sizeof(sec);
+	if (valid) {
+	    memcpy(&sec, buf + pos, sizeof(sec));
+	    pos += sizeof(sec);
+	    valid = len - pos >= sec.len;
+	    pos += valid ? sec.len : 0;
+	}
+    }
+
+    if (valid) {
+	pos = sizeof(cache_header);
+	for (uint32_t i = 0; i < hdr.nsections; i++) {
+	    cache_section sec;
+	    memcpy(&sec, buf + pos, sizeof(sec));
+	    pos += sizeof(sec);
+	    if (sec.kind == cache_output) {
+		sink_write(out, buf + pos, (size_t) sec.len);
+	    } else if (sec.kind == cache_diagnostics) {
+		sink_write(diagnostics, buf + pos, (size_t) sec.len);
+	    }
+	    pos += sec.len;
+	}
+	*ok = hdr.status == 1;
+	// mark the entry as recently used (for eviction)
+	utimensat(AT_FDCWD, path, NULL, 0);
+    }
+    mem_free(buf);
+    mem_free(path);
+    return valid;
+}
+
+// Write all n bytes of data to fd. Return false if that fails.
+static bool write_all(int fd, const void *data, size_t n)
+{
+    const char *p = (const char *) data;
+    while (n > 0) {
+	ssize_t w = write(fd, p, n);
+	if (w < 0) {
+	    if (errno == EINTR) {
+		continue;
+	    }
+	    return false;
+	}
+	p += w;
+	n -= (size_t) w;
+    }
+    return true;
+}
+
+// Write a section of the given kind with the len bytes of data to fd.
+// Return false if that fails.
+static bool write_section(int fd, cache_section_kind kind,
+			  const char *data, size_t len)
+{
+    cache_section sec;
+    sec.kind = kind;
+    sec.unused = 0;
+    sec.len = len;
+    return write_all(fd, &sec, sizeof(sec)) && write_all(fd, data, len);
+}
+
+// Order cache files from least to most recently used
+static int compare_cache_files(const void *a, const void *b)
+{
+    const cache_file *fa = (const cache_file *) a;
+    const cache_file *fb = (const cache_file *) b;
+    if (fa->mtime.tv_sec != fb->mtime.tv_sec) {
+	return (fa->mtime.tv_sec < fb->mtime.tv_sec) ? -1 : 1;
+    }
+    if (fa->mtime.tv_nsec != fb->mtime.tv_nsec) {
+	return (fa->mtime.tv_nsec < fb->mtime.tv_nsec) ? -1 : 1;
+    }
+    return strcmp(fa->name, fb->name);
+}
+
+// Return true just when the string s ends with suffix
+static bool ends_with(const char *s, const char *suffix)
+{
+    size_t ls = strlen(s);
+    size_t lsuf = strlen(suffix);
+    return ls >= lsuf && strcmp(s + ls - lsuf, suffix) == 0;
+}
+
+// If the entries in dir take more than max_bytes, remove the least
+// recently used ones (other than the one at the path keep, if it is not
+// NULL) until they take at most CACHE_EVICT_TO_PERCENT percent
+// of max_bytes, and remove abandoned temporary files.
+// Files that another process removes first are skipped.
+// Return the number of bytes the entries left take.
+static size_t cache_evict(const char *dir, size_t max_bytes, const char *keep)
+{
+    DIR *d = opendir(dir);
+    char *path = path_buffer(dir);
+    if (d == NULL || path == NULL) {
+	if (d != NULL) {
+	    closedir(d);
+	}
+	mem_free(path);
+	return 0;
+    }
+    cache_file *files = NULL;
+    size_t nfiles = 0;
+    size_t cap = 0;
+    size_t total = 0;
+    time_t now = time(NULL);
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+	bool is_entry = ends_with(de->d_name, CACHE_SUFFIX);
+	bool is_temp = strncmp(de->d_name, CACHE_TEMP_PREFIX,
+			       strlen(CACHE_TEMP_PREFIX)) == 0;
+	if ((!is_entry && !is_temp)
+	    || strlen(de->d_name) + 2 > CACHE_PATH_EXTRA) {
+	    continue;
+	}
+	struct stat st;
+	sprintf(path, "%s/%s", dir, de->d_name);
+	if (stat(path, &st) != 0) {
+	    continue;
+	}
+	if (is_temp) {
+	    if (now - st.st_mtime > CACHE_STALE_TEMP_SECONDS) {
+		unlink(path);
+	    }
+	    continue;
+	}
+	if (nfiles == cap) {
+	    cap = (cap == 0) ? 64 : 2 * cap;
+	    cache_file *nf = (cache_file *) mem_realloc(mem_driver, files,
+						    cap * sizeof(cache_file));
+	    if (nf == NULL) {
+		break;
+	    }
+	    files = nf;
+	}
+	files[nfiles].name = mem_strdup(mem_driver, de->d_name);
+	files[nfiles].size = st.st_size;
+	files[nfiles].mtime = st.st_mtim;
+	if (files[nfiles].name != NULL) {
+	    total += (size_t) st.st_size;
+	    nfiles++;
+	}
+    }
+    closedir(d);
+
+    if (total > max_bytes) {
+	size_t target = max_bytes / 100 * CACHE_EVICT_TO_PERCENT;
+	qsort(files, nfiles, sizeof(cache_file), compare_cache_files);
+	for (size_t i = 0; i < nfiles && total > target; i++) {
+	    sprintf(path, "%s/%s", dir, files[i].name);
+	    if (keep != NULL && strcmp(path, keep) == 0) {
+		continue;
+	    }
+	    unlink(path);
+	    total -= (size_t) files[i].size;
+	}
+    }
+    for (size_t i = 0; i < nfiles; i++) {
+	mem_free(files[i].name);
+    }
+    mem_free(files);
+    mem_free(path);
+    return total;
+}
+
+// Count the len bytes of the entry just stored at path in dir, and if
+// the entries may now take more than max_bytes (or have not been counted
+// recently), scan dir and remove the least recently used entries other
+// than that one (see cache_evict), so filling a cache does not scan it
+// once for each entry
+static void count_store(const char *dir, const char *path, size_t len,
+			size_t max_bytes)
+{
+    pthread_mutex_lock(&usage_lock);
+    // a directory other than the one counted is scanned first
+    if (usage_dir != dir) {
+	usage_dir = NULL;
+    }
+    usage_bytes += len;
+    stores_since_scan++;
+    if (usage_dir == NULL || usage_bytes > max_bytes
+	|| stores_since_scan >= CACHE_RESCAN_STORES) {
+	usage_bytes = cache_evict(dir, max_bytes, path);
+	usage_dir = dir;
+	stores_since_scan = 0;
+    }
+    pthread_mutex_unlock(&usage_lock);
+}
+
+// Store an entry with the given key, status (ok), output and diagnostics
+// in the cache directory dir (creating dir if needed), unless it alone
+// would take more than max_bytes bytes, then remove least recently used
+// entries until dir takes at most max_bytes bytes (see cache.h).
+// Failures to write are ignored (the cache is optional).
+void cache_store(const char *dir, cache_key key, bool ok,
+		 const char *out, size_t outlen,
+		 const char *diagnostics, size_t diaglen,
+		 size_t max_bytes)
+{
+    size_t len = sizeof(cache_header) + 2 * sizeof(cache_section)
+	+ outlen + diaglen;
+    if (len > max_bytes) {
+	// it would only make room for itself by removing all the others
+	return;
+    }
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+	return;
+    }
+    char *tmp = path_buffer(dir);
+    char *path = path_buffer(dir);
+    if (tmp == NULL || path == NULL) {
+	mem_free(tmp);
+	mem_free(path);
+	return;
+    }
+    sprintf(tmp, "%s/%sXXXXXX", dir, CACHE_TEMP_PREFIX);
+    int fd = mkstemp(tmp);
+    if (fd >= 0) {
+	cache_header hdr;
+	hdr.magic = CACHE_MAGIC;
+	hdr.version = CACHE_FORMAT_VERSION;
+	hdr.check = key.check;
+	hdr.status = ok ? 1 : 0;
+	hdr.nsections = 2;
+	bool written = write_all(fd, &hdr, sizeof(hdr))
+	    && write_section(fd, cache_output, out, outlen)
+	    && write_section(fd, cache_diagnostics, diagnostics, diaglen);
+	written = (close(fd) == 0) && written;
+	entry_path(path, dir, key);
+	// readers see either the old entry or the complete new one
+	if (!written || rename(tmp, path) != 0) {
+	    unlink(tmp);
+	} else {
+	    count_store(dir, path, len, max_bytes);
+	}
+    }
+    mem_free(tmp);
+    mem_free(path);
+}
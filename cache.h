@@ -0,0 +1,61 @@
+#ifndef _CACHE_H
+#define _CACHE_H
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "sink.h"
+
+// An on-disk compilation cache maps the contents of a source file
+// (plus its name and the compiler's flags) to what compiling it produced,
+// so unchanged files do not have to be lexed or parsed again.
+// Entries are written atomically (to a temporary file, then renamed),
+// so several compiler processes (or threads) can share a cache directory.
+// When the entries take more than a given number of bytes,
+// the least recently used ones are removed (see cache_store).
+
+// Kinds of sections in a cache entry
+typedef enum {
+    cache_output = 1, cache_diagnostics = 2, cache_bytecode = 3
+} cache_section_kind;
+
+// Key of a cache entry: two independent 64-bit hashes
+typedef struct {
+    uint64_t name;   // used to name the entry's file
+    uint64_t check;  // checked against the entry, to rule out collisions
+} cache_key;
+
+// Default maximum size of a cache directory, in bytes
+#define CACHE_DEFAULT_MAX_BYTES (256UL * 1024 * 1024)
+
+// Return the key for the source code src (with len bytes)
+// in the file named fname, compiled with the given flags
+// (a string describing all options that affect the output)
+extern cache_key cache_make_key(const char *fname, const char *src,
+				size_t len, const char *flags);
+
+// Look for the entry with the given key in the cache directory dir.
+// If it is there, write its output and diagnostics to out and diagnostics,
+// put its status (true for no errors) in *ok, mark it as recently used,
+// and return true. Otherwise return false.
+extern bool cache_lookup(const char *dir, cache_key key,
+			 sink *out, sink *diagnostics, bool *ok);
+
+// Store an entry with the given key, status (ok), output and diagnostics
+// in the cache directory dir (creating dir if needed), unless the entry
+// alone would take more than max_bytes bytes. Then, if the entries may
+// take more than max_bytes bytes, remove least recently used entries
+// (never the new one) until they take at most 3/4 of that
+// (CACHE_EVICT_TO_PERCENT in cache.c). The entries' bytes are
+// counted from a scan of dir on the first store, and then kept up to date
+// as entries are stored, with a new scan (to count those that other
+// processes stored) after every CACHE_RESCAN_STORES stores (see cache.c)
+// or whenever the count passes max_bytes, so filling a cache takes
+// linear time. dir must stay the same string for each of a process's
+// stores (as in the driver), or it is scanned on each store.
+// Failures to write are ignored (the cache is optional).
+extern void cache_store(const char *dir, cache_key key, bool ok,
+			const char *out, size_t outlen,
+			const char *diagnostics, size_t diaglen,
+			size_t max_bytes);
+
+#endif
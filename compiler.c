@@ -1,31 +1,360 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "lexer.h"
-#include "lexer_output.h"
-#include "parser.h"
-#include "ast.h"
 #include "utilities.h"
-#include "scope_check.h"
-#include "symbol_table.h"
-#include "unparser.h"
+#include "sink.h"
+#include "driver.h"
+#include "batch.h"
+#include "thread_pool.h"
+#include "server.h"
+#include "cache.h"
+#include "stats.h"
+#include "loops.h"
+#include "regalloc.h"
+#include "sampler.h"
+#include "trace.h"
+#include "mem.h"
+
+// Print a usage message on stderr and exit with a failure code
+static void usage(const char *cmdname)
+{
+    fprintf(stderr, "Usage: %s file.pl0\n", cmdname);
+    fprintf(stderr, "   or: %s [-j threads] file.pl0 ...\n", cmdname);
+    fprintf(stderr, "   or: %s [-j threads] @listfile\n", cmdname);
+    fprintf(stderr, "   or: %s --serve[=socket]\n", cmdname);
+    fprintf(stderr, "   or: %s --client[=socket] [--send-source] file.pl0 ...\n",
+	    cmdname);
+    fprintf(stderr, "   or: %s --shutdown[=socket]\n", cmdname);
+    fprintf(stderr, "Options: --cache-dir=dir (or $PL0_CACHE_DIR)"
+	    " caches results in dir\n");
+    fprintf(stderr, "         --cache-size=megabytes limits the cache's size"
+	    " (default %lu)\n", CACHE_DEFAULT_MAX_BYTES / (1024 * 1024));
+    fprintf(stderr, "         --stats[=json|=csv] prints compile statistics"
+	    " on stderr at the end\n");
+    fprintf(stderr, "         --prelex lexes each whole file"
+	    " before parsing it\n");
+    fprintf(stderr, "         --pipeline lexes on another thread"
+	    " while parsing\n");
+    fprintf(stderr, "         --parallel-lex[=threads] lexes each large file"
+	    " in chunks on several threads\n");
+    fprintf(stderr, "         --parallel-check[=threads] checks the"
+	    " statements of large programs on several threads\n");
+    fprintf(stderr, "         --share-exprs shares the nodes"
+	    " of identical expressions\n");
+    fprintf(stderr, "         --cse eliminates common subexpressions"
+	    " (showing the result)\n");
+    fprintf(stderr, "         --simplify folds constants and reduces"
+	    " the strength of loops' multiplications\n");
+    fprintf(stderr, "         --dce eliminates dead code"
+	    " and warns about unused names\n");
+    fprintf(stderr, "         --loops[=unroll] hoists loop invariants"
+	    " and unrolls short loops (by %d)\n", LOOPS_DEFAULT_UNROLL);
+    fprintf(stderr, "         --regalloc[=registers] reports a linear-scan"
+	    " allocation of x86-64 registers (at most %d)\n",
+	    REGALLOC_MAX_REGISTERS);
+    fprintf(stderr, "         --run runs the program"
+	    " (reading stdin) instead of showing it\n");
+    fprintf(stderr, "         --run-counts=file runs the program, writing"
+	    " its execution counts to file\n");
+    fprintf(stderr, "         --use-counts=file uses the execution counts"
+	    " in file to guide optimizations\n");
+    fprintf(stderr, "         --emit-ast writes each checked program's AST"
+	    " to file.ast (in binary)\n");
+    fprintf(stderr, "         --load-ast reads binary AST files"
+	    " instead of source code\n");
+    fprintf(stderr, "         --trace=file.json writes a Chrome trace"
+	    " of the compiler's phases\n");
+    fprintf(stderr, "         --profile[=file.folded] samples where the"
+	    " compiler spends its time (default %s)\n", SAMPLER_DEFAULT_FILE);
+    fprintf(stderr, "         --mem-report tracks each block of memory"
+	    " and prints each subsystem's use on stderr at the end\n");
+    fprintf(stderr, "A listfile names one file per line"
+	    " (blank lines and lines starting with # are ignored)\n");
+    fprintf(stderr, "The default socket is $PL0_SOCKET or %s\n",
+	    server_default_path());
+    exit(EXIT_FAILURE);
+}
+
+// Add a copy of fname to the growable array *files (with *count elements
+// and room for *capacity)
+static void add_file(const char ***files, size_t *count, size_t *capacity,
+		     const char *fname)
+{
+    char *copy = mem_strdup(mem_driver, fname);
+    if (copy == NULL) {
+	bail_with_error("No space for a file name!");
+    }
+    if (*count == *capacity) {
+	*capacity = (*capacity == 0) ? 16 : 2 * *capacity;
+	*files = (const char **) mem_realloc(mem_driver, *files,
+					 *capacity * sizeof(const char *));
+	if (*files == NULL) {
+	    bail_with_error("No space for the list of files!");
+	}
+    }
+    (*files)[(*count)++] = copy;
+}
+
+// Add each file named in the list file listname to *files
+static void add_list_file(const char ***files, size_t *count,
+			  size_t *capacity, const char *listname)
+{
+    FILE *lf = fopen(listname, "r");
+    if (lf == NULL) {
+	bail_with_error("Cannot open list file %s", listname);
+    }
+    char line[BUFSIZ];
+    while (fgets(line, sizeof(line), lf) != NULL) {
+	line[strcspn(line, "\r\n")] = '\0';
+	if (line[0] == '\0' || line[0] == '#') {
+	    continue;
+	}
+	add_file(files, count, capacity, line);
+    }
+    fclose(lf);
+}
 
 int main(int argc, char *argv[]){
-    if (argc == 2) {
-        parser_open(argv[1]);
-        AST * progast = parseProgram();
-        parser_close();
-        // unparse to check on the AST
-        unparseProgram(stdout, progast);
-        
-        // build symbol table and check declarations
-        scope_initialize();
-        scope_check_program(progast); 
-
-        return EXIT_SUCCESS;
-    }
-    else {
-        printf("Passed incorrect number of command-line arguments"); 
-        return EXIT_FAILURE; 
-    }
-}
\ No newline at end of file
+    const char *cmdname = argv[0];
+    unsigned int nthreads = pool_default_threads();
+    bool batch_mode = false;
+    const char **files = NULL;
+    size_t nfiles = 0;
+    size_t capacity = 0;
+    const char *serve_path = NULL;
+    const char *client_path = NULL;
+    bool send_source = false;
+    const char *cache_dir = getenv("PL0_CACHE_DIR");
+    size_t cache_bytes = CACHE_DEFAULT_MAX_BYTES;
+    bool want_stats = false;
+    stats_format stats_fmt = stats_text;
+    const char *trace_file = NULL;
+    const char *profile_file = NULL;
+    bool running = false;
+    bool profiled = false;
+    bool mem_reporting = false;
+
+    // the memory report needs each block tracked from the first one
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mem-report") == 0) {
+            mem_track();
+        }
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0) {
+            if (i + 1 >= argc || atoi(argv[i+1]) < 1) {
+                usage(cmdname);
+            }
+            nthreads = (unsigned int) atoi(argv[++i]);
+            batch_mode = true;
+        }
+        else if (strcmp(argv[i], "--serve") == 0) {
+            serve_path = server_default_path();
+        }
+        else if (strncmp(argv[i], "--serve=", 8) == 0) {
+            serve_path = argv[i] + 8;
+        }
+        else if (strcmp(argv[i], "--client") == 0) {
+            client_path = server_default_path();
+        }
+        else if (strncmp(argv[i], "--client=", 9) == 0) {
+            client_path = argv[i] + 9;
+        }
+        else if (strcmp(argv[i], "--send-source") == 0) {
+            send_source = true;
+        }
+        else if (strcmp(argv[i], "--shutdown") == 0) {
+            client_shutdown(server_default_path());
+            return EXIT_SUCCESS;
+        }
+        else if (strncmp(argv[i], "--shutdown=", 11) == 0) {
+            client_shutdown(argv[i] + 11);
+            return EXIT_SUCCESS;
+        }
+        else if (strncmp(argv[i], "--cache-dir=", 12) == 0) {
+            cache_dir = argv[i] + 12;
+        }
+        else if (strncmp(argv[i], "--cache-size=", 13) == 0) {
+            long mb = atol(argv[i] + 13);
+            if (mb < 1) {
+                usage(cmdname);
+            }
+            cache_bytes = (size_t) mb * 1024 * 1024;
+        }
+        else if (strcmp(argv[i], "--stats") == 0) {
+            want_stats = true;
+        }
+        else if (strcmp(argv[i], "--stats=json") == 0) {
+            want_stats = true;
+            stats_fmt = stats_json;
+        }
+        else if (strcmp(argv[i], "--stats=csv") == 0) {
+            want_stats = true;
+            stats_fmt = stats_csv;
+        }
+        else if (strcmp(argv[i], "--prelex") == 0) {
+            driver_use_prelex(true);
+        }
+        else if (strcmp(argv[i], "--pipeline") == 0) {
+            driver_use_pipeline(true);
+        }
+        else if (strcmp(argv[i], "--parallel-lex") == 0) {
+            driver_use_parallel_lex(pool_default_threads());
+        }
+        else if (strncmp(argv[i], "--parallel-lex=", 15) == 0) {
+            if (atoi(argv[i] + 15) < 1) {
+                usage(cmdname);
+            }
+            driver_use_parallel_lex((unsigned int) atoi(argv[i] + 15));
+        }
+        else if (strcmp(argv[i], "--parallel-check") == 0) {
+            driver_use_parallel_check(pool_default_threads());
+        }
+        else if (strncmp(argv[i], "--parallel-check=", 17) == 0) {
+            if (atoi(argv[i] + 17) < 1) {
+                usage(cmdname);
+            }
+            driver_use_parallel_check((unsigned int) atoi(argv[i] + 17));
+        }
+        else if (strcmp(argv[i], "--share-exprs") == 0) {
+            driver_share_exprs(true);
+        }
+        else if (strcmp(argv[i], "--cse") == 0) {
+            driver_use_cse(true);
+        }
+        else if (strcmp(argv[i], "--simplify") == 0) {
+            driver_use_simplify(true);
+        }
+        else if (strcmp(argv[i], "--dce") == 0) {
+            driver_use_dce(true);
+        }
+        else if (strcmp(argv[i], "--loops") == 0) {
+            driver_optimize_loops(LOOPS_DEFAULT_UNROLL);
+        }
+        else if (strncmp(argv[i], "--loops=", 8) == 0) {
+            if (atoi(argv[i] + 8) < 1) {
+                usage(cmdname);
+            }
+            driver_optimize_loops((unsigned int) atoi(argv[i] + 8));
+        }
+        else if (strcmp(argv[i], "--regalloc") == 0) {
+            driver_report_registers(REGALLOC_MAX_REGISTERS);
+        }
+        else if (strncmp(argv[i], "--regalloc=", 11) == 0) {
+            if (atoi(argv[i] + 11) < 1
+                || atoi(argv[i] + 11) > REGALLOC_MAX_REGISTERS) {
+                usage(cmdname);
+            }
+            driver_report_registers((unsigned int) atoi(argv[i] + 11));
+        }
+        else if (strcmp(argv[i], "--run") == 0) {
+            driver_run(true);
+            running = true;
+        }
+        else if (strncmp(argv[i], "--run-counts=", 13) == 0) {
+            driver_count_runs(argv[i] + 13);
+            running = true;
+        }
+        else if (strncmp(argv[i], "--use-counts=", 13) == 0) {
+            driver_use_counts(argv[i] + 13);
+            profiled = true;
+        }
+        else if (strcmp(argv[i], "--emit-ast") == 0) {
+            driver_write_ast(true);
+        }
+        else if (strcmp(argv[i], "--load-ast") == 0) {
+            driver_read_ast(true);
+        }
+        else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            trace_file = argv[i] + 8;
+        }
+        else if (strcmp(argv[i], "--profile") == 0) {
+            profile_file = SAMPLER_DEFAULT_FILE;
+        }
+        else if (strncmp(argv[i], "--profile=", 10) == 0) {
+            profile_file = argv[i] + 10;
+        }
+        else if (strcmp(argv[i], "--mem-report") == 0) {
+            mem_reporting = true;
+        }
+        else if (argv[i][0] == '@') {
+            add_list_file(&files, &nfiles, &capacity, argv[i] + 1);
+            batch_mode = true;
+        }
+        else if (argv[i][0] == '-') {
+            usage(cmdname);
+        }
+        else {
+            add_file(&files, &nfiles, &capacity, argv[i]);
+        }
+    }
+
+    if (cache_dir != NULL && cache_dir[0] != '\0') {
+        driver_use_cache(cache_dir, cache_bytes);
+    }
+    if (want_stats) {
+        stats_enable();
+    }
+    if (trace_file != NULL) {
+        trace_enable();
+    }
+    if (profile_file != NULL) {
+        sampler_enable();
+    }
+
+    // a run reads stdin, and a profile is for one program
+    if ((running || profiled)
+        && (nfiles != 1 || batch_mode || serve_path != NULL
+            || client_path != NULL)) {
+        usage(cmdname);
+    }
+
+    int status = EXIT_SUCCESS;
+    if (serve_path != NULL) {
+        if (nfiles != 0 || client_path != NULL) {
+            usage(cmdname);
+        }
+        server_run(serve_path);
+    }
+    else if (client_path != NULL) {
+        // the statistics are the server's
+        size_t failures = client_run(client_path, files, nfiles, send_source);
+        return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    else if (nfiles == 1 && !batch_mode) {
+        sink *out = sink_file(stdout);
+        sink *diagnostics = sink_file(stderr);
+        bool ok = driver_try_compile(files[0], NULL, 0, out, diagnostics);
+        sink_close(out);
+        sink_close(diagnostics);
+        status = ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    else if (nfiles >= 1) {
+        size_t failures = batch_compile(files, nfiles, nthreads);
+        status = (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    else if (!batch_mode) {
+        usage(cmdname);
+    }
+    // otherwise there was an empty list file
+
+    stats_report(stderr, stats_fmt);
+    if (trace_file != NULL) {
+        trace_write(trace_file);
+    }
+    if (profile_file != NULL) {
+        sampler_write(profile_file);
+    }
+    // free what is still held, so a report shows any blocks leaked
+    for (size_t i = 0; i < nfiles; i++) {
+        mem_free((char *) files[i]);
+    }
+    mem_free(files);
+    driver_finish();
+    if (mem_reporting) {
+        mem_report(stderr);
+    }
+    return status;
+}
@@ -0,0 +1,565 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "ast.h"
+#include "ast_walk.h"
+#include "id_attrs.h"
+#include "symbol_table.h"
+#include "hash.h"
+#include "temps.h"
+#include "trace.h"
+#include "utilities.h"
+#include "cse.h"
+#include "mem.h"
+
+// Kinds of value number keys (a binary expression's kind is
+// VN_BIN plus its bin_arith_op)
+#define VN_IDENT 0
+#define VN_NUMBER 1
+#define VN_BIN 2
+
+// Empty slot in the hash table of value numbers
+#define NO_VN UINT32_MAX
+
+// The value of an expression node, as a key: an ident's variable
+// (by its offset) and version, a number's value, or an operator
+// and the value numbers of its operands
+typedef struct {
+    uint32_t kind;
+    uint32_t a;
+    uint32_t b;
+} vn_key;
+
+// What is known about a value number in the current block
+typedef struct {
+    vn_key key;
+    size_t size;            // number of nodes in its expression
+    int first;              // its first occurrence
+    int last;               // its last occurrence
+    int def;                // the occurrence that computes its temporary
+    int temp;               // index of its temporary (or -1 if none)
+} vn_info;
+
+// An occurrence of an expression node in the current block
+// (numbered in the order a walk finishes them)
+typedef struct {
+    uint32_t vn;
+    int start;              // the first occurrence in its subtree
+    int next;               // the next occurrence with the same value number
+    bool dead;              // inside an occurrence that is not computed
+} occurrence;
+
+// The state of eliminating common subexpressions in a program
+typedef struct {
+    AST *prog;
+    uint32_t *versions;     // of each variable, indexed by offset
+    // value numbers of the current block, and a hash table of them
+    vn_info *vals;
+    size_t num_vals;
+    size_t vals_cap;
+    uint32_t *slots;
+    size_t num_slots;       // a power of 2
+    // occurrences of the current block
+    occurrence *occs;
+    size_t num_occs;
+    size_t occs_cap;
+    // the stack of a walk (of occurrences or of rewritten ASTs)
+    void *stack;
+    size_t depth;
+    size_t stack_cap;
+    // the next occurrence that a rewriting walk finishes
+    size_t next_occ;
+    // the temporaries made so far
+    const char **temps;
+    size_t num_temps;
+    size_t temps_cap;
+    unsigned int next_temp; // for temp_declare (see temps.h)
+    // the statements that compute temporaries for the current statement
+    AST_list defs;
+    AST *last_def;
+} cse_state;
+
+// Make sure that the array at *arr (of *cap elements of size elem)
+// has room for n elements
+static void *reserve(void *arr, size_t *cap, size_t n, size_t elem)
+{
+    if (n <= *cap) {
+	return arr;
+    }
+    size_t new_cap = (*cap == 0) ? 64 : 2 * *cap;
+    while (new_cap < n) {
+	new_cap *= 2;
+    }
+    arr = mem_realloc(mem_optimizer, arr, new_cap * elem);
+    if (arr == NULL) {
+	bail_with_error("No space to eliminate common subexpressions!");
+    }
+    *cap = new_cap;
+    return arr;
+}
+
+// Push the element of size elem at p onto the walk stack of s
+static void push(cse_state *s, const void *p, size_t elem)
+{
+    s->stack = reserve(s->stack, &s->stack_cap, s->depth + 1, elem);
+    memcpy((char *) s->stack + s->depth * elem, p, elem);
+    s->depth++;
+}
+
+// Pop the top element (of size elem) of the walk stack of s into p
+static void pop(cse_state *s, void *p, size_t elem)
+{
+    s->depth--;
+    memcpy(p, (char *) s->stack + s->depth * elem, elem);
+}
+
+// Empty the table of value numbers of s (for a new block)
+static void clear_vals(cse_state *s)
+{
+    for (size_t i = 0; i < s->num_slots; i++) {
+	s->slots[i] = NO_VN;
+    }
+    s->num_vals = 0;
+    s->num_occs = 0;
+}
+
+// Double the number of slots in the hash table of value numbers of s
+static void grow_slots(cse_state *s)
+{
+    size_t num_slots = (s->num_slots == 0) ? 256 : 2 * s->num_slots;
+    uint32_t *slots = (uint32_t *) mem_alloc(
+	mem_optimizer, num_slots * sizeof(uint32_t));
+    if (slots == NULL) {
+	bail_with_error("No space to eliminate common subexpressions!");
+    }
+    for (size_t i = 0; i < num_slots; i++) {
+	slots[i] = NO_VN;
+    }
+    for (size_t i = 0; i < s->num_vals; i++) {
+	size_t k = xxh64(&s->vals[i].key, sizeof(vn_key), 0)
+	    & (num_slots - 1);
+	while (slots[k] != NO_VN) {
+	    k = (k + 1) & (num_slots - 1);
+	}
+	slots[k] = (uint32_t) i;
+    }
+    mem_free(s->slots);
+    s->slots = slots;
+    s->num_slots = num_slots;
+}
+
+// Return the value number for key in s (adding it, with the given size,
+// if it is new), and add an occurrence of it, whose subtree starts
+// at the occurrence start (or at the new occurrence, if start < 0)
+static int add_occurrence(cse_state *s, vn_key key, size_t size, int start)
+{
+    if (2 * (s->num_vals + 1) > s->num_slots) {
+	grow_slots(s);
+    }
+    size_t k = xxh64(&key, sizeof(vn_key), 0) & (s->num_slots - 1);
+    while (s->slots[k] != NO_VN
+	   && memcmp(&s->vals[s->slots[k]].key, &key, sizeof(vn_key)) != 0) {
+	k = (k + 1) & (s->num_slots - 1);
+    }
+    int i = (int) s->num_occs;
+    s->occs = (occurrence *) reserve(s->occs, &s->occs_cap, s->num_occs + 1,
+				     sizeof(occurrence));
+    s->num_occs++;
+    if (s->slots[k] == NO_VN) {
+	s->vals = (vn_info *) reserve(s->vals, &s->vals_cap, s->num_vals + 1,
+				      sizeof(vn_info));
+	vn_info *v = &s->vals[s->num_vals];
+	v->key = key;
+	v->size = size;
+	v->first = i;
+	v->last = i;
+	v->def = -1;
+	v->temp = -1;
+	s->slots[k] = (uint32_t) s->num_vals++;
+    } else {
+	vn_info *v = &s->vals[s->slots[k]];
+	s->occs[v->last].next = i;
+	v->last = i;
+    }
+    occurrence *o = &s->occs[i];
+    o->vn = s->slots[k];
+    o->start = (start < 0) ? i : start;
+    o->next = -1;
+    o->dead = false;
+    return i;
+}
+
+// Return the offset of the variable (or constant) named name
+static uint32_t offset_of(const char *name)
+{
+    id_attrs *attrs = scope_lookup(name);
+    if (attrs == NULL) {
+	bail_with_error("Undeclared name \"%s\" in cse_program", name);
+    }
+    return attrs->offset;
+}
+
+// Callbacks for numbering the values of an expression's nodes,
+// which push the index of each node's occurrence
+static void number_ident(ast_walker *w, AST *exp, int level,
+			 unsigned int flags)
+{
+    cse_state *s = (cse_state *) ast_walk_context(w);
+    uint32_t off = offset_of(exp->data.ident.name);
+    vn_key key = { VN_IDENT, off, s->versions[off] };
+    int i = add_occurrence(s, key, 1, -1);
+    push(s, &i, sizeof(int));
+}
+
+static void number_number(ast_walker *w, AST *exp, int level,
+			  unsigned int flags)
+{
+    cse_state *s = (cse_state *) ast_walk_context(w);
+    vn_key key = { VN_NUMBER, (uint16_t) exp->data.number.value, 0 };
+    int i = add_occurrence(s, key, 1, -1);
+    push(s, &i, sizeof(int));
+}
+
+static void number_bin_expr(ast_walker *w, AST *exp, int level,
+			    unsigned int flags)
+{
+    cse_state *s = (cse_state *) ast_walk_context(w);
+    int l, r;
+    pop(s, &r, sizeof(int));
+    pop(s, &l, sizeof(int));
+    const vn_info *lv = &s->vals[s->occs[l].vn];
+    const vn_info *rv = &s->vals[s->occs[r].vn];
+    vn_key key = { VN_BIN + exp->data.bin_expr.arith_op,
+		   s->occs[l].vn, s->occs[r].vn };
+    int i = add_occurrence(s, key, 1 + lv->size + rv->size,
+			   s->occs[l].start);
+    push(s, &i, sizeof(int));
+}
+
+static const ast_visitor number_visitor = {
+    .post = {
+	[ident_ast] = number_ident,
+	[number_ast] = number_number,
+	[bin_expr_ast] = number_bin_expr,
+    },
+};
+
+// Add the occurrences of the expression nodes of exp to s
+static void number_expr(cse_state *s, AST *exp)
+{
+    s->depth = 0;
+    ast_walk(exp, &number_visitor, s, 0, 0);
+}
+
+// Return the name of the temporary with index t in s,
+// declaring it if it is new
+static const char *temp_name(cse_state *s, size_t t)
+{
+    if (t < s->num_temps) {
+	return s->temps[t];
+    }
+    const char *name = temp_declare(s->prog, "cse", &s->next_temp);
+    if (name == NULL) {
+	return NULL;
+    }
+    s->temps = (const char **) reserve(s->temps, &s->temps_cap,
+				       s->num_temps + 1, sizeof(char *));
+    s->temps[s->num_temps++] = name;
+    return name;
+}
+
+// The state whose value numbers larger_first compares
+static _Thread_local const cse_state *cmp_state;
+
+// Compare the value numbers at p1 and p2 (of cmp_state)
+// so that larger expressions come first
+static int larger_first(const void *p1, const void *p2)
+{
+    size_t s1 = cmp_state->vals[*(const uint32_t *) p1].size;
+    size_t s2 = cmp_state->vals[*(const uint32_t *) p2].size;
+    if (s1 != s2) {
+	return (s1 > s2) ? -1 : 1;
+    }
+    // keep the order of their first occurrences
+    int f1 = cmp_state->vals[*(const uint32_t *) p1].first;
+    int f2 = cmp_state->vals[*(const uint32_t *) p2].first;
+    return (f1 > f2) - (f1 < f2);
+}
+
+// Choose which values of the current block of s are computed
+// into temporaries: those that occur (outside of the occurrences
+// already replaced) at least twice, largest first, so an expression
+// inside a repeated one is only counted where it is still computed
+static void choose_temps(cse_state *s)
+{
+    uint32_t *cands = (uint32_t *) mem_alloc(mem_optimizer, (s->num_vals + 1)
+					  * sizeof(uint32_t));
+    if (cands == NULL) {
+	bail_with_error("No space to eliminate common subexpressions!");
+    }
+    size_t ncands = 0;
+    for (size_t v = 0; v < s->num_vals; v++) {
+	if (s->vals[v].key.kind >= VN_BIN
+	    && s->vals[v].first != s->vals[v].last) {
+	    cands[ncands++] = (uint32_t) v;
+	}
+    }
+    cmp_state = s;
+    qsort(cands, ncands, sizeof(uint32_t), larger_first);
+    size_t num_chosen = 0;
+    for (size_t c = 0; c < ncands; c++) {
+	vn_info *v = &s->vals[cands[c]];
+	int first = -1;
+	size_t alive = 0;
+	for (int i = v->first; i >= 0; i = s->occs[i].next) {
+	    if (!s->occs[i].dead) {
+		if (first < 0) {
+		    first = i;
+		}
+		alive++;
+	    }
+	}
+	if (alive < 2) {
+	    continue;
+	}
+	temp_name(s, num_chosen);
+	num_chosen++;
+	v->def = first;
+	// only the first occurrence's operands are still computed
+	for (int i = s->occs[first].next; i >= 0; i = s->occs[i].next) {
+	    if (!s->occs[i].dead) {
+		for (int j = s->occs[i].start; j < i; j++) {
+		    s->occs[j].dead = true;
+		}
+	    }
+	}
+    }
+    mem_free(cands);
+    // number the temporaries in the order they are computed
+    size_t next_temp = 0;
+    for (size_t i = 0; i < s->num_occs; i++) {
+	vn_info *v = &s->vals[s->occs[i].vn];
+	if (v->def == (int) i) {
+	    v->temp = (int) next_temp++;
+	}
+    }
+}
+
+// Callbacks for rewriting an expression, which push
+// the (possibly new) AST for each node's occurrence
+static void rewrite_leaf(ast_walker *w, AST *exp, int level,
+			 unsigned int flags)
+{
+    cse_state *s = (cse_state *) ast_walk_context(w);
+    s->next_occ++;
+    push(s, &exp, sizeof(AST *));
+}
+
+static void rewrite_bin_expr(ast_walker *w, AST *exp, int level,
+			     unsigned int flags)
+{
+    cse_state *s = (cse_state *) ast_walk_context(w);
+    const occurrence *o = &s->occs[s->next_occ++];
+    AST *l, *r;
+    pop(s, &r, sizeof(AST *));
+    pop(s, &l, sizeof(AST *));
+    AST *ret = exp;
+    if (l != exp->data.bin_expr.leftexp || r != exp->data.bin_expr.rightexp) {
+	ret = ast_bin_expr(file_loc2token(exp->file_loc), l,
+			   exp->data.bin_expr.arith_op, r);
+    }
+    const vn_info *v = &s->vals[o->vn];
+    if (!o->dead && v->temp >= 0) {
+	const char *name = s->temps[v->temp];
+	if (s->next_occ - 1 == (size_t) v->def) {
+	    AST *def = ast_assign_stmt(file_loc2token(exp->file_loc), name, ret);
+	    if (ast_list_is_empty(s->defs)) {
+		s->defs = ast_list_singleton(def);
+	    } else {
+		ast_list_splice(s->last_def, def);
+	    }
+	    s->last_def = def;
+	}
+	ret = ast_ident(file_loc2token(exp->file_loc), name);
+    }
+    push(s, &ret, sizeof(AST *));
+}
+
+static const ast_visitor rewrite_visitor = {
+    .post = {
+	[ident_ast] = rewrite_leaf,
+	[number_ast] = rewrite_leaf,
+	[bin_expr_ast] = rewrite_bin_expr,
+    },
+};
+
+// Return exp with the occurrences of s that have temporaries replaced,
+// adding the statements that compute the temporaries to s's defs
+static AST *rewrite_expr(cse_state *s, AST *exp)
+{
+    s->depth = 0;
+    ast_walk(exp, &rewrite_visitor, s, 0, 0);
+    AST *ret;
+    pop(s, &ret, sizeof(AST *));
+    return ret;
+}
+
+// Requires: n > 0 and stmts[0..n-1] are assign, read, write,
+//           or skip statements, in order
+// Return the list of the statements of the block stmts[0..n-1]
+// with its common subexpressions eliminated
+static AST_list cse_block(cse_state *s, AST **stmts, size_t n)
+{
+    clear_vals(s);
+    for (size_t i = 0; i < n; i++) {
+	AST *stmt = stmts[i];
+	switch (stmt->type_tag) {
+	case assign_ast:
+	    number_expr(s, stmt->data.assign_stmt.exp);
+	    s->versions[offset_of(stmt->data.assign_stmt.name)]++;
+	    break;
+	case read_ast:
+	    s->versions[offset_of(stmt->data.read_stmt.name)]++;
+	    break;
+	case write_ast:
+	    number_expr(s, stmt->data.write_stmt.exp);
+	    break;
+	default:
+	    break;
+	}
+    }
+    choose_temps(s);
+
+    AST_list ret = ast_list_empty_list();
+    AST *last = NULL;
+    s->next_occ = 0;
+    for (size_t i = 0; i < n; i++) {
+	AST *stmt = stmts[i];
+	s->defs = ast_list_empty_list();
+	s->last_def = NULL;
+	if (stmt->type_tag == assign_ast) {
+	    AST *exp = rewrite_expr(s, stmt->data.assign_stmt.exp);
+	    if (exp != stmt->data.assign_stmt.exp) {
+		stmt = ast_assign_stmt(file_loc2token(stmt->file_loc),
+				       stmt->data.assign_stmt.name, exp);
+	    }
+	} else if (stmt->type_tag == write_ast) {
+	    AST *exp = rewrite_expr(s, stmt->data.write_stmt.exp);
+	    if (exp != stmt->data.write_stmt.exp) {
+		stmt = ast_write_stmt(file_loc2token(stmt->file_loc), exp);
+	    }
+	}
+	stmt->next = NULL;
+	if (!ast_list_is_empty(s->defs)) {
+	    ast_list_splice(s->last_def, stmt);
+	    stmt = s->defs;
+	}
+	if (ast_list_is_empty(ret)) {
+	    ret = stmt;
+	} else {
+	    ast_list_splice(last, stmt);
+	}
+	last = ast_list_last_elem(stmt);
+    }
+    return ret;
+}
+
+static AST *cse_stmt(cse_state *s, AST *stmt);
+
+// Return true just when stmt is a statement that can be in a basic block
+static bool is_simple(AST *stmt)
+{
+    switch (stmt->type_tag) {
+    case assign_ast:
+    case read_ast:
+    case write_ast:
+    case skip_ast:
+	return true;
+    default:
+	return false;
+    }
+}
+
+// Return the list stmts with the common subexpressions
+// of each of its basic blocks (and nested statements) eliminated
+static AST_list cse_stmts(cse_state *s, AST_list stmts)
+{
+    AST_list ret = ast_list_empty_list();
+    AST *last = NULL;
+    AST **block = NULL;
+    size_t block_cap = 0;
+    while (!ast_list_is_empty(stmts)) {
+	AST_list done;
+	if (is_simple(ast_list_first(stmts))) {
+	    size_t n = 0;
+	    while (!ast_list_is_empty(stmts) && is_simple(ast_list_first(stmts))) {
+		block = (AST **) reserve(block, &block_cap, n + 1, sizeof(AST *));
+		block[n++] = ast_list_first(stmts);
+		stmts = ast_list_rest(stmts);
+	    }
+	    done = cse_block(s, block, n);
+	} else {
+	    AST *stmt = ast_list_first(stmts);
+	    stmts = ast_list_rest(stmts);
+	    done = cse_stmt(s, stmt);
+	    done->next = NULL;
+	}
+	if (ast_list_is_empty(ret)) {
+	    ret = done;
+	} else {
+	    ast_list_splice(last, done);
+	}
+	last = ast_list_last_elem(done);
+    }
+    mem_free(block);
+    return ret;
+}
+
+// Return stmt with the common subexpressions of its basic blocks eliminated
+static AST *cse_stmt(cse_state *s, AST *stmt)
+{
+    switch (stmt->type_tag) {
+    case begin_ast:
+	stmt->data.begin_stmt.stmts = cse_stmts(s, stmt->data.begin_stmt.stmts);
+	return stmt;
+    case if_ast:
+	stmt->data.if_stmt.thenstmt = cse_stmt(s, stmt->data.if_stmt.thenstmt);
+	stmt->data.if_stmt.elsestmt = cse_stmt(s, stmt->data.if_stmt.elsestmt);
+	return stmt;
+    case while_ast:
+	stmt->data.while_stmt.stmt = cse_stmt(s, stmt->data.while_stmt.stmt);
+	return stmt;
+    default: {
+	// a statement by itself is a block, which may need a begin
+	AST_list stmts = cse_block(s, &stmt, 1);
+	if (ast_list_is_empty(ast_list_rest(stmts))) {
+	    return stmts;
+	}
+	return ast_begin_stmt(file_loc2token(stmt->file_loc), stmts);
+    }
+    }
+}
+
+// Eliminate the common subexpressions in prog (see cse.h)
+void cse_program(AST *prog)
+{
+    TRACE_BEGIN("cse");
+    cse_state s;
+    memset(&s, 0, sizeof(s));
+    s.prog = prog;
+    s.versions = (uint32_t *) mem_calloc(
+	mem_optimizer, scope_size() + 1, sizeof(uint32_t));
+    if (s.versions == NULL) {
+	bail_with_error("No space to eliminate common subexpressions!");
+    }
+    prog->data.program.stmt = cse_stmt(&s, prog->data.program.stmt);
+    mem_free(s.versions);
+    mem_free(s.vals);
+    mem_free(s.slots);
+    mem_free(s.occs);
+    mem_free(s.stack);
+    mem_free(s.temps);
+    TRACE_END();
+}
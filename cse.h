@@ -0,0 +1,31 @@
+#ifndef _CSE_H
+#define _CSE_H
+#include "ast.h"
+
+// Common subexpression elimination: within each basic block
+// (a run of assign, read, write and skip statements), a binary expression
+// that is computed more than once with the same values of its variables
+// is computed once, into a compiler temporary, before the first statement
+// that uses it; its occurrences then use the temporary.
+// For example,
+//     x := (a*b) + (a*b) * c
+// becomes
+//     cse1 := a * b;
+//     x := cse1 + cse1 * c
+// An assignment to (or read of) a variable ends the life of the values
+// of the expressions that use it, so they are computed again after it.
+// The temporaries are declared as variables at the end of the program's
+// var declarations (with the first names cse1, cse2, ... that are not
+// already declared), and are added to the current scope's symbol table
+// after the program's own names (so their offsets come after all others).
+// Blocks reuse the same temporaries, as no value is kept between blocks.
+
+// Requires: prog has passed its scope check (see scope_check.h),
+//           the current scope is prog's symbol table, and the expression
+//           nodes of prog may be shared (see ast_share_begin in ast.h)
+// Eliminate the common subexpressions in prog (changing it in place,
+// but making new nodes for the statements and expressions that change).
+// If there is no space, bail with an error message.
+extern void cse_program(AST *prog);
+
+#endif
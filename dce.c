@@ -0,0 +1,428 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "ast.h"
+#include "ast_walk.h"
+#include "id_attrs.h"
+#include "symbol_table.h"
+#include "exprs.h"
+#include "trace.h"
+#include "hash.h"
+#include "utilities.h"
+#include "dce.h"
+#include "mem.h"
+
+// The variables found to be live at a loop's condition
+typedef struct {
+    AST *loop;
+    uint64_t *live;
+} loop_live;
+
+// The state of eliminating a program's dead code
+typedef struct {
+    AST *prog;
+    size_t num_words;       // the number of words in a set of offsets
+    const_values consts;
+    // hash table of the variables live at each loop's condition so far
+    // (the sets only grow, so a loop's analysis starts from its last one)
+    loop_live *loops;
+    size_t num_slots;       // a power of 2
+    size_t num_loops;
+} dce_state;
+
+// A set of offsets (a bit for each), such as the live variables
+typedef uint64_t *offset_set;
+
+// Return a fresh, empty set of offsets for s
+static offset_set set_create(dce_state *s)
+{
+    offset_set ret = (offset_set) mem_calloc(
+	mem_optimizer, s->num_words, sizeof(uint64_t));
+    if (ret == NULL) {
+	bail_with_error("No space for a set of live variables!");
+    }
+    return ret;
+}
+
+// Make the set to have the same elements as the set from
+static void set_copy(dce_state *s, offset_set to, offset_set from)
+{
+    memcpy(to, from, s->num_words * sizeof(uint64_t));
+}
+
+// Add the elements of from to the set to,
+// and return true just when that changes to
+static bool set_union(dce_state *s, offset_set to, offset_set from)
+{
+    bool changed = false;
+    for (size_t i = 0; i < s->num_words; i++) {
+	uint64_t w = to[i] | from[i];
+	changed = changed || w != to[i];
+	to[i] = w;
+    }
+    return changed;
+}
+
+static void set_add(offset_set set, unsigned int ofst)
+{
+    set[ofst / 64] |= (uint64_t) 1 << (ofst % 64);
+}
+
+static void set_remove(offset_set set, unsigned int ofst)
+{
+    set[ofst / 64] &= ~((uint64_t) 1 << (ofst % 64));
+}
+
+static bool set_has(offset_set set, unsigned int ofst)
+{
+    return (set[ofst / 64] >> (ofst % 64)) & 1;
+}
+
+// Return the slot for loop in the hash table of s
+static loop_live *loop_slot(dce_state *s, loop_live *slots,
+			    size_t num_slots, AST *loop)
+{
+    size_t k = xxh64(&loop, sizeof(AST *), 0) & (num_slots - 1);
+    while (slots[k].loop != NULL && slots[k].loop != loop) {
+	k = (k + 1) & (num_slots - 1);
+    }
+    return &slots[k];
+}
+
+// Return the set of variables found to be live at the condition
+// of loop so far (which is empty the first time)
+static offset_set loop_live_set(dce_state *s, AST *loop)
+{
+    if (2 * (s->num_loops + 1) > s->num_slots) {
+	size_t num_slots = (s->num_slots == 0) ? 64 : 2 * s->num_slots;
+	loop_live *slots = (loop_live *) mem_calloc(
+	    mem_optimizer, num_slots, sizeof(loop_live));
+	if (slots == NULL) {
+	    bail_with_error("No space to eliminate dead code!");
+	}
+	for (size_t i = 0; i < s->num_slots; i++) {
+	    if (s->loops[i].loop != NULL) {
+		*loop_slot(s, slots, num_slots, s->loops[i].loop) = s->loops[i];
+	    }
+	}
+	mem_free(s->loops);
+	s->loops = slots;
+	s->num_slots = num_slots;
+    }
+    loop_live *ll = loop_slot(s, s->loops, s->num_slots, loop);
+    if (ll->loop == NULL) {
+	ll->loop = loop;
+	ll->live = set_create(s);
+	s->num_loops++;
+    }
+    return ll->live;
+}
+
+// Return the offset of the declared name
+static unsigned int offset_of(const char *name)
+{
+    id_attrs *attrs = scope_lookup(name);
+    assert(attrs != NULL);
+    return attrs->offset;
+}
+
+// Add the variables that are used by an expression
+// (in the offset_set context) to that set
+static void add_use(ast_walker *w, AST *exp, int level, unsigned int flags)
+{
+    id_attrs *attrs = scope_lookup(exp->data.ident.name);
+    if (attrs != NULL && attrs->kind == variable) {
+	set_add((offset_set) ast_walk_context(w), attrs->offset);
+    }
+}
+
+static const ast_visitor use_visitor = {
+    .pre = { [ident_ast] = add_use },
+};
+
+// Add the variables that exp uses to the set live
+static void add_uses(AST *exp, offset_set live)
+{
+    ast_walk(exp, &use_visitor, live, 0, 0);
+}
+
+// Add the variables that the condition cond uses to the set live
+static void add_cond_uses(AST *cond, offset_set live)
+{
+    if (cond->type_tag == odd_cond_ast) {
+	add_uses(cond->data.odd_cond.exp, live);
+    } else {
+	add_uses(cond->data.bin_cond.leftexp, live);
+	add_uses(cond->data.bin_cond.rightexp, live);
+    }
+}
+
+// Return stmt if it is not NULL, and otherwise a skip statement
+// located at where
+static AST *or_skip(AST *stmt, AST *where)
+{
+    if (stmt != NULL) {
+	return stmt;
+    }
+    return ast_skip_stmt(file_loc2token(where->file_loc));
+}
+
+// Requires: live holds the variables that are live after stmt
+// Change live to hold the variables that are live before stmt.
+// If change is true, eliminate stmt's dead code, returning
+// the statement that remains (or NULL if there is none),
+// and otherwise return stmt unchanged.
+static AST *dce_stmt(dce_state *s, AST *stmt, offset_set live, bool change)
+{
+    switch (stmt->type_tag) {
+    case assign_ast: {
+	unsigned int ofst = offset_of(stmt->data.assign_stmt.name);
+	if (!set_has(live, ofst) && !expr_may_fail(stmt->data.assign_stmt.exp)) {
+	    return change ? NULL : stmt;
+	}
+	set_remove(live, ofst);
+	add_uses(stmt->data.assign_stmt.exp, live);
+	return stmt;
+    }
+    case read_ast:
+	set_remove(live, offset_of(stmt->data.read_stmt.name));
+	return stmt;
+    case write_ast:
+	add_uses(stmt->data.write_stmt.exp, live);
+	return stmt;
+    case skip_ast:
+	return change ? NULL : stmt;
+    case begin_ast: {
+	// the statements are visited last to first
+	size_t n = 0;
+	AST_list stmts = stmt->data.begin_stmt.stmts;
+	for (AST_list l = stmts; !ast_list_is_empty(l); l = ast_list_rest(l)) {
+	    n++;
+	}
+	AST **all = (AST **) mem_alloc(mem_optimizer, n * sizeof(AST *));
+	if (all == NULL) {
+	    bail_with_error("No space to eliminate dead code!");
+	}
+	n = 0;
+	for (AST_list l = stmts; !ast_list_is_empty(l); l = ast_list_rest(l)) {
+	    all[n++] = ast_list_first(l);
+	}
+	AST_list kept = ast_list_empty_list();
+	while (n > 0) {
+	    AST *done = dce_stmt(s, all[--n], live, change);
+	    if (change && done != NULL) {
+		done->next = kept;
+		kept = done;
+	    }
+	}
+	mem_free(all);
+	if (!change) {
+	    return stmt;
+	}
+	if (ast_list_is_empty(kept)) {
+	    return NULL;
+	}
+	stmt->data.begin_stmt.stmts = kept;
+	return stmt;
+    }
+    case if_ast: {
+	AST *cond = stmt->data.if_stmt.cond;
+	bool b;
+	if (cond_eval(&s->consts, cond, NULL, 0, &b)) {
+	    // only the branch taken is reachable
+	    return dce_stmt(s, b ? stmt->data.if_stmt.thenstmt
+			    : stmt->data.if_stmt.elsestmt, live, change);
+	}
+	offset_set else_live = set_create(s);
+	set_copy(s, else_live, live);
+	AST *thenstmt = dce_stmt(s, stmt->data.if_stmt.thenstmt, live, change);
+	AST *elsestmt = dce_stmt(s, stmt->data.if_stmt.elsestmt, else_live,
+				 change);
+	set_union(s, live, else_live);
+	mem_free(else_live);
+	add_cond_uses(cond, live);
+	if (!change) {
+	    return stmt;
+	}
+	if (thenstmt == NULL && elsestmt == NULL && !cond_may_fail(cond)) {
+	    return NULL;
+	}
+	stmt->data.if_stmt.thenstmt = or_skip(thenstmt, stmt);
+	stmt->data.if_stmt.elsestmt = or_skip(elsestmt, stmt);
+	return stmt;
+    }
+    case while_ast: {
+	AST *cond = stmt->data.while_stmt.cond;
+	bool b;
+	if (cond_eval(&s->consts, cond, NULL, 0, &b) && !b) {
+	    // the body is unreachable
+	    return change ? NULL : stmt;
+	}
+	// the variables live at the condition are those live after
+	// the loop, those the condition uses, and those live before
+	// the body (when the condition's are live after it)
+	offset_set found = loop_live_set(s, stmt);
+	add_cond_uses(cond, live);
+	set_union(s, live, found);
+	offset_set body_live = set_create(s);
+	do {
+	    set_copy(s, body_live, live);
+	    dce_stmt(s, stmt->data.while_stmt.stmt, body_live, false);
+	} while (set_union(s, live, body_live));
+	set_copy(s, found, live);
+	if (change) {
+	    set_copy(s, body_live, live);
+	    stmt->data.while_stmt.stmt = or_skip(
+		dce_stmt(s, stmt->data.while_stmt.stmt, body_live, true),
+		stmt);
+	}
+	mem_free(body_live);
+	return stmt;
+    }
+    default:
+	return stmt;
+    }
+}
+
+// The names that a program uses, found by a walk
+typedef struct {
+    bool *used;                     // by offset
+    const const_values *consts;     // to skip unreachable code, or NULL
+} name_uses;
+
+// Mark the names that a program uses (in the name_uses context)
+static void note_use(ast_walker *w, AST *ast, int level, unsigned int flags)
+{
+    const char *name;
+    switch (ast->type_tag) {
+    case assign_ast:
+	name = ast->data.assign_stmt.name;
+	break;
+    case read_ast:
+	name = ast->data.read_stmt.name;
+	break;
+    default:
+	name = ast->data.ident.name;
+	break;
+    }
+    ((name_uses *) ast_walk_context(w))->used[offset_of(name)] = true;
+}
+
+// If the name_uses context skips unreachable code and the condition
+// of the if statement stmt has a constant value, visit only the condition
+// and the branch taken (and otherwise visit all of stmt's children)
+static void note_if_uses(ast_walker *w, AST *stmt, int level,
+			 unsigned int flags)
+{
+    name_uses *nu = (name_uses *) ast_walk_context(w);
+    bool b;
+    if (nu->consts != NULL
+	&& cond_eval(nu->consts, stmt->data.if_stmt.cond, NULL, 0, &b)) {
+	ast_walk_visit(w, stmt->data.if_stmt.cond, level + 1, 0);
+	ast_walk_visit(w, b ? stmt->data.if_stmt.thenstmt
+		       : stmt->data.if_stmt.elsestmt, level + 1, 0);
+    }
+}
+
+// If the name_uses context skips unreachable code and the condition
+// of the while statement stmt is constantly false, visit only the
+// condition (and otherwise visit all of stmt's children)
+static void note_while_uses(ast_walker *w, AST *stmt, int level,
+			    unsigned int flags)
+{
+    name_uses *nu = (name_uses *) ast_walk_context(w);
+    bool b;
+    if (nu->consts != NULL
+	&& cond_eval(nu->consts, stmt->data.while_stmt.cond, NULL, 0, &b)
+	&& !b) {
+	ast_walk_visit(w, stmt->data.while_stmt.cond, level + 1, 0);
+    }
+}
+
+static const ast_visitor used_visitor = {
+    .pre = {
+	[assign_ast] = note_use,
+	[read_ast] = note_use,
+	[ident_ast] = note_use,
+	[if_ast] = note_if_uses,
+	[while_ast] = note_while_uses,
+    },
+};
+
+// Return a fresh array that says which names (by offset)
+// the statement of prog uses, only in its reachable code
+// (as dce_stmt finds it, using consts) if consts is not NULL
+static bool *names_used(AST *prog, const const_values *consts)
+{
+    name_uses nu;
+    nu.used = (bool *) mem_calloc(
+	mem_optimizer, scope_size() + 1, sizeof(bool));
+    if (nu.used == NULL) {
+	bail_with_error("No space to find unused names!");
+    }
+    nu.consts = consts;
+    ast_walk(prog->data.program.stmt, &used_visitor, &nu, 0, 0);
+    return nu.used;
+}
+
+// Warn about the declared name (of the given kind, declared by decl)
+// if it is not used, given the names used anywhere and the names used
+// in reachable code. (A name that is only used by code this pass removed,
+// such as a constant in a condition it folded, is not warned about.)
+static void warn_if_unused(AST *decl, const char *kind, const char *name,
+			   const bool *used, const bool *used_reachable)
+{
+    unsigned int ofst = offset_of(name);
+    if (!used[ofst]) {
+	general_warning(decl->file_loc, "%s %s is never used", kind, name);
+    } else if (!used_reachable[ofst]) {
+	general_warning(decl->file_loc,
+			"%s %s is only used by unreachable code", kind, name);
+    }
+}
+
+// Requires: the dead code of prog has not been eliminated yet
+// Warn about each declared name of prog that its statement does not use,
+// or only uses in code that is unreachable (see dce.h)
+static void warn_unused(AST *prog, const const_values *consts)
+{
+    bool *used = names_used(prog, NULL);
+    bool *used_reachable = names_used(prog, consts);
+    for (AST_list cds = prog->data.program.cds; !ast_list_is_empty(cds);
+	 cds = ast_list_rest(cds)) {
+	AST *cd = ast_list_first(cds);
+	warn_if_unused(cd, "constant", cd->data.const_decl.name,
+		       used, used_reachable);
+    }
+    for (AST_list vds = prog->data.program.vds; !ast_list_is_empty(vds);
+	 vds = ast_list_rest(vds)) {
+	AST *vd = ast_list_first(vds);
+	warn_if_unused(vd, "variable", vd->data.var_decl.name,
+		       used, used_reachable);
+    }
+    mem_free(used);
+    mem_free(used_reachable);
+}
+
+// Eliminate the dead code in prog (see dce.h)
+void dce_program(AST *prog)
+{
+    TRACE_BEGIN("dce");
+    dce_state s;
+    memset(&s, 0, sizeof(s));
+    s.prog = prog;
+    s.num_words = scope_size() / 64 + 1;
+    const_values_init(&s.consts, prog);
+    // the warnings are about the program as written
+    warn_unused(prog, &s.consts);
+    offset_set live = set_create(&s);
+    prog->data.program.stmt = or_skip(
+	dce_stmt(&s, prog->data.program.stmt, live, true), prog);
+    mem_free(live);
+    const_values_free(&s.consts);
+    for (size_t i = 0; i < s.num_slots; i++) {
+	mem_free(s.loops[i].live);
+    }
+    mem_free(s.loops);
+    TRACE_END();
+}
@@ -0,0 +1,31 @@
+#ifndef _DCE_H
+#define _DCE_H
+#include "ast.h"
+
+// Dead code elimination, using a liveness analysis of the program's
+// statements (a variable is live at a point if its value there may be
+// written later). The pass
+//  - removes assignments to variables that are not live after them,
+//    when evaluating their expressions cannot fail (see exprs.h),
+//  - replaces an if statement whose condition has a constant value
+//    by the branch that is taken, and removes a while loop
+//    whose condition is constantly false,
+//  - removes skip statements and if statements that do nothing
+//    (an empty begin, branch or loop body becomes skip),
+//  - and warns about each declared constant or variable that the program
+//    (as written) does not use, or only uses in unreachable code
+//    (a branch that is not taken or a loop body that never runs),
+//    but not about names whose uses are removed in other ways (such as
+//    a constant in a condition that is folded, or a dead assignment).
+// A loop's live variables are found by iterating over its body
+// until they do not change; no variable is live at the program's end.
+
+// Requires: prog has passed its scope check (see scope_check.h),
+//           the current scope is prog's symbol table, and the expression
+//           nodes of prog may be shared (see ast_share_begin in ast.h)
+// Eliminate the dead code in prog (changing its statements in place),
+// writing warnings about its unused names to where errors go.
+// If there is no space, bail with an error message.
+extern void dce_program(AST *prog);
+
+#endif
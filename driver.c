@@ -0,0 +1,721 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "utilities.h"
+#include "parser.h"
+#include "ast.h"
+#include "ast_walk.h"
+#include "unparser.h"
+#include "scope_check.h"
+#include "symbol_table.h"
+#include "sink.h"
+#include "cache.h"
+#include "stats.h"
+#include "sampler.h"
+#include "trace.h"
+#include "token_array.h"
+#include "incremental.h"
+#include "ast_file.h"
+#include "cse.h"
+#include "dce.h"
+#include "exprs.h"
+#include "exec_counts.h"
+#include "interpreter.h"
+#include "layout.h"
+#include "loops.h"
+#include "regalloc.h"
+#include "simplify.h"
+#include "driver.h"
+#include "mem.h"
+
+// The compilation cache's directory (NULL if there is no cache)
+static const char *cache_dir = NULL;
+// The maximum size of the cache directory in bytes
+static size_t cache_max_bytes = CACHE_DEFAULT_MAX_BYTES;
+// Whether to lex each whole file before parsing it
+static bool prelex = false;
+// Whether to lex on another thread while parsing
+static bool pipeline = false;
+// The number of threads to lex each file with (0 to not split files)
+static unsigned int lex_threads = 0;
+// The number of threads to check each program's statements with
+// (0 to check them in order on one thread)
+static unsigned int check_threads = 0;
+// Whether to share the nodes of identical expressions
+static bool share_exprs = false;
+// Whether to eliminate common subexpressions in each checked program
+static bool cse = false;
+// Whether to simplify the expressions of each checked program
+static bool simplify = false;
+// Whether to eliminate the dead code of each checked program
+static bool dce = false;
+// The unrolling factor for optimizing each checked program's loops
+// (0 to not optimize loops)
+static unsigned int loops_unroll = 0;
+// The number of registers to allocate for each checked program's report
+// (0 to not allocate registers)
+static unsigned int regalloc_registers = 0;
+// Whether to run each checked program (instead of unparsing it)
+static bool run_programs = false;
+// The file to write each run's execution counts to (or NULL)
+static const char *counts_file = NULL;
+// The profile that guides optimizations (or NULL)
+static exec_counts *guide = NULL;
+// Whether to write each checked program's AST to a binary AST file
+static bool emit_ast = false;
+// Whether files hold binary ASTs (instead of source code)
+static bool load_ast = false;
+
+// The current thread's token array, when prelexing
+// (it holds the texts of the AST's names, so it is kept until the end)
+static _Thread_local token_array *prelexed = NULL;
+// The current thread's store for the ASTs of the compile it is doing
+// (an edit's ASTs are its document's, see incremental.h)
+static _Thread_local ast_store compile_store;
+// The current thread's source file, when it is compiled under another
+// name (see driver_try_compile_as), which its AST file is named after
+static _Thread_local const char *source_path = NULL;
+
+static void compile_opened(sink *out);
+static void compile_loaded(ast_file *f, sink *out);
+
+// Requires: fp is open for reading
+// Lex all of fp (which is named name) into the current thread's
+// token array and start the parser reading that
+static void parser_open_prelexed(FILE *fp, const char *name)
+{
+    stats_timer t;
+    stats_timer_start(&t, phase_lex);
+    TRACE_BEGIN("prelex");
+    prelexed = token_array_lex_stream(fp, name);
+    TRACE_END();
+    stats_timer_stop(&t);
+    stats_count_tokens(token_array_length(prelexed));
+    parser_open_array(prelexed);
+}
+
+// Requires: text has len chars
+// Lex text (the source of the file named name) in chunks on several
+// threads into the current thread's token array
+// and start the parser reading that
+static void parser_open_split(const char *text, size_t len, const char *name)
+{
+    stats_timer t;
+    stats_timer_start(&t, phase_lex);
+    TRACE_BEGIN("parallel_lex");
+    prelexed = token_array_lex_parallel(text, len, name, lex_threads);
+    TRACE_END();
+    stats_timer_stop(&t);
+    stats_count_tokens(token_array_length(prelexed));
+    parser_open_array(prelexed);
+}
+
+// Requires: fname is the name of a readable file
+// Map the file named fname into memory and lex it
+// like parser_open_split
+static void parser_open_mapped(const char *fname)
+{
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) {
+	bail_with_error("Invalid file name");
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+	close(fd);
+	bail_with_error("Cannot get the size of %s", fname);
+    }
+    size_t len = (size_t) st.st_size;
+    if (len == 0) {
+	close(fd);
+	parser_open_split("", 0, fname);
+	return;
+    }
+    void *text = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED) {
+	bail_with_error("Cannot map %s into memory", fname);
+    }
+    // the tokens' texts are copied, so the file can be unmapped
+    parser_open_split((const char *) text, len, fname);
+    munmap(text, len);
+}
+
+// Requires: fp is open for reading
+// Start the parser reading fp (which is named name)
+// in the way the options say
+static void parser_open_chosen(FILE *fp, const char *name)
+{
+    if (prelex) {
+	parser_open_prelexed(fp, name);
+    } else if (pipeline) {
+	parser_open_pipelined(fp, name);
+    } else {
+	parser_open_stream(fp, name);
+    }
+}
+
+// Free the current thread's token array (if it has one)
+static void release_prelexed()
+{
+    if (prelexed != NULL) {
+	token_array_free(prelexed);
+	prelexed = NULL;
+    }
+}
+
+// Requires: fname is the name of a readable file
+// Compile the program in the file named fname:
+// parse it, unparse the AST to out (flushing out afterwards),
+// then build the symbol table and check the declarations.
+// Errors are reported as usual (see utilities.h).
+void driver_compile(const char *fname, sink *out)
+{
+    if (load_ast) {
+	compile_loaded(ast_file_open(fname), out);
+	return;
+    }
+    if (lex_threads > 0) {
+	parser_open_mapped(fname);
+    } else if (prelex || pipeline) {
+	FILE *fp = fopen(fname, "r");
+	if (fp == NULL) {
+	    bail_with_error("Invalid file name");
+	}
+	parser_open_chosen(fp, fname);
+    } else {
+	parser_open(fname);
+    }
+    compile_opened(out);
+}
+
+// Requires: text has len chars
+// Compile the program whose source is text, in the same way as
+// driver_compile, using name as its file name in messages.
+void driver_compile_source(const char *name, const char *text, size_t len,
+			   sink *out)
+{
+    if (load_ast) {
+	compile_loaded(ast_file_open_buffer(name, text, len), out);
+	return;
+    }
+    if (lex_threads > 0) {
+	parser_open_split(text, len, name);
+	compile_opened(out);
+	return;
+    }
+    FILE *fp = fmemopen((void *) text, len, "r");
+    if (fp == NULL) {
+	bail_with_error("Cannot read the source of %s", name);
+    }
+    parser_open_chosen(fp, name);
+    compile_opened(out);
+}
+
+// Lex all of each file before parsing it (if on is true),
+// so the parser reads a token array (see token_array.h)
+void driver_use_prelex(bool on)
+{
+    prelex = on;
+}
+
+// Lex each file on another thread while parsing it (if on is true),
+// passing the tokens through a token ring (see token_ring.h)
+void driver_use_pipeline(bool on)
+{
+    pipeline = on;
+}
+
+// Lex each large file in chunks on nthreads threads
+// (or, if nthreads is 0, do not split files)
+void driver_use_parallel_lex(unsigned int nthreads)
+{
+    lex_threads = nthreads;
+}
+
+// Check the top-level statements of each program on nthreads threads
+// (or, if nthreads is 0, in order on one thread)
+void driver_use_parallel_check(unsigned int nthreads)
+{
+    check_threads = nthreads;
+}
+
+// Share the nodes of structurally identical expressions (if on is true)
+// while parsing each program (see ast_share_begin in ast.h)
+void driver_share_exprs(bool on)
+{
+    share_exprs = on;
+}
+
+// Eliminate the common subexpressions of each program (if on is true)
+// after it passes its checks, and unparse the result (see cse.h)
+void driver_use_cse(bool on)
+{
+    cse = on;
+}
+
+// Simplify the expressions of each program (if on is true)
+// after it passes its checks, and unparse the result (see simplify.h)
+void driver_use_simplify(bool on)
+{
+    simplify = on;
+}
+
+// Eliminate the dead code of each program (if on is true)
+// after it passes its checks, and unparse the result (see dce.h)
+void driver_use_dce(bool on)
+{
+    dce = on;
+}
+
+// Optimize the loops of each program (if unroll is not 0) after it
+// passes its checks, unrolling by the factor unroll, and unparse
+// the result (see loops.h)
+void driver_optimize_loops(unsigned int unroll)
+{
+    loops_unroll = unroll;
+}
+
+// Allocate the given number of registers (0 for none) to the variables
+// and temporaries of each program after it passes its checks
+// (and is optimized), reporting the allocation (see regalloc.h)
+void driver_report_registers(unsigned int registers)
+{
+    regalloc_registers = registers;
+}
+
+// Run each program that passes its checks (after optimizing it),
+// if on is true, instead of unparsing it (see interpreter.h)
+void driver_run(bool on)
+{
+    run_programs = on;
+}
+
+// Run each checked program, counting how often its statements run,
+// and write the counts to the file named fname (see exec_counts.h)
+void driver_count_runs(const char *fname)
+{
+    run_programs = true;
+    counts_file = fname;
+}
+
+// Read the profile in the file named fname to guide the optimizations
+// of each checked program (see layout.h and loops.h)
+void driver_use_counts(const char *fname)
+{
+    guide = exec_counts_read(fname);
+}
+
+// Write the AST of each program that passes its checks (if on is true)
+// to a binary AST file (see ast_file.h), named like the source file
+// but ending in .ast instead of .pl0
+void driver_write_ast(bool on)
+{
+    emit_ast = on;
+}
+
+// Read each file as a binary AST file (if on is true) instead of
+// source code, and compile it by unparsing its AST
+// (it was checked before it was written)
+void driver_read_ast(bool on)
+{
+    load_ast = on;
+}
+
+// Use the cache directory dir (of at most max_bytes bytes)
+// to remember what compiling each file produced
+void driver_use_cache(const char *dir, size_t max_bytes)
+{
+    cache_dir = dir;
+    cache_max_bytes = max_bytes;
+}
+
+// Free what the driver still holds (see driver.h)
+void driver_finish()
+{
+    if (guide != NULL) {
+	exec_counts_free(guide);
+	guide = NULL;
+    }
+    scope_release();
+}
+
+// Return a description of the options that change what compiling produces
+// (a parallel check reports all the statements' errors),
+// which is part of each cache key
+static const char *driver_flags()
+{
+    // (sized for the longest of each option, so nothing is cut off)
+    char loops[sizeof("unroll=4294967295 ")] = "";
+    char regalloc[sizeof("regalloc=4294967295 ")] = "";
+    static _Thread_local char flags[sizeof("parallel-check dce simplify cse ")
+				    + sizeof(loops) + sizeof(regalloc)];
+    if (loops_unroll > 0) {
+	snprintf(loops, sizeof(loops), "unroll=%u ", loops_unroll);
+    }
+    if (regalloc_registers > 0) {
+	snprintf(regalloc, sizeof(regalloc), "regalloc=%u ",
+		 regalloc_registers);
+    }
+    snprintf(flags, sizeof(flags), "%s%s%s%s%s%s",
+	     (check_threads > 0) ? "parallel-check " : "",
+	     dce ? "dce " : "", simplify ? "simplify " : "",
+	     loops, cse ? "cse " : "", regalloc);
+    size_t len = strlen(flags);
+    if (len > 0) {
+	flags[len - 1] = '\0';
+    }
+    return flags;
+}
+
+// Unparse progast to out, flushing out afterwards
+// (so the output comes before any error messages)
+static void unparse_flushed(AST *progast, sink *out)
+{
+    stats_timer t;
+    stats_timer_start(&t, phase_unparse);
+    TRACE_BEGIN("unparse");
+    unparseProgram(out, progast);
+    sink_flush(out);
+    TRACE_END();
+    stats_timer_stop(&t);
+}
+
+// A compile to run under an error trap (see run_trapped):
+// the file named name (if text is NULL), the len chars of text,
+// or (if doc is not NULL) doc after replacing its deleted chars
+// at offset with the len chars of text
+typedef struct {
+    const char *name;
+    const char *text;
+    size_t len;
+    incr_doc *doc;
+    size_t offset;
+    size_t deleted;
+} compile_job;
+
+// Requires: job->doc != NULL
+// Edit the document of job and compile its new text
+// (like compile_opened), parsing and checking only what the edit changed
+static void compile_edit(const compile_job *job, sink *out)
+{
+    stats_timer t;
+    stats_timer_start(&t, phase_parse);
+    TRACE_BEGIN("parse");
+    incr_edit(job->doc, job->offset, job->deleted, job->text, job->len);
+    TRACE_END();
+    stats_timer_stop(&t);
+    AST *progast = incr_program(job->doc);
+    stats_count_ast(progast);
+
+    unparse_flushed(progast, out);
+
+    stats_timer_start(&t, phase_scope_check);
+    TRACE_BEGIN("scope_check");
+    incr_check(job->doc);
+    TRACE_END();
+    stats_timer_stop(&t);
+}
+
+// Do the compile job (see compile_job), with output to out
+static void run_job(const compile_job *job, sink *out)
+{
+    if (job->doc != NULL) {
+	compile_edit(job, out);
+    } else if (job->text == NULL) {
+	driver_compile(job->name, out);
+    } else {
+	driver_compile_source(job->name, job->text, job->len, out);
+    }
+}
+
+// Do the compile job, catching any error
+// (writing its messages to diagnostics).
+// Return true just when there were no errors.
+static bool run_trapped(const compile_job *job, sink *out, sink *diagnostics)
+{
+    error_trap trap;
+    volatile bool ok = true;
+    trap.diagnostics = diagnostics;
+    // start like a fresh run, so messages do not mention old errors
+    errno = 0;
+    stats_file_begin();
+    TRACE_BEGIN_DETAIL(job->doc != NULL ? "edit" : "compile", job->name);
+    unsigned int trace_level = trace_depth();
+    unsigned int sample_level = sampler_depth();
+    unsigned int walk_level = ast_walk_depth();
+    ast_store_init(&compile_store);
+    ast_store *outer_store = ast_use_store(&compile_store);
+    if (setjmp(trap.env) == 0) {
+	error_trap_set(&trap);
+	run_job(job, out);
+    } else {
+	ok = false;
+	// the error may have happened before the file was closed
+	parser_close();
+	// and inside traced spans
+	trace_unwind(trace_level);
+	sampler_unwind(sample_level);
+	ast_walk_unwind(walk_level);
+	release_prelexed();
+	ast_share_end();
+    }
+    // the compile's ASTs (and the names in them) are no longer used
+    ast_use_store(outer_store);
+    ast_store_release(&compile_store);
+    TRACE_END();
+    error_trap_clear();
+    stats_file_end(false);
+    return ok;
+}
+
+// Compile (like driver_try_compile) without using the cache
+static bool try_compile(const char *name, const char *text, size_t len,
+			sink *out, sink *diagnostics)
+{
+    compile_job job = { name, text, len, NULL, 0, 0 };
+    return run_trapped(&job, out, diagnostics);
+}
+
+// Compile the program in the file named name
+// (or, if text != NULL, the len chars of source code in text)
+// like driver_compile (or driver_compile_source),
+// but catch any error, writing error messages to diagnostics
+// instead of exiting.
+// If a cache is in use, the result is taken from the cache when possible,
+// and otherwise stored there.
+// Return true just when there were no errors.
+bool driver_try_compile(const char *name, const char *text, size_t len,
+			sink *out, sink *diagnostics)
+{
+    // binary AST files are quicker to read than the cache,
+    // and writing them must not be skipped; runs depend on their input,
+    // and profiles on more than the options
+    if (cache_dir == NULL || emit_ast || load_ast || run_programs
+	|| guide != NULL) {
+	return try_compile(name, text, len, out, diagnostics);
+    }
+    char *contents = NULL;
+    if (text == NULL) {
+	contents = read_whole_file(name, &len);
+	if (contents == NULL) {
+	    // let the lexer report the problem
+	    return try_compile(name, NULL, 0, out, diagnostics);
+	}
+	text = contents;
+    }
+
+    bool ok;
+    cache_key key = cache_make_key(name, text, len, driver_flags());
+    TRACE_BEGIN_DETAIL("cache_lookup", name);
+    bool hit = cache_lookup(cache_dir, key, out, diagnostics, &ok);
+    TRACE_END();
+    if (hit) {
+	stats_file_begin();
+	stats_file_end(true);
+    } else {
+	sink *new_out = sink_string();
+	sink *new_diagnostics = sink_string();
+	ok = try_compile(name, text, len, new_out, new_diagnostics);
+	TRACE_BEGIN_DETAIL("cache_store", name);
+	cache_store(cache_dir, key, ok,
+		    sink_contents(new_out), sink_length(new_out),
+		    sink_contents(new_diagnostics),
+		    sink_length(new_diagnostics), cache_max_bytes);
+	TRACE_END();
+	sink_write(out, sink_contents(new_out), sink_length(new_out));
+	sink_write(diagnostics, sink_contents(new_diagnostics),
+		   sink_length(new_diagnostics));
+	sink_close(new_out);
+	sink_close(new_diagnostics);
+    }
+    mem_free(contents);
+    return ok;
+}
+
+// Compile the program in the file named path like driver_try_compile,
+// but using name as its file name in messages
+bool driver_try_compile_as(const char *path, const char *name,
+			   sink *out, sink *diagnostics)
+{
+    size_t len;
+    char *text = read_whole_file(path, &len);
+    if (text == NULL) {
+	// let the lexer report the problem
+	return driver_try_compile(path, NULL, 0, out, diagnostics);
+    }
+    source_path = path;
+    bool ok = driver_try_compile(name, text, len, out, diagnostics);
+    source_path = NULL;
+    mem_free(text);
+    return ok;
+}
+
+// Requires: offset + deleted <= the length of doc's text and text has len chars
+// Replace the deleted chars at offset in the text of doc with the len chars
+// of text, then compile the new text like driver_try_compile (without
+// the cache), parsing and checking only the parts of the program
+// that the edit changed, where possible (see incremental.h).
+// Return true just when there were no errors.
+bool driver_try_edit(incr_doc *doc, size_t offset, size_t deleted,
+		     const char *text, size_t len, sink *out, sink *diagnostics)
+{
+    compile_job job = { incr_name(doc), text, len, doc, offset, deleted };
+    return run_trapped(&job, out, diagnostics);
+}
+
+// Write the AST of progast to the binary AST file for its source file
+// (see driver_write_ast)
+static void write_ast_file(AST *progast)
+{
+    const char *src = (source_path != NULL) ? source_path
+	: progast->file_loc.filename;
+    size_t len = strlen(src);
+    if (len > 4 && strcmp(src + len - 4, ".pl0") == 0) {
+	len -= 4;
+    }
+    char *fname = (char *) mem_alloc(mem_driver, len + 5);
+    if (fname == NULL) {
+	bail_with_error("No space for the name of an AST file!");
+    }
+    memcpy(fname, src, len);
+    strcpy(fname + len, ".ast");
+    TRACE_BEGIN_DETAIL("write_ast", fname);
+    ast_file_write(progast, fname);
+    TRACE_END();
+    mem_free(fname);
+}
+
+// Return true just when checked programs are optimized
+// (so they are unparsed after they are checked and optimized)
+static bool optimizing()
+{
+    return cse || simplify || dce || loops_unroll > 0 || guide != NULL;
+}
+
+// Requires: progast has passed its checks and the current scope
+//           is its symbol table
+// Apply the chosen optimizations to progast
+static void optimize(AST *progast)
+{
+    TRACE_BEGIN("optimize");
+    if (share_exprs) {
+	// the optimizations build expressions at their nodes' locations
+	exprs_unshare(progast);
+    }
+    if (guide != NULL) {
+	layout_branches(progast, guide);
+    }
+    if (dce) {
+	dce_program(progast);
+    }
+    if (simplify) {
+	simplify_program(progast);
+    }
+    if (loops_unroll > 0) {
+	loops_optimize(progast, loops_unroll, guide);
+    }
+    if (cse) {
+	cse_program(progast);
+    }
+    TRACE_END();
+}
+
+// The number of lines in the report of a run's hottest lines
+#define HOT_LINES 10
+
+// Requires: progast has passed its checks and the current scope
+//           is its symbol table
+// Run progast, reading from stdin and writing to out (then flushing it),
+// and write its execution counts (see driver_count_runs)
+static void run_program(AST *progast, sink *out)
+{
+    TRACE_BEGIN("run");
+    exec_counts *counts = (counts_file == NULL) ? NULL
+	: exec_counts_create(progast->file_loc.filename);
+    interpret(progast, stdin, out, counts);
+    sink_flush(out);
+    if (counts != NULL) {
+	exec_counts_write(counts, counts_file);
+	exec_counts_report(counts, HOT_LINES);
+	exec_counts_free(counts);
+    }
+    TRACE_END();
+}
+
+// Requires: the parser is open
+// Compile the program the parser is reading (see driver_compile)
+static void compile_opened(sink *out)
+{
+    stats_timer t;
+    stats_timer_start(&t, phase_parse);
+    TRACE_BEGIN("parse");
+    if (share_exprs) {
+	ast_share_begin();
+    }
+    AST *progast = parseProgram();
+    ast_share_end();
+    TRACE_END();
+    stats_timer_stop(&t);
+    parser_close();
+    stats_count_ast(progast);
+
+    // unparse to check on the AST
+    // (an optimized program is unparsed once it is optimized,
+    // and a program that is run is not unparsed)
+    if (!optimizing() && !run_programs) {
+	unparse_flushed(progast, out);
+    }
+
+    // build symbol table and check declarations
+    stats_timer_start(&t, phase_scope_check);
+    TRACE_BEGIN("scope_check");
+    scope_initialize();
+    if (check_threads > 0) {
+	scope_check_program_parallel(progast, check_threads);
+    } else {
+	scope_check_program(progast);
+    }
+    TRACE_END();
+    stats_timer_stop(&t);
+    stats_count_symbols(scope_size());
+    if (optimizing()) {
+	optimize(progast);
+    }
+    if (run_programs) {
+	run_program(progast, out);
+    } else if (optimizing()) {
+	unparse_flushed(progast, out);
+    }
+    if (regalloc_registers > 0) {
+	regalloc_report(progast, regalloc_registers);
+    }
+    if (emit_ast) {
+	write_ast_file(progast);
+    }
+    release_prelexed();
+}
+
+// Requires: f is open
+// Compile the program in the binary AST file f (see driver_read_ast)
+// by unparsing it to out (flushing out afterwards), then close f
+static void compile_loaded(ast_file *f, sink *out)
+{
+    stats_timer t;
+    stats_timer_start(&t, phase_parse);
+    TRACE_BEGIN("load_ast");
+    AST *progast = ast_file_load(f);
+    TRACE_END();
+    stats_timer_stop(&t);
+    stats_count_ast(progast);
+
+    unparse_flushed(progast, out);
+    mem_free(progast);
+    ast_file_close(f);
+}
@@ -0,0 +1,141 @@
+#ifndef _DRIVER_H
+#define _DRIVER_H
+#include <stddef.h>
+#include <stdbool.h>
+#include "sink.h"
+#include "incremental.h"
+
+// Requires: fname is the name of a readable file
+// Compile the program in the file named fname:
+// parse it, unparse the AST to out (flushing out afterwards),
+// then build the symbol table and check the declarations.
+// Errors are reported as usual (see utilities.h).
+// The AST is built in the current thread's store (see ast.h).
+extern void driver_compile(const char *fname, sink *out);
+
+// Requires: text has len chars
+// Compile the program whose source is text, in the same way as
+// driver_compile, using name as its file name in messages.
+extern void driver_compile_source(const char *name, const char *text,
+				  size_t len, sink *out);
+
+// Lex all of each file before parsing it (if on is true),
+// so the parser reads a token array (see token_array.h)
+extern void driver_use_prelex(bool on);
+
+// Lex each file on another thread while parsing it (if on is true),
+// passing the tokens through a token ring (see token_ring.h)
+extern void driver_use_pipeline(bool on);
+
+// Lex each large file in chunks on nthreads threads
+// (or, if nthreads is 0, do not split files; see token_array.h)
+extern void driver_use_parallel_lex(unsigned int nthreads);
+
+// Check the top-level statements of each program on nthreads threads
+// (or, if nthreads is 0, in order on one thread; see scope_check.h)
+extern void driver_use_parallel_check(unsigned int nthreads);
+
+// Share the nodes of structurally identical expressions (if on is true)
+// while parsing each program (see ast_share_begin in ast.h)
+extern void driver_share_exprs(bool on);
+
+// Eliminate the common subexpressions of each program (if on is true)
+// after it passes its checks, and unparse the result instead of the
+// program as parsed (see cse.h). Edits (see driver_try_edit) and binary
+// AST files (see driver_read_ast) are not optimized.
+extern void driver_use_cse(bool on);
+
+// Simplify the expressions of each program (if on is true) after it
+// passes its checks, as for driver_use_cse (see simplify.h).
+// Simplification is done before common subexpression elimination.
+extern void driver_use_simplify(bool on);
+
+// Eliminate the dead code of each program (if on is true) after it
+// passes its checks, as for driver_use_cse, warning about its unused
+// names (see dce.h). This is done before the other optimizations,
+// so the warnings are only about the program's own names.
+extern void driver_use_dce(bool on);
+
+// Optimize the loops of each program (if unroll is not 0) after it
+// passes its checks, as for driver_use_cse, unrolling by the factor
+// unroll (1 to only hoist invariants) and reporting the loops
+// transformed to where errors go (see loops.h). This is done after
+// simplification and before common subexpression elimination.
+extern void driver_optimize_loops(unsigned int unroll);
+
+// Requires: registers <= REGALLOC_MAX_REGISTERS (see regalloc.h)
+// Allocate the given number of registers (0 for none) to the variables
+// and temporaries of each program after it passes its checks (and is
+// optimized), reporting the allocation to where errors go.
+// Edits and binary AST files are not reported on.
+extern void driver_report_registers(unsigned int registers);
+
+// Run each program that passes its checks (after any optimizations),
+// if on is true, instead of unparsing it: its read statements read
+// numbers from stdin, and its write statements write to the output
+// (see interpreter.h). Binary AST files are not run.
+extern void driver_run(bool on);
+
+// Run each program that passes its checks (as for driver_run),
+// counting how often each statement runs and each condition is true
+// and false, then write the counts to the file named fname and report
+// the program's hottest lines to where errors go (see exec_counts.h).
+// (The counts are not written if the program fails.)
+extern void driver_count_runs(const char *fname);
+
+// Read the profile in the file named fname (see exec_counts.h),
+// and use it to guide the optimization of each program after it passes
+// its checks: its if statements' parts are laid out with the usual one
+// first (see layout.h), and its loops are only unrolled if they ran
+// often enough (see loops.h), with the result unparsed as for
+// driver_use_cse. If the file cannot be read, bail with an error message.
+extern void driver_use_counts(const char *fname);
+
+// Write the AST of each program that passes its checks (if on is true)
+// to a binary AST file (see ast_file.h), named like the source file
+// but ending in .ast instead of .pl0
+extern void driver_write_ast(bool on);
+
+// Read each file as a binary AST file (if on is true) instead of
+// source code, and compile it by unparsing its AST
+// (it was checked before it was written)
+extern void driver_read_ast(bool on);
+
+// Use the cache directory dir (of at most max_bytes bytes)
+// to remember what compiling each file produced (see cache.h)
+extern void driver_use_cache(const char *dir, size_t max_bytes);
+
+// Compile the program in the file named name
+// (or, if text != NULL, the len chars of source code in text)
+// like driver_compile (or driver_compile_source),
+// but catch any error, writing error messages to diagnostics
+// instead of exiting.
+// If a cache is in use, the result is taken from the cache when possible,
+// and otherwise stored there.
+// Return true just when there were no errors.
+extern bool driver_try_compile(const char *name, const char *text,
+			       size_t len, sink *out, sink *diagnostics);
+
+// Compile the program in the file named path like driver_try_compile,
+// but using name as its file name in messages (e.g., the name a client
+// gave for the file, so the messages are those of a direct compile)
+extern bool driver_try_compile_as(const char *path, const char *name,
+				  sink *out, sink *diagnostics);
+
+// Requires: offset + deleted <= the length of doc's text and text has len chars
+// Replace the deleted chars at offset in the text of doc with the len chars
+// of text, then compile the new text like driver_try_compile (without
+// the cache), parsing and checking only the parts of the program
+// that the edit changed, where possible (see incremental.h).
+// Return true just when there were no errors.
+extern bool driver_try_edit(incr_doc *doc, size_t offset, size_t deleted,
+			    const char *text, size_t len,
+			    sink *out, sink *diagnostics);
+
+// Requires: no other thread is compiling
+// Free what the driver still holds (e.g., the profile that guides
+// optimizations and the current thread's symbol table),
+// for when a process is done compiling
+extern void driver_finish();
+
+#endif
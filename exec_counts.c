@@ -0,0 +1,306 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "hash.h"
+#include "utilities.h"
+#include "exec_counts.h"
+#include "mem.h"
+
+// A table of counts, in the order their locations were added,
+// with a hash table of their indexes (plus 1, so 0 is an empty slot)
+struct exec_counts_s {
+    char *filename;
+    exec_count *counts;
+    size_t num_counts;
+    size_t counts_cap;
+    size_t *slots;
+    size_t num_slots;       // a power of 2
+};
+
+// Return a fresh, empty table of counts (see exec_counts.h)
+exec_counts *exec_counts_create(const char *filename)
+{
+    exec_counts *c = (exec_counts *) mem_calloc(
+	mem_interpreter, 1, sizeof(exec_counts));
+    if (c == NULL
+	|| (c->filename = mem_strdup(mem_interpreter, filename)) == NULL) {
+	bail_with_error("No space for execution counts!");
+    }
+    return c;
+}
+
+// Free the table c
+void exec_counts_free(exec_counts *c)
+{
+    mem_free(c->filename);
+    mem_free(c->counts);
+    mem_free(c->slots);
+    mem_free(c);
+}
+
+// Return the slot for the location (line, column) in slots
+static size_t *count_slot(const exec_counts *c, size_t *slots,
+			  size_t num_slots, unsigned int line,
+			  unsigned int column)
+{
+    unsigned int key[2] = { line, column };
+    size_t k = xxh64(key, sizeof(key), 0) & (num_slots - 1);
+    while (slots[k] != 0) {
+	const exec_count *ec = &c->counts[slots[k] - 1];
+	if (ec->line == line && ec->column == column) {
+	    break;
+	}
+	k = (k + 1) & (num_slots - 1);
+    }
+    return &slots[k];
+}
+
+// Return the counts for the location loc in c (see exec_counts.h)
+exec_count *exec_counts_at(exec_counts *c, file_location loc)
+{
+    if (c->num_slots > 0) {
+	size_t *slot = count_slot(c, c->slots, c->num_slots,
+				  loc.line, loc.column);
+	if (*slot != 0) {
+	    return &c->counts[*slot - 1];
+	}
+    }
+    if (2 * (c->num_counts + 1) > c->num_slots) {
+	size_t num_slots = (c->num_slots == 0) ? 64 : 2 * c->num_slots;
+	size_t *slots = (size_t *) mem_calloc(
+	    mem_interpreter, num_slots, sizeof(size_t));
+	if (slots == NULL) {
+	    bail_with_error("No space for execution counts!");
+	}
+	for (size_t i = 0; i < c->num_counts; i++) {
+	    *count_slot(c, slots, num_slots, c->counts[i].line,
+			c->counts[i].column) = i + 1;
+	}
+	mem_free(c->slots);
+	c->slots = slots;
+	c->num_slots = num_slots;
+    }
+    if (c->num_counts == c->counts_cap) {
+	c->counts_cap = (c->counts_cap == 0) ? 64 : 2 * c->counts_cap;
+	c->counts = (exec_count *) mem_realloc(mem_interpreter, c->counts,
+					   c->counts_cap * sizeof(exec_count));
+	if (c->counts == NULL) {
+	    bail_with_error("No space for execution counts!");
+	}
+    }
+    exec_count *ec = &c->counts[c->num_counts++];
+    memset(ec, 0, sizeof(exec_count));
+    ec->line = loc.line;
+    ec->column = loc.column;
+    *count_slot(c, c->slots, c->num_slots, loc.line, loc.column)
+	= c->num_counts;
+    return ec;
+}
+
+// Return the counts for the location loc in c (or NULL if none)
+const exec_count *exec_counts_find(const exec_counts *c, file_location loc)
+{
+    if (c->num_slots == 0) {
+	return NULL;
+    }
+    size_t slot = *count_slot(c, c->slots, c->num_slots,
+			      loc.line, loc.column);
+    return (slot == 0) ? NULL : &c->counts[slot - 1];
+}
+
+// Compare counts by their locations (for qsort)
+static int by_location(const void *p1, const void *p2)
+{
+    const exec_count *ec1 = (const exec_count *) p1;
+    const exec_count *ec2 = (const exec_count *) p2;
+    if (ec1->line != ec2->line) {
+	return (ec1->line < ec2->line) ? -1 : 1;
+    }
+    if (ec1->column != ec2->column) {
+	return (ec1->column < ec2->column) ? -1 : 1;
+    }
+    return 0;
+}
+
+// Return a fresh copy of the counts of c, sorted by their locations.
+// If there is no space, bail with an error message.
+static exec_count *sorted_counts(const exec_counts *c)
+{
+    exec_count *sorted = (exec_count *) mem_alloc(mem_interpreter, 
+	(c->num_counts + 1) * sizeof(exec_count));
+    if (sorted == NULL) {
+	bail_with_error("No space for execution counts!");
+    }
+    if (c->num_counts > 0) {
+	memcpy(sorted, c->counts, c->num_counts * sizeof(exec_count));
+    }
+    qsort(sorted, c->num_counts, sizeof(exec_count), by_location);
+    return sorted;
+}
+
+// Write c to the file named fname (see exec_counts.h)
+void exec_counts_write(const exec_counts *c, const char *fname)
+{
+    FILE *f = fopen(fname, "w");
+    if (f == NULL) {
+	bail_with_error("Cannot write execution counts to %s", fname);
+    }
+    exec_count *sorted = sorted_counts(c);
+    fprintf(f, "# execution counts of %s\n", c->filename);
+    fprintf(f, "# line column count [true false]\n");
+    for (size_t i = 0; i < c->num_counts; i++) {
+	const exec_count *ec = &sorted[i];
+	if (ec->is_branch) {
+	    fprintf(f, "%u %u %lu %lu %lu\n", ec->line, ec->column,
+		    ec->count, ec->taken, ec->not_taken);
+	} else {
+	    fprintf(f, "%u %u %lu\n", ec->line, ec->column, ec->count);
+	}
+    }
+    mem_free(sorted);
+    if (fclose(f) != 0) {
+	bail_with_error("Cannot write execution counts to %s", fname);
+    }
+}
+
+// Return a fresh table read from the file named fname (see exec_counts.h)
+exec_counts *exec_counts_read(const char *fname)
+{
+    FILE *f = fopen(fname, "r");
+    if (f == NULL) {
+	bail_with_error("Cannot open execution counts file %s", fname);
+    }
+    exec_counts *c = exec_counts_create(fname);
+    char line[BUFSIZ];
+    unsigned int line_num = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+	line_num++;
+	if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0') {
+	    continue;
+	}
+	file_location loc = { fname, 0, 0 };
+	unsigned long count, taken, not_taken;
+	char extra;
+	int n = sscanf(line, "%u %u %lu %lu %lu %c", &loc.line, &loc.column,
+		       &count, &taken, &not_taken, &extra);
+	if (n != 3 && n != 5) {
+	    errno = 0;
+	    bail_with_error("Bad execution counts in %s, line %u",
+			    fname, line_num);
+	}
+	exec_count *ec = exec_counts_at(c, loc);
+	ec->count += count;
+	if (n == 5) {
+	    ec->is_branch = true;
+	    ec->taken += taken;
+	    ec->not_taken += not_taken;
+	}
+    }
+    fclose(f);
+    return c;
+}
+
+// Return the start of each line of text (of len chars) in a fresh array,
+// putting the number of lines into *num_lines
+static const char **line_starts(const char *text, size_t len,
+				unsigned int *num_lines)
+{
+    unsigned int n = 1;
+    for (size_t i = 0; i < len; i++) {
+	n += (text[i] == '\n');
+    }
+    const char **starts = (const char **) mem_alloc(
+	mem_interpreter, n * sizeof(const char *));
+    if (starts == NULL) {
+	bail_with_error("No space to report execution counts!");
+    }
+    starts[0] = text;
+    unsigned int k = 1;
+    for (size_t i = 0; i < len; i++) {
+	if (text[i] == '\n') {
+	    starts[k++] = &text[i + 1];
+	}
+    }
+    *num_lines = n;
+    return starts;
+}
+
+// A line of the program and its hottest count
+typedef struct {
+    unsigned int line;
+    unsigned long count;
+    size_t first;           // its first count in the sorted counts
+} hot_line;
+
+// Compare hot lines by their counts, most first (for qsort)
+static int by_heat(const void *p1, const void *p2)
+{
+    const hot_line *h1 = (const hot_line *) p1;
+    const hot_line *h2 = (const hot_line *) p2;
+    if (h1->count != h2->count) {
+	return (h1->count > h2->count) ? -1 : 1;
+    }
+    return (h1->line < h2->line) ? -1 : (h1->line > h2->line);
+}
+
+// Write a report of the hottest lines of c (see exec_counts.h)
+void exec_counts_report(const exec_counts *c, unsigned int lines)
+{
+    exec_count *sorted = sorted_counts(c);
+    hot_line *hot = (hot_line *) mem_alloc(mem_interpreter, 
+	(c->num_counts + 1) * sizeof(hot_line));
+    if (hot == NULL) {
+	bail_with_error("No space to report execution counts!");
+    }
+    size_t num_hot = 0;
+    unsigned long total = 0;
+    for (size_t i = 0; i < c->num_counts; i++) {
+	total += sorted[i].count;
+	if (num_hot == 0 || hot[num_hot - 1].line != sorted[i].line) {
+	    hot[num_hot].line = sorted[i].line;
+	    hot[num_hot].count = 0;
+	    hot[num_hot].first = i;
+	    num_hot++;
+	}
+	if (sorted[i].count > hot[num_hot - 1].count) {
+	    hot[num_hot - 1].count = sorted[i].count;
+	}
+    }
+    qsort(hot, num_hot, sizeof(hot_line), by_heat);
+
+    // the source text is only for annotating, so it may be missing
+    size_t len = 0;
+    char *text = read_whole_file(c->filename, &len);
+    if (text == NULL) {
+	errno = 0;
+    }
+    unsigned int num_lines = 0;
+    const char **starts = (text == NULL) ? NULL
+	: line_starts(text, len, &num_lines);
+    diagnostic_print("%s: %lu statements executed; hottest lines:\n",
+		     c->filename, total);
+    for (size_t h = 0; h < num_hot && h < lines && hot[h].count > 0; h++) {
+	unsigned int line = hot[h].line;
+	diagnostic_print("%12lu  %5u | ", hot[h].count, line);
+	if (starts != NULL && 0 < line && line <= num_lines) {
+	    const char *start = starts[line - 1];
+	    int width = (int) strcspn(start, "\r\n");
+	    diagnostic_print("%.*s", width, start);
+	}
+	for (size_t i = hot[h].first;
+	     i < c->num_counts && sorted[i].line == line; i++) {
+	    if (sorted[i].is_branch) {
+		diagnostic_print("  [column %u: %lu true, %lu false]",
+				 sorted[i].column, sorted[i].taken,
+				 sorted[i].not_taken);
+	    }
+	}
+	diagnostic_print("\n");
+    }
+    mem_free(starts);
+    mem_free(text);
+    mem_free(hot);
+    mem_free(sorted);
+}
@@ -0,0 +1,64 @@
+#ifndef _EXEC_COUNTS_H
+#define _EXEC_COUNTS_H
+#include <stdbool.h>
+#include "file_location.h"
+
+// Execution counts of a program's statements (an execution profile),
+// kept by the file location (line and column) where each starts,
+// so a profile recorded from one compile of a program can guide
+// the optimization of a later one (statements at the same location,
+// e.g., the copies of an unrolled loop's body, share their counts).
+// For an if or while statement, the times its condition was true
+// and false are counted too.
+//
+// A profile is saved as text: lines starting with # are comments,
+// and each other line holds a statement's line, column and count,
+// followed (for an if or while statement) by its true and false counts.
+
+// The counts of the statements at one location
+typedef struct {
+    unsigned int line;
+    unsigned int column;
+    unsigned long count;        // times the statements were executed
+    bool is_branch;             // whether one is an if or while statement
+    unsigned long taken;        // times its condition was true
+    unsigned long not_taken;    // times its condition was false
+} exec_count;
+
+// A table of counts (for the statements of one program)
+typedef struct exec_counts_s exec_counts;
+
+// Return a fresh, empty table of counts for the program in the file
+// named filename (which is used in reports).
+// If there is no space, bail with an error message.
+extern exec_counts *exec_counts_create(const char *filename);
+
+// Free the table c
+extern void exec_counts_free(exec_counts *c);
+
+// Return the counts for the location loc in c,
+// adding zero counts for it if it is not there yet.
+// If there is no space, bail with an error message.
+extern exec_count *exec_counts_at(exec_counts *c, file_location loc);
+
+// Return the counts for the location loc in c (or NULL if none)
+extern const exec_count *exec_counts_find(const exec_counts *c,
+					  file_location loc);
+
+// Write c to the file named fname (in the form above).
+// If the file cannot be written, bail with an error message.
+extern void exec_counts_write(const exec_counts *c, const char *fname);
+
+// Return a fresh table read from the file named fname
+// (in the form above, as written by exec_counts_write).
+// If the file cannot be read or is not in that form,
+// bail with an error message.
+extern exec_counts *exec_counts_read(const char *fname);
+
+// Write a report of the (at most) lines hottest lines of the program
+// of c to where errors go: each line's source text, annotated with the
+// most times a statement starting on it was executed, and with the
+// true and false counts of its conditions.
+extern void exec_counts_report(const exec_counts *c, unsigned int lines);
+
+#endif
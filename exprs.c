@@ -0,0 +1,392 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "ast.h"
+#include "ast_walk.h"
+#include "id_attrs.h"
+#include "symbol_table.h"
+#include "utilities.h"
+#include "exprs.h"
+#include "mem.h"
+
+// Fill in cv with the values of prog's constants
+void const_values_init(const_values *cv, AST *prog)
+{
+    cv->size = scope_size() + 1;
+    cv->vals = (short *) mem_calloc(mem_optimizer, cv->size, sizeof(short));
+    cv->is_const = (bool *) mem_calloc(mem_optimizer, cv->size, sizeof(bool));
+    if (cv->vals == NULL || cv->is_const == NULL) {
+	bail_with_error("No space for the values of constants!");
+    }
+    for (AST_list cds = prog->data.program.cds; !ast_list_is_empty(cds);
+	 cds = ast_list_rest(cds)) {
+	AST *cd = ast_list_first(cds);
+	id_attrs *attrs = scope_lookup(cd->data.const_decl.name);
+	if (attrs != NULL && attrs->kind == constant
+	    && attrs->offset < cv->size) {
+	    cv->vals[attrs->offset] = cd->data.const_decl.num_val;
+	    cv->is_const[attrs->offset] = true;
+	}
+    }
+}
+
+// Free the tables of cv
+void const_values_free(const_values *cv)
+{
+    mem_free(cv->vals);
+    mem_free(cv->is_const);
+}
+
+// If exp is a number or the name of a constant, set *v to its value
+// and return true, otherwise return false
+bool const_value(const const_values *cv, AST *exp, long *v)
+{
+    if (exp->type_tag == number_ast) {
+	*v = exp->data.number.value;
+	return true;
+    }
+    if (exp->type_tag == ident_ast) {
+	id_attrs *attrs = scope_lookup(exp->data.ident.name);
+	// names declared after cv was filled in (temporaries) are variables
+	if (attrs != NULL && attrs->offset < cv->size
+	    && cv->is_const[attrs->offset]) {
+	    *v = cv->vals[attrs->offset];
+	    return true;
+	}
+    }
+    return false;
+}
+
+// The state of evaluating an expression
+typedef struct {
+    const const_values *cv;
+    const char *name;       // the variable with a known value (or NULL)
+    long value;             // its value
+    long *stack;            // the values of the nodes done so far
+    size_t depth;
+    size_t cap;
+    bool unknown;           // whether the value is unknown
+} evaluation;
+
+// Push v onto the stack of ev
+static void push(evaluation *ev, long v)
+{
+    if (ev->depth == ev->cap) {
+	ev->cap = (ev->cap == 0) ? 32 : 2 * ev->cap;
+	ev->stack = (long *) mem_realloc(
+	    mem_optimizer, ev->stack, ev->cap * sizeof(long));
+	if (ev->stack == NULL) {
+	    bail_with_error("No space to evaluate expressions!");
+	}
+    }
+    ev->stack[ev->depth++] = v;
+}
+
+// Callbacks for evaluating an expression (in the evaluation context),
+// which push the value of each node (or note that it is unknown)
+static void eval_leaf(ast_walker *w, AST *exp, int level,
+		      unsigned int flags)
+{
+    evaluation *ev = (evaluation *) ast_walk_context(w);
+    long v = 0;
+    if (exp->type_tag == ident_ast && ev->name != NULL
+	&& strcmp(exp->data.ident.name, ev->name) == 0) {
+	v = ev->value;
+    } else if (!const_value(ev->cv, exp, &v)) {
+	ev->unknown = true;
+    }
+    push(ev, v);
+}
+
+static void eval_bin_expr(ast_walker *w, AST *exp, int level,
+			  unsigned int flags)
+{
+    evaluation *ev = (evaluation *) ast_walk_context(w);
+    long b = ev->stack[--ev->depth];
+    long a = ev->stack[--ev->depth];
+    long v;
+    switch (exp->data.bin_expr.arith_op) {
+    case addop:
+	v = a + b;
+	break;
+    case subop:
+	v = a - b;
+	break;
+    case multop:
+	v = a * b;
+	break;
+    default:
+	if (b == 0) {
+	    ev->unknown = true;
+	    b = 1;
+	}
+	v = a / b;
+	break;
+    }
+    if (v < SHRT_MIN || SHRT_MAX < v) {
+	ev->unknown = true;
+	v = 0;
+    }
+    push(ev, v);
+}
+
+static const ast_visitor eval_visitor = {
+    .post = {
+	[number_ast] = eval_leaf,
+	[ident_ast] = eval_leaf,
+	[bin_expr_ast] = eval_bin_expr,
+    },
+};
+
+// Evaluate exp (see exprs.h)
+bool expr_eval(const const_values *cv, AST *exp,
+	       const char *name, long value, long *v)
+{
+    evaluation ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.cv = cv;
+    ev.name = name;
+    ev.value = value;
+    ast_walk(exp, &eval_visitor, &ev, 0, 0);
+    *v = ev.stack[0];
+    mem_free(ev.stack);
+    return !ev.unknown;
+}
+
+// Evaluate the condition cond (see exprs.h)
+bool cond_eval(const const_values *cv, AST *cond,
+	       const char *name, long value, bool *b)
+{
+    long v1, v2;
+    if (cond->type_tag == odd_cond_ast) {
+	if (!expr_eval(cv, cond->data.odd_cond.exp, name, value, &v1)) {
+	    return false;
+	}
+	*b = v1 % 2 != 0;
+	return true;
+    }
+    if (!expr_eval(cv, cond->data.bin_cond.leftexp, name, value, &v1)
+	|| !expr_eval(cv, cond->data.bin_cond.rightexp, name, value, &v2)) {
+	return false;
+    }
+    switch (cond->data.bin_cond.relop) {
+    case eqop:
+	*b = v1 == v2;
+	break;
+    case neqop:
+	*b = v1 != v2;
+	break;
+    case ltop:
+	*b = v1 < v2;
+	break;
+    case leqop:
+	*b = v1 <= v2;
+	break;
+    case gtop:
+	*b = v1 > v2;
+	break;
+    default:
+	*b = v1 >= v2;
+	break;
+    }
+    return true;
+}
+
+// Callback that notes a division that may fail (in the bool context)
+static void note_division(ast_walker *w, AST *exp, int level,
+			  unsigned int flags)
+{
+    AST *divisor = exp->data.bin_expr.rightexp;
+    if (exp->data.bin_expr.arith_op == divop
+	&& (divisor->type_tag != number_ast
+	    || divisor->data.number.value == 0)) {
+	*(bool *) ast_walk_context(w) = true;
+    }
+}
+
+static const ast_visitor division_visitor = {
+    .pre = { [bin_expr_ast] = note_division },
+};
+
+// Return true just when evaluating exp can fail
+bool expr_may_fail(AST *exp)
+{
+    bool ret = false;
+    ast_walk(exp, &division_visitor, &ret, 0, 0);
+    return ret;
+}
+
+// Return true just when evaluating the condition cond can fail
+bool cond_may_fail(AST *cond)
+{
+    if (cond->type_tag == odd_cond_ast) {
+	return expr_may_fail(cond->data.odd_cond.exp);
+    }
+    return expr_may_fail(cond->data.bin_cond.leftexp)
+	|| expr_may_fail(cond->data.bin_cond.rightexp);
+}
+
+// Return true just when the expressions e1 and e2 have the same structure
+bool expr_same(AST *e1, AST *e2)
+{
+    while (e1 != e2) {
+	if (e1->type_tag != e2->type_tag) {
+	    return false;
+	}
+	switch (e1->type_tag) {
+	case ident_ast:
+	    return strcmp(e1->data.ident.name, e2->data.ident.name) == 0;
+	case number_ast:
+	    return e1->data.number.value == e2->data.number.value;
+	case bin_expr_ast:
+	    if (e1->data.bin_expr.arith_op != e2->data.bin_expr.arith_op
+		|| !expr_same(e1->data.bin_expr.rightexp,
+			      e2->data.bin_expr.rightexp)) {
+		return false;
+	    }
+	    e1 = e1->data.bin_expr.leftexp;
+	    e2 = e2->data.bin_expr.leftexp;
+	    break;
+	default:
+	    return false;
+	}
+    }
+    return true;
+}
+
+// The state of giving the expressions of an expression parent
+// nodes of their own
+typedef struct {
+    const file_location *locs;  // of the parent's expression nodes
+    size_t done;                // how many of those are copied
+    AST **stack;                // the copies of the nodes done so far
+    size_t depth;
+    size_t cap;
+} unsharing;
+
+// Push the copy exp onto the stack of u
+static void push_copy(unsharing *u, AST *exp)
+{
+    if (u->depth == u->cap) {
+	u->cap = (u->cap == 0) ? 32 : 2 * u->cap;
+	u->stack = (AST **) mem_realloc(
+	    mem_optimizer, u->stack, u->cap * sizeof(AST *));
+	if (u->stack == NULL) {
+	    bail_with_error("No space to copy expressions!");
+	}
+    }
+    u->stack[u->depth++] = exp;
+}
+
+// Callbacks for copying an expression (in the unsharing context),
+// which push a copy of each node at its occurrence's file location
+static void copy_number(ast_walker *w, AST *exp, int level,
+			unsigned int flags)
+{
+    unsharing *u = (unsharing *) ast_walk_context(w);
+    token t = file_loc2token(u->locs[u->done++]);
+    push_copy(u, ast_number(t, exp->data.number.value));
+}
+
+static void copy_ident(ast_walker *w, AST *exp, int level,
+		       unsigned int flags)
+{
+    unsharing *u = (unsharing *) ast_walk_context(w);
+    token t = file_loc2token(u->locs[u->done++]);
+    push_copy(u, ast_ident(t, exp->data.ident.name));
+}
+
+static void copy_bin_expr(ast_walker *w, AST *exp, int level,
+			  unsigned int flags)
+{
+    unsharing *u = (unsharing *) ast_walk_context(w);
+    token t = file_loc2token(u->locs[u->done++]);
+    AST *e2 = u->stack[--u->depth];
+    AST *e1 = u->stack[--u->depth];
+    push_copy(u, ast_bin_expr(t, e1, exp->data.bin_expr.arith_op, e2));
+}
+
+static const ast_visitor copy_visitor = {
+    .post = {
+	[number_ast] = copy_number,
+	[ident_ast] = copy_ident,
+	[bin_expr_ast] = copy_bin_expr,
+    },
+};
+
+// Return exp if its parent's expressions are not shared (u->locs is NULL),
+// and otherwise a copy of it with a node for each occurrence
+static AST *unshare_expr(unsharing *u, AST *exp)
+{
+    if (u->locs == NULL) {
+	return exp;
+    }
+    ast_walk(exp, &copy_visitor, u, 0, 0);
+    return u->stack[--u->depth];
+}
+
+// Start copying the expressions of the expression parent
+static void begin_unsharing(unsharing *u, const AST *parent)
+{
+    u->locs = ast_expr_locations(parent);
+    u->done = 0;
+}
+
+// Give the expressions of the condition cond nodes of their own
+static void unshare_cond(unsharing *u, AST *cond)
+{
+    begin_unsharing(u, cond);
+    if (cond->type_tag == odd_cond_ast) {
+	cond->data.odd_cond.exp = unshare_expr(u, cond->data.odd_cond.exp);
+    } else {
+	cond->data.bin_cond.leftexp = unshare_expr(
+	    u, cond->data.bin_cond.leftexp);
+	cond->data.bin_cond.rightexp = unshare_expr(
+	    u, cond->data.bin_cond.rightexp);
+    }
+}
+
+// Give the expressions of stmt (and the statements in it)
+// nodes of their own
+static void unshare_stmt(unsharing *u, AST *stmt)
+{
+    switch (stmt->type_tag) {
+    case assign_ast:
+	begin_unsharing(u, stmt);
+	stmt->data.assign_stmt.exp = unshare_expr(
+	    u, stmt->data.assign_stmt.exp);
+	break;
+    case write_ast:
+	begin_unsharing(u, stmt);
+	stmt->data.write_stmt.exp = unshare_expr(
+	    u, stmt->data.write_stmt.exp);
+	break;
+    case begin_ast:
+	for (AST_list l = stmt->data.begin_stmt.stmts; !ast_list_is_empty(l);
+	     l = ast_list_rest(l)) {
+	    unshare_stmt(u, ast_list_first(l));
+	}
+	break;
+    case if_ast:
+	unshare_cond(u, stmt->data.if_stmt.cond);
+	unshare_stmt(u, stmt->data.if_stmt.thenstmt);
+	unshare_stmt(u, stmt->data.if_stmt.elsestmt);
+	break;
+    case while_ast:
+	unshare_cond(u, stmt->data.while_stmt.cond);
+	unshare_stmt(u, stmt->data.while_stmt.stmt);
+	break;
+    default:
+	break;
+    }
+}
+
+// Give each occurrence of a shared expression in prog nodes
+// of its own (see exprs.h)
+void exprs_unshare(AST *prog)
+{
+    unsharing u;
+    memset(&u, 0, sizeof(u));
+    unshare_stmt(&u, prog->data.program.stmt);
+    mem_free(u.stack);
+}
@@ -0,0 +1,63 @@
+#ifndef _EXPRS_H
+#define _EXPRS_H
+#include <stdbool.h>
+#include "ast.h"
+
+// Facts about expressions and conditions that optimizations share
+
+// The values of a program's constants
+typedef struct {
+    short *vals;        // the value of each constant, by offset
+    bool *is_const;     // whether each offset is a constant's
+    unsigned int size;  // the number of offsets in the tables
+} const_values;
+
+// Requires: the current scope is prog's symbol table
+// Fill in cv with the values of prog's constants.
+// If there is no space, bail with an error message.
+extern void const_values_init(const_values *cv, AST *prog);
+
+// Free the tables of cv
+extern void const_values_free(const_values *cv);
+
+// Requires: the current scope is the symbol table of cv's program
+// If exp is a number or the name of a constant, set *v to its value
+// and return true, otherwise return false
+extern bool const_value(const const_values *cv, AST *exp, long *v);
+
+// Requires: the current scope is the symbol table of cv's program
+// If the value of exp only depends on numbers, constants and the
+// variable name (taken to have the given value; name may be NULL),
+// and evaluating it neither fails nor makes a value too large
+// for a number, put its value in *v and return true;
+// otherwise return false
+extern bool expr_eval(const const_values *cv, AST *exp,
+		      const char *name, long value, long *v);
+
+// Requires: the current scope is the symbol table of cv's program
+// If the condition cond has a value as for expr_eval,
+// put it in *b and return true; otherwise return false
+extern bool cond_eval(const const_values *cv, AST *cond,
+		      const char *name, long value, bool *b);
+
+// Return true just when evaluating exp can fail (because it divides,
+// other than by a number that is not 0)
+extern bool expr_may_fail(AST *exp);
+
+// Return true just when evaluating the condition cond can fail
+extern bool cond_may_fail(AST *cond);
+
+// Return true just when the expressions e1 and e2 have the same structure
+// (the C stack only grows with the depth of their right operands)
+extern bool expr_same(AST *e1, AST *e2);
+
+// Requires: the current thread is not sharing expressions (see ast.h)
+// Give each occurrence of a shared expression in prog's statements
+// nodes of its own, at the file location of that occurrence
+// (keeping the side table of their file locations right),
+// so the expressions an optimization builds from them keep
+// their locations (e.g., for the interpreter's error messages).
+// If there is no space, bail with an error message.
+extern void exprs_unshare(AST *prog);
+
+#endif
@@ -1,4 +1,5 @@
 /* $Id: file_location.c,v 1.1 2023/02/19 03:07:27 leavens Exp $ */
+#include <string.h>
 #include "file_location.h"
 
 // Return the file location information from a token
@@ -10,3 +11,14 @@ file_location token2file_loc(token t)
     ret.column = t.column;
     return ret;
 }
+
+// Return a token (of no particular type) at the file location floc
+token file_loc2token(file_location floc)
+{
+    token ret;
+    memset(&ret, 0, sizeof(ret));
+    ret.filename = floc.filename;
+    ret.line = floc.line;
+    ret.column = floc.column;
+    return ret;
+}
@@ -13,4 +13,8 @@ typedef struct {
 // Return the file location information from a token
 extern file_location token2file_loc(token t);
 
+// Return a token (of no particular type) at the file location floc,
+// for making ASTs that do not come from a token in the source
+extern token file_loc2token(file_location floc);
+
 #endif
@@ -0,0 +1,12 @@
+#ifndef _HASH_H
+#define _HASH_H
+#include <stdint.h>
+#include <stddef.h>
+
+// Return the 64-bit xxHash (XXH64) of the len bytes starting at data,
+// using the given seed.
+// (The byte order is taken to be little-endian, as on x86-64,
+// so hashes are only meant to be compared on the same kind of machine.)
+extern uint64_t xxh64(const void *data, size_t len, uint64_t seed);
+
+#endif
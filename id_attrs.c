@@ -4,19 +4,17 @@
 #include <stddef.h>
 #include "utilities.h"
 #include "id_attrs.h"
+#include "symbol_table.h"
 
 // Return a freshly allocated id_attrs struct
 // with its field tok set to t, kind set to k, 
-// and its offset to ofst.
+// and its offset to ofst, from the current scope's pool.
 // If there is no space, bail with an error message,
 // so this should never return NULL.
 extern id_attrs *create_id_attrs(file_location floc, id_kind k,
 				 unsigned int ofst)
 {
-    id_attrs *ret = (id_attrs *)malloc(sizeof(id_attrs));
-    if (ret == NULL) {
-	bail_with_error("No space to allocate id_attrs!");
-    }
+    id_attrs *ret = scope_alloc_attrs();
     ret->file_loc = floc;
     ret->kind = k;
     ret->offset = ofst;
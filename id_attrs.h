@@ -16,7 +16,9 @@ typedef struct {
 } id_attrs;
 
 // Return a freshly allocated id_attrs struct
-// with token t, kind k, and offset ofst.
+// with token t, kind k, and offset ofst,
+// allocated in the current scope's pool, so it is freed with that scope
+// (and must be added to it with scope_insert).
 // If there is no space, bail with an error message,
 // so this should never return NULL.
 extern id_attrs *create_id_attrs(file_location floc, id_kind k,
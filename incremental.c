@@ -0,0 +1,630 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include "utilities.h"
+#include "ast.h"
+#include "ast_walk.h"
+#include "token_array.h"
+#include "parser.h"
+#include "symbol_table.h"
+#include "scope_check.h"
+#include "sink.h"
+#include "sampler.h"
+#include "trace.h"
+#include "incremental.h"
+#include "mem.h"
+
+// Most chars a document's token pool may have (including the texts
+// of tokens that were replaced), as a multiple of the text's length,
+// before the whole text is lexed again to clean it up
+#define MAX_POOL_FACTOR 4
+// Pool size that is never too big to keep
+#define MIN_POOL_LIMIT 65536
+
+// A statement and the tokens it was parsed from: first, ..., end-1
+typedef struct {
+    AST *stmt;
+    size_t first;
+    size_t end;
+} stmt_span;
+
+// A growable list of spans
+typedef struct {
+    stmt_span *spans;
+    size_t len;
+    size_t cap;
+} span_list;
+
+// Invariant: if progast != NULL, then tokens are the tokens of text,
+// progast is their AST, and spans has the span of each statement in it,
+// sorted by first (which differs for each statement)
+struct incr_doc_s {
+    char *name;
+    char *text;
+    size_t len;
+    size_t cap;
+    token_array *tokens;     // NULL before the first edit
+    ast_store store;         // progast's nodes (and those it no longer has)
+    AST *progast;            // NULL if the last edit had an error
+    span_list spans;
+    AST *changed;            // the only statement parsed since the last
+                             // check (NULL if none or if all were parsed)
+    frozen_scope *scope;     // the declarations (NULL if not checked)
+    bool checked;            // did the last check pass?
+    size_t reparsed;
+    char *error;             // message of the last error reported (or NULL)
+};
+
+// Return a fresh document named name (used in messages), with no text
+incr_doc *incr_open(const char *name)
+{
+    incr_doc *d = (incr_doc *) mem_calloc(mem_driver, 1, sizeof(incr_doc));
+    if (d == NULL || (d->name = mem_strdup(mem_driver, name)) == NULL) {
+	bail_with_error("No space for a document!");
+    }
+    ast_store_init(&d->store);
+    return d;
+}
+
+// Return the name of d
+const char *incr_name(incr_doc *d)
+{
+    return d->name;
+}
+
+// Add the span of stmt (tokens first, ..., end-1) to the span_list arg
+// (called by the parser after each statement)
+static void span_add(AST *stmt, size_t first, size_t end, void *arg)
+{
+    span_list *l = (span_list *) arg;
+    if (l->len == l->cap) {
+	l->cap = (l->cap == 0) ? 256 : 2 * l->cap;
+	l->spans = (stmt_span *) mem_realloc(mem_driver, l->spans,
+					 l->cap * sizeof(stmt_span));
+	if (l->spans == NULL) {
+	    bail_with_error("No space for statement spans!");
+	}
+    }
+    l->spans[l->len].stmt = stmt;
+    l->spans[l->len].first = first;
+    l->spans[l->len].end = end;
+    l->len++;
+}
+
+static int compare_spans(const void *a, const void *b)
+{
+    size_t x = ((const stmt_span *) a)->first;
+    size_t y = ((const stmt_span *) b)->first;
+    return (x < y) ? -1 : (x > y);
+}
+
+// Return the number of newlines in the n chars at s
+static unsigned int count_newlines(const char *s, size_t n)
+{
+    unsigned int count = 0;
+    const char *end = s + n;
+    while ((s = memchr(s, '\n', (size_t) (end - s))) != NULL) {
+	count++;
+	s++;
+    }
+    return count;
+}
+
+// Return the offset of the start of the line in text
+// that has the char at offset pos
+static size_t line_start(const char *text, size_t pos)
+{
+    while (pos > 0 && text[pos - 1] != '\n') {
+	pos--;
+    }
+    return pos;
+}
+
+// Return the index of the first token of a whose offset is at least offset
+// (or the number of tokens, if there is none)
+static size_t token_at(const token_array *a, size_t offset)
+{
+    size_t lo = 0;
+    size_t hi = a->length;
+    while (lo < hi) {
+	size_t mid = lo + (hi - lo) / 2;
+	if (a->tokens[mid].offset < offset) {
+	    lo = mid + 1;
+	} else {
+	    hi = mid;
+	}
+    }
+    return lo;
+}
+
+// Replace the deleted chars at offset in d's text with the len chars of text
+static void replace_text(incr_doc *d, size_t offset, size_t deleted,
+			 const char *text, size_t len)
+{
+    size_t new_len = d->len - deleted + len;
+    if (new_len + 1 > d->cap) {
+	size_t cap = (d->cap == 0) ? 4096 : d->cap;
+	while (cap < new_len + 1) {
+	    cap *= 2;
+	}
+	char *nt = (char *) mem_realloc(mem_driver, d->text, cap);
+	if (nt == NULL) {
+	    bail_with_error("No space for the text of %s!", d->name);
+	}
+	d->text = nt;
+	d->cap = cap;
+    }
+    memmove(d->text + offset + len, d->text + offset + deleted,
+	    d->len - offset - deleted);
+    memcpy(d->text + offset, text, len);
+    d->len = new_len;
+    d->text[new_len] = '\0';
+}
+
+// Forget d's symbol table
+static void forget_scope(incr_doc *d)
+{
+    if (d->scope != NULL) {
+	scope_discard(d->scope);
+	d->scope = NULL;
+    }
+    d->checked = false;
+}
+
+// Run fn(d, arg), building any AST nodes in d's store, and return NULL,
+// or, if it reports an error, return that error's message
+// (a fresh string), closing the parser
+static char *run_catching(void (*fn)(incr_doc *, void *), incr_doc *d,
+			  void *arg)
+{
+    error_trap *outer = error_trap_current();
+    ast_store *outer_store = ast_use_store(&d->store);
+    error_trap trap;
+    trap.diagnostics = sink_string();
+    unsigned int trace_level = trace_depth();
+    unsigned int sample_level = sampler_depth();
+    unsigned int walk_level = ast_walk_depth();
+    volatile bool failed = false;
+    if (setjmp(trap.env) == 0) {
+	error_trap_set(&trap);
+	fn(d, arg);
+    } else {
+	failed = true;
+	parser_close();
+	trace_unwind(trace_level);
+	sampler_unwind(sample_level);
+	ast_walk_unwind(walk_level);
+    }
+    parser_on_stmt(NULL, NULL);
+    ast_use_store(outer_store);
+    if (outer != NULL) {
+	error_trap_set(outer);
+    } else {
+	error_trap_clear();
+    }
+    char *msg = NULL;
+    if (failed) {
+	msg = mem_strdup(mem_driver, sink_contents(trap.diagnostics));
+	if (msg == NULL) {
+	    bail_with_error("No space for an error message!");
+	}
+    }
+    sink_close(trap.diagnostics);
+    return msg;
+}
+
+// Report the error with message msg (from run_catching) as usual,
+// keeping msg until d's next edit, as this does not return
+static void report(incr_doc *d, char *msg)
+{
+    d->error = msg;
+    error_reraise(msg);
+}
+
+// Lex and parse the whole text of d (run by run_catching)
+static void parse_all(incr_doc *d, void *unused)
+{
+    TRACE_BEGIN("incr_parse_all");
+    d->tokens = token_array_lex_text(d->text, d->len, d->name, 1, 0);
+    d->reparsed = token_array_length(d->tokens);
+    parser_on_stmt(span_add, &d->spans);
+    parser_open_array(d->tokens);
+    AST *prog = parseProgram();
+    parser_close();
+    qsort(d->spans.spans, d->spans.len, sizeof(stmt_span), compare_spans);
+    d->progast = prog;
+    TRACE_END();
+}
+
+// How file locations move with an edit:
+// those after the end of the deleted text (at line, column)
+// move down line_delta lines, and those on that same line
+// also move right column_delta columns
+typedef struct {
+    unsigned int line;
+    unsigned int column;
+    int line_delta;
+    int column_delta;
+} location_shift;
+
+// Move the place at *line and *column as s says
+static void shift_place(const location_shift *s, unsigned int *line,
+			unsigned int *column)
+{
+    if (*line == s->line && *column >= s->column) {
+	*column += s->column_delta;
+	*line += s->line_delta;
+    } else if (*line > s->line) {
+	*line += s->line_delta;
+    }
+}
+
+// Move the file location of ast as the location_shift of the walk says
+static void shift_location(ast_walker *w, AST *ast, int level,
+			   unsigned int flags)
+{
+    location_shift *s = (location_shift *) ast_walk_context(w);
+    shift_place(s, &ast->file_loc.line, &ast->file_loc.column);
+}
+
+// Is the token at index i of a (from before an edit that moves
+// tokens as s says) the same as the token at index k of fresh
+// (from after the edit), with the same text at the same place?
+static bool same_token(const token_array *a, size_t i,
+		       const token_array *fresh, size_t k,
+		       const location_shift *s)
+{
+    const packed_token *p = &a->tokens[i];
+    const packed_token *q = &fresh->tokens[k];
+    unsigned int line = p->line;
+    unsigned int column = p->column;
+    shift_place(s, &line, &column);
+    if (p->typ != q->typ || p->length != q->length
+	|| line != q->line || column != q->column) {
+	return false;
+    }
+    if (p->text == NO_TOKEN_TEXT || q->text == NO_TOKEN_TEXT) {
+	return p->text == q->text;
+    }
+    return memcmp(a->pool + p->text, fresh->pool + q->text, p->length) == 0;
+}
+
+static const ast_visitor shift_visitor = {
+    .pre = {
+	[program_ast] = shift_location, [const_decl_ast] = shift_location,
+	[var_decl_ast] = shift_location, [assign_ast] = shift_location,
+	[begin_ast] = shift_location, [if_ast] = shift_location,
+	[while_ast] = shift_location, [read_ast] = shift_location,
+	[write_ast] = shift_location, [skip_ast] = shift_location,
+	[odd_cond_ast] = shift_location, [bin_cond_ast] = shift_location,
+	[op_expr_ast] = shift_location, [bin_expr_ast] = shift_location,
+	[ident_ast] = shift_location, [number_ast] = shift_location,
+    },
+};
+
+// A statement to parse again: the one that had the tokens
+// first, ..., end-1 (after the edit), giving the new statement
+// and the spans of the statements in it
+typedef struct {
+    size_t first;
+    size_t end;
+    AST *stmt;
+    size_t stop;
+    span_list spans;
+} reparse_job;
+
+// Parse the statement of the reparse_job arg again (run by run_catching)
+static void reparse_stmt(incr_doc *d, void *arg)
+{
+    reparse_job *j = (reparse_job *) arg;
+    TRACE_BEGIN("incr_reparse_stmt");
+    parser_on_stmt(span_add, &j->spans);
+    parser_open_array_at(d->tokens, j->first);
+    j->stmt = parse_stmt();
+    j->stop = parser_index();
+    parser_close();
+    TRACE_END();
+}
+
+// Put the statement parsed by j in place of old (the statement
+// that was there, which keeps its place in the AST)
+// and replace the spans of old's statements with j's
+static void install_stmt(incr_doc *d, AST *old, reparse_job *j)
+{
+    AST_list next = old->next;
+    *old = *j->stmt;
+    old->next = next;
+    span_list *l = &j->spans;
+    qsort(l->spans, l->len, sizeof(stmt_span), compare_spans);
+    // the outermost new span is the first, which is j's statement
+    l->spans[0].stmt = old;
+
+    span_list *s = &d->spans;
+    size_t lo = 0;
+    while (lo < s->len && s->spans[lo].first < j->first) {
+	lo++;
+    }
+    size_t hi = lo;
+    while (hi < s->len && s->spans[hi].first < j->end) {
+	hi++;
+    }
+    size_t new_len = s->len - (hi - lo) + l->len;
+    while (s->cap < new_len) {
+	s->cap = (s->cap == 0) ? 256 : 2 * s->cap;
+	s->spans = (stmt_span *) mem_realloc(
+	    mem_driver, s->spans, s->cap * sizeof(stmt_span));
+	if (s->spans == NULL) {
+	    bail_with_error("No space for statement spans!");
+	}
+    }
+    memmove(&s->spans[lo + l->len], &s->spans[hi],
+	    (s->len - hi) * sizeof(stmt_span));
+    memcpy(&s->spans[lo], l->spans, l->len * sizeof(stmt_span));
+    s->len = new_len;
+}
+
+// Try to bring d up to date after replacing the deleted chars at offset
+// of its text with the len chars of text, by lexing again only the lines
+// the edit touched and parsing again only the smallest statement that
+// holds the tokens that changed (and still parses by itself).
+// Return false if this does not work, so the whole text must be parsed again
+// (in which case d's text has been edited, but not its tokens or AST).
+static bool edit_locally(incr_doc *d, size_t offset, size_t deleted,
+			 const char *text, size_t len)
+{
+    token_array *a = d->tokens;
+    size_t old_len = d->len;
+    size_t old_end = offset + deleted;
+    // the lines to lex again: from rs to re_old (before the edit)
+    size_t rs = line_start(d->text, offset);
+    const char *nl = memchr(d->text + old_end, '\n', old_len - old_end);
+    size_t re_old = (nl == NULL) ? old_len : (size_t) (nl - d->text) + 1;
+    // their tokens: ta, ..., tb-1 (with the end-of-file token, if at the end)
+    size_t ta = token_at(a, rs);
+    size_t tb = (re_old == old_len) ? a->length : token_at(a, re_old);
+    unsigned int line = (ta > 0)
+	? a->tokens[ta - 1].line
+	  + count_newlines(d->text + a->tokens[ta - 1].offset,
+			   rs - a->tokens[ta - 1].offset)
+	: 1 + count_newlines(d->text, rs);
+
+    location_shift shift;
+    shift.line = line + count_newlines(d->text + rs, old_end - rs);
+    shift.column = (unsigned int) (old_end - line_start(d->text, old_end)) + 1;
+
+    replace_text(d, offset, deleted, text, len);
+    size_t new_end = offset + len;
+    size_t re_new = re_old - deleted + len;
+    shift.line_delta = (int) (line + count_newlines(d->text + rs, new_end - rs))
+	- (int) shift.line;
+    shift.column_delta = (int) (new_end - line_start(d->text, new_end)) + 1
+	- (int) shift.column;
+
+    TRACE_BEGIN("incr_relex");
+    token_array *fresh = token_array_lex_text(d->text + rs, re_new - rs,
+					      d->name, line,
+					      (unsigned int) rs);
+    TRACE_END();
+    size_t nfresh = fresh->length;
+    // the lines must lex cleanly by themselves, as they did before
+    bool ok = fresh->error == NULL && nfresh > 0
+	&& fresh->tokens[nfresh - 1].typ == eofsym
+	&& fresh->tokens[nfresh - 1].offset == re_new;
+    if (!ok) {
+	token_array_free(fresh);
+	return false;
+    }
+    if (re_new != d->len) {
+	nfresh--; // the end-of-file token of the lines
+    }
+
+    // the tokens that changed: ca, ..., cb-1 before the edit
+    // (the lines' other tokens are the same, apart from moving)
+    size_t most = (nfresh < tb - ta) ? nfresh : tb - ta;
+    size_t same_before = 0;
+    while (same_before < most
+	   && same_token(a, ta + same_before, fresh, same_before, &shift)) {
+	same_before++;
+    }
+    size_t same_after = 0;
+    while (same_before + same_after < most
+	   && same_token(a, tb - 1 - same_after, fresh,
+			 nfresh - 1 - same_after, &shift)) {
+	same_after++;
+    }
+    size_t ca = ta + same_before;
+    size_t cb = tb - same_after;
+    bool unchanged = ca == cb && nfresh == same_before + same_after;
+
+    // the statements holding all the tokens that changed,
+    // innermost first (so the spans in d are in order of first)
+    size_t ncands = 0;
+    for (size_t i = 0; i < d->spans.len; i++) {
+	if (d->spans.spans[i].first <= ca && cb <= d->spans.spans[i].end) {
+	    ncands++;
+	}
+    }
+    if (ncands == 0 && !unchanged) {
+	token_array_free(fresh);
+	return false;
+    }
+    stmt_span *cands = (stmt_span *) mem_alloc(
+	mem_driver, ncands * sizeof(stmt_span));
+    if (cands == NULL && ncands > 0) {
+	bail_with_error("No space for statement spans!");
+    }
+    size_t c = ncands;
+    for (size_t i = 0; i < d->spans.len; i++) {
+	if (d->spans.spans[i].first <= ca && cb <= d->spans.spans[i].end) {
+	    cands[--c] = d->spans.spans[i];
+	}
+    }
+
+    // from here on d's AST, tokens, and spans are for the new text
+    if (shift.line_delta != 0 || shift.column_delta != 0) {
+	ast_walk(d->progast, &shift_visitor, &shift, 0, 0);
+    }
+    long token_delta = (long) nfresh - (long) (tb - ta);
+    token_array_splice(a, ta, tb, fresh, nfresh, shift.line_delta,
+		       (long) len - (long) deleted);
+    token_array_free(fresh);
+    for (size_t i = 0; i < d->spans.len; i++) {
+	stmt_span *s = &d->spans.spans[i];
+	if (s->first >= cb) {
+	    s->first += token_delta;
+	    s->end += token_delta;
+	} else if (s->end >= cb) {
+	    s->end += token_delta;
+	}
+    }
+    if (unchanged) {
+	// only spaces or comments changed, so the AST is still right
+	mem_free(cands);
+	d->reparsed = 0;
+	return true;
+    }
+
+    ok = false;
+    for (c = 0; c < ncands && !ok; c++) {
+	reparse_job j;
+	j.first = cands[c].first;
+	j.end = cands[c].end + token_delta;
+	j.stmt = NULL;
+	j.spans.spans = NULL;
+	j.spans.len = 0;
+	j.spans.cap = 0;
+	if (j.first >= a->length) {
+	    break;
+	}
+	char *msg = run_catching(reparse_stmt, d, &j);
+	if (msg == NULL && j.stmt != NULL && j.stop == j.end) {
+	    install_stmt(d, cands[c].stmt, &j);
+	    d->changed = cands[c].stmt;
+	    d->reparsed = j.end - j.first;
+	    ok = true;
+	}
+	mem_free(msg);
+	mem_free(j.spans.spans);
+    }
+    mem_free(cands);
+    return ok;
+}
+
+// Requires: offset + deleted <= the length of d's text and text has len chars
+// Replace the deleted chars at offset in d's text with the len chars of text,
+// and bring d's tokens and AST up to date.
+// Errors are reported as usual (see utilities.h); after an error
+// d has the edited text but no AST (until a later edit succeeds).
+void incr_edit(incr_doc *d, size_t offset, size_t deleted,
+	       const char *text, size_t len)
+{
+    mem_free(d->error);
+    d->error = NULL;
+    if (offset > d->len || deleted > d->len - offset) {
+	bail_with_error("Edit of %s is outside of its text", d->name);
+    }
+    // the statement the last edit parsed, if it was not checked since
+    AST *unchecked = d->changed;
+    bool local = d->progast != NULL
+	&& d->tokens->pool_len <= MIN_POOL_LIMIT
+				  + MAX_POOL_FACTOR * (d->len + len);
+    if (local) {
+	local = edit_locally(d, offset, deleted, text, len);
+    } else {
+	replace_text(d, offset, deleted, text, len);
+    }
+    if (local) {
+	if (unchecked != NULL && d->changed != unchecked) {
+	    // only one changed statement can be checked by itself
+	    d->checked = false;
+	}
+	return;
+    }
+
+    // parse the whole text (the old AST is no longer used)
+    d->progast = NULL;
+    d->changed = NULL;
+    d->spans.len = 0;
+    forget_scope(d);
+    ast_store_release(&d->store);
+    if (d->tokens != NULL) {
+	token_array_free(d->tokens);
+	d->tokens = NULL;
+    }
+    char *msg = run_catching(parse_all, d, NULL);
+    if (msg != NULL) {
+	d->progast = NULL;
+	report(d, msg);
+    }
+}
+
+// Return d's AST (NULL if the last edit had an error)
+AST *incr_program(incr_doc *d)
+{
+    return d->progast;
+}
+
+// Check the names in the statement d->changed with the frozen scope
+// of d (run by run_catching)
+static void check_changed(incr_doc *d, void *unused)
+{
+    scope_use_frozen(d->scope);
+    scope_check_stmt(d->changed);
+    scope_use_frozen(NULL);
+}
+
+// Requires: incr_program(d) != NULL
+// Build the symbol table for d's program and check the program
+// (like scope_check_program). If the last check passed and the edits
+// since then only parsed one statement again, only the names in that
+// statement are checked, using the symbol table kept from the last check
+// (and if they parsed nothing, nothing is checked).
+void incr_check(incr_doc *d)
+{
+    if (d->checked && d->changed == NULL) {
+	// only spaces or comments changed since the last check
+	return;
+    }
+    if (d->checked) {
+	d->checked = false;
+	char *msg = run_catching(check_changed, d, NULL);
+	if (msg != NULL) {
+	    scope_use_frozen(NULL);
+	    report(d, msg);
+	}
+	d->checked = true;
+	d->changed = NULL;
+	return;
+    }
+    forget_scope(d);
+    scope_initialize();
+    scope_check_program(d->progast);
+    d->scope = scope_detach();
+    d->checked = true;
+    d->changed = NULL;
+}
+
+// Return the number of tokens the last edit of d parsed
+// (all of them, if it parsed the whole text, or 0 if only spaces
+// or comments changed)
+size_t incr_reparsed_tokens(incr_doc *d)
+{
+    return d->reparsed;
+}
+
+// Free d (after which its AST must not be used)
+void incr_close(incr_doc *d)
+{
+    forget_scope(d);
+    if (d->tokens != NULL) {
+	token_array_free(d->tokens);
+    }
+    ast_store_release(&d->store);
+    mem_free(d->spans.spans);
+    mem_free(d->text);
+    mem_free(d->name);
+    mem_free(d->error);
+    mem_free(d);
+}
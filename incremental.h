@@ -0,0 +1,50 @@
+#ifndef _INCREMENTAL_H
+#define _INCREMENTAL_H
+#include <stddef.h>
+#include "ast.h"
+
+// An incremental document keeps the text of a program being edited
+// (e.g., in an editor) together with its token array and AST,
+// so that after an edit only the lines the edit touched are lexed again,
+// and only the smallest statement (or begin block) containing them
+// is parsed again. The rest of the AST is kept (with its file locations
+// moved to match the new text). If an edit cannot be handled that way
+// (e.g., it changes the declarations, or the statement no longer
+// parses by itself), the whole text is lexed and parsed again,
+// so the AST is always the same as parsing the whole text would give.
+typedef struct incr_doc_s incr_doc;
+
+// Return a fresh document named name (used in messages), with no text
+extern incr_doc *incr_open(const char *name);
+
+// Return the name of d
+extern const char *incr_name(incr_doc *d);
+
+// Requires: offset + deleted <= the length of d's text and text has len chars
+// Replace the deleted chars at offset in d's text with the len chars of text,
+// and bring d's tokens and AST up to date.
+// Errors are reported as usual (see utilities.h); after an error
+// d has the edited text but no AST (until a later edit succeeds).
+extern void incr_edit(incr_doc *d, size_t offset, size_t deleted,
+		      const char *text, size_t len);
+
+// Return d's AST (NULL if the last edit had an error)
+extern AST *incr_program(incr_doc *d);
+
+// Requires: incr_program(d) != NULL
+// Build the symbol table for d's program and check the program
+// (like scope_check_program). If the last check passed and the edits
+// since then only parsed one statement again, only the names in that
+// statement are checked, using the symbol table kept from the last check
+// (and if they parsed nothing, nothing is checked).
+extern void incr_check(incr_doc *d);
+
+// Return the number of tokens the last edit of d parsed
+// (all of them, if it parsed the whole text, or 0 if only spaces
+// or comments changed)
+extern size_t incr_reparsed_tokens(incr_doc *d);
+
+// Free d (after which its AST must not be used)
+extern void incr_close(incr_doc *d);
+
+#endif
@@ -0,0 +1,450 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "ast.h"
+#include "ast_walk.h"
+#include "id_attrs.h"
+#include "symbol_table.h"
+#include "exprs.h"
+#include "utilities.h"
+#include "interpreter.h"
+#include "mem.h"
+
+// The instructions of the stack machine
+typedef enum {
+    op_number,      // push arg
+    op_load,        // push the variable at offset arg
+    op_store,       // pop into the variable at offset arg
+    op_add, op_sub, op_mult,
+    op_div,         // (arg is the site of the division)
+    op_odd,
+    op_compare,     // compare with the rel_op arg, pushing 1 or 0
+    op_jump,        // go to arg
+    op_jump_false,  // pop, and go to arg if that was 0
+    op_read,        // push a number read (arg is the site of the read)
+    op_write,       // pop and write
+    op_count,       // count an execution of the statement of counter arg
+    op_branch,      // count the condition on top (for counter arg)
+    op_halt
+} opcode;
+
+typedef struct {
+    opcode op;
+    int arg;
+} instr;
+
+// Where an instruction that can fail came from (for error messages)
+typedef struct {
+    file_location loc;
+    const char *name;       // the variable read (or NULL)
+} site;
+
+// A program translated for the stack machine
+typedef struct {
+    instr *code;
+    size_t size;
+    size_t cap;
+    site *sites;
+    size_t num_sites;
+    size_t sites_cap;
+    // a counter for each statement (if counting)
+    exec_count *counters;
+    size_t num_counters;
+    size_t counters_cap;
+    bool counting;
+    const_values consts;
+    // the current and largest depth of the value stack
+    size_t depth;
+    size_t max_depth;
+    // the file locations of the expression nodes of the expression
+    // parent being translated, if they are shared (see ast.h),
+    // and how many of those nodes are translated
+    const file_location *locs;
+    size_t done;
+} machine;
+
+// Make sure that the array at *arr (of *cap elements of size elem)
+// has room for one more than n elements
+static void reserve(void **arr, size_t *cap, size_t n, size_t elem)
+{
+    if (n == *cap) {
+	*cap = (*cap == 0) ? 64 : 2 * *cap;
+	*arr = mem_realloc(mem_interpreter, *arr, *cap * elem);
+	if (*arr == NULL) {
+	    bail_with_error("No space to interpret a program!");
+	}
+    }
+}
+
+// Append the instruction (op, arg) to the code of m,
+// whose effect on the depth of the value stack is change,
+// and return its index
+static size_t emit(machine *m, opcode op, int arg, int change)
+{
+    reserve((void **) &m->code, &m->cap, m->size, sizeof(instr));
+    m->code[m->size].op = op;
+    m->code[m->size].arg = arg;
+    m->depth += change;
+    if (m->depth > m->max_depth) {
+	m->max_depth = m->depth;
+    }
+    return m->size++;
+}
+
+// Return the index of a new site in m for loc (and the variable name)
+static int add_site(machine *m, file_location loc, const char *name)
+{
+    reserve((void **) &m->sites, &m->sites_cap, m->num_sites, sizeof(site));
+    m->sites[m->num_sites].loc = loc;
+    m->sites[m->num_sites].name = name;
+    return (int) m->num_sites++;
+}
+
+// Return the index of a new counter in m for the statement stmt
+static int add_counter(machine *m, AST *stmt)
+{
+    reserve((void **) &m->counters, &m->counters_cap, m->num_counters,
+	    sizeof(exec_count));
+    exec_count *c = &m->counters[m->num_counters];
+    memset(c, 0, sizeof(exec_count));
+    c->line = stmt->file_loc.line;
+    c->column = stmt->file_loc.column;
+    c->is_branch = stmt->type_tag == if_ast || stmt->type_tag == while_ast;
+    return (int) m->num_counters++;
+}
+
+// Return the offset of the variable named name
+static int offset_of(const char *name)
+{
+    id_attrs *attrs = scope_lookup(name);
+    assert(attrs != NULL);
+    return (int) attrs->offset;
+}
+
+// Start translating the expressions of the expression parent
+// (an assign, write, odd_cond, or bin_cond AST)
+static void begin_parent(machine *m, const AST *parent)
+{
+    m->locs = ast_expr_locations(parent);
+    m->done = 0;
+}
+
+// Return the file location of the occurrence of the expression exp
+// that is being translated (in the current expression parent)
+static file_location occurrence_loc(machine *m, AST *exp)
+{
+    return (m->locs != NULL) ? m->locs[m->done] : exp->file_loc;
+}
+
+// Callbacks for translating an expression (in the machine context),
+// which emit the code of each node after that of its operands
+static void emit_number(ast_walker *w, AST *exp, int level,
+			unsigned int flags)
+{
+    machine *m = (machine *) ast_walk_context(w);
+    emit(m, op_number, exp->data.number.value, 1);
+    m->done++;
+}
+
+static void emit_ident(ast_walker *w, AST *exp, int level,
+		       unsigned int flags)
+{
+    machine *m = (machine *) ast_walk_context(w);
+    long v;
+    if (const_value(&m->consts, exp, &v)) {
+	emit(m, op_number, (int) v, 1);
+    } else {
+	emit(m, op_load, offset_of(exp->data.ident.name), 1);
+    }
+    m->done++;
+}
+
+static void emit_bin_expr(ast_walker *w, AST *exp, int level,
+			  unsigned int flags)
+{
+    machine *m = (machine *) ast_walk_context(w);
+    switch (exp->data.bin_expr.arith_op) {
+    case addop:
+	emit(m, op_add, 0, -1);
+	break;
+    case subop:
+	emit(m, op_sub, 0, -1);
+	break;
+    case multop:
+	emit(m, op_mult, 0, -1);
+	break;
+    default:
+	emit(m, op_div, add_site(m, occurrence_loc(m, exp), NULL), -1);
+	break;
+    }
+    m->done++;
+}
+
+static const ast_visitor emit_visitor = {
+    .post = {
+	[number_ast] = emit_number,
+	[ident_ast] = emit_ident,
+	[bin_expr_ast] = emit_bin_expr,
+    },
+};
+
+// Translate the expression exp, whose value is pushed
+static void emit_expr(machine *m, AST *exp)
+{
+    ast_walk(exp, &emit_visitor, m, 0, 0);
+}
+
+// Translate the condition cond, whose value (1 or 0) is pushed
+static void emit_cond(machine *m, AST *cond)
+{
+    begin_parent(m, cond);
+    if (cond->type_tag == odd_cond_ast) {
+	emit_expr(m, cond->data.odd_cond.exp);
+	emit(m, op_odd, 0, 0);
+    } else {
+	emit_expr(m, cond->data.bin_cond.leftexp);
+	emit_expr(m, cond->data.bin_cond.rightexp);
+	emit(m, op_compare, cond->data.bin_cond.relop, -1);
+    }
+}
+
+// Translate the statement stmt
+static void emit_stmt(machine *m, AST *stmt)
+{
+    int counter = 0;
+    if (m->counting) {
+	counter = add_counter(m, stmt);
+	emit(m, op_count, counter, 0);
+    }
+    switch (stmt->type_tag) {
+    case assign_ast:
+	begin_parent(m, stmt);
+	emit_expr(m, stmt->data.assign_stmt.exp);
+	emit(m, op_store, offset_of(stmt->data.assign_stmt.name), -1);
+	break;
+    case begin_ast:
+	for (AST_list l = stmt->data.begin_stmt.stmts; !ast_list_is_empty(l);
+	     l = ast_list_rest(l)) {
+	    emit_stmt(m, ast_list_first(l));
+	}
+	break;
+    case if_ast: {
+	emit_cond(m, stmt->data.if_stmt.cond);
+	if (m->counting) {
+	    emit(m, op_branch, counter, 0);
+	}
+	size_t to_else = emit(m, op_jump_false, 0, -1);
+	emit_stmt(m, stmt->data.if_stmt.thenstmt);
+	size_t to_end = emit(m, op_jump, 0, 0);
+	m->code[to_else].arg = (int) m->size;
+	emit_stmt(m, stmt->data.if_stmt.elsestmt);
+	m->code[to_end].arg = (int) m->size;
+	break;
+    }
+    case while_ast: {
+	size_t start = m->size;
+	emit_cond(m, stmt->data.while_stmt.cond);
+	if (m->counting) {
+	    emit(m, op_branch, counter, 0);
+	}
+	size_t to_end = emit(m, op_jump_false, 0, -1);
+	emit_stmt(m, stmt->data.while_stmt.stmt);
+	emit(m, op_jump, (int) start, 0);
+	m->code[to_end].arg = (int) m->size;
+	break;
+    }
+    case read_ast: {
+	const char *name = stmt->data.read_stmt.name;
+	emit(m, op_read, add_site(m, stmt->file_loc, name), 1);
+	emit(m, op_store, offset_of(name), -1);
+	break;
+    }
+    case write_ast:
+	begin_parent(m, stmt);
+	emit_expr(m, stmt->data.write_stmt.exp);
+	emit(m, op_write, 0, -1);
+	break;
+    default:
+	// skip statements have no code
+	break;
+    }
+}
+
+// Free the tables of m
+static void machine_free(machine *m)
+{
+    mem_free(m->code);
+    mem_free(m->sites);
+    mem_free(m->counters);
+    const_values_free(&m->consts);
+}
+
+// Requires: values and vars were allocated for running m
+// Free m, values and vars, flush out, then report the error described
+// by msg (and the name of the site s) at the location of s,
+// so this does not return
+static void fail(machine *m, short *values, short *vars, sink *out,
+		 const site *s, const char *msg)
+{
+    file_location loc = s->loc;
+    const char *name = (s->name == NULL) ? "" : s->name;
+    // the message may use the name, which outlives m
+    mem_free(values);
+    mem_free(vars);
+    machine_free(m);
+    sink_flush(out);
+    general_error(loc, msg, name);
+}
+
+// Return v as a 16-bit number, wrapping around
+// (converting to a short keeps the low 16 bits with gcc and clang)
+static inline short wrap(long v)
+{
+    return (short) (unsigned short) v;
+}
+
+// Run the code of m (see interpret)
+static void run(machine *m, FILE *in, sink *out)
+{
+    short *values = (short *) mem_alloc(
+	mem_interpreter, (m->max_depth + 1) * sizeof(short));
+    short *vars = (short *) mem_calloc(
+	mem_interpreter, scope_size() + 1, sizeof(short));
+    if (values == NULL || vars == NULL) {
+	bail_with_error("No space to interpret a program!");
+    }
+    const instr *code = m->code;
+    size_t pc = 0;
+    size_t sp = 0;          // the number of values on the stack
+    for (;;) {
+	const instr *i = &code[pc++];
+	switch (i->op) {
+	case op_number:
+	    values[sp++] = (short) i->arg;
+	    break;
+	case op_load:
+	    values[sp++] = vars[i->arg];
+	    break;
+	case op_store:
+	    vars[i->arg] = values[--sp];
+	    break;
+	case op_add:
+	    sp--;
+	    values[sp - 1] = wrap((long) values[sp - 1] + values[sp]);
+	    break;
+	case op_sub:
+	    sp--;
+	    values[sp - 1] = wrap((long) values[sp - 1] - values[sp]);
+	    break;
+	case op_mult:
+	    sp--;
+	    values[sp - 1] = wrap((long) values[sp - 1] * values[sp]);
+	    break;
+	case op_div:
+	    sp--;
+	    if (values[sp] == 0) {
+		fail(m, values, vars, out, &m->sites[i->arg],
+		     "Division by zero");
+	    }
+	    values[sp - 1] = wrap((long) values[sp - 1] / values[sp]);
+	    break;
+	case op_odd:
+	    values[sp - 1] = (values[sp - 1] % 2 != 0);
+	    break;
+	case op_compare: {
+	    short b = values[--sp];
+	    short a = values[sp - 1];
+	    bool r;
+	    switch ((rel_op) i->arg) {
+	    case eqop:
+		r = a == b;
+		break;
+	    case neqop:
+		r = a != b;
+		break;
+	    case ltop:
+		r = a < b;
+		break;
+	    case leqop:
+		r = a <= b;
+		break;
+	    case gtop:
+		r = a > b;
+		break;
+	    default:
+		r = a >= b;
+		break;
+	    }
+	    values[sp - 1] = r;
+	    break;
+	}
+	case op_jump:
+	    pc = (size_t) i->arg;
+	    break;
+	case op_jump_false:
+	    if (values[--sp] == 0) {
+		pc = (size_t) i->arg;
+	    }
+	    break;
+	case op_read: {
+	    // show what was written before waiting for input
+	    sink_flush(out);
+	    long v;
+	    int n = fscanf(in, "%ld", &v);
+	    if (n == EOF) {
+		fail(m, values, vars, out, &m->sites[i->arg],
+		     "No more input to read into %s");
+	    }
+	    if (n != 1 || v < SHRT_MIN || SHRT_MAX < v) {
+		fail(m, values, vars, out, &m->sites[i->arg],
+		     "The input read into %s is not a number");
+	    }
+	    values[sp++] = (short) v;
+	    break;
+	}
+	case op_write:
+	    sink_put_int(out, values[--sp]);
+	    sink_putc(out, '\n');
+	    break;
+	case op_count:
+	    m->counters[i->arg].count++;
+	    break;
+	case op_branch:
+	    if (values[sp - 1] != 0) {
+		m->counters[i->arg].taken++;
+	    } else {
+		m->counters[i->arg].not_taken++;
+	    }
+	    break;
+	default:
+	    mem_free(values);
+	    mem_free(vars);
+	    return;
+	}
+    }
+}
+
+// Run prog (see interpreter.h)
+void interpret(AST *prog, FILE *in, sink *out, exec_counts *counts)
+{
+    machine m;
+    memset(&m, 0, sizeof(m));
+    m.counting = counts != NULL;
+    const_values_init(&m.consts, prog);
+    emit_stmt(&m, prog->data.program.stmt);
+    emit(&m, op_halt, 0, 0);
+    run(&m, in, out);
+    for (size_t i = 0; i < m.num_counters; i++) {
+	const exec_count *c = &m.counters[i];
+	file_location loc = { prog->file_loc.filename, c->line, c->column };
+	exec_count *ec = exec_counts_at(counts, loc);
+	ec->count += c->count;
+	if (c->is_branch) {
+	    ec->is_branch = true;
+	    ec->taken += c->taken;
+	    ec->not_taken += c->not_taken;
+	}
+    }
+    machine_free(&m);
+}
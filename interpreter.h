@@ -0,0 +1,31 @@
+#ifndef _INTERPRETER_H
+#define _INTERPRETER_H
+#include <stdio.h>
+#include "ast.h"
+#include "sink.h"
+#include "exec_counts.h"
+
+// An interpreter for checked programs, which first translates
+// a program's AST into code for a small stack machine
+// (with the variables' offsets and the constants' values resolved)
+// and then runs that code.
+//
+// Numbers are 16 bits, as in the AST, and arithmetic wraps around;
+// division truncates toward 0, and dividing by 0 is an error.
+// Variables start out as 0.
+
+// Requires: prog has passed its scope check (see scope_check.h)
+//           and the current scope is prog's symbol table
+// Run prog, reading a number from in for each of its read statements,
+// and writing the value of each of its write statements to out
+// (on a line by itself). If counts is not NULL, add to counts the times
+// each statement was executed and each condition was true and false
+// (see exec_counts.h), including a zero count for each statement
+// that was not executed.
+// If the program divides by 0 or cannot read a number, flush out,
+// then report the error (see general_error in utilities.h),
+// so this does not return (and counts are not changed).
+// If there is no space, bail with an error message.
+extern void interpret(AST *prog, FILE *in, sink *out, exec_counts *counts);
+
+#endif
@@ -0,0 +1,63 @@
+#include <stdlib.h>
+#include "ast.h"
+#include "ast_walk.h"
+#include "exec_counts.h"
+#include "trace.h"
+#include "utilities.h"
+#include "layout.h"
+
+// The relational operator that is true just when relop is false
+static rel_op opposite(rel_op relop)
+{
+    switch (relop) {
+    case eqop:
+	return neqop;
+    case neqop:
+	return eqop;
+    case ltop:
+	return geqop;
+    case leqop:
+	return gtop;
+    case gtop:
+	return leqop;
+    default:
+	return ltop;
+    }
+}
+
+// Callback that swaps the parts of an if statement (in the
+// exec_counts context) if its else part usually ran
+static void lay_out_if(ast_walker *w, AST *stmt, int level,
+		       unsigned int flags)
+{
+    const exec_counts *counts = (const exec_counts *) ast_walk_context(w);
+    const exec_count *ec = exec_counts_find(counts, stmt->file_loc);
+    AST *cond = stmt->data.if_stmt.cond;
+    if (ec == NULL || !ec->is_branch || ec->not_taken <= ec->taken
+	|| cond->type_tag != bin_cond_ast) {
+	return;
+    }
+    stmt->data.if_stmt.cond = ast_bin_cond(
+	file_loc2token(cond->file_loc), cond->data.bin_cond.leftexp,
+	opposite(cond->data.bin_cond.relop), cond->data.bin_cond.rightexp);
+    AST *thenstmt = stmt->data.if_stmt.thenstmt;
+    stmt->data.if_stmt.thenstmt = stmt->data.if_stmt.elsestmt;
+    stmt->data.if_stmt.elsestmt = thenstmt;
+    diagnostic_print("%s: line %d, column %d: if parts swapped"
+		     " (the else part ran %lu of %lu times)\n",
+		     stmt->file_loc.filename, stmt->file_loc.line,
+		     stmt->file_loc.column, ec->not_taken,
+		     ec->taken + ec->not_taken);
+}
+
+static const ast_visitor layout_visitor = {
+    .pre = { [if_ast] = lay_out_if },
+};
+
+// Lay out the if statements of prog (see layout.h)
+void layout_branches(AST *prog, const exec_counts *counts)
+{
+    TRACE_BEGIN("layout");
+    ast_walk(prog->data.program.stmt, &layout_visitor, (void *) counts, 0, 0);
+    TRACE_END();
+}
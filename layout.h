@@ -0,0 +1,22 @@
+#ifndef _LAYOUT_H
+#define _LAYOUT_H
+#include "ast.h"
+#include "exec_counts.h"
+
+// Profile-guided branch layout: each if statement whose else part
+// ran more often than its then part in a profile (see exec_counts.h)
+// gets the opposite condition and its parts swapped, so the part that
+// usually runs comes first, where a backend's code would fall through
+// to it without a jump. A condition using odd has no opposite
+// in PL/0, so its if statement is left alone.
+// Each if statement that is changed is reported to where errors go.
+
+// Requires: prog has passed its scope check (see scope_check.h),
+//           and counts are for prog's file (statements at locations
+//           that counts has nothing for are left alone)
+// Lay out the if statements of prog as above (changing them in place,
+// with new nodes for the conditions that change).
+// If there is no space, bail with an error message.
+extern void layout_branches(AST *prog, const exec_counts *counts);
+
+#endif
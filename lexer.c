@@ -18,15 +18,21 @@
 #include "token.h"
 #include "lexer_output.h"
 #include "utilities.h"
+#include "mem.h"
 
 // Variables associated with lexer 
-int done_flag; 
-unsigned int line; 
-unsigned int column; 
-FILE *file_ptr = NULL; 
-const char *file_name = NULL; 
-char buffer[MAX_IDENT_LENGTH + 1]; 
-char legal_symbols[] = {'>', '<', '(', ')', '*', '+', '-', '/', ':', ';', ',', '.', '='}; 
+// (each thread has its own lexer, so several files can be lexed at once)
+static _Thread_local int done_flag; 
+static _Thread_local unsigned int line; 
+static _Thread_local unsigned int column; 
+static _Thread_local FILE *file_ptr = NULL; 
+static _Thread_local const char *file_name = NULL; 
+static _Thread_local char buffer[MAX_IDENT_LENGTH + 1]; 
+// Number of chars read from the file so far (not counting those put back)
+static _Thread_local unsigned int offset; 
+// Offset in the file of the first char of the last token returned
+static _Thread_local unsigned int token_offset; 
+static const char legal_symbols[] = {'>', '<', '(', ')', '*', '+', '-', '/', ':', ';', ',', '.', '='}; 
 
 // Returns token type for a string input character 
 int string_type(){
@@ -110,18 +116,36 @@ void lexer_open(const char *fname){
     if (fp == NULL){
         bail_with_error("Invalid file name");
     }
+    lexer_open_stream(fp, fname); 
+}
 
+void lexer_open_stream(FILE *fp, const char *fname){
     // Initialize the lexer
     column = 0; 
     line = 1; 
     file_name = fname; 
     file_ptr = fp; 
     done_flag = 0; 
+    offset = 0; 
+    token_offset = 0; 
     buffer_reset(); 
 }
 
+// Requires: the lexer was just opened
+// Make the lexer count lines from line and offsets from offset,
+// as when its file is the part of a bigger file that starts there
+// (at the start of a line)
+void lexer_start_at(unsigned int start_line, unsigned int start_offset){
+    line = start_line; 
+    offset = start_offset; 
+    token_offset = start_offset; 
+}
+
 void lexer_close(){
-    fclose(file_ptr); 
+    if (file_ptr != NULL){
+        fclose(file_ptr); 
+        file_ptr = NULL; 
+    }
 }
 
 bool lexer_done(){
@@ -139,6 +163,10 @@ unsigned int lexer_line(){
     return line; 
 }
 
+unsigned int lexer_offset(){
+    return token_offset; 
+}
+
 unsigned int lexer_column(){
     int len = strlen(buffer); 
     if (len > 0){
@@ -169,10 +197,16 @@ token assemble_token(token_type type){
         new_token.text = NULL; 
     }
     else {
-        new_token.text = (char*) malloc(sizeof(buffer + 1) * sizeof(char)); 
+        new_token.text = (char*) mem_alloc(
+            mem_tokens, (strlen(buffer) + 1) * sizeof(char));
+        if (new_token.text == NULL){
+            bail_with_error("No space for token text!"); 
+        }
         strcpy(new_token.text, buffer); 
     }
     new_token.filename = file_name; 
+    // The buffer holds the token's text (but not at the end of the file)
+    token_offset = (type == eofsym) ? offset : offset - strlen(buffer); 
     buffer_reset(); 
     return new_token; 
 }
@@ -181,6 +215,9 @@ token assemble_token(token_type type){
 char get_character(){
     column++;
     char c = getc(file_ptr);  
+    if (c != EOF){
+        offset++; 
+    }
     buffer_cat(c);
 
     return c;
@@ -188,6 +225,9 @@ char get_character(){
 
 // Pushes a character back to input 
 void put_back(){
+    if (buffer[strlen(buffer) - 1] != EOF){
+        offset--; 
+    }
     ungetc(buffer[strlen(buffer) - 1], file_ptr); 
     buffer[strlen(buffer) - 1] = '\0'; 
     column--; 
@@ -207,6 +247,9 @@ void eat_characters(){
                 line++; 
                 column = 0;  
             }
+            // Remove the whitespace from the buffer, so long runs of it
+            // (e.g., deep indentation) cannot overflow the buffer
+            buffer_reset(); 
         }
         // Handle comments 
         else if (current_char == '#'){  
@@ -219,6 +262,7 @@ void eat_characters(){
                 buffer_reset(); 
             }
             ungetc(current_char, file_ptr); 
+            offset--; 
         }
         else {
             stop_eating = 1; 
@@ -1,6 +1,7 @@
 /* $Id: lexer.h,v 1.2 2023/01/31 06:45:02 leavens Exp $ */
 #ifndef _LEXER_H
 #define _LEXER_H
+#include <stdio.h>
 #include <stdbool.h>
 #include "token.h"
 
@@ -10,8 +11,21 @@
 // from the given file name
 extern void lexer_open(const char *fname);
 
+// Requires: fp != NULL and fp is open for reading
+// Initialize the lexer and start it reading from fp,
+// using fname as the file name in tokens and error messages.
+// The lexer closes fp when it is closed.
+extern void lexer_open_stream(FILE *fp, const char *fname);
+
+// Requires: the lexer was just opened
+// Make the lexer count lines from line and offsets from offset,
+// as when its file is the part of a bigger file that starts there
+// (at the start of a line)
+extern void lexer_start_at(unsigned int line, unsigned int offset);
+
 // Close the file the lexer is working on
 // and make this lexer be done
+// (this does nothing if the file is already closed)
 extern void lexer_close();
 
 // Is the lexer's token stream finished
@@ -34,4 +48,8 @@ extern unsigned int lexer_line();
 // Requires: !lexer_done()
 // Return the column number of the next token
 extern unsigned int lexer_column();
+
+// Return the offset (number of chars from the start of the file)
+// of the first char of the token most recently returned by lexer_next
+extern unsigned int lexer_offset();
 #endif
@@ -0,0 +1,746 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "ast.h"
+#include "ast_walk.h"
+#include "id_attrs.h"
+#include "symbol_table.h"
+#include "exec_counts.h"
+#include "exprs.h"
+#include "temps.h"
+#include "trace.h"
+#include "utilities.h"
+#include "loops.h"
+#include "mem.h"
+
+// The most iterations of a loop that are counted to unroll it
+#define MAX_TRIPS 1024
+// The most statements in the copies of an unrolled loop's body
+#define MAX_UNROLLED_STMTS 256
+
+// An invariant expression hoisted out of the current loop
+typedef struct {
+    AST *exp;
+    const char *temp;       // the temporary that holds its value
+    bool moved;             // whether the temporary's assignment was moved
+} hoisted;
+
+// A value while rewriting an expression:
+// its new AST and whether it is invariant in the current loop
+typedef struct {
+    AST *exp;
+    bool invariant;
+} rewritten;
+
+// The state of optimizing a program's loops
+typedef struct {
+    AST *prog;
+    unsigned int unroll;
+    const exec_counts *counts;  // the profile (or NULL)
+    const_values consts;
+    // the variables changed in the current loop, by offset
+    bool *changed;
+    unsigned int num_changed;
+    // the expressions hoisted out of the current loop
+    hoisted *hoists;
+    size_t num_hoists;
+    size_t hoists_cap;
+    unsigned int next_temp; // for temp_declare (see temps.h)
+    // which offsets are those of the temporaries declared by this pass
+    bool *is_temp;
+    unsigned int temps_size;
+    // the stack of a rewriting walk
+    rewritten *stack;
+    size_t depth;
+    size_t stack_cap;
+} loops_state;
+
+// Callback that marks the variable changed by a statement
+// (in the loops_state context)
+static void mark_changed(ast_walker *w, AST *stmt, int level,
+			 unsigned int flags)
+{
+    loops_state *s = (loops_state *) ast_walk_context(w);
+    const char *name = (stmt->type_tag == assign_ast)
+	? stmt->data.assign_stmt.name : stmt->data.read_stmt.name;
+    id_attrs *attrs = scope_lookup(name);
+    if (attrs != NULL && attrs->offset < s->num_changed) {
+	s->changed[attrs->offset] = true;
+    }
+}
+
+static const ast_visitor changed_visitor = {
+    .pre = { [assign_ast] = mark_changed, [read_ast] = mark_changed },
+};
+
+// Count the statements that change a variable (in the name_count context)
+typedef struct {
+    const char *name;
+    size_t changes;
+    size_t stmts;
+} name_count;
+
+static void count_stmt(ast_walker *w, AST *stmt, int level,
+		       unsigned int flags)
+{
+    name_count *nc = (name_count *) ast_walk_context(w);
+    nc->stmts++;
+    const char *name = NULL;
+    if (stmt->type_tag == assign_ast) {
+	name = stmt->data.assign_stmt.name;
+    } else if (stmt->type_tag == read_ast) {
+	name = stmt->data.read_stmt.name;
+    }
+    if (name != NULL && strcmp(name, nc->name) == 0) {
+	nc->changes++;
+    }
+}
+
+static const ast_visitor count_visitor = {
+    .pre = {
+	[assign_ast] = count_stmt,
+	[begin_ast] = count_stmt,
+	[if_ast] = count_stmt,
+	[while_ast] = count_stmt,
+	[read_ast] = count_stmt,
+	[write_ast] = count_stmt,
+	[skip_ast] = count_stmt,
+    },
+};
+
+// Push r onto the walk stack of s
+static void push(loops_state *s, AST *exp, bool invariant)
+{
+    if (s->depth == s->stack_cap) {
+	s->stack_cap = (s->stack_cap == 0) ? 64 : 2 * s->stack_cap;
+	s->stack = (rewritten *) mem_realloc(mem_optimizer, s->stack,
+					 s->stack_cap * sizeof(rewritten));
+	if (s->stack == NULL) {
+	    bail_with_error("No space to optimize loops!");
+	}
+    }
+    s->stack[s->depth].exp = exp;
+    s->stack[s->depth].invariant = invariant;
+    s->depth++;
+}
+
+// Note that the temporary temp holds the value of exp (hoisted out
+// of the current loop), where moved tells if its assignment was moved
+// out of the loop (instead of made by hoisting exp)
+static void add_hoist(loops_state *s, AST *exp, const char *temp,
+		      bool moved)
+{
+    if (s->num_hoists == s->hoists_cap) {
+	s->hoists_cap = (s->hoists_cap == 0) ? 8 : 2 * s->hoists_cap;
+	s->hoists = (hoisted *) mem_realloc(mem_optimizer, s->hoists,
+					s->hoists_cap * sizeof(hoisted));
+	if (s->hoists == NULL) {
+	    bail_with_error("No space to optimize loops!");
+	}
+    }
+    s->hoists[s->num_hoists].exp = exp;
+    s->hoists[s->num_hoists].temp = temp;
+    s->hoists[s->num_hoists].moved = moved;
+    s->num_hoists++;
+}
+
+// Return the temporary that holds the value of exp (an invariant
+// operation), hoisting exp out of the current loop if it is new
+static const char *hoist(loops_state *s, AST *exp)
+{
+    for (size_t i = 0; i < s->num_hoists; i++) {
+	if (expr_same(s->hoists[i].exp, exp)) {
+	    return s->hoists[i].temp;
+	}
+    }
+    const char *temp = temp_declare(s->prog, "inv", &s->next_temp);
+    add_hoist(s, exp, temp, false);
+    unsigned int ofst = scope_lookup(temp)->offset;
+    if (ofst >= s->temps_size) {
+	unsigned int size = 2 * ofst + 64;
+	s->is_temp = (bool *) mem_realloc(
+	    mem_optimizer, s->is_temp, size * sizeof(bool));
+	if (s->is_temp == NULL) {
+	    bail_with_error("No space to optimize loops!");
+	}
+	memset(s->is_temp + s->temps_size, 0,
+	       (size - s->temps_size) * sizeof(bool));
+	s->temps_size = size;
+    }
+    s->is_temp[ofst] = true;
+    return temp;
+}
+
+// Return r's expression, or (if it is an invariant operation
+// whose value is not known when compiling) the name of a temporary
+// holding its value
+static AST *use_hoisted(loops_state *s, rewritten r)
+{
+    long v;
+    if (!r.invariant || r.exp->type_tag != bin_expr_ast
+	|| expr_eval(&s->consts, r.exp, NULL, 0, &v)) {
+	return r.exp;
+    }
+    return ast_ident(file_loc2token(r.exp->file_loc), hoist(s, r.exp));
+}
+
+// Callbacks for hoisting the invariant operations of an expression,
+// which push the rewritten value of each node
+static void hoist_ident(ast_walker *w, AST *exp, int level,
+			unsigned int flags)
+{
+    loops_state *s = (loops_state *) ast_walk_context(w);
+    id_attrs *attrs = scope_lookup(exp->data.ident.name);
+    push(s, exp, attrs != NULL && (attrs->offset >= s->num_changed
+				   || !s->changed[attrs->offset]));
+}
+
+static void hoist_number(ast_walker *w, AST *exp, int level,
+			 unsigned int flags)
+{
+    push((loops_state *) ast_walk_context(w), exp, true);
+}
+
+static void hoist_bin_expr(ast_walker *w, AST *exp, int level,
+			   unsigned int flags)
+{
+    loops_state *s = (loops_state *) ast_walk_context(w);
+    rewritten r2 = s->stack[--s->depth];
+    rewritten r1 = s->stack[--s->depth];
+    AST *divisor = r2.exp;
+    if (r1.invariant && r2.invariant
+	&& (exp->data.bin_expr.arith_op != divop
+	    || (divisor->type_tag == number_ast
+		&& divisor->data.number.value != 0))) {
+	// still invariant, so it may be part of a larger invariant
+	push(s, exp, true);
+	return;
+    }
+    AST *e1 = use_hoisted(s, r1);
+    AST *e2 = use_hoisted(s, r2);
+    if (e1 == exp->data.bin_expr.leftexp && e2 == exp->data.bin_expr.rightexp) {
+	push(s, exp, false);
+    } else {
+	push(s, ast_bin_expr(file_loc2token(exp->file_loc), e1,
+			     exp->data.bin_expr.arith_op, e2), false);
+    }
+}
+
+static const ast_visitor hoist_visitor = {
+    .post = {
+	[ident_ast] = hoist_ident,
+	[number_ast] = hoist_number,
+	[bin_expr_ast] = hoist_bin_expr,
+    },
+};
+
+// Return exp with its invariant operations replaced by temporaries
+static AST *hoist_expr(loops_state *s, AST *exp)
+{
+    s->depth = 0;
+    ast_walk(exp, &hoist_visitor, s, 0, 0);
+    return use_hoisted(s, s->stack[0]);
+}
+
+// Return the condition cond with its invariant operations hoisted
+static AST *hoist_cond(loops_state *s, AST *cond)
+{
+    token t = file_loc2token(cond->file_loc);
+    if (cond->type_tag == odd_cond_ast) {
+	AST *e = hoist_expr(s, cond->data.odd_cond.exp);
+	return (e == cond->data.odd_cond.exp) ? cond : ast_odd_cond(t, e);
+    }
+    AST *e1 = hoist_expr(s, cond->data.bin_cond.leftexp);
+    AST *e2 = hoist_expr(s, cond->data.bin_cond.rightexp);
+    if (e1 == cond->data.bin_cond.leftexp
+	&& e2 == cond->data.bin_cond.rightexp) {
+	return cond;
+    }
+    return ast_bin_cond(t, e1, cond->data.bin_cond.relop, e2);
+}
+
+// Return stmt with the invariant operations in it (and the statements
+// in it) hoisted; an assignment or write whose expression changes
+// is a new statement, as the file locations of a shared expression's
+// occurrences are kept under the statement it was parsed in (see ast.h)
+static AST *hoist_stmt(loops_state *s, AST *stmt)
+{
+    token t = file_loc2token(stmt->file_loc);
+    switch (stmt->type_tag) {
+    case assign_ast: {
+	AST *e = hoist_expr(s, stmt->data.assign_stmt.exp);
+	if (e != stmt->data.assign_stmt.exp) {
+	    return ast_assign_stmt(t, stmt->data.assign_stmt.name, e);
+	}
+	return stmt;
+    }
+    case write_ast: {
+	AST *e = hoist_expr(s, stmt->data.write_stmt.exp);
+	if (e != stmt->data.write_stmt.exp) {
+	    return ast_write_stmt(t, e);
+	}
+	return stmt;
+    }
+    case begin_ast: {
+	AST_list ret = ast_list_empty_list();
+	AST *last = NULL;
+	AST_list stmts = stmt->data.begin_stmt.stmts;
+	while (!ast_list_is_empty(stmts)) {
+	    AST *cur = ast_list_first(stmts);
+	    stmts = ast_list_rest(stmts);
+	    AST *done = hoist_stmt(s, cur);
+	    done->next = NULL;
+	    if (ast_list_is_empty(ret)) {
+		ret = done;
+	    } else {
+		ast_list_splice(last, done);
+	    }
+	    last = done;
+	}
+	stmt->data.begin_stmt.stmts = ret;
+	return stmt;
+    }
+    case if_ast:
+	stmt->data.if_stmt.cond = hoist_cond(s, stmt->data.if_stmt.cond);
+	stmt->data.if_stmt.thenstmt = hoist_stmt(s,
+						 stmt->data.if_stmt.thenstmt);
+	stmt->data.if_stmt.elsestmt = hoist_stmt(s,
+						 stmt->data.if_stmt.elsestmt);
+	return stmt;
+    case while_ast:
+	stmt->data.while_stmt.cond = hoist_cond(s, stmt->data.while_stmt.cond);
+	stmt->data.while_stmt.stmt = hoist_stmt(s, stmt->data.while_stmt.stmt);
+	return stmt;
+    default:
+	return stmt;
+    }
+}
+
+// Append the statement stmt to the list whose first element is *first
+// and whose last is *last
+static void append(AST_list *first, AST **last, AST *stmt)
+{
+    stmt->next = NULL;
+    if (ast_list_is_empty(*first)) {
+	*first = stmt;
+    } else {
+	ast_list_splice(*last, stmt);
+    }
+    *last = stmt;
+}
+
+// Report the transformation of loop (described by fmt, as for printf)
+static void report(AST *loop, const char *fmt, ...);
+
+// Note whether an expression uses a variable changed in the current
+// loop (in the variance context)
+typedef struct {
+    loops_state *s;
+    bool variant;
+} variance;
+
+static void note_variant(ast_walker *w, AST *exp, int level,
+			 unsigned int flags)
+{
+    variance *v = (variance *) ast_walk_context(w);
+    id_attrs *attrs = scope_lookup(exp->data.ident.name);
+    if (attrs == NULL || (attrs->offset < v->s->num_changed
+			  && v->s->changed[attrs->offset])) {
+	v->variant = true;
+    }
+}
+
+static const ast_visitor variance_visitor = {
+    .pre = { [ident_ast] = note_variant },
+};
+
+// Return true just when stmt assigns a temporary of this pass
+// a value that is invariant in the current loop
+// (as when an inner loop's invariant is also the outer loop's)
+static bool invariant_temp_def(loops_state *s, AST *stmt)
+{
+    if (stmt->type_tag != assign_ast) {
+	return false;
+    }
+    id_attrs *attrs = scope_lookup(stmt->data.assign_stmt.name);
+    if (attrs->offset >= s->temps_size || !s->is_temp[attrs->offset]) {
+	return false;
+    }
+    variance v = { s, false };
+    ast_walk(stmt->data.assign_stmt.exp, &variance_visitor, &v, 0, 0);
+    return !v.variant && !expr_may_fail(stmt->data.assign_stmt.exp);
+}
+
+// Move the statements at the top level of loop's body that assign
+// the temporaries of this pass invariant values to the list from
+// *first to *last, and return the number moved
+static size_t move_temp_defs(loops_state *s, AST *loop, AST_list *first,
+			     AST **last)
+{
+    AST *body = loop->data.while_stmt.stmt;
+    if (body->type_tag != begin_ast) {
+	if (!invariant_temp_def(s, body)) {
+	    return 0;
+	}
+	loop->data.while_stmt.stmt = ast_skip_stmt(
+	    file_loc2token(body->file_loc));
+	append(first, last, body);
+	add_hoist(s, body->data.assign_stmt.exp, body->data.assign_stmt.name,
+		  true);
+	return 1;
+    }
+    size_t moved = 0;
+    AST_list kept = ast_list_empty_list();
+    AST *last_kept = NULL;
+    AST_list stmts = body->data.begin_stmt.stmts;
+    while (!ast_list_is_empty(stmts)) {
+	AST *stmt = ast_list_first(stmts);
+	stmts = ast_list_rest(stmts);
+	if (invariant_temp_def(s, stmt)) {
+	    append(first, last, stmt);
+	    add_hoist(s, stmt->data.assign_stmt.exp,
+		      stmt->data.assign_stmt.name, true);
+	    moved++;
+	} else {
+	    append(&kept, &last_kept, stmt);
+	}
+    }
+    if (ast_list_is_empty(kept)) {
+	kept = ast_skip_stmt(file_loc2token(body->file_loc));
+    }
+    body->data.begin_stmt.stmts = kept;
+    return moved;
+}
+
+// Mark the variables changed in loop's body as the current loop's
+static void find_changed(loops_state *s, AST *loop)
+{
+    mem_free(s->changed);
+    s->num_changed = scope_size() + 1;
+    s->changed = (bool *) mem_calloc(
+	mem_optimizer, s->num_changed, sizeof(bool));
+    if (s->changed == NULL) {
+	bail_with_error("No space to optimize loops!");
+    }
+    ast_walk(loop->data.while_stmt.stmt, &changed_visitor, s, 0, 0);
+}
+
+// Requires: loop is a while statement whose inner loops are optimized
+// Hoist the invariant operations of loop, appending their temporaries'
+// assignments to the list from *first to *last
+static void hoist_loop(loops_state *s, AST *loop, AST_list *first,
+		       AST **last)
+{
+    find_changed(s, loop);
+    s->num_hoists = 0;
+    size_t moved = move_temp_defs(s, loop, first, last);
+    if (moved > 0) {
+	// the temporaries moved out are no longer changed in the loop
+	find_changed(s, loop);
+    }
+    loop->data.while_stmt.cond = hoist_cond(s, loop->data.while_stmt.cond);
+    loop->data.while_stmt.stmt = hoist_stmt(s, loop->data.while_stmt.stmt);
+    for (size_t i = 0; i < s->num_hoists; i++) {
+	AST *exp = s->hoists[i].exp;
+	if (s->hoists[i].moved) {
+	    continue;
+	}
+	append(first, last, ast_assign_stmt(file_loc2token(exp->file_loc),
+					    s->hoists[i].temp, exp));
+    }
+    size_t hoisted = s->num_hoists;
+    if (hoisted > 0) {
+	report(loop, "hoisted %zu invariant expression%s", hoisted,
+	       (hoisted == 1) ? "" : "s");
+    }
+    mem_free(s->changed);
+    s->changed = NULL;
+    s->num_changed = 0;
+}
+
+// Return a copy of the statement stmt (and the statements in it),
+// which shares its expressions and conditions
+static AST *copy_stmt(AST *stmt)
+{
+    token t = file_loc2token(stmt->file_loc);
+    switch (stmt->type_tag) {
+    case assign_ast:
+	return ast_assign_stmt(t, stmt->data.assign_stmt.name,
+			       stmt->data.assign_stmt.exp);
+    case read_ast:
+	return ast_read_stmt(t, stmt->data.read_stmt.name);
+    case write_ast:
+	return ast_write_stmt(t, stmt->data.write_stmt.exp);
+    case begin_ast: {
+	AST_list first = ast_list_empty_list();
+	AST *last = NULL;
+	for (AST_list stmts = stmt->data.begin_stmt.stmts;
+	     !ast_list_is_empty(stmts); stmts = ast_list_rest(stmts)) {
+	    append(&first, &last, copy_stmt(ast_list_first(stmts)));
+	}
+	return ast_begin_stmt(t, first);
+    }
+    case if_ast:
+	return ast_if_stmt(t, stmt->data.if_stmt.cond,
+			   copy_stmt(stmt->data.if_stmt.thenstmt),
+			   copy_stmt(stmt->data.if_stmt.elsestmt));
+    case while_ast:
+	return ast_while_stmt(t, stmt->data.while_stmt.cond,
+			      copy_stmt(stmt->data.while_stmt.stmt));
+    default:
+	return ast_skip_stmt(t);
+    }
+}
+
+// Append copies of the top-level statements of body
+// to the list from *first to *last, n times
+static void append_copies(AST *body, size_t n, AST_list *first, AST **last)
+{
+    for (size_t i = 0; i < n; i++) {
+	AST *copy = copy_stmt(body);
+	if (copy->type_tag != begin_ast) {
+	    append(first, last, copy);
+	    continue;
+	}
+	AST_list stmts = copy->data.begin_stmt.stmts;
+	while (!ast_list_is_empty(stmts)) {
+	    AST *next = ast_list_rest(stmts);
+	    append(first, last, stmts);
+	    stmts = next;
+	}
+    }
+}
+
+// Requires: before holds the num_before statements before loop
+//           in the same begin statement
+// If loop runs a number of times known when compiling (see loops.h),
+// put that number in *trips and return true, otherwise return false
+static bool count_trips(loops_state *s, AST *loop, AST **before,
+			size_t num_before, size_t *trips)
+{
+    AST *body = loop->data.while_stmt.stmt;
+    AST_list stmts = (body->type_tag == begin_ast)
+	? body->data.begin_stmt.stmts : ast_list_singleton(body);
+    for (AST_list l = stmts; !ast_list_is_empty(l); l = ast_list_rest(l)) {
+	AST *inc = ast_list_first(l);
+	long step;
+	AST *e = (inc->type_tag == assign_ast) ? inc->data.assign_stmt.exp
+	    : NULL;
+	if (e == NULL || e->type_tag != bin_expr_ast
+	    || e->data.bin_expr.arith_op > subop
+	    || e->data.bin_expr.leftexp->type_tag != ident_ast
+	    || strcmp(e->data.bin_expr.leftexp->data.ident.name,
+		      inc->data.assign_stmt.name) != 0
+	    || !expr_eval(&s->consts, e->data.bin_expr.rightexp, NULL, 0,
+			  &step)) {
+	    continue;
+	}
+	const char *name = inc->data.assign_stmt.name;
+	if (e->data.bin_expr.arith_op == subop) {
+	    step = -step;
+	}
+	name_count nc = { name, 0, 0 };
+	ast_walk(body, &count_visitor, &nc, 0, 0);
+	if (nc.changes != 1) {
+	    continue;
+	}
+	// find the value of name before the loop
+	size_t i = num_before;
+	long value;
+	bool found = false;
+	while (i > 0 && !found) {
+	    AST *prev = before[--i];
+	    if (prev->type_tag == assign_ast
+		&& strcmp(prev->data.assign_stmt.name, name) == 0) {
+		if (!expr_eval(&s->consts, prev->data.assign_stmt.exp, NULL, 0,
+			       &value)) {
+		    return false;
+		}
+		found = true;
+	    } else {
+		name_count prev_nc = { name, 0, 0 };
+		ast_walk(prev, &count_visitor, &prev_nc, 0, 0);
+		if (prev_nc.changes > 0) {
+		    return false;
+		}
+	    }
+	}
+	if (!found) {
+	    return false;
+	}
+	// run the loop's condition and steps
+	for (size_t n = 0; n <= MAX_TRIPS; n++) {
+	    bool b;
+	    if (!cond_eval(&s->consts, loop->data.while_stmt.cond, name, value,
+			   &b)) {
+		return false;
+	    }
+	    if (!b) {
+		*trips = n;
+		return true;
+	    }
+	    value += step;
+	    if (value < SHRT_MIN || SHRT_MAX < value) {
+		return false;
+	    }
+	}
+	return false;
+    }
+    return false;
+}
+
+// Requires: loop is a while statement, and before holds the num_before
+//           statements before it in the same begin statement
+// Unroll loop if it runs a number of times known when compiling,
+// appending the statements that replace it to the list
+// from *first to *last, and return true;
+// otherwise append nothing and return false
+static bool unroll_loop(loops_state *s, AST *loop, AST **before,
+			size_t num_before, AST_list *first, AST **last)
+{
+    size_t trips = 0;
+    if (s->unroll < 2 || !count_trips(s, loop, before, num_before, &trips)
+	|| trips == 0) {
+	return false;
+    }
+    AST *body = loop->data.while_stmt.stmt;
+    name_count nc = { "", 0, 0 };
+    ast_walk(body, &count_visitor, &nc, 0, 0);
+    size_t copies = (trips <= s->unroll) ? trips
+	: s->unroll + trips % s->unroll;
+    if (nc.stmts * copies > MAX_UNROLLED_STMTS) {
+	return false;
+    }
+    const exec_count *ec = (s->counts == NULL) ? NULL
+	: exec_counts_find(s->counts, loop->file_loc);
+    if (ec != NULL && ec->taken < s->unroll) {
+	report(loop, "not unrolled (its body ran %lu time%s when profiled)",
+	       ec->taken, (ec->taken == 1) ? "" : "s");
+	return false;
+    }
+    if (trips <= s->unroll) {
+	append_copies(body, trips, first, last);
+	report(loop, "unrolled fully (%zu iteration%s)", trips,
+	       (trips == 1) ? "" : "s");
+	return true;
+    }
+    append_copies(body, trips % s->unroll, first, last);
+    AST_list stmts = ast_list_empty_list();
+    AST *last_stmt = NULL;
+    append_copies(body, s->unroll, &stmts, &last_stmt);
+    loop->data.while_stmt.stmt = ast_begin_stmt(
+	file_loc2token(body->file_loc), stmts);
+    append(first, last, loop);
+    report(loop, "unrolled by %u (%zu iterations, %zu before the loop)",
+	   s->unroll, trips, trips % s->unroll);
+    return true;
+}
+
+static AST *optimize_stmt(loops_state *s, AST *stmt);
+
+// Requires: loop is a while statement, and before holds the num_before
+//           statements before it in the same begin statement
+// Optimize loop (and its inner loops), appending the statements
+// that replace it to the list from *first to *last
+static void optimize_loop(loops_state *s, AST *loop, AST **before,
+			  size_t num_before, AST_list *first, AST **last)
+{
+    loop->data.while_stmt.stmt = optimize_stmt(s,
+					       loop->data.while_stmt.stmt);
+    hoist_loop(s, loop, first, last);
+    if (!unroll_loop(s, loop, before, num_before, first, last)) {
+	append(first, last, loop);
+    }
+}
+
+// Optimize the loops in stmt, returning the statement that replaces it
+static AST *optimize_stmt(loops_state *s, AST *stmt)
+{
+    switch (stmt->type_tag) {
+    case begin_ast: {
+	// the statements done so far, to find loops' starting values
+	size_t n = 0;
+	for (AST_list l = stmt->data.begin_stmt.stmts; !ast_list_is_empty(l);
+	     l = ast_list_rest(l)) {
+	    n++;
+	}
+	AST **done = (AST **) mem_alloc(mem_optimizer, n * sizeof(AST *));
+	if (done == NULL) {
+	    bail_with_error("No space to optimize loops!");
+	}
+	size_t num_done = 0;
+	AST_list first = ast_list_empty_list();
+	AST *last = NULL;
+	AST_list stmts = stmt->data.begin_stmt.stmts;
+	while (!ast_list_is_empty(stmts)) {
+	    AST *cur = ast_list_first(stmts);
+	    stmts = ast_list_rest(stmts);
+	    if (cur->type_tag == while_ast) {
+		// the statements appended (hoisted assignments, copies)
+		// are not counted as done, as they may not be
+		// simple enough to trace a starting value through
+		optimize_loop(s, cur, done, num_done, &first, &last);
+		num_done = 0;
+	    } else {
+		AST *new_stmt = optimize_stmt(s, cur);
+		append(&first, &last, new_stmt);
+		done[num_done++] = new_stmt;
+	    }
+	}
+	mem_free(done);
+	stmt->data.begin_stmt.stmts = first;
+	return stmt;
+    }
+    case if_ast:
+	stmt->data.if_stmt.thenstmt = optimize_stmt(s,
+						    stmt->data.if_stmt.thenstmt);
+	stmt->data.if_stmt.elsestmt = optimize_stmt(s,
+						    stmt->data.if_stmt.elsestmt);
+	return stmt;
+    case while_ast: {
+	AST_list first = ast_list_empty_list();
+	AST *last = NULL;
+	optimize_loop(s, stmt, NULL, 0, &first, &last);
+	if (first == last) {
+	    return first;
+	}
+	return ast_begin_stmt(file_loc2token(stmt->file_loc), first);
+    }
+    default:
+	return stmt;
+    }
+}
+
+// Report the transformation of loop (described by fmt, as for printf)
+static void report(AST *loop, const char *fmt, ...)
+{
+    char buff[256];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buff, sizeof(buff), fmt, args);
+    va_end(args);
+    diagnostic_print("%s: line %d, column %d: loop %s\n",
+		     loop->file_loc.filename, loop->file_loc.line,
+		     loop->file_loc.column, buff);
+}
+
+// Optimize the loops of prog (see loops.h)
+void loops_optimize(AST *prog, unsigned int unroll,
+		    const exec_counts *counts)
+{
+    TRACE_BEGIN("loops");
+    loops_state s;
+    memset(&s, 0, sizeof(s));
+    s.prog = prog;
+    s.unroll = unroll;
+    s.counts = counts;
+    const_values_init(&s.consts, prog);
+    prog->data.program.stmt = optimize_stmt(&s, prog->data.program.stmt);
+    const_values_free(&s.consts);
+    mem_free(s.hoists);
+    mem_free(s.is_temp);
+    mem_free(s.stack);
+    TRACE_END();
+}
@@ -0,0 +1,41 @@
+#ifndef _LOOPS_H
+#define _LOOPS_H
+#include "ast.h"
+#include "exec_counts.h"
+
+// Loop optimizations for while loops, done innermost loop first:
+//  - Invariant hoisting: each largest operation in a loop's condition
+//    or body whose variables the loop does not change, and whose
+//    evaluation cannot fail (see exprs.h), is computed once before
+//    the loop into a temporary inv1, inv2, ... (see temps.h),
+//    which the loop uses instead (identical operations share one).
+//  - Unrolling: a loop whose body changes a variable i only by one
+//    statement i := i + c (or i - c) at its top level, whose condition
+//    only depends on i and constants, and which follows an assignment
+//    of a constant to i (in the same begin, with no change to i between)
+//    runs a number of times n that is known when compiling.
+//    If n is at most the unrolling factor, the loop is replaced by
+//    n copies of its body; otherwise n mod factor copies are put before
+//    the loop, and its body becomes factor copies of itself
+//    (as long as the copies are not too large).
+//    Given a profile (see exec_counts.h), a loop whose body ran fewer
+//    times than the unrolling factor when profiled is not unrolled,
+//    as the code would grow where little time is spent.
+// Each loop that is transformed is reported to where errors go.
+
+// The unrolling factor used if none is given
+#define LOOPS_DEFAULT_UNROLL 4
+
+// Requires: prog has passed its scope check (see scope_check.h),
+//           the current scope is prog's symbol table, the expression
+//           nodes of prog may be shared (see ast_share_begin in ast.h),
+//           unroll > 0 (1 means not to unroll), and counts is NULL
+//           or a profile of prog's file
+// Optimize the loops of prog (changing its statements in place,
+// but making new nodes for the expressions that change),
+// using the profile counts (if it is not NULL) to choose what to unroll.
+// If there is no space, bail with an error message.
+extern void loops_optimize(AST *prog, unsigned int unroll,
+			   const exec_counts *counts);
+
+#endif
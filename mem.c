@@ -0,0 +1,241 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "mem.h"
+
+// The counts of a subsystem's allocations
+typedef struct {
+    size_t allocations;     // blocks allocated (or resized)
+    size_t bytes;           // bytes allocated (or resized to)
+} mem_counts;
+
+// The current thread's counts, by subsystem
+static _Thread_local mem_counts thread_counts[NUM_MEM_SUBSYSTEMS];
+// Whether the current thread's counts are added to the totals
+// when it ends (see count)
+static _Thread_local bool thread_counted = false;
+// The counts of the threads that have ended, guarded by totals_lock
+static mem_counts totals[NUM_MEM_SUBSYSTEMS];
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+// The key whose destructor adds a thread's counts to the totals
+static pthread_key_t counts_key;
+static pthread_once_t counts_key_once = PTHREAD_ONCE_INIT;
+
+// Whether blocks have headers (see mem_track)
+static bool tracking = false;
+
+// The header in front of each block while memory is tracked
+// (its size keeps the block aligned)
+typedef struct {
+    _Alignas(max_align_t) size_t size;
+    mem_subsystem subsystem;
+} mem_header;
+
+// A subsystem's live blocks and bytes, while memory is tracked
+typedef struct {
+    atomic_size_t blocks;
+    atomic_size_t bytes;
+    atomic_size_t peak_bytes;   // the most bytes has been
+} mem_live;
+
+static mem_live live[NUM_MEM_SUBSYSTEMS];
+
+// (one for each subsystem, in the order of mem_subsystem)
+static const char *subsystem_names[NUM_MEM_SUBSYSTEMS] = {
+    "ast", "tokens", "symbols", "optimizer", "interpreter",
+    "output", "driver", "tools"
+};
+
+// Add the ending thread's counts (see thread_counts) to the totals
+static void add_to_totals(void *counts)
+{
+    mem_counts *c = (mem_counts *) counts;
+    pthread_mutex_lock(&totals_lock);
+    for (int s = 0; s < NUM_MEM_SUBSYSTEMS; s++) {
+	totals[s].allocations += c[s].allocations;
+	totals[s].bytes += c[s].bytes;
+    }
+    pthread_mutex_unlock(&totals_lock);
+}
+
+static void make_counts_key()
+{
+    pthread_key_create(&counts_key, add_to_totals);
+}
+
+// Count an allocation of size bytes for subsystem s in the current thread
+static void count(mem_subsystem s, size_t size)
+{
+    if (!thread_counted) {
+	// the first allocation in this thread
+	pthread_once(&counts_key_once, make_counts_key);
+	pthread_setspecific(counts_key, thread_counts);
+	thread_counted = true;
+    }
+    thread_counts[s].allocations++;
+    thread_counts[s].bytes += size;
+}
+
+// Count size more bytes live in subsystem s (for a block with blocks
+// more blocks, while memory is tracked)
+static void add_live(mem_subsystem s, size_t blocks, size_t size)
+{
+    mem_live *l = &live[s];
+    atomic_fetch_add_explicit(&l->blocks, blocks, memory_order_relaxed);
+    size_t now = atomic_fetch_add_explicit(&l->bytes, size,
+					   memory_order_relaxed) + size;
+    size_t peak = atomic_load_explicit(&l->peak_bytes, memory_order_relaxed);
+    while (now > peak
+	   && !atomic_compare_exchange_weak_explicit(
+		  &l->peak_bytes, &peak, now,
+		  memory_order_relaxed, memory_order_relaxed)) {
+	// peak now holds the latest peak
+    }
+}
+
+// Track each block from now on (see mem.h)
+void mem_track()
+{
+    tracking = true;
+}
+
+// Return a fresh block charged to subsystem s (see mem.h)
+void *mem_alloc(mem_subsystem s, size_t size)
+{
+    count(s, size);
+    if (!tracking) {
+	return malloc(size);
+    }
+    if (size > SIZE_MAX - sizeof(mem_header)) {
+	return NULL;
+    }
+    mem_header *h = (mem_header *) malloc(sizeof(mem_header) + size);
+    if (h == NULL) {
+	return NULL;
+    }
+    h->size = size;
+    h->subsystem = s;
+    add_live(s, 1, size);
+    return h + 1;
+}
+
+// Return a fresh block of zeros charged to subsystem s (see mem.h)
+void *mem_calloc(mem_subsystem s, size_t n, size_t size)
+{
+    if (!tracking) {
+	count(s, n * size);
+	return calloc(n, size);
+    }
+    if (size != 0 && n > SIZE_MAX / size) {
+	return NULL;
+    }
+    void *p = mem_alloc(s, n * size);
+    if (p != NULL) {
+	memset(p, 0, n * size);
+    }
+    return p;
+}
+
+// Resize the block p (see mem.h)
+void *mem_realloc(mem_subsystem s, void *p, size_t size)
+{
+    if (p == NULL) {
+	return mem_alloc(s, size);
+    }
+    if (!tracking) {
+	count(s, size);
+	return realloc(p, size);
+    }
+    if (size > SIZE_MAX - sizeof(mem_header)) {
+	return NULL;
+    }
+    mem_header *h = (mem_header *) p - 1;
+    size_t old_size = h->size;
+    mem_header *moved = (mem_header *) realloc(h, sizeof(mem_header) + size);
+    if (moved == NULL) {
+	return NULL;
+    }
+    count(moved->subsystem, size);
+    atomic_fetch_sub_explicit(&live[moved->subsystem].bytes, old_size,
+			      memory_order_relaxed);
+    add_live(moved->subsystem, 0, size);
+    moved->size = size;
+    return moved + 1;
+}
+
+// Return a fresh copy of str charged to subsystem s (see mem.h)
+char *mem_strdup(mem_subsystem s, const char *str)
+{
+    size_t len = strlen(str) + 1;
+    char *copy = (char *) mem_alloc(s, len);
+    if (copy != NULL) {
+	memcpy(copy, str, len);
+    }
+    return copy;
+}
+
+// Free the block p (see mem.h)
+void mem_free(void *p)
+{
+    if (!tracking || p == NULL) {
+	free(p);
+	return;
+    }
+    mem_header *h = (mem_header *) p - 1;
+    mem_live *l = &live[h->subsystem];
+    atomic_fetch_sub_explicit(&l->blocks, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&l->bytes, h->size, memory_order_relaxed);
+    free(h);
+}
+
+// Return the number of blocks allocated and not yet freed
+size_t mem_live_blocks()
+{
+    size_t blocks = 0;
+    for (int s = 0; s < NUM_MEM_SUBSYSTEMS; s++) {
+	blocks += atomic_load(&live[s].blocks);
+    }
+    return blocks;
+}
+
+// Print a table of each subsystem's memory to f (see mem.h)
+void mem_report(FILE *f)
+{
+    fprintf(f, "Memory:\n");
+    fprintf(f, "  %-12s %12s %14s", "subsystem", "allocations", "bytes");
+    if (tracking) {
+	fprintf(f, " %14s %12s %14s", "peak bytes", "live blocks",
+		"live bytes");
+    }
+    fprintf(f, "\n");
+    size_t allocations = 0, bytes = 0, live_blocks = 0, live_bytes = 0;
+    pthread_mutex_lock(&totals_lock);
+    for (int s = 0; s < NUM_MEM_SUBSYSTEMS; s++) {
+	// the threads that have not ended are this one
+	mem_counts c = totals[s];
+	c.allocations += thread_counts[s].allocations;
+	c.bytes += thread_counts[s].bytes;
+	fprintf(f, "  %-12s %12zu %14zu", subsystem_names[s],
+		c.allocations, c.bytes);
+	if (tracking) {
+	    mem_live *l = &live[s];
+	    fprintf(f, " %14zu %12zu %14zu", atomic_load(&l->peak_bytes),
+		    atomic_load(&l->blocks), atomic_load(&l->bytes));
+	    live_blocks += atomic_load(&l->blocks);
+	    live_bytes += atomic_load(&l->bytes);
+	}
+	fprintf(f, "\n");
+	allocations += c.allocations;
+	bytes += c.bytes;
+    }
+    pthread_mutex_unlock(&totals_lock);
+    fprintf(f, "  %-12s %12zu %14zu", "total", allocations, bytes);
+    if (tracking) {
+	// (the subsystems' peaks need not have been at the same time)
+	fprintf(f, " %14s %12zu %14zu", "", live_blocks, live_bytes);
+    }
+    fprintf(f, "\n");
+}
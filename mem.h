@@ -0,0 +1,72 @@
+#ifndef _MEM_H
+#define _MEM_H
+#include <stdio.h>
+#include <stddef.h>
+
+// The compiler's allocator: every block of memory the compiler's modules
+// allocate comes from the functions below (instead of malloc and free),
+// each charged to a subsystem, so the memory each subsystem uses
+// can be reported (see mem_report).
+// Each thread counts the blocks and bytes it allocates for each subsystem
+// in counters of its own, so counting takes no locks, and blocks
+// are plain malloc blocks. Only when memory is tracked (see mem_track)
+// does each block have a small header with its size and subsystem,
+// so the live blocks and bytes of each subsystem (and their peaks)
+// are known too. Each module frees the memory it allocates, so when
+// a process that embeds the compiler is done with it, no blocks are live.
+// The functions are safe to call from several threads.
+
+// The subsystems that memory is charged to
+typedef enum {
+    mem_ast,            // AST nodes and walks (ast.c, ast_walk.c, ...)
+    mem_tokens,         // the lexer's tokens and token arrays
+    mem_symbols,        // symbol tables, id_attrs and the scope checker
+    mem_optimizer,      // the optimizations and their analyses
+    mem_interpreter,    // the interpreter and execution counts
+    mem_output,         // output sinks
+    mem_driver,         // the driver, batches, the server and the cache
+    mem_tools           // statistics, tracing and profiling
+} mem_subsystem;
+
+// Number of subsystems (for tables indexed by mem_subsystem)
+#define NUM_MEM_SUBSYSTEMS (mem_tools + 1)
+
+// Requires: no block has been allocated yet and no other thread is running
+// Track each block allocated from now on (see above), e.g., to report
+// the memory each subsystem still holds at the end (see mem_report)
+extern void mem_track();
+
+// Return a fresh block of size bytes charged to subsystem s
+// (or NULL if there is no space, like malloc)
+extern void *mem_alloc(mem_subsystem s, size_t size);
+
+// Return a fresh block of n elements of size bytes each, set to zeros,
+// charged to subsystem s (or NULL if there is no space, like calloc)
+extern void *mem_calloc(mem_subsystem s, size_t n, size_t size);
+
+// Requires: p is NULL or a block from these functions that is not freed
+// Resize the block p to size bytes (or, if p is NULL, allocate it,
+// charged to subsystem s), and return the block (which may have moved);
+// if there is no space, return NULL (and p is unchanged), like realloc
+extern void *mem_realloc(mem_subsystem s, void *p, size_t size);
+
+// Return a fresh copy of the string str charged to subsystem s
+// (or NULL if there is no space, like strdup)
+extern char *mem_strdup(mem_subsystem s, const char *str);
+
+// Requires: p is NULL or a block from these functions that is not freed
+// Free the block p (doing nothing if p is NULL)
+extern void mem_free(void *p);
+
+// Return the number of blocks allocated and not yet freed
+// (0 if memory is not tracked)
+extern size_t mem_live_blocks();
+
+// Requires: no other thread is running
+// Print a table of each subsystem's allocations and the bytes it has
+// allocated (counting each resize as an allocation of the new size),
+// with, if memory is tracked, its peak live bytes and the blocks
+// and bytes it still has, to f
+extern void mem_report(FILE *f);
+
+#endif
@@ -7,11 +7,28 @@
 #include "id_attrs.h"
 #include "utilities.h"
 #include "ast.h"
+#include "token_array.h"
+#include "token_ring.h"
 #include "parser.h"
+#include "stats.h"
+#include "sampler.h"
+#include "trace.h"
 
 #define CAN_BEGIN_STMT 7
 
-static token tok;
+// The current token (each thread has its own parser)
+static _Thread_local token tok;
+// The tokens the parser is reading, if it is not reading from the lexer
+// (see parser_open_array), and the index of the next one to read
+static _Thread_local const token_array *tokens = NULL;
+static _Thread_local size_t next_index;
+// The ring the parser is reading, if a lexer thread is feeding it
+// (see parser_open_pipelined)
+static _Thread_local token_ring *ring = NULL;
+// The function to call after each statement is parsed from a token array
+// (see parser_on_stmt) and its argument
+static _Thread_local parser_stmt_fn stmt_fn = NULL;
+static _Thread_local void *stmt_fn_arg = NULL;
 static char relationals[][3] = {"=", "<>", "<", "<=", ">", ">=" }; 
 static token_type begin_stmt_tokens[] = {identsym, beginsym, ifsym, whilesym, readsym, writesym, skipsym}; 
 
@@ -24,18 +41,133 @@ static rel_op get_rel_op(char *op){
     return -1; 
 }
 
+// Give the text of t, a token from the lexer (or the parser's ring),
+// to the current AST store, as the AST may keep it, and return t
+static token adopted(token t){
+    if (t.text != NULL) {
+        ast_store_adopt(t.text);
+    }
+    return t;
+}
+
+// Return the next token from the lexer (or the parser's array of tokens,
+// or its ring of tokens)
+// (timing and counting it, if statistics are being collected or sampled;
+// it is not traced, as a span per token would swamp the trace, so lexing
+// is part of the parse span, or a span of its own with --prelex)
+static token next_token(){
+    if (ring != NULL) {
+        return adopted(token_ring_next(ring));
+    }
+    if (tokens != NULL) {
+        if (next_index == token_array_length(tokens)) {
+            // this is where the lexer stopped with an error
+            error_reraise(token_array_error(tokens));
+        }
+        return token_array_get(tokens, next_index++);
+    }
+    if (!stats_enabled() && !sampler_active) {
+        return adopted(lexer_next());
+    }
+    stats_timer t;
+    stats_timer_start(&t, phase_lex);
+    SAMPLE_BEGIN("lexer_next");
+    token ret = lexer_next();
+    SAMPLE_END();
+    stats_timer_stop(&t);
+    stats_count_tokens(1);
+    return adopted(ret);
+}
+
 void parser_open(const char *filename){
     lexer_open(filename);
-    tok = lexer_next();
+    tok = next_token();
+}
+
+void parser_open_stream(FILE *fp, const char *filename){
+    lexer_open_stream(fp, filename);
+    tok = next_token();
+}
+
+// Start the parser reading the tokens in the array toks
+// instead of reading a file with the lexer,
+// so it can look ahead any number of tokens (see parser_peek)
+void parser_open_array(const token_array *toks){
+    parser_open_array_at(toks, 0);
+}
+
+// Requires: index < token_array_length(toks)
+// Start the parser reading the tokens in the array toks
+// from the one at the given index (e.g., to parse one statement again)
+void parser_open_array_at(const token_array *toks, size_t index){
+    tokens = toks;
+    next_index = index;
+    tok = next_token();
+}
+
+// Requires: the parser is reading a token array
+// Return the index in the array of the current token
+size_t parser_index(){
+    return next_index - 1;
+}
+
+// Make the parser call fn(stmt, first, end, arg) after it parses
+// each statement stmt from a token array, where the statement's tokens
+// are those with indexes first, ..., end-1 (stop if fn is NULL)
+void parser_on_stmt(parser_stmt_fn fn, void *arg){
+    stmt_fn = fn;
+    stmt_fn_arg = arg;
+}
+
+// Requires: fp is open for reading
+// Start the parser reading the tokens of fp from a lexer
+// running on another thread (see token_ring.h),
+// using filename as the file name in tokens and messages
+void parser_open_pipelined(FILE *fp, const char *filename){
+    ring = token_ring_start(fp, filename);
+    tok = next_token();
+}
+
+// Requires: the parser is reading a token array, or k == 0
+// Return the token k tokens after the current token
+// (the last token read, if there are not that many)
+token parser_peek(unsigned int k){
+    if (k == 0 || tokens == NULL) {
+        return tok;
+    }
+    size_t i = next_index - 1 + k;
+    size_t len = token_array_length(tokens);
+    return token_array_get(tokens, (i < len) ? i : len - 1);
 }
 
 void parser_close(){
-    lexer_close();
+    if (ring != NULL) {
+        token_ring_stop(ring);
+        ring = NULL;
+    }
+    else if (tokens != NULL) {
+        tokens = NULL;
+    }
+    else {
+        lexer_close();
+    }
+}
+
+// Are there no more tokens for the parser?
+static bool tokens_done(){
+    if (ring != NULL) {
+        return token_ring_done(ring);
+    }
+    if (tokens != NULL) {
+        return next_index >= token_array_length(tokens)
+            && token_array_error(tokens) == NULL;
+    }
+    return lexer_done();
 }
 
 static void advance(){
-    if (!lexer_done()) {
-	    tok = lexer_next();
+    if (!tokens_done()) {
+	    tok = next_token();
     }
 }
 
@@ -90,11 +222,12 @@ AST *parse_paren_expr(){
     eat(lparensym);
     AST *ret = parse_expression();
     eat(rparensym);
-    ret->file_loc = token2file_loc(left_par);
+    ast_relocate(ret, token2file_loc(left_par));
     return ret;
 }
 
 AST *parse_factor(){
+    SAMPLE_BEGIN("parse_factor");
     AST *exp = NULL; 
 
     switch(tok.typ){
@@ -110,12 +243,17 @@ AST *parse_factor(){
         case (numbersym): 
             exp = parse_num_expr();
             break; 
-        case (lparensym): 
-            exp = parse_paren_expr(); 
-            break; 
-        default: 
-            break; 
-    } 
+        case (lparensym):
+            exp = parse_paren_expr();
+            break;
+        default: {
+            token_type expected[] = {identsym, plussym, minussym,
+                                     numbersym, lparensym};
+            parse_error_unexpected(expected, 5, tok);
+            break;
+        }
+    }
+    SAMPLE_END();
     return exp; 
 }
 
@@ -167,6 +305,7 @@ AST *parse_mult_div_factor(){
 }
 
 AST *parse_term(){
+    SAMPLE_BEGIN("parse_term");
     token first = tok; 
     AST *factor = parse_factor(); 
     while (tok.typ == multsym || tok.typ == divsym) {
@@ -174,28 +313,34 @@ AST *parse_term(){
 	    factor = ast_bin_expr(first, factor, rght->data.op_expr.arith_op, rght->data.op_expr.exp);
     }
 
+    SAMPLE_END();
     return factor; 
 }
 
 AST *parse_expression(){
+    TRACE_BEGIN("parse_expression");
     token fst = tok;
     AST *exp = parse_term();
     while (tok.typ == plussym || tok.typ == minussym) {
 	    AST *rght = parse_add_sub_term();
 	    exp = ast_bin_expr(fst, exp, rght->data.op_expr.arith_op, rght->data.op_expr.exp);
     }
+    TRACE_END();
     return exp;
 }
 
 AST *parse_becomes_stmt(){
+    SAMPLE_BEGIN("parse_becomes_stmt");
     token ident_tok = tok; 
     eat(identsym); 
     eat(becomessym); 
     AST *exp = parse_expression(); 
+    SAMPLE_END();
     return ast_assign_stmt(ident_tok, ident_tok.text, exp); 
 }
 
 AST *parse_begin_stmt(){
+    SAMPLE_BEGIN("parse_begin_stmt");
     token begin_tok = tok;
     eat(beginsym);
     AST_list stmts = ast_list_singleton(parse_stmt());
@@ -208,25 +353,31 @@ AST *parse_begin_stmt(){
     }
     eat(endsym);
     AST *ret = ast_begin_stmt(begin_tok, stmts);
+    SAMPLE_END();
     return ret;
 }
 
 AST *parse_read_stmt(){
+    SAMPLE_BEGIN("parse_read_stmt");
     token rt = tok;
     eat(readsym);
     const char *name = tok.text;
     eat(identsym);
+    SAMPLE_END();
     return ast_read_stmt(rt, name);
 }
 
 AST *parse_write_stmt(){
+    SAMPLE_BEGIN("parse_write_stmt");
     token wt = tok;
     eat(writesym);
     AST *exp = parse_expression();
+    SAMPLE_END();
     return ast_write_stmt(wt, exp);
 }
 
 AST *parse_if_stmt(){
+    SAMPLE_BEGIN("parse_if_stmt");
     token if_tok = tok;
     eat(ifsym);
     AST *if_cond = parse_condition();
@@ -234,6 +385,7 @@ AST *parse_if_stmt(){
     AST *then_stmt = parse_stmt();
     eat(elsesym); 
     AST *else_stmt = parse_stmt(); 
+    SAMPLE_END();
     return ast_if_stmt(if_tok, if_cond, then_stmt, else_stmt);
 }
 
@@ -260,19 +412,23 @@ static bool can_start_exp(token_type tt){
 }
 
 AST *parse_while_stmt(){
+  SAMPLE_BEGIN("parse_while_stmt");
   token while_tok = tok;
   eat(whilesym); 
   AST *cond = parse_condition(); 
   eat(dosym); 
   AST *stmt = parse_stmt(); 
+  SAMPLE_END();
   return ast_while_stmt(while_tok, cond, stmt); 
 }
 
 AST *parse_condition(){
+  SAMPLE_BEGIN("parse_condition");
   if (tok.typ == oddsym){
       token odd_tok = tok; 
       eat(oddsym); 
       AST *exp = parse_expression(); 
+      SAMPLE_END();
       return ast_odd_cond(odd_tok, exp);
   }
   else if (can_start_exp(tok.typ)){
@@ -288,6 +444,7 @@ AST *parse_condition(){
       }
       eat(op_tok.typ); 
       AST *exp2 = parse_expression(); 
+      SAMPLE_END();
       return ast_bin_cond(start_tok, exp1, op, exp2); 
   }
   else {
@@ -295,11 +452,14 @@ AST *parse_condition(){
       parse_error_unexpected(expected, 6, tok);
   }
   // Should never execute
+  SAMPLE_END();
   return (AST *) NULL; 
 }
 
 AST *parse_stmt(){
+    TRACE_BEGIN("parse_stmt");
     AST* ret = NULL;
+    size_t first = (tokens != NULL) ? next_index - 1 : 0;
     switch (tok.typ) {
         case identsym: 
             ret = parse_becomes_stmt(); 
@@ -325,6 +485,10 @@ AST *parse_stmt(){
         default:
             parse_error_unexpected(begin_stmt_tokens, CAN_BEGIN_STMT, tok);
     } 
+    if (stmt_fn != NULL && tokens != NULL) {
+        stmt_fn(ret, first, next_index - 1, stmt_fn_arg);
+    }
+    TRACE_END();
     return ret;
 }
 
@@ -6,10 +6,23 @@
 #include "id_attrs.h"
 #include "utilities.h"
 #include "ast.h"
+#include "token_array.h"
 
 #define NUM_RELATIONALS 6
 
+// Type of the functions called after each statement is parsed
+// (see parser_on_stmt)
+typedef void (*parser_stmt_fn)(AST *stmt, size_t first, size_t end,
+                               void *arg);
+
 extern void parser_open(const char *filename); 
+extern void parser_open_stream(FILE *fp, const char *filename); 
+extern void parser_open_array(const token_array *toks); 
+extern void parser_open_array_at(const token_array *toks, size_t index); 
+extern size_t parser_index(); 
+extern void parser_on_stmt(parser_stmt_fn fn, void *arg); 
+extern void parser_open_pipelined(FILE *fp, const char *filename); 
+extern token parser_peek(unsigned int k); 
 extern void parser_close(); 
 extern AST *parseProgram(); 
 extern AST *parse_skip_stmt(); 
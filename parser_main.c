@@ -7,6 +7,7 @@
 #include "ast.h"
 #include "utilities.h"
 #include "unparser.h"
+#include "sink.h"
 
 int main(int argc, char *argv[]){
     const char *cmdname = argv[0];
@@ -38,7 +39,11 @@ int main(int argc, char *argv[]){
         AST * progast = parseProgram();
         parser_close();
         // unparse to check on the AST
-        unparseProgram(stdout, progast);
+        // (closing the sink flushes it, so the output
+        // comes before any error messages from the checks below)
+        sink *out = sink_file(stdout);
+        unparseProgram(out, progast);
+        sink_close(out);
         
         /*
         // build symbol table and check declarations
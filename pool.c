@@ -0,0 +1,66 @@
+#include <stddef.h>
+#include "utilities.h"
+#include "pool.h"
+
+// Make p an empty pool (see pool.h)
+void pool_init(pool *p, mem_subsystem s, size_t object_size)
+{
+    p->subsystem = s;
+    p->object_size = object_size;
+    p->count = 0;
+    p->first = NULL;
+    p->current = NULL;
+}
+
+// Return a fresh object from p (see pool.h)
+void *pool_alloc(pool *p)
+{
+    pool_slab *s = p->current;
+    if (s == NULL || s->used == POOL_SLAB_OBJECTS) {
+	// go on to the next slab, which is kept after a clear,
+	// or allocate it
+	pool_slab *next = (s == NULL) ? p->first : s->next;
+	if (next == NULL) {
+	    next = (pool_slab *) mem_alloc(p->subsystem, sizeof(pool_slab)
+					   + POOL_SLAB_OBJECTS * p->object_size);
+	    if (next == NULL) {
+		bail_with_error("No space for a pool's slab!");
+	    }
+	    next->next = NULL;
+	    next->used = 0;
+	    if (s == NULL) {
+		p->first = next;
+	    } else {
+		s->next = next;
+	    }
+	}
+	s = next;
+	p->current = s;
+    }
+    p->count++;
+    return pool_slab_object(p, s, s->used++);
+}
+
+// Make p empty, keeping its slabs (see pool.h)
+void pool_clear(pool *p)
+{
+    for (pool_slab *s = p->first; s != NULL && s->used > 0; s = s->next) {
+	s->used = 0;
+    }
+    p->count = 0;
+    p->current = NULL;
+}
+
+// Free all of p's slabs (see pool.h)
+void pool_release(pool *p)
+{
+    pool_slab *s = p->first;
+    while (s != NULL) {
+	pool_slab *next = s->next;
+	mem_free(s);
+	s = next;
+    }
+    p->count = 0;
+    p->first = NULL;
+    p->current = NULL;
+}
@@ -0,0 +1,55 @@
+#ifndef _POOL_H
+#define _POOL_H
+#include <stddef.h>
+#include "mem.h"
+
+// A pool of objects that all have the same size, allocated in slabs
+// of POOL_SLAB_OBJECTS objects (see mem.h), so small objects do not each
+// need a block of their own. The objects are kept contiguously in each
+// slab, in the order they were allocated, so all of them can be visited
+// with a linear sweep (see the loop below), and they are all freed
+// together (by pool_clear or pool_release), not one at a time.
+// The slabs are visited in order by:
+//
+//    for (pool_slab *s = p->first; s != NULL && s->used > 0; s = s->next)
+//        for (size_t i = 0; i < s->used; i++)
+//            ... pool_slab_object(p, s, i) ...
+
+// Number of objects in each slab
+#define POOL_SLAB_OBJECTS 256
+
+// A slab of a pool's objects (the first used of which are in use)
+typedef struct pool_slab_s {
+    struct pool_slab_s *next;
+    size_t used;
+    _Alignas(max_align_t) char objects[];
+} pool_slab;
+
+typedef struct {
+    mem_subsystem subsystem;  // that the slabs are charged to
+    size_t object_size;
+    size_t count;             // number of objects allocated
+    pool_slab *first;         // NULL if no slabs are allocated
+    pool_slab *current;       // the slab that objects come from
+} pool;
+
+// Return (a pointer to) the ith object in the slab s of pool p
+#define pool_slab_object(p, s, i) \
+    ((void *) ((s)->objects + (i) * (p)->object_size))
+
+// Make p an empty pool of objects of object_size bytes,
+// whose slabs are charged to subsystem s (none are allocated yet)
+extern void pool_init(pool *p, mem_subsystem s, size_t object_size);
+
+// Return (a pointer to) a fresh object from p (not initialized),
+// after all the objects allocated from p since it was last cleared.
+// If there is no space, bail with an error message.
+extern void *pool_alloc(pool *p);
+
+// Make p empty, keeping its slabs for the objects allocated next
+extern void pool_clear(pool *p);
+
+// Free all of p's slabs (and so its objects), making p empty
+extern void pool_release(pool *p);
+
+#endif
@@ -0,0 +1,426 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "ast.h"
+#include "ast_walk.h"
+#include "id_attrs.h"
+#include "symbol_table.h"
+#include "trace.h"
+#include "utilities.h"
+#include "regalloc.h"
+#include "mem.h"
+
+// The registers that are allocated, in the order they are used
+// (rsp and rbp are for the stack, rax and rdx for division)
+static const char *const register_names[REGALLOC_MAX_REGISTERS] = {
+    "rbx", "rcx", "rsi", "rdi", "r8", "r9",
+    "r10", "r11", "r12", "r13", "r14", "r15",
+};
+
+// A use in a loop weighs LOOP_WEIGHT times as much as one just outside,
+// up to a depth of MAX_WEIGHT_DEPTH
+#define LOOP_WEIGHT 8
+#define MAX_WEIGHT_DEPTH 6
+
+// Where an interval lives when it has no register
+#define SPILLED (-1)
+
+// The live interval of a variable or an expression temporary
+typedef struct {
+    const char *name;       // NULL for an expression temporary
+    unsigned int start;     // the first number at which it is live
+    unsigned int end;       // the last number at which it is live
+    unsigned long weight;   // the sum of its uses' weights
+    unsigned int uses;      // the number of places it is used or changed
+    int reg;                // its register's index, or SPILLED
+} interval;
+
+// A while loop's numbers (from its condition to the end of its body)
+typedef struct {
+    unsigned int start;
+    unsigned int end;
+} loop_span;
+
+// The state of allocating registers for a program
+typedef struct {
+    AST *prog;
+    unsigned int registers;
+    unsigned int pos;       // the number of the current statement
+    unsigned int depth;     // the loop depth of the current statement
+    unsigned long weight;   // the weight of a use at that depth
+    interval *vars;         // the variables' intervals, by offset
+    size_t num_vars;
+    // the intervals of the expression temporaries, in order
+    interval *temps;
+    size_t num_temps;
+    size_t temps_cap;
+    // the while loops, in the order of their conditions
+    loop_span *loops;
+    size_t num_loops;
+    size_t loops_cap;
+    // the stack of Sethi-Ullman numbers while numbering an expression
+    unsigned int *stack;
+    size_t su_depth;
+    size_t stack_cap;
+} regalloc_state;
+
+// Note a use of (or change to) the variable name at the current number
+static void note_use(regalloc_state *s, const char *name)
+{
+    id_attrs *attrs = scope_lookup(name);
+    if (attrs == NULL || attrs->kind != variable) {
+	return;
+    }
+    interval *iv = &s->vars[attrs->offset];
+    if (iv->uses == 0) {
+	iv->name = name;
+	iv->start = s->pos;
+    }
+    iv->end = s->pos;
+    iv->weight += s->weight;
+    iv->uses++;
+}
+
+// Push the Sethi-Ullman number n onto the stack of s
+static void push(regalloc_state *s, unsigned int n)
+{
+    if (s->su_depth == s->stack_cap) {
+	s->stack_cap = (s->stack_cap == 0) ? 64 : 2 * s->stack_cap;
+	s->stack = (unsigned int *) mem_realloc(mem_optimizer, s->stack,
+					    s->stack_cap * sizeof(unsigned int));
+	if (s->stack == NULL) {
+	    bail_with_error("No space to allocate registers!");
+	}
+    }
+    s->stack[s->su_depth++] = n;
+}
+
+// Return the Sethi-Ullman number of an operation whose operands have
+// the numbers n1 and n2, where the right operand is a leaf
+// (so needs no register of its own) if right_leaf is true
+static unsigned int su_combine(unsigned int n1, unsigned int n2,
+			       bool right_leaf)
+{
+    if (right_leaf) {
+	n2 = 0;
+    }
+    return (n1 == n2) ? n1 + 1 : ((n1 > n2) ? n1 : n2);
+}
+
+// Callbacks for numbering an expression (in the regalloc_state context),
+// which note its variables' uses and push each node's Sethi-Ullman number
+static void number_leaf(ast_walker *w, AST *exp, int level,
+			unsigned int flags)
+{
+    regalloc_state *s = (regalloc_state *) ast_walk_context(w);
+    if (exp->type_tag == ident_ast) {
+	note_use(s, exp->data.ident.name);
+    }
+    push(s, 1);
+}
+
+static void number_bin_expr(ast_walker *w, AST *exp, int level,
+			    unsigned int flags)
+{
+    regalloc_state *s = (regalloc_state *) ast_walk_context(w);
+    unsigned int n2 = s->stack[--s->su_depth];
+    unsigned int n1 = s->stack[--s->su_depth];
+    push(s, su_combine(n1, n2,
+		       exp->data.bin_expr.rightexp->type_tag != bin_expr_ast));
+}
+
+static const ast_visitor number_visitor = {
+    .post = {
+	[ident_ast] = number_leaf,
+	[number_ast] = number_leaf,
+	[bin_expr_ast] = number_bin_expr,
+    },
+};
+
+// Note the uses of variables in exp at the current number
+// and return the number of temporaries needed to evaluate it
+static unsigned int number_expr(regalloc_state *s, AST *exp)
+{
+    s->su_depth = 0;
+    ast_walk(exp, &number_visitor, s, 0, 0);
+    return s->stack[0];
+}
+
+// Add n expression temporaries, live at the current number
+static void add_temps(regalloc_state *s, unsigned int n)
+{
+    for (unsigned int i = 0; i < n; i++) {
+	if (s->num_temps == s->temps_cap) {
+	    s->temps_cap = (s->temps_cap == 0) ? 256 : 2 * s->temps_cap;
+	    s->temps = (interval *) mem_realloc(mem_optimizer, s->temps,
+					    s->temps_cap * sizeof(interval));
+	    if (s->temps == NULL) {
+		bail_with_error("No space to allocate registers!");
+	    }
+	}
+	interval *iv = &s->temps[s->num_temps++];
+	iv->name = NULL;
+	iv->start = s->pos;
+	iv->end = s->pos;
+	iv->weight = ULONG_MAX;
+	iv->uses = 1;
+	iv->reg = SPILLED;
+    }
+}
+
+// Number the condition cond, noting its uses and temporaries
+static void number_cond(regalloc_state *s, AST *cond)
+{
+    s->pos++;
+    if (cond->type_tag == odd_cond_ast) {
+	add_temps(s, number_expr(s, cond->data.odd_cond.exp));
+    } else {
+	AST *e2 = cond->data.bin_cond.rightexp;
+	unsigned int n1 = number_expr(s, cond->data.bin_cond.leftexp);
+	unsigned int n2 = number_expr(s, e2);
+	add_temps(s, su_combine(n1, n2, e2->type_tag != bin_expr_ast));
+    }
+}
+
+// Number the statement stmt (and those in it), noting the uses
+// of variables, the temporaries needed and the loops
+static void number_stmt(regalloc_state *s, AST *stmt)
+{
+    switch (stmt->type_tag) {
+    case assign_ast:
+	s->pos++;
+	add_temps(s, number_expr(s, stmt->data.assign_stmt.exp));
+	note_use(s, stmt->data.assign_stmt.name);
+	break;
+    case read_ast:
+	s->pos++;
+	note_use(s, stmt->data.read_stmt.name);
+	break;
+    case write_ast:
+	s->pos++;
+	add_temps(s, number_expr(s, stmt->data.write_stmt.exp));
+	break;
+    case begin_ast:
+	for (AST_list stmts = stmt->data.begin_stmt.stmts;
+	     !ast_list_is_empty(stmts); stmts = ast_list_rest(stmts)) {
+	    number_stmt(s, ast_list_first(stmts));
+	}
+	break;
+    case if_ast:
+	number_cond(s, stmt->data.if_stmt.cond);
+	number_stmt(s, stmt->data.if_stmt.thenstmt);
+	number_stmt(s, stmt->data.if_stmt.elsestmt);
+	break;
+    case while_ast: {
+	if (s->num_loops == s->loops_cap) {
+	    s->loops_cap = (s->loops_cap == 0) ? 64 : 2 * s->loops_cap;
+	    s->loops = (loop_span *) mem_realloc(mem_optimizer, s->loops,
+					     s->loops_cap * sizeof(loop_span));
+	    if (s->loops == NULL) {
+		bail_with_error("No space to allocate registers!");
+	    }
+	}
+	size_t i = s->num_loops++;
+	unsigned long weight = s->weight;
+	s->depth++;
+	if (s->depth <= MAX_WEIGHT_DEPTH) {
+	    s->weight *= LOOP_WEIGHT;
+	}
+	number_cond(s, stmt->data.while_stmt.cond);
+	s->loops[i].start = s->pos;
+	number_stmt(s, stmt->data.while_stmt.stmt);
+	s->loops[i].end = s->pos;
+	s->depth--;
+	s->weight = weight;
+	break;
+    }
+    default:
+	break;
+    }
+}
+
+// Extend each variable's interval that overlaps a loop to cover it
+// (the loops are in the order of their starts, so outer loops come
+// before the loops in them, and after an interval covers a loop
+// the loops in it change nothing)
+static void extend_over_loops(regalloc_state *s)
+{
+    for (size_t i = 0; i < s->num_loops; i++) {
+	loop_span *l = &s->loops[i];
+	for (size_t v = 0; v < s->num_vars; v++) {
+	    interval *iv = &s->vars[v];
+	    if (iv->uses == 0 || iv->end < l->start || l->end < iv->start) {
+		continue;
+	    }
+	    if (l->start < iv->start) {
+		iv->start = l->start;
+	    }
+	    if (iv->end < l->end) {
+		iv->end = l->end;
+	    }
+	}
+    }
+}
+
+// Compare intervals (given by pointers to pointers) by their starts,
+// putting variables before temporaries with the same start
+static int by_start(const void *p1, const void *p2)
+{
+    const interval *i1 = *(const interval *const *) p1;
+    const interval *i2 = *(const interval *const *) p2;
+    if (i1->start != i2->start) {
+	return (i1->start < i2->start) ? -1 : 1;
+    }
+    if ((i1->name == NULL) != (i2->name == NULL)) {
+	return (i1->name == NULL) ? 1 : -1;
+    }
+    return (i1 < i2) ? -1 : (i1 > i2);
+}
+
+// Requires: all has num intervals, sorted by by_start
+// Allocate registers to the intervals in all by a linear scan
+static void linear_scan(regalloc_state *s, interval **all, size_t num)
+{
+    // the intervals with registers, in order of their ends
+    interval *active[REGALLOC_MAX_REGISTERS];
+    size_t num_active = 0;
+    bool in_use[REGALLOC_MAX_REGISTERS] = { false };
+    for (size_t i = 0; i < num; i++) {
+	interval *cur = all[i];
+	// free the registers of the intervals that have ended
+	size_t ended = 0;
+	while (ended < num_active && active[ended]->end < cur->start) {
+	    in_use[active[ended]->reg] = false;
+	    ended++;
+	}
+	memmove(active, active + ended,
+		(num_active - ended) * sizeof(interval *));
+	num_active -= ended;
+	if (num_active == s->registers) {
+	    // spill the interval of least weight (the one that ends last
+	    // if there is a tie, which may be cur)
+	    interval *victim = cur;
+	    size_t at = num_active;
+	    for (size_t a = 0; a < num_active; a++) {
+		if (active[a]->weight < victim->weight
+		    || (active[a]->weight == victim->weight
+			&& active[a]->end > victim->end)) {
+		    victim = active[a];
+		    at = a;
+		}
+	    }
+	    if (victim == cur) {
+		cur->reg = SPILLED;
+		continue;
+	    }
+	    in_use[victim->reg] = false;
+	    victim->reg = SPILLED;
+	    memmove(active + at, active + at + 1,
+		    (num_active - at - 1) * sizeof(interval *));
+	    num_active--;
+	}
+	int reg = 0;
+	while (in_use[reg]) {
+	    reg++;
+	}
+	in_use[reg] = true;
+	cur->reg = reg;
+	size_t a = num_active;
+	while (a > 0 && active[a - 1]->end > cur->end) {
+	    active[a] = active[a - 1];
+	    a--;
+	}
+	active[a] = cur;
+	num_active++;
+    }
+}
+
+// Write the report of the allocation for s's program
+static void report(regalloc_state *s, size_t num_vars)
+{
+    size_t vars_spilled = 0;
+    size_t temps_spilled = 0;
+    unsigned long spill_uses = 0;
+    for (size_t v = 0; v < s->num_vars; v++) {
+	if (s->vars[v].uses > 0 && s->vars[v].reg == SPILLED) {
+	    vars_spilled++;
+	    spill_uses += s->vars[v].uses;
+	}
+    }
+    for (size_t t = 0; t < s->num_temps; t++) {
+	if (s->temps[t].reg == SPILLED) {
+	    temps_spilled++;
+	    spill_uses += 2;   // stored, then loaded
+	}
+    }
+    diagnostic_print("%s: register allocation with %u registers:"
+		     " %zu variables (%zu spilled),"
+		     " %zu temporaries (%zu spilled),"
+		     " %lu spill loads and stores\n",
+		     s->prog->file_loc.filename, s->registers,
+		     num_vars, vars_spilled, s->num_temps, temps_spilled,
+		     spill_uses);
+    for (size_t v = 0; v < s->num_vars; v++) {
+	interval *iv = &s->vars[v];
+	if (iv->uses == 0) {
+	    continue;
+	}
+	diagnostic_print("  %s: %s, live over %u-%u, %u use%s, weight %lu\n",
+			 iv->name, (iv->reg == SPILLED) ? "spilled"
+			 : register_names[iv->reg],
+			 iv->start, iv->end, iv->uses,
+			 (iv->uses == 1) ? "" : "s", iv->weight);
+    }
+}
+
+// Allocate registers to prog's variables and temporaries and report
+// the allocation (see regalloc.h)
+void regalloc_report(AST *prog, unsigned int registers)
+{
+    TRACE_BEGIN("regalloc");
+    regalloc_state s;
+    memset(&s, 0, sizeof(s));
+    s.prog = prog;
+    s.registers = registers;
+    s.weight = 1;
+    s.num_vars = scope_size() + 1;
+    s.vars = (interval *) mem_calloc(
+	mem_optimizer, s.num_vars, sizeof(interval));
+    if (s.vars == NULL) {
+	bail_with_error("No space to allocate registers!");
+    }
+    number_stmt(&s, prog->data.program.stmt);
+    extend_over_loops(&s);
+
+    size_t num_vars = 0;
+    for (size_t v = 0; v < s.num_vars; v++) {
+	if (s.vars[v].uses > 0) {
+	    num_vars++;
+	}
+    }
+    size_t num = num_vars + s.num_temps;
+    interval **all = (interval **) mem_alloc(
+	mem_optimizer, (num + 1) * sizeof(interval *));
+    if (all == NULL) {
+	bail_with_error("No space to allocate registers!");
+    }
+    size_t n = 0;
+    for (size_t v = 0; v < s.num_vars; v++) {
+	if (s.vars[v].uses > 0) {
+	    all[n++] = &s.vars[v];
+	}
+    }
+    for (size_t t = 0; t < s.num_temps; t++) {
+	all[n++] = &s.temps[t];
+    }
+    qsort(all, num, sizeof(interval *), by_start);
+    linear_scan(&s, all, num);
+    report(&s, num_vars);
+
+    mem_free(all);
+    mem_free(s.vars);
+    mem_free(s.temps);
+    mem_free(s.loops);
+    mem_free(s.stack);
+    TRACE_END();
+}
@@ -0,0 +1,41 @@
+#ifndef _REGALLOC_H
+#define _REGALLOC_H
+#include "ast.h"
+
+// Linear-scan register allocation (after Poletto and Sarkar) of a
+// program's variables and expression temporaries to the registers
+// an x86-64 backend would have for them, reported as a plan
+// (the compiler has no backend yet, so nothing is emitted).
+//
+// The program's assign, read and write statements and its conditions
+// are numbered in order (a while loop's condition comes before its
+// body), and each variable's live interval runs from the first to the
+// last number at which it is used or changed. An interval that
+// overlaps a while loop is extended to cover the whole loop, as its
+// value must survive the loop's repetitions. Evaluating an expression
+// needs as many temporaries as its Sethi-Ullman number (the right
+// operand of an operation can be a variable or a number in place),
+// each with an interval covering just that statement.
+//
+// The intervals are visited in order of their starts, and each gets
+// a free register if there is one. When there is none, the interval
+// with the least weight is spilled (to memory, for all of its life),
+// where a use in a loop weighs 8 times as much as one outside it
+// (up to a depth of 6), so the variables of inner loops are kept in
+// registers; an expression temporary is only spilled when it is
+// competing with other temporaries. The report tells where each
+// variable lives and counts the spills.
+
+// The most registers allocated (rax and rdx are kept for division)
+#define REGALLOC_MAX_REGISTERS 12
+
+// Requires: prog has passed its scope check (see scope_check.h),
+//           the current scope is prog's symbol table,
+//           and 0 < registers <= REGALLOC_MAX_REGISTERS
+// Allocate the first registers of the x86-64 registers available
+// to prog's variables and temporaries, and write a report of the
+// allocation to where errors go.
+// If there is no space, bail with an error message.
+extern void regalloc_report(AST *prog, unsigned int registers);
+
+#endif
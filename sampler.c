@@ -0,0 +1,229 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "utilities.h"
+#include "sampler.h"
+#include "mem.h"
+
+// The most names on a thread's stack (deeper names are not kept,
+// but are still counted, so pops match pushes)
+#define MAX_STACK_DEPTH 1024
+// The most thread names, and the most chars in one
+#define MAX_THREAD_NAMES 64
+#define MAX_THREAD_NAME 32
+
+// A sample of a thread's stack (depth is 0 until the sample is complete)
+typedef struct {
+    const char *names[SAMPLER_SAMPLE_DEPTH];
+    atomic_uint depth;
+} sample;
+
+bool sampler_active = false;
+
+// The samples taken (num_samples counts the dropped ones too)
+static sample *samples = NULL;
+static atomic_size_t num_samples = 0;
+
+// This thread's stack of names, and its name
+static _Thread_local const char *stack[MAX_STACK_DEPTH];
+static _Thread_local volatile unsigned int stack_depth = 0;
+static _Thread_local const char *thread_name = NULL;
+
+// The thread names given so far (which outlive their threads),
+// guarded by names_lock
+static char thread_names[MAX_THREAD_NAMES][MAX_THREAD_NAME];
+static unsigned int num_thread_names = 0;
+static pthread_mutex_t names_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// The SIGPROF handler: copy the interrupted thread's stack into a sample
+static void take_sample(int sig)
+{
+    int saved_errno = errno;
+    size_t i = atomic_fetch_add(&num_samples, 1);
+    if (i < SAMPLER_MAX_SAMPLES) {
+	sample *s = &samples[i];
+	unsigned int depth = stack_depth;
+	if (depth > MAX_STACK_DEPTH) {
+	    depth = MAX_STACK_DEPTH;
+	}
+	unsigned int n = 0;
+	s->names[n++] = (thread_name == NULL) ? "thread" : thread_name;
+	if (depth < SAMPLER_SAMPLE_DEPTH) {
+	    for (unsigned int k = 0; k < depth; k++) {
+		s->names[n++] = stack[k];
+	    }
+	} else {
+	    for (unsigned int k = 0; n < SAMPLER_SAMPLE_DEPTH - 2; k++) {
+		s->names[n++] = stack[k];
+	    }
+	    s->names[n++] = "...";
+	    s->names[n++] = stack[depth - 1];
+	}
+	atomic_store(&s->depth, n);
+    }
+    errno = saved_errno;
+}
+
+// Start sampling (see sampler.h)
+void sampler_enable()
+{
+    samples = (sample *) mem_calloc(
+	mem_tools, SAMPLER_MAX_SAMPLES, sizeof(sample));
+    if (samples == NULL) {
+	bail_with_error("No space for profile samples!");
+    }
+    sampler_active = true;
+    sampler_name_thread("main");
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = take_sample;
+    sigemptyset(&sa.sa_mask);
+    // so reads and waits that are interrupted carry on
+    sa.sa_flags = SA_RESTART;
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = SAMPLER_INTERVAL_USEC;
+    timer.it_value = timer.it_interval;
+    if (sigaction(SIGPROF, &sa, NULL) != 0
+	|| setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+	bail_with_error("Cannot start the profiling timer");
+    }
+}
+
+// Push name on this thread's stack
+void sampler_begin(const char *name)
+{
+    unsigned int depth = stack_depth;
+    if (depth < MAX_STACK_DEPTH) {
+	stack[depth] = name;
+    }
+    // the name must be there before a sample can see it
+    atomic_signal_fence(memory_order_seq_cst);
+    stack_depth = depth + 1;
+}
+
+// Pop the innermost name from this thread's stack
+void sampler_end()
+{
+    if (stack_depth > 0) {
+	stack_depth = stack_depth - 1;
+    }
+}
+
+// Return the number of names on this thread's stack
+unsigned int sampler_depth()
+{
+    return stack_depth;
+}
+
+// Pop names from this thread's stack until only depth are left
+void sampler_unwind(unsigned int depth)
+{
+    if (stack_depth > depth) {
+	stack_depth = depth;
+    }
+}
+
+// Name this thread, as the outermost name of its samples
+void sampler_name_thread(const char *name)
+{
+    if (!sampler_active) {
+	return;
+    }
+    pthread_mutex_lock(&names_lock);
+    const char *interned = NULL;
+    for (unsigned int i = 0; i < num_thread_names; i++) {
+	if (strncmp(thread_names[i], name, MAX_THREAD_NAME - 1) == 0) {
+	    interned = thread_names[i];
+	    break;
+	}
+    }
+    if (interned == NULL && num_thread_names < MAX_THREAD_NAMES) {
+	char *copy = thread_names[num_thread_names++];
+	snprintf(copy, MAX_THREAD_NAME, "%s", name);
+	interned = copy;
+    }
+    pthread_mutex_unlock(&names_lock);
+    thread_name = interned;
+}
+
+// Compare samples by their stacks' names (for qsort)
+static int by_stack(const void *p1, const void *p2)
+{
+    const sample *s1 = *(const sample * const *) p1;
+    const sample *s2 = *(const sample * const *) p2;
+    unsigned int d1 = atomic_load(&s1->depth);
+    unsigned int d2 = atomic_load(&s2->depth);
+    for (unsigned int i = 0; i < d1 && i < d2; i++) {
+	int c = strcmp(s1->names[i], s2->names[i]);
+	if (c != 0) {
+	    return c;
+	}
+    }
+    return (d1 < d2) ? -1 : (d1 > d2);
+}
+
+// Stop sampling and write the samples as folded stacks (see sampler.h)
+void sampler_write(const char *fname)
+{
+    if (!sampler_active) {
+	return;
+    }
+    struct itimerval off;
+    memset(&off, 0, sizeof(off));
+    setitimer(ITIMER_PROF, &off, NULL);
+    // a signal still pending must not see the samples freed
+    signal(SIGPROF, SIG_IGN);
+    size_t taken = atomic_load(&num_samples);
+    size_t kept = (taken < SAMPLER_MAX_SAMPLES) ? taken : SAMPLER_MAX_SAMPLES;
+
+    // the complete samples, in order of their stacks
+    const sample **sorted = (const sample **) mem_alloc(mem_tools,
+	(kept + 1) * sizeof(const sample *));
+    if (sorted == NULL) {
+	bail_with_error("No space to write the profile!");
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < kept; i++) {
+	if (atomic_load(&samples[i].depth) > 0) {
+	    sorted[n++] = &samples[i];
+	}
+    }
+    qsort(sorted, n, sizeof(const sample *), by_stack);
+
+    FILE *f = fopen(fname, "w");
+    if (f == NULL) {
+	bail_with_error("Cannot write the profile to %s", fname);
+    }
+    for (size_t i = 0; i < n; ) {
+	size_t j = i + 1;
+	while (j < n && by_stack(&sorted[i], &sorted[j]) == 0) {
+	    j++;
+	}
+	unsigned int depth = atomic_load(&sorted[i]->depth);
+	for (unsigned int k = 0; k < depth; k++) {
+	    fprintf(f, "%s%s", (k == 0) ? "" : ";", sorted[i]->names[k]);
+	}
+	fprintf(f, " %zu\n", j - i);
+	i = j;
+    }
+    if (fclose(f) != 0) {
+	bail_with_error("Cannot write the profile to %s", fname);
+    }
+    fprintf(stderr, "Profile: %zu samples (every %d microseconds of CPU"
+	    " time) written to %s", n, SAMPLER_INTERVAL_USEC, fname);
+    if (taken > kept) {
+	fprintf(stderr, " (%zu more dropped)", taken - kept);
+    }
+    fprintf(stderr, "\n");
+    mem_free(sorted);
+    mem_free(samples);
+    samples = NULL;
+    sampler_active = false;
+}
@@ -0,0 +1,75 @@
+#ifndef _SAMPLER_H
+#define _SAMPLER_H
+#include <stdbool.h>
+
+// A sampling profiler for the compiler itself. Each thread keeps a
+// stack of the names of the functions (or phases) it is in, pushed and
+// popped by the macros below (and by the TRACE_ macros of trace.h).
+// While sampling, a SIGPROF timer (see setitimer) interrupts the
+// running thread every SAMPLER_INTERVAL_USEC microseconds of CPU time
+// (or every tick of the kernel's clock, if that is longer),
+// and the handler copies that thread's stack into a preallocated table,
+// so the handler neither allocates nor locks.
+// At the end the samples are written as folded stacks: a line for each
+// distinct stack (its names, outermost first, joined by semicolons,
+// starting with the thread's name) followed by a space and the number
+// of samples that had it, as flamegraph.pl and speedscope read them.
+// Time spent in functions without names on the stack counts for the
+// innermost name that is on it.
+
+// The file the samples are written to if no other is given
+#define SAMPLER_DEFAULT_FILE "profile.folded"
+
+// CPU time between samples, in microseconds
+#define SAMPLER_INTERVAL_USEC 1000
+
+// The most samples kept (later ones are counted as dropped)
+#define SAMPLER_MAX_SAMPLES 65536
+
+// The most names on a stack that a sample keeps
+// (deeper stacks keep their outermost names, "..." and the innermost)
+#define SAMPLER_SAMPLE_DEPTH 32
+
+// Is sampling on? (only set before any stacks are pushed)
+extern bool sampler_active;
+
+// Push the name name (a string that lives as long as the program)
+// on this thread's stack
+#define SAMPLE_BEGIN(name) \
+    do { if (sampler_active) { sampler_begin(name); } } while (0)
+
+// Pop the innermost name from this thread's stack
+#define SAMPLE_END() \
+    do { if (sampler_active) { sampler_end(); } } while (0)
+
+// Start sampling (called before any threads are started).
+// If there is no space or the timer cannot be set,
+// bail with an error message.
+extern void sampler_enable();
+
+// Requires: sampling is on
+// Push name on this thread's stack
+extern void sampler_begin(const char *name);
+
+// Requires: sampling is on and this thread's stack is not empty
+// Pop the innermost name from this thread's stack
+extern void sampler_end();
+
+// Return the number of names on this thread's stack
+extern unsigned int sampler_depth();
+
+// Pop names from this thread's stack until only depth are left
+// (e.g., after an error skipped their ends)
+extern void sampler_unwind(unsigned int depth);
+
+// Name this thread, as the outermost name of its samples
+// (the name is copied), if sampling is on
+extern void sampler_name_thread(const char *name);
+
+// Stop sampling, and write the samples as folded stacks
+// to the file named fname, with a summary line on stderr
+// (if sampling is on). If the file cannot be written,
+// bail with an error message.
+extern void sampler_write(const char *fname);
+
+#endif
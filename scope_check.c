@@ -1,22 +1,215 @@
 /* $Id: scope_check.c,v 1.2 2023/02/22 03:33:43 leavens Exp $ */
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <setjmp.h>
 #include "scope_check.h"
 #include "id_attrs.h"
 #include "file_location.h"
 #include "ast.h"
 #include "utilities.h"
 #include "symbol_table.h"
-#include "scope_check.h"
+#include "ast_walk.h"
+#include "sink.h"
+#include "stats.h"
+#include "trace.h"
+#include "thread_pool.h"
+#include "mem.h"
+
+// Fewest top-level statements worth giving each thread
+// when checking in parallel
+#define MIN_STMTS_PER_THREAD 64
+// Number of top-level statements in each job of a parallel check
+#define STMTS_PER_JOB 32
+
+// Where a walk is among the expression nodes of an expression parent,
+// so the file location of a shared expression node's occurrence
+// can be found (see ast_expr_locations in ast.h)
+typedef struct {
+    const AST *parent;      // the current expression parent (or NULL)
+    size_t done;            // how many of its expression nodes are done
+} expr_position;
+
+// Callbacks for the walker, which only need to act
+// on the nodes that declare or mention names
+// (and on the expressions, to keep track of their position)
+static void visit_constDecl(ast_walker *w, AST *cd, int level, unsigned int flags){
+    scope_check_constDecl(cd);
+}
+
+static void visit_varDecl(ast_walker *w, AST *vd, int level, unsigned int flags){
+    scope_check_varDecl(vd);
+}
+
+static void visit_exprParent(ast_walker *w, AST *ast, int level, unsigned int flags){
+    expr_position *pos = (expr_position *) ast_walk_context(w);
+    pos->parent = ast;
+    pos->done = 0;
+}
+
+static void visit_assignStmt(ast_walker *w, AST *stmt, int level, unsigned int flags){
+    scope_check_ident(stmt->file_loc, stmt->data.assign_stmt.name);
+    visit_exprParent(w, stmt, level, flags);
+}
+
+static void visit_readStmt(ast_walker *w, AST *stmt, int level, unsigned int flags){
+    scope_check_readStmt(stmt);
+}
+
+static void finish_expr(ast_walker *w, AST *exp, int level, unsigned int flags){
+    expr_position *pos = (expr_position *) ast_walk_context(w);
+    pos->done++;
+}
+
+static void visit_ident(ast_walker *w, AST *exp, int level, unsigned int flags){
+    if (!scope_defined(exp->data.ident.name)) {
+        // only look for the occurrence's location when reporting it
+        expr_position *pos = (expr_position *) ast_walk_context(w);
+        const file_location *locs = NULL;
+        if (pos->parent != NULL) {
+            locs = ast_expr_locations(pos->parent);
+        }
+        scope_check_ident(locs != NULL ? locs[pos->done] : exp->file_loc,
+                          exp->data.ident.name);
+    }
+    finish_expr(w, exp, level, flags);
+}
+
+// The scope checker's table of callbacks
+// (declarations are visited in order before the statement,
+// so each name is declared before the uses are checked)
+static const ast_visitor scope_check_visitor = {
+    .pre = {
+        [const_decl_ast] = visit_constDecl,
+        [var_decl_ast] = visit_varDecl,
+        [assign_ast] = visit_assignStmt,
+        [read_ast] = visit_readStmt,
+        [write_ast] = visit_exprParent,
+        [odd_cond_ast] = visit_exprParent,
+        [bin_cond_ast] = visit_exprParent,
+        [ident_ast] = visit_ident,
+        [number_ast] = finish_expr,
+    },
+    .post = {
+        [bin_expr_ast] = finish_expr,
+    },
+};
 
 // Build the symbol table for the given program AST
 // and Check the given program AST for duplicate declarations
 // or uses of identifiers that were not declared
 void scope_check_program(AST *prog){
-    scope_check_constDecls(prog->data.program.cds); 
+    expr_position pos = { NULL, 0 };
+    ast_walk(prog, &scope_check_visitor, &pos, 0, 0);
+}
+
+// The work of checking a program's top-level statements in parallel
+typedef struct {
+    AST **stmts;            // the statements, in order
+    char **messages;        // the error message for each (or NULL)
+    size_t nstmts;
+    const frozen_scope *scope;
+} parallel_check;
+
+// Check the statements of job number job (of the parallel_check arg)
+// using its frozen scope, recording each statement's error message
+// (each statement is checked under its own error trap, so an error in one
+// does not stop the others)
+static void check_stmts_job(size_t job, void *arg)
+{
+    parallel_check *pc = (parallel_check *) arg;
+    size_t first = job * STMTS_PER_JOB;
+    size_t end = first + STMTS_PER_JOB;
+    if (end > pc->nstmts) {
+	end = pc->nstmts;
+    }
+    TRACE_BEGIN("scope_check_stmts");
+    scope_use_frozen(pc->scope);
+    error_trap *outer = error_trap_current();
+    error_trap trap;
+    trap.diagnostics = sink_string();
+    unsigned int walk_level = ast_walk_depth();
+    for (size_t i = first; i < end; i++) {
+	if (setjmp(trap.env) == 0) {
+	    error_trap_set(&trap);
+	    scope_check_stmt(pc->stmts[i]);
+	} else {
+	    // the error skipped the end of the statement's walk
+	    ast_walk_unwind(walk_level);
+	    pc->messages[i] = mem_strdup(
+		mem_symbols, sink_contents(trap.diagnostics));
+	    sink_reset(trap.diagnostics);
+	}
+    }
+    if (outer != NULL) {
+	error_trap_set(outer);
+    } else {
+	error_trap_clear();
+    }
+    sink_close(trap.diagnostics);
+    scope_use_frozen(NULL);
+    stats_merge_helper();
+    TRACE_END();
+}
+
+// Build the symbol table for the given program AST and check it,
+// like scope_check_program, but after the declarations are in the
+// symbol table (which is then frozen), check the statements of a
+// top-level begin statement on (at most) nthreads threads at once.
+// An error in a top-level statement does not stop the checking of
+// the others; the errors found are reported together, in the order
+// of the statements (and so of their file locations), which does not
+// depend on the number of threads.
+void scope_check_program_parallel(AST *prog, unsigned int nthreads){
+    scope_check_constDecls(prog->data.program.cds);
     scope_check_varDecls(prog->data.program.vds);
-    scope_check_stmt(prog->data.program.stmt);
+    AST *body = prog->data.program.stmt;
+    size_t nstmts = 0;
+    if (body->type_tag == begin_ast) {
+        for (AST_list s = body->data.begin_stmt.stmts; !ast_list_is_empty(s);
+             s = ast_list_rest(s)) {
+            nstmts++;
+        }
+    }
+    if (nthreads > nstmts / MIN_STMTS_PER_THREAD) {
+        nthreads = (unsigned int) (nstmts / MIN_STMTS_PER_THREAD);
+    }
+    if (nthreads <= 1) {
+        scope_check_stmt(body);
+        return;
+    }
+
+    parallel_check pc;
+    pc.nstmts = nstmts;
+    pc.stmts = (AST **) mem_alloc(mem_symbols, nstmts * sizeof(AST *));
+    pc.messages = (char **) mem_calloc(mem_symbols, nstmts, sizeof(char *));
+    if (pc.stmts == NULL || pc.messages == NULL) {
+        bail_with_error("No space to check statements in parallel!");
+    }
+    size_t i = 0;
+    for (AST_list s = body->data.begin_stmt.stmts; !ast_list_is_empty(s);
+         s = ast_list_rest(s)) {
+        pc.stmts[i++] = ast_list_first(s);
+    }
+    pc.scope = scope_freeze();
+    pool_run((nstmts + STMTS_PER_JOB - 1) / STMTS_PER_JOB, nthreads,
+             check_stmts_job, &pc);
+
+    // report all the errors at once
+    sink *errors = sink_string();
+    for (i = 0; i < nstmts; i++) {
+        if (pc.messages[i] != NULL) {
+            sink_puts(errors, pc.messages[i]);
+            mem_free(pc.messages[i]);
+        }
+    }
+    mem_free(pc.stmts);
+    mem_free(pc.messages);
+    if (sink_length(errors) > 0) {
+        error_reraise_sink(errors);
+    }
+    sink_close(errors);
 }
 
 // Put the given name, which is to be declared with var_type vt,
@@ -69,26 +262,16 @@ void scope_check_stmt(AST *stmt)
 {
     switch (stmt->type_tag) {
     case assign_ast:
-	    scope_check_assignStmt(stmt);
-	    break;
     case skip_ast:
-        // Nothing to check here 
-        break; 
     case begin_ast:
-	    scope_check_beginStmt(stmt);
-	    break;
     case while_ast: 
-        scope_check_whileStmt(stmt); 
-        break; 
     case if_ast:
-	    scope_check_ifStmt(stmt);
-	    break;
     case read_ast:
-	    scope_check_readStmt(stmt);
-	    break;
-    case write_ast:
-	    scope_check_writeStmt(stmt);
+    case write_ast: {
+	    expr_position pos = { NULL, 0 };
+	    ast_walk(stmt, &scope_check_visitor, &pos, 0, 0);
 	    break;
+    }
     default:
         printf("type tag: %d ", stmt->type_tag); 
 	    bail_with_error("Call to scope_check_stmt with an AST that is not a statement!");
@@ -96,50 +279,6 @@ void scope_check_stmt(AST *stmt)
     }
 }
 
-// check the statement to make sure that
-// all idenfifiers referenced in it have been declared
-// (if not, then produce an error)
-void scope_check_assignStmt(AST *stmt)
-{
-    scope_check_ident(stmt->file_loc, stmt->data.assign_stmt.name);
-    scope_check_expr(stmt->data.assign_stmt.exp);
-}
-
-void scope_check_whileStmt(AST *stmt){
-    scope_check_expr(stmt->data.while_stmt.cond); 
-    scope_check_stmt(stmt->data.while_stmt.stmt); 
-}
-
-// check the statement to make sure that
-// all idenfifiers referenced in it have been declared
-// (if not, then produce an error)
-void scope_check_beginStmt(AST *stmt)
-{
-    AST_list stmts = stmt->data.begin_stmt.stmts;
-    while (!ast_list_is_empty(stmts)) {
-	    scope_check_stmt(ast_list_first(stmts));
-	    stmts = ast_list_rest(stmts);
-    }
-}
-
-void scope_check_bin_cond(AST *exp){
-    scope_check_expr(exp->data.bin_cond.leftexp); 
-    scope_check_expr(exp->data.bin_cond.rightexp); 
-}
-
-void scope_check_odd_cond(AST *exp){
-    scope_check_expr(exp->data.odd_cond.exp); 
-}
-
-// check the statement to make sure that
-// all idenfifiers referenced in it have been declared
-// (if not, then produce an error)
-void scope_check_ifStmt(AST *stmt){
-    scope_check_expr(stmt->data.if_stmt.cond);
-    scope_check_stmt(stmt->data.if_stmt.thenstmt);
-    scope_check_stmt(stmt->data.if_stmt.elsestmt);
-}
-
 // check the statement to make sure that
 // all idenfifiers referenced in it have been declared
 // (if not, then produce an error)
@@ -148,14 +287,6 @@ void scope_check_readStmt(AST *stmt)
     scope_check_ident(stmt->file_loc, stmt->data.read_stmt.name);
 }
 
-// check the statement to make sure that
-// all idenfifiers referenced in it have been declared
-// (if not, then produce an error)
-void scope_check_writeStmt(AST *stmt)
-{
-    scope_check_expr(stmt->data.write_stmt.exp);
-}
-
 // check the expresion to make sure that
 // all idenfifiers referenced in it have been declared
 // (if not, then produce an error)
@@ -163,20 +294,14 @@ void scope_check_expr(AST *exp)
 {
     switch (exp->type_tag) {
     case ident_ast:
-        scope_check_ident(exp->file_loc, exp->data.ident.name);
-        break;
     case bin_cond_ast: 
-        scope_check_bin_cond(exp); 
-        break; 
     case odd_cond_ast: 
-        scope_check_odd_cond(exp); 
-        break; 
     case bin_expr_ast:
-	    scope_check_bin_expr(exp);
-	    break;
-    case number_ast:
-	    // no identifiers are possible in this case, so just return
+    case number_ast: {
+	    expr_position pos = { NULL, 0 };
+	    ast_walk(exp, &scope_check_visitor, &pos, 0, 0);
 	    break;
+    }
     default:
 	    bail_with_error("Unexpected type_tag (%d) in scope_check_expr (for line %d, column %d)!", exp->type_tag, exp->file_loc.line, exp->file_loc.column);
 	    break;
@@ -190,13 +315,4 @@ void scope_check_ident(file_location floc, const char *name)
     if (!scope_defined(name)) {
 	    general_error(floc, "identifer \"%s\" is not declared!", name);
     }
-}
-
-// check the expression (exp) to make sure that
-// all idenfifiers referenced in it have been declared
-// (if not, then produce an error)
-void scope_check_bin_expr(AST *exp)
-{
-    scope_check_expr(exp->data.bin_expr.leftexp);
-    scope_check_expr(exp->data.bin_expr.rightexp);
 }
\ No newline at end of file
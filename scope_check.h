@@ -7,6 +7,16 @@
 // or uses of identifiers that were not declared
 extern void scope_check_program(AST *prog);
 
+// Build the symbol table for the given program AST and check it,
+// like scope_check_program, but after the declarations are in the
+// symbol table (which is then frozen), check the statements of a
+// top-level begin statement on (at most) nthreads threads at once.
+// An error in a top-level statement does not stop the checking of
+// the others; the errors found are reported together, in the order
+// of the statements (and so of their file locations), which does not
+// depend on the number of threads.
+extern void scope_check_program_parallel(AST *prog, unsigned int nthreads);
+
 // build the symbol table and check the declarations in vds
 extern void scope_check_varDecls(AST *vds);
 
@@ -20,37 +30,14 @@ extern void scope_check_varDecl(AST *vd);
 // (if not, then produce an error)
 extern void scope_check_stmt(AST *stmt);
 
-// check the statement to make sure that
-// all idenfifiers referenced in it have been declared
-// (if not, then produce an error)
-extern void scope_check_assignStmt(AST *stmt);
-
-extern void scope_check_whileStmt(AST *stmt); 
-extern void scope_check_bin_cond(AST *exp); 
-extern void scope_check_odd_cond(AST *exp); 
 extern void scope_check_constDecl(AST *cd);
 extern void scope_check_constDecls(AST_list cds); 
 
-// check the statement to make sure that
-// all idenfifiers referenced in it have been declared
-// (if not, then produce an error)
-extern void scope_check_beginStmt(AST *stmt);
-
-// check the statement to make sure that
-// all idenfifiers referenced in it have been declared
-// (if not, then produce an error)
-extern void scope_check_ifStmt(AST *stmt);
-
 // check the statement to make sure that
 // all idenfifiers referenced in it have been declared
 // (if not, then produce an error)
 extern void scope_check_readStmt(AST *stmt);
 
-// check the statement to make sure that
-// all idenfifiers referenced in it have been declared
-// (if not, then produce an error)
-extern void scope_check_writeStmt(AST *stmt);
-
 // check the expresion to make sure that
 // all idenfifiers referenced in it have been declared
 // (if not, then produce an error)
@@ -60,9 +47,4 @@ extern void scope_check_expr(AST *exp);
 // if not, then produce an error using the file_location (floc) given.
 extern void scope_check_ident(file_location floc, const char *name);
 
-// check the expression (exp) to make sure that
-// all idenfifiers referenced in it have been declared
-// (if not, then produce an error)
-extern void scope_check_bin_expr(AST *exp);
-
 #endif
\ No newline at end of file
@@ -0,0 +1,445 @@
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "utilities.h"
+#include "sink.h"
+#include "incremental.h"
+#include "driver.h"
+#include "server.h"
+#include "mem.h"
+
+// Number of pending connections the server's socket allows
+#define SERVER_BACKLOG 16
+
+// State kept by the server between requests,
+// so that each request reuses buffers that are already allocated
+typedef struct {
+    sink *out;
+    sink *diagnostics;
+    char *source;       // buffer for the source of SOURCE requests
+    size_t source_cap;
+    incr_doc **docs;    // the documents opened by OPEN requests
+    size_t num_docs;
+    size_t docs_cap;
+    bool shutdown;
+} server_state;
+
+// Set by the signal handler to stop the server
+static volatile sig_atomic_t server_interrupted = 0;
+
+static void server_on_signal(int sig)
+{
+    server_interrupted = 1;
+}
+
+// Return the socket path to use when none is given:
+// the value of the environment variable PL0_SOCKET, if it is set,
+// and otherwise a path in /tmp that is specific to the user
+const char *server_default_path()
+{
+    static char path[64];
+    const char *env = getenv("PL0_SOCKET");
+    if (env != NULL && env[0] != '\0') {
+	return env;
+    }
+    snprintf(path, sizeof(path), "/tmp/pl0-compiler-%ld.sock",
+	     (long) getuid());
+    return path;
+}
+
+// Fill in addr with the address of the socket at path
+static void socket_address(struct sockaddr_un *addr, const char *path)
+{
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+	bail_with_error("Socket path too long: %s", path);
+    }
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+}
+
+// Write all n bytes of data to the file descriptor fd.
+// Return false if the other end went away.
+static bool write_all(int fd, const char *data, size_t n)
+{
+    while (n > 0) {
+	ssize_t w = write(fd, data, n);
+	if (w < 0) {
+	    if (errno == EINTR) {
+		continue;
+	    }
+	    return false;
+	}
+	data += w;
+	n -= (size_t) w;
+    }
+    return true;
+}
+
+// Make sure the server's source buffer can hold len bytes
+static void server_reserve_source(server_state *st, size_t len)
+{
+    if (len + 1 <= st->source_cap) {
+	return;
+    }
+    size_t cap = (st->source_cap == 0) ? 4096 : st->source_cap;
+    while (cap < len + 1) {
+	cap *= 2;
+    }
+    char *nb = (char *) mem_realloc(mem_driver, st->source, cap);
+    if (nb == NULL) {
+	bail_with_error("No space for request source!");
+    }
+    st->source = nb;
+    st->source_cap = cap;
+}
+
+// Read len bytes from in into the server's source buffer.
+// Return false if the client went away first.
+static bool server_read_source(server_state *st, FILE *in, size_t len)
+{
+    server_reserve_source(st, len);
+    if (fread(st->source, 1, len, in) != len) {
+	return false;
+    }
+    st->source[len] = '\0';
+    return true;
+}
+
+// Return the index of the open document named name
+// (or the number of documents, if there is none)
+static size_t server_find_doc(server_state *st, const char *name)
+{
+    size_t i = 0;
+    while (i < st->num_docs && strcmp(incr_name(st->docs[i]), name) != 0) {
+	i++;
+    }
+    return i;
+}
+
+// Close the open document named name (if there is one)
+static void server_close_doc(server_state *st, const char *name)
+{
+    size_t i = server_find_doc(st, name);
+    if (i < st->num_docs) {
+	incr_close(st->docs[i]);
+	st->docs[i] = st->docs[--st->num_docs];
+    }
+}
+
+// Return a fresh open document named name,
+// replacing any document open with that name
+static incr_doc *server_open_doc(server_state *st, const char *name)
+{
+    server_close_doc(st, name);
+    if (st->num_docs == st->docs_cap) {
+	st->docs_cap = (st->docs_cap == 0) ? 8 : 2 * st->docs_cap;
+	st->docs = (incr_doc **) mem_realloc(mem_driver, st->docs,
+					 st->docs_cap * sizeof(incr_doc *));
+	if (st->docs == NULL) {
+	    bail_with_error("No space for open documents!");
+	}
+    }
+    incr_doc *d = incr_open(name);
+    st->docs[st->num_docs++] = d;
+    return d;
+}
+
+// Send the reply to a request on fd: its status (ok),
+// followed by the server's output and diagnostics.
+// Return false if the client went away.
+static bool serve_reply(server_state *st, int fd, bool ok)
+{
+    char header[64];
+    int hlen = snprintf(header, sizeof(header), "%s %zu %zu\n",
+			ok ? "OK" : "ERROR", sink_length(st->out),
+			sink_length(st->diagnostics));
+    return write_all(fd, header, (size_t) hlen)
+	&& write_all(fd, sink_contents(st->out), sink_length(st->out))
+	&& write_all(fd, sink_contents(st->diagnostics),
+		     sink_length(st->diagnostics));
+}
+
+// Compile the file named name (or the len bytes of source in text,
+// if text != NULL) and send the reply on fd.
+// Return false if the client went away.
+static bool serve_compile(server_state *st, int fd, const char *name,
+			  const char *text, size_t len)
+{
+    sink_reset(st->out);
+    sink_reset(st->diagnostics);
+    bool ok = driver_try_compile(name, text, len, st->out, st->diagnostics);
+    return serve_reply(st, fd, ok);
+}
+
+// Compile the file named path, using name as its name in messages,
+// and send the reply on fd.
+// Return false if the client went away.
+static bool serve_compile_as(server_state *st, int fd, const char *path,
+			     const char *name)
+{
+    sink_reset(st->out);
+    sink_reset(st->diagnostics);
+    bool ok = driver_try_compile_as(path, name, st->out, st->diagnostics);
+    return serve_reply(st, fd, ok);
+}
+
+// Replace the deleted bytes at offset in the text of the document d
+// with the len bytes of text, compile its new text,
+// and send the reply on fd.
+// Return false if the client went away.
+static bool serve_edit(server_state *st, int fd, incr_doc *d,
+		       size_t offset, size_t deleted,
+		       const char *text, size_t len)
+{
+    sink_reset(st->out);
+    sink_reset(st->diagnostics);
+    bool ok = driver_try_edit(d, offset, deleted, text, len,
+			      st->out, st->diagnostics);
+    return serve_reply(st, fd, ok);
+}
+
+// Serve the requests on the connection fd until the client closes it
+// (or asks the server to shut down)
+static void serve_connection(server_state *st, int fd)
+{
+    FILE *in = fdopen(fd, "r");
+    if (in == NULL) {
+	close(fd);
+	return;
+    }
+    char *line = NULL;
+    size_t linecap = 0;
+    ssize_t n;
+    while (!st->shutdown && (n = getline(&line, &linecap, in)) > 0) {
+	line[strcspn(line, "\r\n")] = '\0';
+	bool alive = true;
+	if (strncmp(line, "PATH ", 5) == 0) {
+	    char *name = strchr(line + 5, '\t');
+	    if (name == NULL) {
+		alive = serve_compile(st, fd, line + 5, NULL, 0);
+	    } else {
+		*name++ = '\0';
+		alive = serve_compile_as(st, fd, line + 5, name);
+	    }
+	} else if (strncmp(line, "SOURCE ", 7) == 0) {
+	    char *rest;
+	    size_t len = (size_t) strtoull(line + 7, &rest, 10);
+	    const char *name = (*rest == ' ') ? rest + 1 : "<source>";
+	    if (!server_read_source(st, in, len)) {
+		break;
+	    }
+	    alive = serve_compile(st, fd, name, st->source, len);
+	} else if (strncmp(line, "OPEN ", 5) == 0) {
+	    char *rest;
+	    size_t len = (size_t) strtoull(line + 5, &rest, 10);
+	    const char *name = (*rest == ' ') ? rest + 1 : "<source>";
+	    if (!server_read_source(st, in, len)) {
+		break;
+	    }
+	    incr_doc *d = server_open_doc(st, name);
+	    alive = serve_edit(st, fd, d, 0, 0, st->source, len);
+	} else if (strncmp(line, "EDIT ", 5) == 0) {
+	    char *rest;
+	    size_t offset = (size_t) strtoull(line + 5, &rest, 10);
+	    size_t deleted = (size_t) strtoull(rest, &rest, 10);
+	    size_t len = (size_t) strtoull(rest, &rest, 10);
+	    const char *name = (*rest == ' ') ? rest + 1 : "<source>";
+	    if (!server_read_source(st, in, len)) {
+		break;
+	    }
+	    size_t i = server_find_doc(st, name);
+	    if (i < st->num_docs) {
+		alive = serve_edit(st, fd, st->docs[i], offset, deleted,
+				   st->source, len);
+	    } else {
+		const char *msg = "ERROR 0 17\nunknown document\n";
+		alive = write_all(fd, msg, strlen(msg));
+	    }
+	} else if (strncmp(line, "CLOSE ", 6) == 0) {
+	    server_close_doc(st, line + 6);
+	    const char *msg = "OK 0 0\n";
+	    alive = write_all(fd, msg, strlen(msg));
+	} else if (strcmp(line, "SHUTDOWN") == 0) {
+	    st->shutdown = true;
+	} else {
+	    const char *msg = "ERROR 0 16\nunknown request\n";
+	    alive = write_all(fd, msg, strlen(msg));
+	}
+	if (!alive) {
+	    break;
+	}
+    }
+    free(line);
+    fclose(in);
+}
+
+// Serve compile requests on a Unix domain socket at path,
+// until a SHUTDOWN request or an interrupt (SIGINT or SIGTERM).
+// Connections are served one at a time.
+void server_run(const char *path)
+{
+    struct sockaddr_un addr;
+    socket_address(&addr, path);
+
+    // a client going away should not kill the server
+    signal(SIGPIPE, SIG_IGN);
+    // no SA_RESTART, so that accept returns when interrupted
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = server_on_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (lfd < 0) {
+	bail_with_error("Cannot create socket");
+    }
+    unlink(path);
+    if (bind(lfd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+	bail_with_error("Cannot bind socket %s", path);
+    }
+    if (listen(lfd, SERVER_BACKLOG) < 0) {
+	bail_with_error("Cannot listen on socket %s", path);
+    }
+
+    server_state st;
+    st.out = sink_string();
+    st.diagnostics = sink_string();
+    st.source = NULL;
+    st.source_cap = 0;
+    st.docs = NULL;
+    st.num_docs = 0;
+    st.docs_cap = 0;
+    st.shutdown = false;
+    while (!st.shutdown && !server_interrupted) {
+	int cfd = accept(lfd, NULL, NULL);
+	if (cfd < 0) {
+	    if (errno == EINTR || errno == ECONNABORTED) {
+		continue;
+	    }
+	    bail_with_error("Cannot accept a connection on %s", path);
+	}
+	serve_connection(&st, cfd);
+    }
+    close(lfd);
+    unlink(path);
+    sink_close(st.out);
+    sink_close(st.diagnostics);
+    mem_free(st.source);
+    for (size_t i = 0; i < st.num_docs; i++) {
+	incr_close(st.docs[i]);
+    }
+    mem_free(st.docs);
+}
+
+// Return a socket connected to the server at path
+static int client_connect(const char *path)
+{
+    struct sockaddr_un addr;
+    socket_address(&addr, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+	bail_with_error("Cannot create socket");
+    }
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+	bail_with_error("Cannot connect to compile server at %s", path);
+    }
+    return fd;
+}
+
+// Copy n bytes from in to out
+static void copy_bytes(FILE *in, FILE *out, size_t n)
+{
+    char buf[BUFSIZ];
+    while (n > 0) {
+	size_t chunk = (n < sizeof(buf)) ? n : sizeof(buf);
+	if (fread(buf, 1, chunk, in) != chunk) {
+	    bail_with_error("Compile server closed the connection");
+	}
+	fwrite(buf, 1, chunk, out);
+	n -= chunk;
+    }
+}
+
+// Send a compile request for each of the nfiles files named in fnames
+// to the server at path (sending the files' contents if send_source is true,
+// and otherwise their absolute names, with the names as given
+// for messages), printing each reply's output
+// on stdout and its diagnostics on stderr.
+// Return the number of files that had errors.
+size_t client_run(const char *path, const char **fnames, size_t nfiles,
+		  bool send_source)
+{
+    int fd = client_connect(path);
+    FILE *in = fdopen(fd, "r");
+    if (in == NULL) {
+	bail_with_error("Cannot read from the compile server");
+    }
+    size_t failures = 0;
+    for (size_t i = 0; i < nfiles; i++) {
+	char header[2 * PATH_MAX + 64];
+	int hlen;
+	if (send_source) {
+	    size_t len;
+	    char *text = read_whole_file(fnames[i], &len);
+	    if (text == NULL) {
+		bail_with_error("Invalid file name");
+	    }
+	    hlen = snprintf(header, sizeof(header), "SOURCE %zu %s\n",
+			    len, fnames[i]);
+	    if (!write_all(fd, header, (size_t) hlen)
+		|| !write_all(fd, text, len)) {
+		bail_with_error("Cannot send a request to the compile server");
+	    }
+	    mem_free(text);
+	} else {
+	    // the server opens the file by its absolute name,
+	    // but uses the name it was given in messages
+	    char abspath[PATH_MAX];
+	    if (realpath(fnames[i], abspath) != NULL) {
+		hlen = snprintf(header, sizeof(header), "PATH %s\t%s\n",
+				abspath, fnames[i]);
+	    } else {
+		hlen = snprintf(header, sizeof(header), "PATH %s\n", fnames[i]);
+	    }
+	    if (!write_all(fd, header, (size_t) hlen)) {
+		bail_with_error("Cannot send a request to the compile server");
+	    }
+	}
+
+	char status[16];
+	size_t outlen, errlen;
+	if (fscanf(in, "%15s %zu %zu", status, &outlen, &errlen) != 3
+	    || fgetc(in) != '\n') {
+	    bail_with_error("Bad reply from the compile server");
+	}
+	copy_bytes(in, stdout, outlen);
+	fflush(stdout);
+	copy_bytes(in, stderr, errlen);
+	fflush(stderr);
+	if (strcmp(status, "OK") != 0) {
+	    failures++;
+	}
+    }
+    fclose(in);
+    return failures;
+}
+
+// Ask the server at path to shut down
+void client_shutdown(const char *path)
+{
+    int fd = client_connect(path);
+    const char *msg = "SHUTDOWN\n";
+    write_all(fd, msg, strlen(msg));
+    close(fd);
+}
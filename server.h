@@ -0,0 +1,53 @@
+#ifndef _SERVER_H
+#define _SERVER_H
+#include <stddef.h>
+#include <stdbool.h>
+
+// A compile server keeps one process (and its warm buffers and symbol table)
+// alive to serve many compile requests over a Unix domain socket.
+//
+// Protocol: each request is a header line, which is one of
+//    PATH <file name>[<tab><name to use in messages>]
+//    SOURCE <number of bytes> <name to use in messages>
+//    OPEN <number of bytes> <document name>
+//    EDIT <offset> <number of bytes deleted> <number of bytes> <document name>
+//    CLOSE <document name>
+//    SHUTDOWN
+// where a SOURCE line is followed by that many bytes of PL/0 source code
+// (a PATH's file name is used in messages if no other name is given).
+// OPEN starts an incremental document (see incremental.h) with the source
+// code that follows it (replacing any open document with that name),
+// and EDIT replaces the given number of bytes at offset in the document
+// with the bytes that follow it; each compiles the document's new text,
+// parsing and checking again only what the edit changed, where possible.
+// Documents stay open (across connections) until a CLOSE request.
+// The reply to a PATH, SOURCE, OPEN, or EDIT request is a header line
+//    <status> <output length> <diagnostics length>
+// where status is OK or ERROR, followed by the unparsed program
+// and then the error messages (with the given lengths in bytes).
+// The reply to a CLOSE request is "OK 0 0".
+// A connection may carry any number of requests.
+
+// Return the socket path to use when none is given:
+// the value of the environment variable PL0_SOCKET, if it is set,
+// and otherwise a path in /tmp that is specific to the user
+extern const char *server_default_path();
+
+// Serve compile requests on a Unix domain socket at path,
+// until a SHUTDOWN request or an interrupt (SIGINT or SIGTERM).
+// Connections are served one at a time.
+extern void server_run(const char *path);
+
+// Send a compile request for each of the nfiles files named in fnames
+// to the server at path (sending the files' contents if send_source is true,
+// and otherwise their absolute names, with the names as given
+// for messages), printing each reply's output
+// on stdout and its diagnostics on stderr.
+// Return the number of files that had errors.
+extern size_t client_run(const char *path, const char **fnames,
+			 size_t nfiles, bool send_source);
+
+// Ask the server at path to shut down
+extern void client_shutdown(const char *path);
+
+#endif
@@ -0,0 +1,531 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "ast.h"
+#include "ast_walk.h"
+#include "id_attrs.h"
+#include "symbol_table.h"
+#include "exprs.h"
+#include "temps.h"
+#include "trace.h"
+#include "utilities.h"
+#include "simplify.h"
+#include "mem.h"
+
+// The most distinct factors of one induction variable that are reduced
+#define MAX_FACTORS 8
+
+// The state of simplifying a program
+typedef struct {
+    AST *prog;
+    const_values consts;
+    // the stack of a rewriting walk
+    AST **stack;
+    size_t depth;
+    size_t stack_cap;
+    // while replacing products: the products iv_name * iv_factor
+    // are replaced by the temporary iv_temp
+    const char *iv_name;
+    long iv_factor;
+    const char *iv_temp;
+    unsigned int next_temp; // for temp_declare (see temps.h)
+} simplify_state;
+
+// A function that rewrites an expression (see map_stmt)
+typedef AST *(*expr_fn)(simplify_state *s, AST *exp);
+
+// Push ast onto the walk stack of s
+static void push(simplify_state *s, AST *ast)
+{
+    if (s->depth == s->stack_cap) {
+	s->stack_cap = (s->stack_cap == 0) ? 64 : 2 * s->stack_cap;
+	s->stack = (AST **) mem_realloc(
+	    mem_optimizer, s->stack, s->stack_cap * sizeof(AST *));
+	if (s->stack == NULL) {
+	    bail_with_error("No space to simplify expressions!");
+	}
+    }
+    s->stack[s->depth++] = ast;
+}
+
+// Pop the top AST off the walk stack of s
+static AST *pop(simplify_state *s)
+{
+    return s->stack[--s->depth];
+}
+
+// Return true just when v can be the value of a number
+static bool fits(long v)
+{
+    return SHRT_MIN < v && v <= SHRT_MAX;
+}
+
+// If a op b is a number, put it in *v and return true;
+// otherwise return false
+static bool fold(bin_arith_op op, long a, long b, long *v)
+{
+    switch (op) {
+    case addop:
+	*v = a + b;
+	break;
+    case subop:
+	*v = a - b;
+	break;
+    case multop:
+	*v = a * b;
+	break;
+    default:
+	if (b == 0) {
+	    return false;
+	}
+	*v = a / b;
+	break;
+    }
+    return fits(*v);
+}
+
+// Return a (pointer to a) fresh AST for the number v, located at where
+static AST *number_at(AST *where, long v)
+{
+    return ast_number(file_loc2token(where->file_loc), (short int) v);
+}
+
+// Return a (pointer to a) fresh AST for e1 op e2, located at where
+static AST *bin_at(AST *where, AST *e1, bin_arith_op op, AST *e2)
+{
+    return ast_bin_expr(file_loc2token(where->file_loc), e1, op, e2);
+}
+
+// If exp is x + c or x - c for a constant c, set *x to x and *d to c
+// (or -c) and return true, otherwise return false
+static bool split_offset(simplify_state *s, AST *exp, AST **x, long *d)
+{
+    long c;
+    if (exp->type_tag != bin_expr_ast
+	|| exp->data.bin_expr.arith_op > subop
+	|| !const_value(&s->consts, exp->data.bin_expr.rightexp, &c)) {
+	return false;
+    }
+    *x = exp->data.bin_expr.leftexp;
+    *d = (exp->data.bin_expr.arith_op == addop) ? c : -c;
+    return true;
+}
+
+// If exp is x op c for a constant c, set *x to x and *c to c
+// and return true, otherwise return false
+static bool split_factor(simplify_state *s, AST *exp, bin_arith_op op,
+			 AST **x, long *c)
+{
+    if (exp->type_tag != bin_expr_ast || exp->data.bin_expr.arith_op != op
+	|| !const_value(&s->consts, exp->data.bin_expr.rightexp, c)) {
+	return false;
+    }
+    *x = exp->data.bin_expr.leftexp;
+    return true;
+}
+
+// Return an expression for x + d (located at where),
+// combining d with the constant that x adds, if any
+static AST *add_offset(simplify_state *s, AST *where, AST *x, long d)
+{
+    AST *y;
+    long e;
+    if (split_offset(s, x, &y, &e) && fits(d + e) && fits(-(d + e))) {
+	x = y;
+	d += e;
+    } else if (!fits(d) || !fits(-d)) {
+	return bin_at(where, x, addop, number_at(where, d));
+    }
+    if (d == 0) {
+	return x;
+    }
+    return (d > 0) ? bin_at(where, x, addop, number_at(where, d))
+	: bin_at(where, x, subop, number_at(where, -d));
+}
+
+// Requires: e1 and e2 are simplified
+// Return a simplified expression for e1 op e2, where orig is
+// the expression being simplified (and is returned if nothing changes)
+static AST *simplify_bin(simplify_state *s, AST *orig, AST *e1,
+			 bin_arith_op op, AST *e2)
+{
+    long a, b, v;
+    bool ca = const_value(&s->consts, e1, &a);
+    bool cb = const_value(&s->consts, e2, &b);
+    if (ca && cb && fold(op, a, b, &v)) {
+	return number_at(orig, v);
+    }
+    // constants go on the right of sums and products
+    if (ca && !cb && (op == addop || op == multop)) {
+	AST *t = e1;
+	e1 = e2;
+	e2 = t;
+	b = a;
+	cb = true;
+    }
+    AST *x;
+    long c;
+    switch (op) {
+    case addop:
+    case subop:
+	if (cb) {
+	    return add_offset(s, orig, e1, (op == addop) ? b : -b);
+	}
+	if (op == subop && expr_same(e1, e2) && !expr_may_fail(e1)) {
+	    return number_at(orig, 0);
+	}
+	// (x + c) op y is (x op y) + c
+	if (split_offset(s, e1, &x, &c)) {
+	    return add_offset(s, orig, simplify_bin(s, orig, x, op, e2), c);
+	}
+	// x op (y + c) is (x op y) + c, or (x op y) - c for subtraction
+	if (split_offset(s, e2, &x, &c)) {
+	    return add_offset(s, orig, simplify_bin(s, orig, e1, op, x),
+			      (op == addop) ? c : -c);
+	}
+	break;
+    case multop:
+	if (cb) {
+	    if (b == 1) {
+		return e1;
+	    }
+	    if (b == 0 && !expr_may_fail(e1)) {
+		return number_at(orig, 0);
+	    }
+	    if (split_factor(s, e1, multop, &x, &c) && fits(c * b)) {
+		return bin_at(orig, x, multop, number_at(orig, c * b));
+	    }
+	    break;
+	}
+	// (x * c) * y and y * (x * c) are (x * y) * c
+	if (split_factor(s, e1, multop, &x, &c)) {
+	    return bin_at(orig, simplify_bin(s, orig, x, multop, e2), multop,
+			  e1->data.bin_expr.rightexp);
+	}
+	if (split_factor(s, e2, multop, &x, &c)) {
+	    return bin_at(orig, simplify_bin(s, orig, e1, multop, x), multop,
+			  e2->data.bin_expr.rightexp);
+	}
+	break;
+    default:
+	if (cb && b == 1) {
+	    return e1;
+	}
+	// (x / c) / b is x / (c * b) for positive c and b
+	if (cb && b > 0 && split_factor(s, e1, divop, &x, &c) && c > 0
+	    && fits(c * b)) {
+	    return bin_at(orig, x, divop, number_at(orig, c * b));
+	}
+	break;
+    }
+    if (orig->type_tag == bin_expr_ast && orig->data.bin_expr.arith_op == op
+	&& orig->data.bin_expr.leftexp == e1
+	&& orig->data.bin_expr.rightexp == e2) {
+	return orig;
+    }
+    return bin_at(orig, e1, op, e2);
+}
+
+// Callbacks for simplifying an expression, which push
+// the simplified AST for each node
+static void simplify_leaf(ast_walker *w, AST *exp, int level,
+			  unsigned int flags)
+{
+    push((simplify_state *) ast_walk_context(w), exp);
+}
+
+static void simplify_bin_expr(ast_walker *w, AST *exp, int level,
+			      unsigned int flags)
+{
+    simplify_state *s = (simplify_state *) ast_walk_context(w);
+    AST *e2 = pop(s);
+    AST *e1 = pop(s);
+    push(s, simplify_bin(s, exp, e1, exp->data.bin_expr.arith_op, e2));
+}
+
+static const ast_visitor simplify_visitor = {
+    .post = {
+	[ident_ast] = simplify_leaf,
+	[number_ast] = simplify_leaf,
+	[bin_expr_ast] = simplify_bin_expr,
+    },
+};
+
+// Return a simplified version of the expression exp
+static AST *simplify_expr(simplify_state *s, AST *exp)
+{
+    s->depth = 0;
+    ast_walk(exp, &simplify_visitor, s, 0, 0);
+    return pop(s);
+}
+
+// Return true just when exp is the product s->iv_name * s->iv_factor
+static bool is_iv_product(simplify_state *s, AST *exp)
+{
+    long k;
+    return exp->type_tag == bin_expr_ast
+	&& exp->data.bin_expr.arith_op == multop
+	&& exp->data.bin_expr.leftexp->type_tag == ident_ast
+	&& strcmp(exp->data.bin_expr.leftexp->data.ident.name,
+		  s->iv_name) == 0
+	&& const_value(&s->consts, exp->data.bin_expr.rightexp, &k)
+	&& k == s->iv_factor;
+}
+
+// Callbacks for replacing the products s->iv_name * s->iv_factor
+// with s->iv_temp, which push the new AST for each node
+static void replace_bin_expr(ast_walker *w, AST *exp, int level,
+			     unsigned int flags)
+{
+    simplify_state *s = (simplify_state *) ast_walk_context(w);
+    AST *e2 = pop(s);
+    AST *e1 = pop(s);
+    if (is_iv_product(s, exp)) {
+	push(s, ast_ident(file_loc2token(exp->file_loc), s->iv_temp));
+    } else if (e1 != exp->data.bin_expr.leftexp
+	       || e2 != exp->data.bin_expr.rightexp) {
+	push(s, bin_at(exp, e1, exp->data.bin_expr.arith_op, e2));
+    } else {
+	push(s, exp);
+    }
+}
+
+static const ast_visitor replace_visitor = {
+    .post = {
+	[ident_ast] = simplify_leaf,
+	[number_ast] = simplify_leaf,
+	[bin_expr_ast] = replace_bin_expr,
+    },
+};
+
+// Return exp with the products s->iv_name * s->iv_factor replaced
+static AST *replace_products(simplify_state *s, AST *exp)
+{
+    s->depth = 0;
+    ast_walk(exp, &replace_visitor, s, 0, 0);
+    return pop(s);
+}
+
+// Return the condition cond with its expressions rewritten by fn
+static AST *map_cond(simplify_state *s, AST *cond, expr_fn fn)
+{
+    token t = file_loc2token(cond->file_loc);
+    if (cond->type_tag == odd_cond_ast) {
+	AST *e = fn(s, cond->data.odd_cond.exp);
+	return (e == cond->data.odd_cond.exp) ? cond : ast_odd_cond(t, e);
+    }
+    AST *e1 = fn(s, cond->data.bin_cond.leftexp);
+    AST *e2 = fn(s, cond->data.bin_cond.rightexp);
+    if (e1 == cond->data.bin_cond.leftexp
+	&& e2 == cond->data.bin_cond.rightexp) {
+	return cond;
+    }
+    return ast_bin_cond(t, e1, cond->data.bin_cond.relop, e2);
+}
+
+static AST *reduce_loop(simplify_state *s, AST *loop);
+
+// Return stmt with its expressions rewritten by fn
+// (and, if loops is true, with the strength of its loops reduced,
+// innermost first)
+static AST *map_stmt(simplify_state *s, AST *stmt, expr_fn fn, bool loops)
+{
+    token t = file_loc2token(stmt->file_loc);
+    switch (stmt->type_tag) {
+    case assign_ast: {
+	AST *e = fn(s, stmt->data.assign_stmt.exp);
+	if (e != stmt->data.assign_stmt.exp) {
+	    return ast_assign_stmt(t, stmt->data.assign_stmt.name, e);
+	}
+	return stmt;
+    }
+    case write_ast: {
+	AST *e = fn(s, stmt->data.write_stmt.exp);
+	if (e != stmt->data.write_stmt.exp) {
+	    return ast_write_stmt(t, e);
+	}
+	return stmt;
+    }
+    case begin_ast: {
+	AST_list ret = ast_list_empty_list();
+	AST *last = NULL;
+	AST_list stmts = stmt->data.begin_stmt.stmts;
+	while (!ast_list_is_empty(stmts)) {
+	    // take the rest first, as a reduced loop is cut off from it
+	    AST *cur = ast_list_first(stmts);
+	    stmts = ast_list_rest(stmts);
+	    AST *done = map_stmt(s, cur, fn, loops);
+	    done->next = NULL;
+	    if (ast_list_is_empty(ret)) {
+		ret = done;
+	    } else {
+		ast_list_splice(last, done);
+	    }
+	    last = done;
+	}
+	stmt->data.begin_stmt.stmts = ret;
+	return stmt;
+    }
+    case if_ast:
+	stmt->data.if_stmt.cond = map_cond(s, stmt->data.if_stmt.cond, fn);
+	stmt->data.if_stmt.thenstmt = map_stmt(s, stmt->data.if_stmt.thenstmt,
+					       fn, loops);
+	stmt->data.if_stmt.elsestmt = map_stmt(s, stmt->data.if_stmt.elsestmt,
+					       fn, loops);
+	return stmt;
+    case while_ast:
+	stmt->data.while_stmt.cond = map_cond(s, stmt->data.while_stmt.cond,
+					      fn);
+	stmt->data.while_stmt.stmt = map_stmt(s, stmt->data.while_stmt.stmt,
+					      fn, loops);
+	return loops ? reduce_loop(s, stmt) : stmt;
+    default:
+	return stmt;
+    }
+}
+
+// Count the statements that change a variable (in the name_count context)
+typedef struct {
+    const char *name;
+    size_t changes;
+} name_count;
+
+static void count_change(ast_walker *w, AST *stmt, int level,
+			 unsigned int flags)
+{
+    name_count *nc = (name_count *) ast_walk_context(w);
+    const char *name = (stmt->type_tag == assign_ast)
+	? stmt->data.assign_stmt.name : stmt->data.read_stmt.name;
+    if (strcmp(name, nc->name) == 0) {
+	nc->changes++;
+    }
+}
+
+static const ast_visitor change_visitor = {
+    .pre = { [assign_ast] = count_change, [read_ast] = count_change },
+};
+
+// Collect the distinct factors k (up to MAX_FACTORS of them, in *factors)
+// of the products name * k (in the factor_list context)
+typedef struct {
+    simplify_state *s;
+    const char *name;
+    long factors[MAX_FACTORS];
+    size_t num_factors;
+} factor_list;
+
+static void note_factor(ast_walker *w, AST *exp, int level,
+			unsigned int flags)
+{
+    factor_list *fl = (factor_list *) ast_walk_context(w);
+    long k;
+    if (exp->data.bin_expr.arith_op != multop
+	|| exp->data.bin_expr.leftexp->type_tag != ident_ast
+	|| strcmp(exp->data.bin_expr.leftexp->data.ident.name, fl->name) != 0
+	|| !const_value(&fl->s->consts, exp->data.bin_expr.rightexp, &k)) {
+	return;
+    }
+    for (size_t i = 0; i < fl->num_factors; i++) {
+	if (fl->factors[i] == k) {
+	    return;
+	}
+    }
+    if (fl->num_factors < MAX_FACTORS) {
+	fl->factors[fl->num_factors++] = k;
+    }
+}
+
+static const ast_visitor factor_visitor = {
+    .pre = { [bin_expr_ast] = note_factor },
+};
+
+// Requires: loop is a while statement whose parts are simplified
+// Return loop with the strength of the multiplications by its
+// induction variables reduced (see simplify.h), which may be
+// a begin statement that sets the temporaries and then does the loop
+static AST *reduce_loop(simplify_state *s, AST *loop)
+{
+    AST *body = loop->data.while_stmt.stmt;
+    AST_list stmts = (body->type_tag == begin_ast)
+	? body->data.begin_stmt.stmts : ast_list_singleton(body);
+    AST_list inits = ast_list_empty_list();
+    AST *last_init = NULL;
+    for (AST *inc = stmts; !ast_list_is_empty(inc); inc = ast_list_rest(inc)) {
+	AST *x;
+	long c;
+	if (inc->type_tag != assign_ast
+	    || !split_offset(s, inc->data.assign_stmt.exp, &x, &c)
+	    || x->type_tag != ident_ast
+	    || strcmp(x->data.ident.name, inc->data.assign_stmt.name) != 0) {
+	    continue;
+	}
+	const char *name = inc->data.assign_stmt.name;
+	name_count nc = { name, 0 };
+	ast_walk(body, &change_visitor, &nc, 0, 0);
+	if (nc.changes != 1) {
+	    continue;
+	}
+	factor_list fl;
+	fl.s = s;
+	fl.name = name;
+	fl.num_factors = 0;
+	ast_walk(loop, &factor_visitor, &fl, 0, 0);
+	for (size_t i = 0; i < fl.num_factors; i++) {
+	    long k = fl.factors[i];
+	    if (!fits(c * k) || !fits(-c * k)) {
+		continue;
+	    }
+	    const char *temp = temp_declare(s->prog, "iv", &s->next_temp);
+	    s->iv_name = name;
+	    s->iv_factor = k;
+	    s->iv_temp = temp;
+	    loop->data.while_stmt.stmt = map_stmt(s, loop->data.while_stmt.stmt,
+						  replace_products, false);
+	    loop->data.while_stmt.cond = map_cond(s, loop->data.while_stmt.cond,
+						  replace_products);
+	    // the increment itself is unchanged, so it is still inc,
+	    // and the temporary follows it
+	    token t = file_loc2token(inc->file_loc);
+	    AST *step = ast_assign_stmt(t, temp, add_offset(
+		s, inc, ast_ident(t, temp), c * k));
+	    step->next = inc->next;
+	    inc->next = step;
+	    AST *init = ast_assign_stmt(
+		t, temp, bin_at(inc, ast_ident(t, name), multop,
+				number_at(inc, k)));
+	    if (ast_list_is_empty(inits)) {
+		inits = init;
+	    } else {
+		ast_list_splice(last_init, init);
+	    }
+	    last_init = init;
+	}
+    }
+    if (ast_list_is_empty(inits)) {
+	return loop;
+    }
+    body = loop->data.while_stmt.stmt;
+    if (body->type_tag != begin_ast && body->next != NULL) {
+	// the body was one statement, and now has its temporaries' steps
+	loop->data.while_stmt.stmt = ast_begin_stmt(
+	    file_loc2token(body->file_loc), body);
+    }
+    ast_list_splice(last_init, loop);
+    loop->next = NULL;
+    return ast_begin_stmt(file_loc2token(loop->file_loc), inits);
+}
+
+// Simplify the expressions of prog (see simplify.h)
+void simplify_program(AST *prog)
+{
+    TRACE_BEGIN("simplify");
+    simplify_state s;
+    memset(&s, 0, sizeof(s));
+    s.prog = prog;
+    const_values_init(&s.consts, prog);
+    prog->data.program.stmt = map_stmt(&s, prog->data.program.stmt,
+				       simplify_expr, true);
+    const_values_free(&s.consts);
+    mem_free(s.stack);
+    TRACE_END();
+}
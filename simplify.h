@@ -0,0 +1,29 @@
+#ifndef _SIMPLIFY_H
+#define _SIMPLIFY_H
+#include "ast.h"
+
+// Algebraic simplification of a program's expressions, which
+//  - folds operations on constants (numbers and declared constants)
+//    whose result is a number (so, e.g., division by 0 is not folded),
+//  - applies the identities x+0 = x-0 = x*1 = x/1 = x, and also
+//    x*0 = x-x = 0 when evaluating x cannot fail (see exprs.h),
+//  - reassociates sums and products to bring their constants together,
+//    so (x+3)+y+4 becomes (x+y)+7, and (x*2)*4 becomes x*8
+//    (arithmetic is on 16-bit numbers that wrap around, so this
+//    does not change the result, even if a step overflows),
+//  - and reduces the strength of multiplications by induction variables
+//    in while loops: if a loop's body changes a variable i only by one
+//    statement i := i + c (or i - c) at its top level, then i * k
+//    (for a constant k) in the loop is replaced by a temporary
+//    that is set to i * k before the loop and increased by c * k
+//    right after each change to i (see temps.h for temporaries).
+
+// Requires: prog has passed its scope check (see scope_check.h),
+//           the current scope is prog's symbol table, and the expression
+//           nodes of prog may be shared (see ast_share_begin in ast.h)
+// Simplify the expressions of prog (changing it in place,
+// but making new nodes for the statements and expressions that change).
+// If there is no space, bail with an error message.
+extern void simplify_program(AST *prog);
+
+#endif
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utilities.h"
+#include "sink.h"
+#include "mem.h"
+
+// Initial size of the buffer of a string sink
+#define STRING_SINK_INITIAL_SIZE 4096
+
+// Number of chars needed for the decimal form of any long (with a sign)
+#define MAX_LONG_DIGITS 24
+
+// Return a fresh sink with a buffer of cap chars writing to f
+static sink *sink_create(FILE *f, size_t cap)
+{
+    sink *s = (sink *) mem_alloc(mem_output, sizeof(sink));
+    if (s == NULL) {
+	bail_with_error("No space for a sink!");
+    }
+    s->buf = (char *) mem_alloc(mem_output, cap);
+    if (s->buf == NULL) {
+	bail_with_error("No space for a sink's buffer!");
+    }
+    s->file = f;
+    s->len = 0;
+    s->cap = cap;
+    s->discard = false;
+    return s;
+}
+
+// Return a fresh sink that writes to the FILE f.
+// If there is no space, bail with an error message.
+sink *sink_file(FILE *f)
+{
+    return sink_create(f, SINK_BUFFER_SIZE);
+}
+
+// Return a fresh sink that collects its output in memory
+// (see sink_contents).
+// If there is no space, bail with an error message.
+sink *sink_string()
+{
+    return sink_create(NULL, STRING_SINK_INITIAL_SIZE);
+}
+
+// Return a fresh sink that throws away its output
+// (e.g., to time the code that writes to it).
+// If there is no space, bail with an error message.
+sink *sink_null()
+{
+    sink *s = sink_create(NULL, SINK_BUFFER_SIZE);
+    s->discard = true;
+    return s;
+}
+
+// Requires: s is a string sink
+// Make room in s's buffer for at least n more chars (and a null char)
+static void sink_grow(sink *s, size_t n)
+{
+    size_t newcap = s->cap;
+    while (newcap - s->len <= n) {
+	newcap *= 2;
+    }
+    char *nb = (char *) mem_realloc(mem_output, s->buf, newcap);
+    if (nb == NULL) {
+	bail_with_error("No space to grow a string sink!");
+    }
+    s->buf = nb;
+    s->cap = newcap;
+}
+
+// Make room in s's buffer for n more chars,
+// flushing a file sink, emptying a null sink, or growing a string sink.
+// Return false if a file (or null) sink's buffer cannot hold n chars at all.
+static bool sink_reserve(sink *s, size_t n)
+{
+    if (s->cap - s->len > n) {
+	return true;
+    }
+    if (s->discard) {
+	s->len = 0;
+	return s->cap > n;
+    }
+    if (s->file == NULL) {
+	sink_grow(s, n);
+	return true;
+    }
+    sink_flush(s);
+    return s->cap > n;
+}
+
+// Write the n chars starting at data to s
+void sink_write(sink *s, const char *data, size_t n)
+{
+    if (sink_reserve(s, n)) {
+	memcpy(s->buf + s->len, data, n);
+	s->len += n;
+    } else if (s->file != NULL) {
+	// too big to be worth buffering
+	fwrite(data, 1, n, s->file);
+    }
+}
+
+// Write the null-terminated string str to s
+void sink_puts(sink *s, const char *str)
+{
+    sink_write(s, str, strlen(str));
+}
+
+// Write the char c to s
+void sink_putc(sink *s, char c)
+{
+    if (s->cap - s->len <= 1) {
+	sink_reserve(s, 1);
+    }
+    s->buf[s->len++] = c;
+}
+
+// Write the decimal form of v to s
+void sink_put_int(sink *s, long v)
+{
+    char digits[MAX_LONG_DIGITS];
+    char *p = digits + MAX_LONG_DIGITS;
+    // use an unsigned magnitude, so that LONG_MIN works too
+    unsigned long mag = (v < 0) ? -(unsigned long) v : (unsigned long) v;
+    do {
+	*--p = (char) ('0' + mag % 10);
+	mag /= 10;
+    } while (mag != 0);
+    if (v < 0) {
+	*--p = '-';
+    }
+    sink_write(s, p, (size_t) (digits + MAX_LONG_DIGITS - p));
+}
+
+// Write n spaces to s
+void sink_spaces(sink *s, size_t n)
+{
+    while (n > 0) {
+	size_t chunk = (n < s->cap / 2) ? n : s->cap / 2;
+	sink_reserve(s, chunk);
+	memset(s->buf + s->len, ' ', chunk);
+	s->len += chunk;
+	n -= chunk;
+    }
+}
+
+// Write the buffered output of a file sink to its FILE
+// (or throw it away, for a null sink).
+// Does nothing for a string sink.
+void sink_flush(sink *s)
+{
+    if (s->discard) {
+	s->len = 0;
+	return;
+    }
+    if (s->file == NULL || s->len == 0) {
+	return;
+    }
+    if (fwrite(s->buf, 1, s->len, s->file) != s->len) {
+	bail_with_error("Error writing output!");
+    }
+    s->len = 0;
+    fflush(s->file);
+}
+
+// Requires: s is a string sink
+// Return the (null-terminated) text written to s so far,
+// which is valid until the next write to s or until s is closed
+const char *sink_contents(sink *s)
+{
+    // there is always room for the null char (see sink_reserve)
+    s->buf[s->len] = '\0';
+    return s->buf;
+}
+
+// Return the number of chars written to s and not yet flushed
+// (for a string sink that is all the text written so far)
+size_t sink_length(sink *s)
+{
+    return s->len;
+}
+
+// Discard the text in s's buffer (without writing it),
+// keeping the buffer for reuse
+void sink_reset(sink *s)
+{
+    s->len = 0;
+}
+
+// Flush s, then free it (and its buffer)
+void sink_close(sink *s)
+{
+    sink_flush(s);
+    mem_free(s->buf);
+    mem_free(s);
+}
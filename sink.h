@@ -0,0 +1,71 @@
+#ifndef _SINK_H
+#define _SINK_H
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Size of the user-space buffer of a sink that writes to a FILE
+#define SINK_BUFFER_SIZE (256 * 1024)
+
+// An output sink collects text in a large buffer.
+// A file sink writes its buffer to a FILE when it fills up
+// (or is flushed), a string sink keeps all the text in memory.
+typedef struct sink_s {
+    FILE *file;    // NULL for a string sink
+    char *buf;
+    size_t len;    // number of chars used in buf
+    size_t cap;    // size of buf
+    bool discard;  // true for a null sink
+} sink;
+
+// Return a fresh sink that writes to the FILE f.
+// If there is no space, bail with an error message.
+extern sink *sink_file(FILE *f);
+
+// Return a fresh sink that collects its output in memory
+// (see sink_contents).
+// If there is no space, bail with an error message.
+extern sink *sink_string();
+
+// Return a fresh sink that throws away its output
+// (e.g., to time the code that writes to it).
+// If there is no space, bail with an error message.
+extern sink *sink_null();
+
+// Write the n chars starting at data to s
+extern void sink_write(sink *s, const char *data, size_t n);
+
+// Write the null-terminated string str to s
+extern void sink_puts(sink *s, const char *str);
+
+// Write the char c to s
+extern void sink_putc(sink *s, char c);
+
+// Write the decimal form of v to s
+extern void sink_put_int(sink *s, long v);
+
+// Write n spaces to s
+extern void sink_spaces(sink *s, size_t n);
+
+// Write the buffered output of a file sink to its FILE
+// (or throw it away, for a null sink).
+// Does nothing for a string sink.
+extern void sink_flush(sink *s);
+
+// Requires: s is a string sink
+// Return the (null-terminated) text written to s so far,
+// which is valid until the next write to s or until s is closed
+extern const char *sink_contents(sink *s);
+
+// Return the number of chars written to s and not yet flushed
+// (for a string sink that is all the text written so far)
+extern size_t sink_length(sink *s);
+
+// Discard the text in s's buffer (without writing it),
+// keeping the buffer for reuse
+extern void sink_reset(sink *s);
+
+// Flush s, then free it (and its buffer)
+extern void sink_close(sink *s);
+
+#endif
@@ -0,0 +1,330 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include "ast.h"
+#include "ast_walk.h"
+#include "stats.h"
+
+// Statistics of some compiled files
+typedef struct {
+    double wall[NUM_STATS_PHASES];
+    double cpu[NUM_STATS_PHASES];
+    unsigned long tokens;
+    unsigned long ast_nodes[NUM_AST_TYPES];
+    unsigned long symbols;
+    unsigned long lookups;
+    unsigned long files;
+    unsigned long cached_files;
+} compile_stats;
+
+// Names of the phases, indexed by stats_phase
+static const char *phase_names[NUM_STATS_PHASES] = {
+    "lex", "parse", "unparse", "scope_check"
+};
+
+// Names of the AST types, indexed by AST_type
+static const char *ast_type_names[NUM_AST_TYPES] = {
+    "program", "const_decl", "var_decl", "assign", "begin",
+    "if", "while", "read", "write", "skip",
+    "odd_cond", "bin_cond", "op_expr", "bin_expr", "ident", "number"
+};
+
+// Is --stats on? (only set before any files are compiled)
+static bool collecting = false;
+// Wall-clock time when collecting started
+static double run_start;
+
+// Totals for the run, guarded by totals_lock
+static compile_stats totals;
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Statistics of the file the current thread is compiling
+static _Thread_local compile_stats file_stats;
+// The innermost running timer of the current thread (or NULL)
+static _Thread_local stats_timer *current_timer = NULL;
+
+// Return the time of the given clock, in seconds
+static double clock_seconds(clockid_t clk)
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+// Start collecting statistics for this run
+// (called before any file is compiled)
+void stats_enable()
+{
+    collecting = true;
+    run_start = clock_seconds(CLOCK_MONOTONIC);
+}
+
+// Are statistics being collected?
+bool stats_enabled()
+{
+    return collecting;
+}
+
+// Start collecting the statistics of a file in the current thread
+void stats_file_begin()
+{
+    if (!collecting) {
+	return;
+    }
+    memset(&file_stats, 0, sizeof(file_stats));
+    // timers of a file that had an error were never stopped
+    current_timer = NULL;
+}
+
+// Requires: totals_lock is held
+// Add the current thread's statistics to the totals
+static void add_file_stats()
+{
+    for (int p = 0; p < NUM_STATS_PHASES; p++) {
+	totals.wall[p] += file_stats.wall[p];
+	totals.cpu[p] += file_stats.cpu[p];
+    }
+    totals.tokens += file_stats.tokens;
+    for (int t = 0; t < NUM_AST_TYPES; t++) {
+	totals.ast_nodes[t] += file_stats.ast_nodes[t];
+    }
+    totals.symbols += file_stats.symbols;
+    totals.lookups += file_stats.lookups;
+}
+
+// Add the current thread's statistics for the file it was compiling
+// to the totals (from_cache is true if the file's results were
+// taken from the compilation cache, so no phases ran)
+void stats_file_end(bool from_cache)
+{
+    if (!collecting) {
+	return;
+    }
+    pthread_mutex_lock(&totals_lock);
+    add_file_stats();
+    totals.files++;
+    if (from_cache) {
+	totals.cached_files++;
+    }
+    pthread_mutex_unlock(&totals_lock);
+    memset(&file_stats, 0, sizeof(file_stats));
+}
+
+// Add the counts the current thread made while helping another thread
+// compile a file (e.g., lookups in a frozen scope) to the totals
+void stats_merge_helper()
+{
+    if (!collecting) {
+	return;
+    }
+    pthread_mutex_lock(&totals_lock);
+    add_file_stats();
+    pthread_mutex_unlock(&totals_lock);
+    memset(&file_stats, 0, sizeof(file_stats));
+}
+
+// Start the timer t for the given phase
+void stats_timer_start(stats_timer *t, stats_phase phase)
+{
+    if (!collecting) {
+	return;
+    }
+    t->phase = phase;
+    t->child_wall = 0.0;
+    t->child_cpu = 0.0;
+    t->parent = current_timer;
+    current_timer = t;
+    t->wall_start = clock_seconds(CLOCK_MONOTONIC);
+    t->cpu_start = clock_seconds(CLOCK_THREAD_CPUTIME_ID);
+}
+
+// Requires: t is the most recently started timer that is still running
+// Stop the timer t, adding its time to its phase
+void stats_timer_stop(stats_timer *t)
+{
+    if (!collecting) {
+	return;
+    }
+    double wall = clock_seconds(CLOCK_MONOTONIC) - t->wall_start;
+    double cpu = clock_seconds(CLOCK_THREAD_CPUTIME_ID) - t->cpu_start;
+    file_stats.wall[t->phase] += wall - t->child_wall;
+    file_stats.cpu[t->phase] += cpu - t->child_cpu;
+    if (t->parent != NULL) {
+	t->parent->child_wall += wall;
+	t->parent->child_cpu += cpu;
+    }
+    current_timer = t->parent;
+}
+
+// Count n tokens read by the lexer
+void stats_count_tokens(unsigned long n)
+{
+    file_stats.tokens += n;
+}
+
+// Count the node ast in the array of counts that is the walk's context
+static void count_node(ast_walker *w, AST *ast, int level, unsigned int flags)
+{
+    unsigned long *counts = (unsigned long *) ast_walk_context(w);
+    counts[ast->type_tag]++;
+}
+
+static const ast_visitor count_visitor = {
+    .pre = {
+	[program_ast] = count_node, [const_decl_ast] = count_node,
+	[var_decl_ast] = count_node, [assign_ast] = count_node,
+	[begin_ast] = count_node, [if_ast] = count_node,
+	[while_ast] = count_node, [read_ast] = count_node,
+	[write_ast] = count_node, [skip_ast] = count_node,
+	[odd_cond_ast] = count_node, [bin_cond_ast] = count_node,
+	[op_expr_ast] = count_node, [bin_expr_ast] = count_node,
+	[ident_ast] = count_node, [number_ast] = count_node,
+    },
+};
+
+// Count the nodes (by type) in the AST of a program
+void stats_count_ast(AST *progast)
+{
+    if (!collecting) {
+	return;
+    }
+    ast_walk(progast, &count_visitor, file_stats.ast_nodes, 0, 0);
+}
+
+// Record the number of identifiers declared in the program's scope
+void stats_count_symbols(unsigned int n)
+{
+    file_stats.symbols += n;
+}
+
+// Count one lookup in the symbol table
+void stats_count_lookup()
+{
+    file_stats.lookups++;
+}
+
+// Return the total number of AST nodes counted
+static unsigned long total_ast_nodes()
+{
+    unsigned long nodes = 0;
+    for (int t = 0; t < NUM_AST_TYPES; t++) {
+	nodes += totals.ast_nodes[t];
+    }
+    return nodes;
+}
+
+// Return n per second of the given time (0 if no time was measured)
+static double per_second(unsigned long n, double seconds)
+{
+    return (seconds > 0.0) ? n / seconds : 0.0;
+}
+
+// Return the peak resident set size of this process in kilobytes
+static long peak_rss_kb()
+{
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) {
+	return 0;
+    }
+    return ru.ru_maxrss;
+}
+
+// Print the totals on out as plain text
+static void report_text(FILE *out, double run_wall, double run_cpu)
+{
+    fprintf(out, "Compile statistics (%lu files, %lu from the cache):\n",
+	    totals.files, totals.cached_files);
+    fprintf(out, "  %-14s %12s %12s\n", "phase", "wall (s)", "cpu (s)");
+    for (int p = 0; p < NUM_STATS_PHASES; p++) {
+	fprintf(out, "  %-14s %12.6f %12.6f\n", phase_names[p],
+		totals.wall[p], totals.cpu[p]);
+    }
+    fprintf(out, "  %-14s %12.6f %12.6f\n", "total (run)", run_wall, run_cpu);
+    unsigned long nodes = total_ast_nodes();
+    fprintf(out, "  tokens: %lu (%.0f/s lexing)\n", totals.tokens,
+	    per_second(totals.tokens, totals.wall[phase_lex]));
+    fprintf(out, "  symbols: %lu\n", totals.symbols);
+    fprintf(out, "  lookups: %lu (%.0f/s scope checking)\n", totals.lookups,
+	    per_second(totals.lookups, totals.wall[phase_scope_check]));
+    fprintf(out, "  AST nodes: %lu (%.0f/s parsing)\n", nodes,
+	    per_second(nodes, totals.wall[phase_parse]));
+    for (int t = 0; t < NUM_AST_TYPES; t++) {
+	if (totals.ast_nodes[t] != 0) {
+	    fprintf(out, "    %-12s %10lu\n", ast_type_names[t],
+		    totals.ast_nodes[t]);
+	}
+    }
+    fprintf(out, "  peak RSS: %ld KiB\n", peak_rss_kb());
+}
+
+// Print the totals on out as a JSON object
+static void report_json(FILE *out, double run_wall, double run_cpu)
+{
+    fprintf(out, "{\"files\": %lu, \"cached_files\": %lu,\n",
+	    totals.files, totals.cached_files);
+    fprintf(out, " \"phases\": {");
+    for (int p = 0; p < NUM_STATS_PHASES; p++) {
+	fprintf(out, "%s\"%s\": {\"wall\": %.6f, \"cpu\": %.6f}",
+		(p == 0) ? "" : ", ", phase_names[p],
+		totals.wall[p], totals.cpu[p]);
+    }
+    fprintf(out, "},\n \"total\": {\"wall\": %.6f, \"cpu\": %.6f},\n",
+	    run_wall, run_cpu);
+    fprintf(out, " \"tokens\": %lu, \"symbols\": %lu, \"lookups\": %lu,\n",
+	    totals.tokens, totals.symbols, totals.lookups);
+    fprintf(out, " \"ast_nodes\": {");
+    for (int t = 0; t < NUM_AST_TYPES; t++) {
+	fprintf(out, "%s\"%s\": %lu", (t == 0) ? "" : ", ",
+		ast_type_names[t], totals.ast_nodes[t]);
+    }
+    fprintf(out, "},\n \"peak_rss_kb\": %ld}\n", peak_rss_kb());
+}
+
+// Print the totals on out as a CSV header line and a line of values,
+// including the rates of each phase
+static void report_csv(FILE *out, double run_wall, double run_cpu)
+{
+    fprintf(out, "files,cached_files,tokens,ast_nodes,symbols,lookups");
+    for (int p = 0; p < NUM_STATS_PHASES; p++) {
+	fprintf(out, ",%s_wall,%s_cpu", phase_names[p], phase_names[p]);
+    }
+    fprintf(out, ",total_wall,total_cpu,tokens_per_sec,nodes_per_sec"
+	    ",lookups_per_sec,peak_rss_kb\n");
+
+    unsigned long nodes = total_ast_nodes();
+    fprintf(out, "%lu,%lu,%lu,%lu,%lu,%lu", totals.files,
+	    totals.cached_files, totals.tokens, nodes, totals.symbols,
+	    totals.lookups);
+    for (int p = 0; p < NUM_STATS_PHASES; p++) {
+	fprintf(out, ",%.6f,%.6f", totals.wall[p], totals.cpu[p]);
+    }
+    fprintf(out, ",%.6f,%.6f,%.0f,%.0f,%.0f,%ld\n", run_wall, run_cpu,
+	    per_second(totals.tokens, totals.wall[phase_lex]),
+	    per_second(nodes, totals.wall[phase_parse]),
+	    per_second(totals.lookups, totals.wall[phase_scope_check]),
+	    peak_rss_kb());
+}
+
+// Print a report of the totals on out in the given format
+// (for stats_csv, a header line and a line of values)
+void stats_report(FILE *out, stats_format fmt)
+{
+    if (!collecting) {
+	return;
+    }
+    double run_wall = clock_seconds(CLOCK_MONOTONIC) - run_start;
+    double run_cpu = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+    pthread_mutex_lock(&totals_lock);
+    if (fmt == stats_json) {
+	report_json(out, run_wall, run_cpu);
+    } else if (fmt == stats_csv) {
+	report_csv(out, run_wall, run_cpu);
+    } else {
+	report_text(out, run_wall, run_cpu);
+    }
+    pthread_mutex_unlock(&totals_lock);
+    fflush(out);
+}
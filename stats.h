@@ -0,0 +1,79 @@
+#ifndef _STATS_H
+#define _STATS_H
+#include <stdio.h>
+#include <stdbool.h>
+#include "ast.h"
+
+// Compile statistics (for the --stats option) record where compile time
+// goes: the wall-clock and CPU time of each phase, and counts of
+// tokens, AST nodes (by type), declared identifiers and symbol table lookups.
+// Each thread collects the statistics of the file it is compiling,
+// and these are added to the totals for the run when the file is done.
+// When statistics are not enabled, the functions below do nothing.
+
+// The phases that are timed
+typedef enum {
+    phase_lex, phase_parse, phase_unparse, phase_scope_check
+} stats_phase;
+
+// Number of phases (for tables indexed by stats_phase)
+#define NUM_STATS_PHASES (phase_scope_check + 1)
+
+// Formats for reports
+typedef enum { stats_text, stats_json, stats_csv } stats_format;
+
+// A timer for one phase. Timers nest: time spent in a phase
+// that starts while another phase's timer is running
+// is not counted in the outer phase (e.g., lexing during parsing).
+typedef struct stats_timer_s {
+    stats_phase phase;
+    double wall_start;
+    double cpu_start;
+    double child_wall;   // time spent in nested timers
+    double child_cpu;
+    struct stats_timer_s *parent;
+} stats_timer;
+
+// Start collecting statistics for this run
+// (called before any file is compiled)
+extern void stats_enable();
+
+// Are statistics being collected?
+extern bool stats_enabled();
+
+// Start collecting the statistics of a file in the current thread
+extern void stats_file_begin();
+
+// Add the current thread's statistics for the file it was compiling
+// to the totals (from_cache is true if the file's results were
+// taken from the compilation cache, so no phases ran)
+extern void stats_file_end(bool from_cache);
+
+// Add the counts the current thread made while helping another thread
+// compile a file (e.g., lookups in a frozen scope) to the totals
+extern void stats_merge_helper();
+
+// Start the timer t for the given phase
+extern void stats_timer_start(stats_timer *t, stats_phase phase);
+
+// Requires: t is the most recently started timer that is still running
+// Stop the timer t, adding its time to its phase
+extern void stats_timer_stop(stats_timer *t);
+
+// Count n tokens read by the lexer
+extern void stats_count_tokens(unsigned long n);
+
+// Count the nodes (by type) in the AST of a program
+extern void stats_count_ast(AST *progast);
+
+// Record the number of identifiers declared in the program's scope
+extern void stats_count_symbols(unsigned int n);
+
+// Count one lookup in the symbol table
+extern void stats_count_lookup();
+
+// Print a report of the totals on out in the given format
+// (for stats_csv, a header line and a line of values)
+extern void stats_report(FILE *out, stats_format fmt);
+
+#endif
@@ -2,25 +2,37 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
 #include "symbol_table.h"
 #include "utilities.h"
+#include "stats.h"
+#include "sampler.h"
+#include "mem.h"
+#include "pool.h"
 
 typedef struct {
     const char *id;
     id_attrs *attrs;
 } symtab_assoc_t;
 
-// Invariant: 0 <= size < MAX_SCOPE_SIZE;
+// Invariant: entries.count == attrs.count;
+// The associations are kept in declaration order in the pool entries,
+// and their attributes (see create_id_attrs) in the pool attrs,
+// so a lookup is a linear sweep (see pool.h) and the whole table
+// is emptied or freed at once.
 typedef struct scope_symtab_s {
-    unsigned int size;
-    symtab_assoc_t *entries[MAX_SCOPE_SIZE];
+    pool entries;  // of symtab_assoc_t
+    pool attrs;    // of id_attrs
 } scope_symtab_t;
 
 // The current scope (i.e., the symbol table)
-// Idea: size is the index into entries
-// of the most recent symtab_assoc added to the list of entries.
-// So the next entry goes into the index size+1
-static scope_symtab_t *symtab = NULL;
+// Each thread has its own current scope.
+static _Thread_local scope_symtab_t *symtab = NULL;
+// The current thread's own scope, while it is using a frozen one
+static _Thread_local scope_symtab_t *own_symtab = NULL;
+// The key whose destructor frees a thread's scope when the thread ends
+static pthread_key_t scope_key;
+static pthread_once_t scope_key_once = PTHREAD_ONCE_INIT;
 
 // Allocate a fresh scope symbol table and return (a pointer to) it.
 // Issues an error message (on stderr) if there is no space
@@ -28,47 +40,104 @@ static scope_symtab_t *symtab = NULL;
 static scope_symtab_t * scope_create()
 {
     scope_symtab_t *new_scope
-	= (scope_symtab_t *) malloc(sizeof(scope_symtab_t));
+	= (scope_symtab_t *) mem_alloc(mem_symbols, sizeof(scope_symtab_t));
     if (new_scope == NULL) {
 	bail_with_error("No space for new scope_symtab_t!");
     }
-    new_scope->size = 0;
-    for (int j; j < MAX_SCOPE_SIZE; j++) {
-	new_scope->entries[j] = NULL;
-    }
+    pool_init(&new_scope->entries, mem_symbols, sizeof(symtab_assoc_t));
+    pool_init(&new_scope->attrs, mem_symbols, sizeof(id_attrs));
     return new_scope;
 }
 
+// Free the scope s of a thread that has ended
+static void discard_thread_scope(void *s)
+{
+    scope_discard((frozen_scope *) s);
+}
+
+static void make_scope_key()
+{
+    pthread_key_create(&scope_key, discard_thread_scope);
+}
+
 // initialize the symbol table for the current scope
+// (reusing the current thread's table and its slabs, if it has one,
+// so a long-running process does not allocate one per program;
+// the table is freed when the thread ends, or by scope_release)
 void scope_initialize()
 {
-    // create the scope and assign it to the global symtab
-    symtab = scope_create();
+    if (symtab == NULL) {
+	// create the scope and assign it to the global symtab
+	symtab = scope_create();
+	pthread_once(&scope_key_once, make_scope_key);
+	pthread_setspecific(scope_key, symtab);
+	return;
+    }
+    pool_clear(&symtab->entries);
+    pool_clear(&symtab->attrs);
 }
 
-// Return the current scope's next offset to use for allocation,
-// which is the size of the current scope (number of declared ids).
-unsigned int scope_size()
+// Return the current scope, which must not be changed from now on
+// while any thread is using it (see scope_use_frozen)
+const frozen_scope *scope_freeze()
+{
+    return symtab;
+}
+
+// Requires: if s != NULL, this thread is not already using a frozen scope
+// Make the current thread look up names in the frozen scope s
+// instead of its own, or (if s is NULL) in its own scope again
+void scope_use_frozen(const frozen_scope *s)
+{
+    if (s != NULL) {
+	own_symtab = symtab;
+	symtab = (scope_symtab_t *) s;
+    } else {
+	symtab = own_symtab;
+	own_symtab = NULL;
+    }
+}
+
+// Take the current scope away from the current thread
+// (so its next scope_initialize makes a new one) and return it, frozen
+frozen_scope *scope_detach()
 {
-    return symtab->size;
+    scope_symtab_t *s = symtab;
+    symtab = NULL;
+    if (s != NULL) {
+	pthread_setspecific(scope_key, NULL);
+    }
+    return s;
 }
 
-// Is the current scope full?
-bool scope_full()
+// Free the current thread's scope, if it has one
+void scope_release()
 {
-    return scope_size() >= MAX_SCOPE_SIZE;
+    if (symtab != NULL) {
+	scope_discard(scope_detach());
+    }
 }
 
-// Requires: assoc != NULL && !scope_full() && !scope_defined(assoc->id);
-// Add an association from the given name to the given id attributes
-// in the current scope.
-static void scope_add(symtab_assoc_t *assoc)
+// Free the scope s (taken by scope_detach), with its attributes
+void scope_discard(frozen_scope *s)
 {
-    // assert(assoc != NULL);
-    // assert(!scope_full());
-    // assert(!scope_defined(assoc->id));
-    symtab->entries[symtab->size] = assoc;
-    symtab->size++;
+    pool_release(&s->entries);
+    pool_release(&s->attrs);
+    mem_free(s);
+}
+
+// Return the current scope's next offset to use for allocation,
+// which is the size of the current scope (number of declared ids).
+unsigned int scope_size()
+{
+    return (unsigned int) symtab->entries.count;
+}
+
+// Return space for the attributes of a name about to be added
+// to the current scope (see id_attrs.h)
+id_attrs *scope_alloc_attrs()
+{
+    return (id_attrs *) pool_alloc(&symtab->attrs);
 }
 
 // Requires: !scope_defined(name) && attrs != NULL;
@@ -78,13 +147,9 @@ void scope_insert(const char *name, id_attrs *attrs)
 {
     // assert(!scope_defined(name));
     // assert(attrs != NULL);
-    symtab_assoc_t *new_assoc = malloc(sizeof(symtab_assoc_t));
-    if (new_assoc == NULL) {
-	bail_with_error("No space for association!");
-    }
+    symtab_assoc_t *new_assoc = (symtab_assoc_t *) pool_alloc(&symtab->entries);
     new_assoc->id = name;
     new_assoc->attrs = attrs;
-    scope_add(new_assoc);
 }
 
 // Requires: name != NULL;
@@ -101,19 +166,21 @@ bool scope_defined(const char *name)
 // or NULL if there is no association for name.
 id_attrs *scope_lookup(const char *name)
 {
-    int i;
     // assert(name != NULL);
     // assert(symtab != NULL);
-    for (i = 0; i < symtab->size; i++) {
-	// assert(symtab != NULL);
-	// assert(symtab->entries != NULL);
-	// assert(0 <= i && i < symtab->size);
-	// assert(symtab->entries[i] != NULL);
-	// assert(symtab->entries[i]->id != NULL);
-	if (strcmp(symtab->entries[i]->id, name) == 0) {
-	    return symtab->entries[i]->attrs;
+    stats_count_lookup();
+    SAMPLE_BEGIN("scope_lookup");
+    const pool *entries = &symtab->entries;
+    for (pool_slab *s = entries->first; s != NULL && s->used > 0; s = s->next) {
+	const symtab_assoc_t *assocs = (const symtab_assoc_t *) s->objects;
+	for (size_t i = 0; i < s->used; i++) {
+	    // assert(assocs[i].id != NULL);
+	    if (strcmp(assocs[i].id, name) == 0) {
+		SAMPLE_END();
+		return assocs[i].attrs;
+	    }
 	}
     }
-    // assert(i == symtab->size);
+    SAMPLE_END();
     return NULL;
 }
\ No newline at end of file
@@ -6,23 +6,51 @@
 #include "ast.h"
 #include "id_attrs.h"
 
-// Maximum number of declarations that can be stored in a scope
-#define MAX_SCOPE_SIZE 4096
-
 // initialize the symbol table for the current scope
+// (emptying it, if it was used before)
 extern void scope_initialize();
 
+// A scope that is no longer changed, so several threads can look up
+// names in it at once
+typedef struct scope_symtab_s frozen_scope;
+
+// Return the current scope, which must not be changed from now on
+// while any thread is using it (see scope_use_frozen)
+extern const frozen_scope *scope_freeze();
+
+// Requires: if s != NULL, this thread is not already using a frozen scope
+// Make the current thread look up names in the frozen scope s
+// instead of its own, or (if s is NULL) in its own scope again
+extern void scope_use_frozen(const frozen_scope *s);
+
+// Take the current scope away from the current thread
+// (so its next scope_initialize makes a new one) and return it, frozen
+extern frozen_scope *scope_detach();
+
+// Free the scope s (taken by scope_detach), with its attributes
+extern void scope_discard(frozen_scope *s);
+
+// Requires: the current thread is not using a frozen scope
+// Free the current thread's scope, if it has one (so its next
+// scope_initialize makes a new one); a thread's scope is also freed
+// when the thread ends
+extern void scope_release();
+
 // Return the current scope's next offset to use for allocation,
 // which is the size of the current scope (number of declared ids).
 extern unsigned int scope_size();
 
-// Is the current scope full?
-extern bool scope_full();
-
 // Is the given name associated with some attributes in the current scope?
 extern bool scope_defined(const char *name);
 
-// Requires: !scope_defined(name) && attrs != NULL;
+// Return space (not initialized) for the attributes of a name
+// that is about to be added to the current scope, from the scope's pool
+// (see pool.h), which are freed with the scope's associations
+// (as create_id_attrs does)
+extern id_attrs *scope_alloc_attrs();
+
+// Requires: !scope_defined(name) && attrs != NULL
+//           && attrs was made by create_id_attrs for the current scope;
 // Modify the current scope symbol table to
 // add an association from the given name to the given id_attrs attrs.
 extern void scope_insert(const char *name, id_attrs *attrs);
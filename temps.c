@@ -0,0 +1,36 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include "ast.h"
+#include "id_attrs.h"
+#include "symbol_table.h"
+#include "utilities.h"
+#include "temps.h"
+#include "mem.h"
+
+// Declare a new temporary in prog whose name starts with prefix
+// (see temps.h)
+const char *temp_declare(AST *prog, const char *prefix, unsigned int *next)
+{
+    char buf[MAX_IDENT_LENGTH + 1];
+    unsigned int n = (*next == 0) ? 1 : *next;
+    do {
+	snprintf(buf, sizeof(buf), "%s%u", prefix, n++);
+    } while (scope_defined(buf));
+    *next = n;
+    char *name = mem_strdup(mem_optimizer, buf);
+    if (name == NULL) {
+	bail_with_error("No space for a temporary!");
+    }
+    // the name is freed with prog
+    ast_store_adopt(name);
+    scope_insert(name, create_id_attrs(prog->file_loc, variable,
+				       scope_size()));
+    AST *vd = ast_var_decl(file_loc2token(prog->file_loc), name);
+    if (ast_list_is_empty(prog->data.program.vds)) {
+	prog->data.program.vds = ast_list_singleton(vd);
+    } else {
+	ast_list_splice(ast_list_last_elem(prog->data.program.vds), vd);
+    }
+    return name;
+}
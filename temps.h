@@ -0,0 +1,24 @@
+#ifndef _TEMPS_H
+#define _TEMPS_H
+#include "ast.h"
+
+// Compiler temporaries are variables that optimizations add to a program.
+// Each is declared at the end of the program's var declarations
+// and added to the current scope after the names already there,
+// so its offset comes after the offsets of all the program's own names.
+
+// Requires: the current scope is prog's symbol table, the current thread's
+//           AST store is prog's (see ast.h), and *next is 0
+//           or one more than the number of the last temporary declared
+//           with this prefix for prog
+// Declare a new temporary in prog, named prefix followed by
+// the smallest number (from *next, or 1 if it is 0) that makes a name
+// not already declared, set *next to the number after that one,
+// and return its name.
+// (So a pass that keeps *next for its prefix, starting at 0,
+// gets the names it would get by starting from 1 each time.)
+// If there is no space, bail with an error message.
+extern const char *temp_declare(AST *prog, const char *prefix,
+				unsigned int *next);
+
+#endif
@@ -0,0 +1,205 @@
+// Check incremental reparsing (see incremental.h): a program is edited
+// a step at a time, and after each edit the document's unparsed program,
+// diagnostics, and AST file locations must be the same as compiling
+// the edited text from scratch gives. Each edit also says how much
+// it should parse again (nothing, one statement, or everything).
+//
+// Usage: incr_test
+// Prints each failure and exits with a failure code if there were any.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utilities.h"
+#include "ast.h"
+#include "ast_walk.h"
+#include "incremental.h"
+#include "driver.h"
+#include "sink.h"
+
+// Name of the document (and of the file in messages)
+#define DOC_NAME "edited.pl0"
+
+// How much of the program an edit should parse again
+typedef enum {
+    parse_none,   // only spaces or comments changed
+    parse_local,  // one statement (or begin block), not the whole text
+    parse_all,    // the whole text
+    edit_error    // the edit makes the program wrong
+} reparse_kind;
+
+// An edit replaces the first occurrence of find in the text with replace
+typedef struct {
+    const char *find;
+    const char *replace;
+    reparse_kind expect;
+} edit;
+
+static const char *start =
+    "# a program to edit\n"
+    "const k = 2;\n"
+    "var x, y;\n"
+    "begin\n"
+    "  x := 1;\n"
+    "  y := x + k;\n"
+    "  if x < y then\n"
+    "    write y\n"
+    "  else\n"
+    "    write x;\n"
+    "  while x < 3 do\n"
+    "    x := x + 1;\n"
+    "  write x\n"
+    "end.\n";
+
+static const edit edits[] = {
+    { "y := x + k", "y := x * k + 10", parse_local },
+    { "# a program to edit", "# a program being edited", parse_none },
+    { "    write y\n",
+      "    begin\n      write y;\n      write k\n    end\n", parse_local },
+    { "x := x + 1;", "x := x + 1 + k;", parse_local },
+    { "x := 1;\n  y", "x := 1; y", parse_local },
+    { "write k", "write z", edit_error },
+    { "var x, y;", "var x, y, z;", parse_all },
+    { "x := 1;", "x := 1 +;", edit_error },
+    // the first edit after an error parses everything again
+    { "x := 1 +;", "x := 1;", parse_all },
+    { "  while", "  z := y;\n  while", parse_local },
+    { "while x < 3 do", "while x < 3 do\n", parse_none },
+};
+
+#define NUM_EDITS (sizeof(edits) / sizeof(edits[0]))
+
+// Names of the reparse_kinds, for messages
+static const char *kind_names[] = { "nothing", "one statement",
+				    "everything", "an error" };
+
+// Append the AST type and file location of ast to the string sink
+// that is the walk's context
+static void note_location(ast_walker *w, AST *ast, int level,
+			  unsigned int flags)
+{
+    sink *s = (sink *) ast_walk_context(w);
+    sink_put_int(s, ast->type_tag);
+    sink_putc(s, ' ');
+    sink_put_int(s, ast->file_loc.line);
+    sink_putc(s, ':');
+    sink_put_int(s, ast->file_loc.column);
+    sink_putc(s, '\n');
+}
+
+// Write the type and file location of each node of prog to s
+static void write_locations(sink *s, AST *prog)
+{
+    ast_visitor v;
+    for (int t = 0; t < NUM_AST_TYPES; t++) {
+	v.pre[t] = note_location;
+	v.post[t] = NULL;
+    }
+    ast_walk(prog, &v, s, 0, 0);
+}
+
+// Compare what the sinks got and complain (for edit number n) if differ
+static int compare(size_t n, const char *what, sink *edited, sink *full)
+{
+    if (strcmp(sink_contents(edited), sink_contents(full)) == 0) {
+	return 0;
+    }
+    printf("FAILED: edit %zu gave different %s:\n%s--- instead of ---\n%s",
+	   n + 1, what, sink_contents(edited), sink_contents(full));
+    return 1;
+}
+
+int main()
+{
+    size_t cap = strlen(start) + 1;
+    for (size_t i = 0; i < NUM_EDITS; i++) {
+	cap += strlen(edits[i].replace);
+    }
+    char *text = (char *) malloc(cap);
+    if (text == NULL) {
+	bail_with_error("No space for the text to edit!");
+    }
+    strcpy(text, start);
+
+    sink *out = sink_string();
+    sink *diagnostics = sink_string();
+    sink *full_out = sink_string();
+    sink *full_diagnostics = sink_string();
+    sink *locs = sink_string();
+    sink *full_locs = sink_string();
+    int failures = 0;
+
+    incr_doc *doc = incr_open(DOC_NAME);
+    if (!driver_try_edit(doc, 0, 0, text, strlen(text), out, diagnostics)) {
+	printf("FAILED: the starting program has errors:\n%s",
+	       sink_contents(diagnostics));
+	return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < NUM_EDITS; i++) {
+	const edit *e = &edits[i];
+	char *at = strstr(text, e->find);
+	if (at == NULL) {
+	    printf("FAILED: edit %zu cannot find \"%s\"\n", i + 1, e->find);
+	    return EXIT_FAILURE;
+	}
+	size_t offset = at - text;
+	size_t deleted = strlen(e->find);
+	size_t len = strlen(e->replace);
+	memmove(at + len, at + deleted, strlen(at + deleted) + 1);
+	memcpy(at, e->replace, len);
+
+	sink_reset(out);
+	sink_reset(diagnostics);
+	bool ok = driver_try_edit(doc, offset, deleted, e->replace, len,
+				  out, diagnostics);
+	sink_reset(full_out);
+	sink_reset(full_diagnostics);
+	bool full_ok = driver_try_compile(DOC_NAME, text, strlen(text),
+					  full_out, full_diagnostics);
+
+	if (ok != full_ok || ok != (e->expect != edit_error)) {
+	    printf("FAILED: edit %zu %s, but compiling its text %s\n", i + 1,
+		   ok ? "succeeded" : "failed", full_ok ? "succeeded" : "failed");
+	    failures++;
+	}
+	failures += compare(i, "output", out, full_out);
+	failures += compare(i, "diagnostics", diagnostics, full_diagnostics);
+	if (!ok) {
+	    continue;
+	}
+
+	size_t reparsed = incr_reparsed_tokens(doc);
+	incr_doc *fresh = incr_open(DOC_NAME);
+	incr_edit(fresh, 0, 0, text, strlen(text));
+	size_t all = incr_reparsed_tokens(fresh);
+	reparse_kind got = (reparsed == 0) ? parse_none
+	    : (reparsed == all) ? parse_all : parse_local;
+	if (got != e->expect) {
+	    printf("FAILED: edit %zu parsed %s again (%zu of %zu tokens),"
+		   " not %s\n", i + 1, kind_names[got], reparsed, all,
+		   kind_names[e->expect]);
+	    failures++;
+	}
+
+	sink_reset(locs);
+	sink_reset(full_locs);
+	write_locations(locs, incr_program(doc));
+	write_locations(full_locs, incr_program(fresh));
+	failures += compare(i, "file locations", locs, full_locs);
+	incr_close(fresh);
+    }
+
+    incr_close(doc);
+    sink_close(out);
+    sink_close(diagnostics);
+    sink_close(full_out);
+    sink_close(full_diagnostics);
+    sink_close(locs);
+    sink_close(full_locs);
+    free(text);
+    if (failures > 0) {
+	return EXIT_FAILURE;
+    }
+    printf("All %zu edits passed\n", NUM_EDITS);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,71 @@
+#!/bin/sh
+# Check the compilation cache (compiler --cache-dir): a file compiled
+# again is found in the cache (a hit), a changed file is not (a miss),
+# the least recently used entries are removed when the cache is full,
+# and an entry bigger than the whole cache is not stored (and removes
+# nothing). Programs are generated in a temporary directory.
+# Usage: tests/run_cache.sh
+# Set COMPILER to use a compiler other than ./compiler.
+
+COMPILER=${COMPILER:-./compiler}
+WORK=${TMPDIR:-/tmp}/pl0-cache-$$
+CACHE=$WORK/cache
+
+mkdir -p $WORK
+trap 'rm -rf $WORK' EXIT
+FAILED=0
+
+# write a program with $2 assignments (about 18 bytes each, unparsed)
+# to $1.pl0, which is different for each name
+program() {
+    awk -v n=$2 -v name=$1 'BEGIN {
+	print "# " name; print "var x;"; print "begin"; print "  x := 0;"
+	for (i = 0; i < n; i++) print "  x := x + " i % 1000 ";"
+	print "  write x"; print "end." }' > $WORK/$1.pl0
+}
+
+# compile the files named $2 ... with cache size $1 (in megabytes)
+# and print how many were found in the cache
+from_cache() {
+    size=$1
+    shift
+    files=""
+    for f in "$@"; do
+	files="$files $WORK/$f.pl0"
+    done
+    $COMPILER -j 1 --cache-dir=$CACHE --cache-size=$size --stats $files \
+	2>&1 >/dev/null | sed -n 's/.*, \([0-9]*\) from the cache.*/\1/p'
+}
+
+# check that what $1 describes found $2 files in the cache (given $3)
+expect() {
+    if test "$3" = "$2"; then
+	echo "passed: $1"
+    else
+	echo "FAILED: $1 (${3:-no} files from the cache, expected $2)"
+	FAILED=1
+    fi
+}
+
+program small 10
+expect "a miss on the first compile" 0 "$(from_cache 1 small)"
+expect "a hit on the next compile" 1 "$(from_cache 1 small)"
+echo "  x := 1;" >> $WORK/small.pl0
+expect "a miss after the file changes" 0 "$(from_cache 1 small)"
+expect "a hit after the file changes" 1 "$(from_cache 1 small)"
+
+# six entries of about 180 KB each do not all fit in 1 MB
+for f in a b c d e f; do
+    program $f 10000
+done
+from_cache 1 a b c d e f >/dev/null
+expect "the most recently used entry is kept" 1 "$(from_cache 1 f)"
+expect "the least recently used entry is removed" 0 "$(from_cache 1 a)"
+
+# an entry of about 1.4 MB is not stored, and removes nothing
+program big 80000
+from_cache 1 big >/dev/null
+expect "an entry bigger than the cache is not stored" 0 "$(from_cache 1 big)"
+expect "an entry bigger than the cache removes nothing" 2 "$(from_cache 1 a f)"
+
+exit $FAILED
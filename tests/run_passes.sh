@@ -0,0 +1,68 @@
+#!/bin/sh
+# Run each program in tests/passes with compiler --run, without
+# optimizations and with each of them, and compare what it writes
+# with the expected output (name.out), so a pass that changes
+# what a program does is caught. A program reads name.in, if it exists.
+# If name.err exists, the messages (on stderr) of a run with each line
+# of options in name.flags are compared with it too (e.g., for warnings,
+# reports or the locations of errors).
+# Usage: tests/run_passes.sh [program.pl0 ...]
+# Set COMPILER to use a compiler other than ./compiler.
+
+COMPILER=${COMPILER:-./compiler}
+case $COMPILER in
+    /*) ;;
+    *) COMPILER=$(pwd)/$COMPILER ;;
+esac
+DIR=tests/passes
+WORK=${TMPDIR:-/tmp}/pl0-passes-$$
+
+mkdir -p $WORK
+trap 'rm -rf $WORK' EXIT
+if test $# -eq 0; then
+    set -- $DIR/*.pl0
+fi
+
+FAILED=0
+# report a failure of the program $1 with the options $2, given the
+# expected and actual output files
+failed() {
+    echo "FAILED: $1 (options: ${2:-none})"
+    diff "$3" "$4" | head -10
+    FAILED=1
+}
+
+for prog in "$@"; do
+    name=${prog%.pl0}
+    input=/dev/null
+    if test -f $name.in; then
+	input=$name.in
+    fi
+    # each option is run on the program alone, then all of them together,
+    # then with the execution counts of its first run (if it did not fail,
+    # as then it writes no counts)
+    counts=$WORK/counts.prof
+    rm -f $counts
+    for opts in "" --simplify --cse --dce --loops --loops=2 --share-exprs \
+		--regalloc "--cse --simplify --dce --loops" \
+		--run-counts=$counts "--use-counts=$counts --loops"; do
+	case $opts in
+	    --use-counts=*) test -f $counts || continue ;;
+	esac
+	$COMPILER --run $opts $prog < $input > $WORK/out 2>/dev/null
+	cmp -s $name.out $WORK/out || failed $prog "$opts" $name.out $WORK/out
+    done
+    if test -f $name.err; then
+	# messages name the program as given, so run it in its directory
+	while read opts; do
+	    (cd $(dirname $prog) && $COMPILER --run $opts $(basename $prog)) \
+		< $input > /dev/null 2> $WORK/err
+	    cmp -s $name.err $WORK/err || failed $prog "$opts" $name.err $WORK/err
+	done < $name.flags
+    fi
+done
+
+if test $FAILED -eq 0; then
+    echo "All $# programs passed"
+fi
+exit $FAILED
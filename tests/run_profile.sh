@@ -0,0 +1,55 @@
+#!/bin/sh
+# Check the sampling profiler (compiler --profile): profiling does not
+# change what the compiler writes, the samples file has a folded stack
+# (starting with the thread's name) and a count on each line, the counts
+# add up to the number of samples reported, and the stacks name the
+# phases that ran. A large program is generated in a temporary directory,
+# so there is time for many samples.
+# Usage: tests/run_profile.sh
+# Set COMPILER to use a compiler other than ./compiler.
+
+COMPILER=${COMPILER:-./compiler}
+WORK=${TMPDIR:-/tmp}/pl0-profile-$$
+PROG=$WORK/big.pl0
+FOLDED=$WORK/big.folded
+
+mkdir -p $WORK
+trap 'rm -rf $WORK' EXIT
+FAILED=0
+
+awk 'BEGIN {
+    print "var x;"; print "begin"; print "  x := 0;"
+    for (i = 0; i < 100000; i++) print "  x := x + (" i % 1000 " * 2 - 1) / 3;"
+    print "  write x"; print "end." }' > $PROG
+
+# check the profile of running the compiler with the options $1,
+# whose stacks must include the name $2
+check() {
+    opts=$1
+    phase=$2
+    $COMPILER $opts $PROG > $WORK/expected 2>/dev/null
+    $COMPILER --profile=$FOLDED $opts $PROG > $WORK/out 2> $WORK/err
+    if ! cmp -s $WORK/out $WORK/expected; then
+	echo "FAILED: --profile changed the output (options: $opts)"
+	FAILED=$((FAILED + 1))
+    fi
+    reported=`sed -n 's/^Profile: \([0-9]*\) samples.*/\1/p' $WORK/err`
+    if ! grep -v -q '^main\(;[^; ]*\)* [0-9][0-9]*$' $FOLDED \
+	    && test "$reported" = \
+		"`awk '{ n += $NF } END { print n + 0 }' $FOLDED`" \
+	    && grep -q "^main;compile;.*$phase" $FOLDED; then
+	return
+    fi
+    echo "FAILED: profile of options $opts (reported $reported samples,"
+    echo "expected stacks in $phase):"
+    cat $WORK/err $FOLDED
+    FAILED=$((FAILED + 1))
+}
+
+check "" parse
+check "--run --simplify" simplify
+
+if [ $FAILED -eq 0 ]; then
+    echo "All profiles passed"
+fi
+exit $FAILED
@@ -0,0 +1,155 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "utilities.h"
+#include "sampler.h"
+#include "trace.h"
+#include "thread_pool.h"
+#include "mem.h"
+
+// The jobs a worker has left to run: next, next+1, ..., end-1
+// Invariant: next <= end
+typedef struct {
+    pthread_mutex_t lock;
+    size_t next;
+    size_t end;
+} job_range;
+
+// Shared state of a call to pool_run
+typedef struct {
+    job_range *ranges;  // one per worker
+    unsigned int nworkers;
+    pool_job_fn fn;
+    void *arg;
+} pool_state;
+
+// Argument of each worker thread
+typedef struct {
+    pool_state *pool;
+    unsigned int id;
+    pthread_t thread;
+} worker_info;
+
+// Return the number of threads to use by default
+// (the number of online processors)
+unsigned int pool_default_threads()
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n < 1) ? 1 : (unsigned int) n;
+}
+
+// Take the next job from the range r, putting it in *job.
+// Return false if r has no more jobs.
+static bool take_job(job_range *r, size_t *job)
+{
+    bool ret = false;
+    pthread_mutex_lock(&r->lock);
+    if (r->next < r->end) {
+	*job = r->next++;
+	ret = true;
+    }
+    pthread_mutex_unlock(&r->lock);
+    return ret;
+}
+
+// Move the upper half of the remaining jobs of some other worker
+// into the (empty) range of worker self.
+// Return false if no other worker has any jobs left.
+static bool steal_jobs(pool_state *pool, unsigned int self)
+{
+    for (unsigned int k = 1; k < pool->nworkers; k++) {
+	job_range *victim = &pool->ranges[(self + k) % pool->nworkers];
+	pthread_mutex_lock(&victim->lock);
+	size_t remaining = victim->end - victim->next;
+	if (remaining == 0) {
+	    pthread_mutex_unlock(&victim->lock);
+	    continue;
+	}
+	size_t take = (remaining + 1) / 2;
+	size_t end = victim->end;
+	victim->end -= take;
+	pthread_mutex_unlock(&victim->lock);
+
+	job_range *mine = &pool->ranges[self];
+	pthread_mutex_lock(&mine->lock);
+	mine->next = end - take;
+	mine->end = end;
+	pthread_mutex_unlock(&mine->lock);
+	return true;
+    }
+    return false;
+}
+
+// Body of each worker thread: run its own jobs, then steal more
+static void *worker_main(void *info)
+{
+    worker_info *w = (worker_info *) info;
+    pool_state *pool = w->pool;
+    size_t job;
+    if (trace_active || sampler_active) {
+	char name[32];
+	snprintf(name, sizeof(name), "worker %u", w->id);
+	trace_name_thread(name);
+	sampler_name_thread(name);
+    }
+    do {
+	while (take_job(&pool->ranges[w->id], &job)) {
+	    pool->fn(job, pool->arg);
+	}
+    } while (steal_jobs(pool, w->id));
+    return NULL;
+}
+
+// Run fn(j, arg) for each job j in 0 .. njobs-1,
+// using (at most) nthreads threads, and return when all are done.
+// If nthreads <= 1, then the jobs are run in order by the calling thread.
+void pool_run(size_t njobs, unsigned int nthreads, pool_job_fn fn, void *arg)
+{
+    if (nthreads > njobs) {
+	nthreads = (unsigned int) njobs;
+    }
+    if (nthreads <= 1) {
+	for (size_t j = 0; j < njobs; j++) {
+	    fn(j, arg);
+	}
+	return;
+    }
+
+    pool_state pool;
+    pool.nworkers = nthreads;
+    pool.fn = fn;
+    pool.arg = arg;
+    pool.ranges = (job_range *) mem_alloc(
+	mem_driver, nthreads * sizeof(job_range));
+    worker_info *workers
+	= (worker_info *) mem_alloc(mem_driver, nthreads * sizeof(worker_info));
+    if (pool.ranges == NULL || workers == NULL) {
+	bail_with_error("No space for a thread pool!");
+    }
+    // split the jobs evenly, in order
+    for (unsigned int i = 0; i < nthreads; i++) {
+	pthread_mutex_init(&pool.ranges[i].lock, NULL);
+	pool.ranges[i].next = njobs * i / nthreads;
+	pool.ranges[i].end = njobs * (i + 1) / nthreads;
+    }
+    for (unsigned int i = 0; i < nthreads; i++) {
+	workers[i].pool = &pool;
+	workers[i].id = i;
+	if (pthread_create(&workers[i].thread, NULL,
+			   worker_main, &workers[i]) != 0) {
+	    bail_with_error("Cannot create a worker thread!");
+	}
+    }
+    for (unsigned int i = 0; i < nthreads; i++) {
+	pthread_join(workers[i].thread, NULL);
+    }
+    // only now, as workers still running may steal from any range
+    for (unsigned int i = 0; i < nthreads; i++) {
+	pthread_mutex_destroy(&pool.ranges[i].lock);
+    }
+    mem_free(workers);
+    mem_free(pool.ranges);
+}
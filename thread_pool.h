@@ -0,0 +1,21 @@
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H
+#include <stddef.h>
+
+// Type of the work done for each job: fn(job, arg)
+typedef void (*pool_job_fn)(size_t job, void *arg);
+
+// Return the number of threads to use by default
+// (the number of online processors)
+extern unsigned int pool_default_threads();
+
+// Run fn(j, arg) for each job j in 0 .. njobs-1,
+// using (at most) nthreads threads, and return when all are done.
+// The jobs are split evenly among the threads at the start,
+// and a thread that runs out of jobs steals half of the remaining jobs
+// of another thread, so the threads stay busy when jobs vary in cost.
+// If nthreads <= 1, then the jobs are run in order by the calling thread.
+extern void pool_run(size_t njobs, unsigned int nthreads,
+		     pool_job_fn fn, void *arg);
+
+#endif
@@ -0,0 +1,418 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include "utilities.h"
+#include "lexer.h"
+#include "sink.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "token_array.h"
+#include "mem.h"
+
+// Initial numbers of tokens and of pool chars in a token array
+#define INITIAL_TOKENS 4096
+#define INITIAL_POOL (8 * INITIAL_TOKENS)
+// Fewest chars worth giving a thread of its own to lex
+#define MIN_CHUNK_CHARS (256 * 1024)
+
+// Return a fresh, empty token array for the file named fname
+static token_array *token_array_create(const char *fname)
+{
+    token_array *a = (token_array *) mem_alloc(mem_tokens, sizeof(token_array));
+    if (a == NULL) {
+	bail_with_error("No space for a token array!");
+    }
+    a->filename = fname;
+    a->length = 0;
+    a->cap = INITIAL_TOKENS;
+    a->tokens = (packed_token *) mem_alloc(
+	mem_tokens, a->cap * sizeof(packed_token));
+    a->pool_len = 0;
+    a->pool_cap = INITIAL_POOL;
+    a->pool = (char *) mem_alloc(mem_tokens, a->pool_cap);
+    a->error = NULL;
+    a->old_pools = NULL;
+    a->num_old_pools = 0;
+    if (a->tokens == NULL || a->pool == NULL) {
+	bail_with_error("No space for a token array!");
+    }
+    return a;
+}
+
+// Make room in a for n more tokens and pool_chars more pool chars
+static void token_array_reserve(token_array *a, size_t n, size_t pool_chars)
+{
+    if (a->cap - a->length < n) {
+	while (a->cap - a->length < n) {
+	    a->cap *= 2;
+	}
+	a->tokens = (packed_token *) mem_realloc(mem_tokens, a->tokens,
+					     a->cap * sizeof(packed_token));
+	if (a->tokens == NULL) {
+	    bail_with_error("No space to grow a token array!");
+	}
+    }
+    if (a->pool_cap - a->pool_len < pool_chars) {
+	while (a->pool_cap - a->pool_len < pool_chars) {
+	    a->pool_cap *= 2;
+	}
+	a->pool = (char *) mem_realloc(mem_tokens, a->pool, a->pool_cap);
+	if (a->pool == NULL) {
+	    bail_with_error("No space to grow a token array!");
+	}
+    }
+}
+
+// Add the token t, which starts at the given offset in the file, to a
+static void token_array_add(token_array *a, token t, unsigned int offset)
+{
+    token_array_reserve(a, 1, 0);
+    packed_token *p = &a->tokens[a->length++];
+    p->offset = offset;
+    p->line = t.line;
+    p->column = t.column;
+    p->typ = (uint8_t) t.typ;
+    p->unused = 0;
+    if (t.text == NULL) {
+	p->text = NO_TOKEN_TEXT;
+	p->length = 0;
+	return;
+    }
+    size_t len = strlen(t.text);
+    token_array_reserve(a, 0, len + 1);
+    p->text = (uint32_t) a->pool_len;
+    p->length = (uint16_t) len;
+    memcpy(a->pool + a->pool_len, t.text, len + 1);
+    a->pool_len += len + 1;
+}
+
+// Requires: fp is open for reading and a has no error
+// Lex all of fp (using fname as the file name in tokens and messages)
+// onto the end of a, closing fp afterwards, where fp's text starts
+// at the given line and offset of the file (at the start of a line).
+// If a lexical error occurs, stop and keep its message in a.
+static void lex_into(token_array *a, FILE *fp, const char *fname,
+		     unsigned int line, unsigned int offset)
+{
+    // catch a lexical error, so it can be reported later
+    error_trap *outer = error_trap_current();
+    error_trap trap;
+    trap.diagnostics = sink_string();
+    lexer_open_stream(fp, fname);
+    lexer_start_at(line, offset);
+    if (setjmp(trap.env) == 0) {
+	error_trap_set(&trap);
+	token t;
+	do {
+	    t = lexer_next();
+	    token_array_add(a, t, lexer_offset());
+	    mem_free(t.text);
+	} while (t.typ != eofsym);
+    } else {
+	a->error = mem_strdup(mem_tokens, sink_contents(trap.diagnostics));
+	if (a->error == NULL) {
+	    bail_with_error("No space for an error message!");
+	}
+    }
+    if (outer != NULL) {
+	error_trap_set(outer);
+    } else {
+	error_trap_clear();
+    }
+    sink_close(trap.diagnostics);
+    lexer_close();
+}
+
+// Requires: fp is open for reading
+// Lex all of fp (using fname as the file name in tokens and messages)
+// into a fresh token array, closing fp afterwards.
+// If a lexical error occurs, the array ends before the token
+// that had the error, and token_array_error returns its message.
+// If there is no space, bail with an error message.
+token_array *token_array_lex_stream(FILE *fp, const char *fname)
+{
+    token_array *a = token_array_create(fname);
+    lex_into(a, fp, fname, 1, 0);
+    return a;
+}
+
+// A piece of a file to be lexed by itself
+typedef struct {
+    const char *text;   // its first char, which starts a line
+    size_t len;
+    const char *fname;
+    token_array *tokens;
+} lex_chunk;
+
+// Requires: text has len chars
+// Lex the len chars of text onto the end of a (see lex_into)
+static void lex_text_into(token_array *a, const char *text, size_t len,
+			  const char *fname, unsigned int line,
+			  unsigned int offset)
+{
+    // fmemopen cannot open an empty buffer
+    FILE *fp = (len == 0) ? fopen("/dev/null", "r")
+	: fmemopen((void *) text, len, "r");
+    if (fp == NULL) {
+	bail_with_error("Cannot read %s from memory", fname);
+    }
+    lex_into(a, fp, fname, line, offset);
+}
+
+// Requires: text has len chars
+// Lex the len chars of text, which start at the given line and offset
+// of the file named fname (at the start of a line), into a fresh
+// token array, like token_array_lex_stream
+token_array *token_array_lex_text(const char *text, size_t len,
+				  const char *fname, unsigned int line,
+				  unsigned int offset)
+{
+    token_array *a = token_array_create(fname);
+    lex_text_into(a, text, len, fname, line, offset);
+    return a;
+}
+
+// Lex the chunk numbered job (of those in arg) into its own array,
+// guessing that it starts outside of any token or comment
+// (numbering its lines from 1 and its offsets from 0)
+static void lex_chunk_job(size_t job, void *arg)
+{
+    lex_chunk *c = &((lex_chunk *) arg)[job];
+    TRACE_BEGIN("lex_chunk");
+    c->tokens = token_array_create(c->fname);
+    lex_text_into(c->tokens, c->text, c->len, c->fname, 1, 0);
+    TRACE_END();
+}
+
+// Did the lexing of the chunk c end cleanly at the chunk's end?
+// (if so, it started outside of any token or comment,
+// as the next chunk assumed, and its tokens are the file's tokens)
+static bool chunk_valid(const lex_chunk *c)
+{
+    const token_array *t = c->tokens;
+    return t->error == NULL && t->length > 0
+	&& t->tokens[t->length - 1].typ == eofsym
+	&& t->tokens[t->length - 1].offset == c->len;
+}
+
+// Append the tokens of c (except its end-of-file token, unless keep_eof)
+// to a, moving them down by line_delta lines and offset_delta chars
+static void append_chunk(token_array *a, const lex_chunk *c, bool keep_eof,
+			 unsigned int line_delta, unsigned int offset_delta)
+{
+    const token_array *t = c->tokens;
+    size_t n = keep_eof ? t->length : t->length - 1;
+    token_array_reserve(a, n, t->pool_len);
+    uint32_t pool_base = (uint32_t) a->pool_len;
+    memcpy(a->pool + a->pool_len, t->pool, t->pool_len);
+    a->pool_len += t->pool_len;
+    for (size_t i = 0; i < n; i++) {
+	packed_token p = t->tokens[i];
+	p.line += line_delta;
+	p.offset += offset_delta;
+	if (p.text != NO_TOKEN_TEXT) {
+	    p.text += pool_base;
+	}
+	a->tokens[a->length++] = p;
+    }
+}
+
+// Requires: text has len chars
+// Lex the len chars of text (the contents of the file named fname)
+// into a fresh token array, like token_array_lex_stream,
+// but splitting text at line ends into chunks that are lexed
+// on (at most) nthreads threads at once.
+// Each chunk is lexed as if it started outside of any token or comment;
+// that guess is checked at each seam (the previous chunk must end cleanly),
+// and the text from the first chunk where it fails is lexed again
+// serially (so lexical errors are found as by a single lexer).
+// The chunks' tokens are stitched into one array, with their lines
+// and offsets counted from the start of the file.
+token_array *token_array_lex_parallel(const char *text, size_t len,
+				      const char *fname,
+				      unsigned int nthreads)
+{
+    size_t nchunks = len / MIN_CHUNK_CHARS;
+    if (nchunks > nthreads) {
+	nchunks = nthreads;
+    }
+    token_array *a = token_array_create(fname);
+    if (nchunks <= 1) {
+	lex_text_into(a, text, len, fname, 1, 0);
+	return a;
+    }
+
+    // split text just after newlines near each nchunks'th part
+    lex_chunk *chunks = (lex_chunk *) mem_alloc(
+	mem_tokens, nchunks * sizeof(lex_chunk));
+    if (chunks == NULL) {
+	bail_with_error("No space for the chunks of %s!", fname);
+    }
+    size_t n = 0;
+    size_t start = 0;
+    for (size_t k = 1; k <= nchunks && start < len; k++) {
+	size_t end = len;
+	if (k < nchunks && start < k * (len / nchunks)) {
+	    size_t guess = k * (len / nchunks);
+	    const char *nl = memchr(text + guess, '\n', len - guess);
+	    end = (nl == NULL) ? len : (size_t) (nl - text) + 1;
+	}
+	if (k < nchunks && end == len) {
+	    continue;
+	}
+	chunks[n].text = text + start;
+	chunks[n].len = end - start;
+	chunks[n].fname = fname;
+	chunks[n].tokens = NULL;
+	n++;
+	start = end;
+    }
+    pool_run(n, nthreads, lex_chunk_job, chunks);
+
+    TRACE_BEGIN("stitch_chunks");
+    unsigned int line = 1;
+    size_t offset = 0;
+    for (size_t k = 0; k < n; k++) {
+	if (!chunk_valid(&chunks[k])) {
+	    // the guess was wrong here, so lex the rest of the file serially
+	    lex_text_into(a, chunks[k].text, len - offset, fname,
+			  line, (unsigned int) offset);
+	    break;
+	}
+	append_chunk(a, &chunks[k], k == n - 1, line - 1,
+		     (unsigned int) offset);
+	const token_array *t = chunks[k].tokens;
+	line += t->tokens[t->length - 1].line - 1;
+	offset += chunks[k].len;
+    }
+    for (size_t k = 0; k < n; k++) {
+	token_array_free(chunks[k].tokens);
+    }
+    mem_free(chunks);
+    TRACE_END();
+    return a;
+}
+
+// Requires: fname is the name of a readable file
+// Lex the file named fname into a fresh token array
+// (like token_array_lex_stream)
+token_array *token_array_lex(const char *fname)
+{
+    FILE *fp = fopen(fname, "r");
+    if (fp == NULL) {
+	bail_with_error("Invalid file name");
+    }
+    return token_array_lex_stream(fp, fname);
+}
+
+// Make room in a's pool for pool_chars more chars
+// without moving the texts already in it: a bigger pool is made
+// (with a copy of the texts, so their indexes stay the same)
+// and the old one is kept until a is freed
+static void token_array_reserve_stable(token_array *a, size_t pool_chars)
+{
+    if (a->pool_cap - a->pool_len >= pool_chars) {
+	return;
+    }
+    size_t cap = a->pool_cap;
+    while (cap - a->pool_len < pool_chars) {
+	cap *= 2;
+    }
+    char *pool = (char *) mem_alloc(mem_tokens, cap);
+    char **old = (char **) mem_realloc(mem_tokens, a->old_pools,
+				   (a->num_old_pools + 1) * sizeof(char *));
+    if (pool == NULL || old == NULL) {
+	bail_with_error("No space to grow a token array!");
+    }
+    memcpy(pool, a->pool, a->pool_len);
+    old[a->num_old_pools++] = a->pool;
+    a->old_pools = old;
+    a->pool = pool;
+    a->pool_cap = cap;
+}
+
+// Requires: first <= end <= token_array_length(a), n <= length of src,
+//           neither a nor src has an error,
+//           and src's tokens have their lines and offsets in a's file
+// Replace the tokens first, ..., end-1 of a with the first n tokens of src,
+// and move the tokens after them down by line_delta lines
+// and offset_delta chars. The texts of a's tokens do not move
+// (even those that are replaced), so pointers to them stay valid.
+void token_array_splice(token_array *a, size_t first, size_t end,
+			const token_array *src, size_t n,
+			int line_delta, long offset_delta)
+{
+    size_t removed = end - first;
+    if (n > removed) {
+	token_array_reserve(a, n - removed, 0);
+    }
+    token_array_reserve_stable(a, src->pool_len);
+    memmove(&a->tokens[first + n], &a->tokens[end],
+	    (a->length - end) * sizeof(packed_token));
+    a->length = a->length - removed + n;
+    for (size_t i = first + n; i < a->length; i++) {
+	a->tokens[i].line += line_delta;
+	a->tokens[i].offset += offset_delta;
+    }
+    uint32_t pool_base = (uint32_t) a->pool_len;
+    memcpy(a->pool + a->pool_len, src->pool, src->pool_len);
+    a->pool_len += src->pool_len;
+    for (size_t i = 0; i < n; i++) {
+	packed_token p = src->tokens[i];
+	if (p.text != NO_TOKEN_TEXT) {
+	    p.text += pool_base;
+	}
+	a->tokens[first + i] = p;
+    }
+}
+
+// Return the number of tokens in a
+size_t token_array_length(const token_array *a)
+{
+    return a->length;
+}
+
+// Requires: i < token_array_length(a)
+// Return the ith token of a; its text points into a's pool,
+// so it is valid until a is freed
+token token_array_get(const token_array *a, size_t i)
+{
+    const packed_token *p = &a->tokens[i];
+    token t;
+    t.typ = (token_type) p->typ;
+    t.filename = a->filename;
+    t.line = p->line;
+    t.column = p->column;
+    t.text = (p->text == NO_TOKEN_TEXT) ? NULL : a->pool + p->text;
+    t.value = (t.typ == numbersym) ? (short int) atoi(t.text) : 0;
+    return t;
+}
+
+// Requires: i < token_array_length(a)
+// Return the type of the ith token of a
+token_type token_array_type(const token_array *a, size_t i)
+{
+    return (token_type) a->tokens[i].typ;
+}
+
+// Return the message (with a newline at its end) of the error
+// that stopped the lexing of a, or NULL if there was none
+const char *token_array_error(const token_array *a)
+{
+    return a->error;
+}
+
+// Free a (including its pool, so token texts from it become invalid)
+void token_array_free(token_array *a)
+{
+    mem_free(a->tokens);
+    mem_free(a->pool);
+    mem_free(a->error);
+    for (size_t i = 0; i < a->num_old_pools; i++) {
+	mem_free(a->old_pools[i]);
+    }
+    mem_free(a->old_pools);
+    mem_free(a);
+}
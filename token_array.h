@@ -0,0 +1,112 @@
+#ifndef _TOKEN_ARRAY_H
+#define _TOKEN_ARRAY_H
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "token.h"
+
+// A token array holds all the tokens of a file, lexed before parsing,
+// in one contiguous array of compact (20 byte) records,
+// with the tokens' texts kept together in a pool of chars.
+// A token struct for any index can be made with token_array_get,
+// so a parser can look ahead any number of tokens.
+// If lexing stopped at an error, the array holds the tokens before it
+// and the error message, which is reported when the parser reaches
+// that point (so errors are reported in the same order as when
+// lexing and parsing are interleaved).
+
+// A token in a token array
+typedef struct {
+    uint32_t offset;   // of the token's first char in the file
+    uint32_t text;     // index of its text in the pool (NO_TOKEN_TEXT if none)
+    uint32_t line;
+    uint32_t column;
+    uint16_t length;   // number of chars in its text
+    uint8_t typ;       // its token_type
+    uint8_t unused;
+} packed_token;
+
+// The text index of a token that has no text
+#define NO_TOKEN_TEXT UINT32_MAX
+
+typedef struct {
+    const char *filename;
+    packed_token *tokens;
+    size_t length;     // number of tokens
+    size_t cap;
+    char *pool;        // the tokens' texts, each null-terminated
+    size_t pool_len;
+    size_t pool_cap;
+    char *error;       // message of the error that stopped lexing, or NULL
+    char **old_pools;  // pools replaced by token_array_splice, whose texts
+    size_t num_old_pools; // may still be in use (e.g., by ASTs)
+} token_array;
+
+// Requires: fp is open for reading
+// Lex all of fp (using fname as the file name in tokens and messages)
+// into a fresh token array, closing fp afterwards.
+// If a lexical error occurs, the array ends before the token
+// that had the error, and token_array_error returns its message.
+// If there is no space, bail with an error message.
+extern token_array *token_array_lex_stream(FILE *fp, const char *fname);
+
+// Requires: text has len chars
+// Lex the len chars of text, which start at the given line and offset
+// of the file named fname (at the start of a line), into a fresh
+// token array, like token_array_lex_stream
+extern token_array *token_array_lex_text(const char *text, size_t len,
+					 const char *fname, unsigned int line,
+					 unsigned int offset);
+
+// Requires: text has len chars
+// Lex the len chars of text (the contents of the file named fname)
+// into a fresh token array, like token_array_lex_stream,
+// but splitting text at line ends into chunks that are lexed
+// on (at most) nthreads threads at once.
+// Each chunk is lexed as if it started outside of any token or comment;
+// that guess is checked at each seam (the previous chunk must end cleanly),
+// and the text from the first chunk where it fails is lexed again
+// serially (so lexical errors are found as by a single lexer).
+// The chunks' tokens are stitched into one array, with their lines
+// and offsets counted from the start of the file.
+extern token_array *token_array_lex_parallel(const char *text, size_t len,
+					     const char *fname,
+					     unsigned int nthreads);
+
+// Requires: first <= end <= token_array_length(a), n <= length of src,
+//           neither a nor src has an error,
+//           and src's tokens have their lines and offsets in a's file
+// Replace the tokens first, ..., end-1 of a with the first n tokens of src,
+// and move the tokens after them down by line_delta lines
+// and offset_delta chars. The texts of a's tokens do not move
+// (even those that are replaced), so pointers to them stay valid.
+extern void token_array_splice(token_array *a, size_t first, size_t end,
+			       const token_array *src, size_t n,
+			       int line_delta, long offset_delta);
+
+// Requires: fname is the name of a readable file
+// Lex the file named fname into a fresh token array
+// (like token_array_lex_stream)
+extern token_array *token_array_lex(const char *fname);
+
+// Return the number of tokens in a
+extern size_t token_array_length(const token_array *a);
+
+// Requires: i < token_array_length(a)
+// Return the ith token of a; its text points into a's pool,
+// so it is valid until a is freed
+extern token token_array_get(const token_array *a, size_t i);
+
+// Requires: i < token_array_length(a)
+// Return the type of the ith token of a
+extern token_type token_array_type(const token_array *a, size_t i);
+
+// Return the message (with a newline at its end) of the error
+// that stopped the lexing of a, or NULL if there was none
+extern const char *token_array_error(const token_array *a);
+
+// Free a (including its pool, so token texts from it become invalid)
+extern void token_array_free(token_array *a);
+
+#endif
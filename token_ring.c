@@ -0,0 +1,229 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include "utilities.h"
+#include "lexer.h"
+#include "sink.h"
+#include "stats.h"
+#include "sampler.h"
+#include "trace.h"
+#include "token_ring.h"
+#include "mem.h"
+
+// Number of batches in a ring (a power of 2) and of tokens in a batch
+#define RING_BATCHES 64
+#define BATCH_TOKENS 256
+// Number of times to check the other thread before yielding the processor
+#define SPINS_BEFORE_YIELD 128
+
+// A batch of tokens; if error is not NULL, lexing stopped
+// with that error after the batch's tokens
+typedef struct {
+    token toks[BATCH_TOKENS];
+    unsigned int count;
+    char *error;
+} token_batch;
+
+// Invariant: tail <= head <= tail + RING_BATCHES.
+// The batches from tail to head-1 (mod RING_BATCHES) are full,
+// and only the producer writes head and only the consumer writes tail.
+struct token_ring_s {
+    token_batch batches[RING_BATCHES];
+    _Atomic size_t head;        // number of batches published
+    _Atomic size_t tail;        // number of batches consumed
+    atomic_bool cancelled;      // should the producer stop?
+    FILE *fp;
+    const char *fname;
+    pthread_t thread;
+    // the consumer's state
+    token_batch *current;       // the batch being read (or NULL)
+    unsigned int next;          // index of the next token in current
+    bool done;                  // has the EOF token been read?
+};
+
+// Wait a little for the other thread (spins counts the waits so far)
+static void ring_wait(unsigned int *spins)
+{
+    if (++*spins >= SPINS_BEFORE_YIELD) {
+	*spins = 0;
+	sched_yield();
+    }
+}
+
+// Wait for room for a batch in r and return it,
+// or return NULL if the consumer stopped the producer
+static token_batch *producer_batch(token_ring *r)
+{
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    unsigned int spins = 0;
+    while (head - atomic_load_explicit(&r->tail, memory_order_acquire)
+	   == RING_BATCHES) {
+	if (atomic_load_explicit(&r->cancelled, memory_order_relaxed)) {
+	    return NULL;
+	}
+	ring_wait(&spins);
+    }
+    token_batch *b = &r->batches[head % RING_BATCHES];
+    b->count = 0;
+    b->error = NULL;
+    return b;
+}
+
+// Make the batch being filled (the one at head) visible to the consumer
+static void producer_publish(token_ring *r)
+{
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+// The producer thread: lex the ring's file into its batches
+static void *producer_main(void *arg)
+{
+    token_ring *r = (token_ring *) arg;
+    trace_name_thread("lexer");
+    sampler_name_thread("lexer");
+    TRACE_BEGIN_DETAIL("lex", r->fname);
+    // catch a lexical error, so it can be reported by the parser
+    error_trap trap;
+    trap.diagnostics = sink_string();
+    lexer_open_stream(r->fp, r->fname);
+    token_batch *volatile b = producer_batch(r);
+    if (b == NULL) {
+	// stopped before starting
+    } else if (setjmp(trap.env) == 0) {
+	error_trap_set(&trap);
+	token t;
+	do {
+	    if (b->count == BATCH_TOKENS) {
+		producer_publish(r);
+		b = producer_batch(r);
+		if (b == NULL) {
+		    break;
+		}
+	    }
+	    t = lexer_next();
+	    b->toks[b->count++] = t;
+	} while (t.typ != eofsym);
+	if (b != NULL) {
+	    producer_publish(r);
+	}
+    } else {
+	error_trap_clear();
+	b->error = mem_strdup(mem_tokens, sink_contents(trap.diagnostics));
+	if (b->error == NULL) {
+	    bail_with_error("No space for an error message!");
+	}
+	producer_publish(r);
+    }
+    error_trap_clear();
+    sink_close(trap.diagnostics);
+    lexer_close();
+    TRACE_END();
+    return NULL;
+}
+
+// Requires: fp is open for reading
+// Start a thread lexing all of fp (using fname as the file name
+// in tokens and messages) into a fresh token ring, which closes fp.
+// If there is no space or no thread can be made, bail with an error message.
+token_ring *token_ring_start(FILE *fp, const char *fname)
+{
+    token_ring *r = (token_ring *) mem_alloc(mem_tokens, sizeof(token_ring));
+    if (r == NULL) {
+	bail_with_error("No space for a token ring!");
+    }
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->cancelled, false);
+    r->fp = fp;
+    r->fname = fname;
+    r->current = NULL;
+    r->next = 0;
+    r->done = false;
+    if (pthread_create(&r->thread, NULL, producer_main, r) != 0) {
+	fclose(fp);
+	mem_free(r);
+	bail_with_error("Cannot start a lexer thread");
+    }
+    return r;
+}
+
+// Wait for the next batch of r to be published and make it current
+// (timing the wait as lexing, since the parser cannot go on without it)
+static void consumer_batch(token_ring *r)
+{
+    stats_timer t;
+    stats_timer_start(&t, phase_lex);
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    unsigned int spins = 0;
+    while (atomic_load_explicit(&r->head, memory_order_acquire) == tail) {
+	ring_wait(&spins);
+    }
+    stats_timer_stop(&t);
+    r->current = &r->batches[tail % RING_BATCHES];
+    r->next = 0;
+    stats_count_tokens(r->current->count);
+}
+
+// Give the current batch of r back to the producer
+static void consumer_release(token_ring *r)
+{
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+    r->current = NULL;
+}
+
+// Requires: !token_ring_done(r)
+// Return the next token from r, waiting for the lexer if needed.
+// If the lexer stopped with an error here, report that error instead
+// (so this does not return).
+token token_ring_next(token_ring *r)
+{
+    if (r->current == NULL) {
+	consumer_batch(r);
+    }
+    token_batch *b = r->current;
+    if (r->next == b->count) {
+	// this is where the lexer stopped with an error
+	error_reraise(b->error);
+    }
+    token t = b->toks[r->next++];
+    if (t.typ == eofsym) {
+	r->done = true;
+    }
+    if (r->next == b->count && b->error == NULL) {
+	consumer_release(r);
+    }
+    return t;
+}
+
+// Has the end-of-file token been read from r?
+bool token_ring_done(token_ring *r)
+{
+    return r->done;
+}
+
+// Stop the lexer of r (if it is still running), wait for its thread,
+// and free r, including the texts of the tokens that were not read
+void token_ring_stop(token_ring *r)
+{
+    atomic_store_explicit(&r->cancelled, true, memory_order_relaxed);
+    pthread_join(r->thread, NULL);
+    // the producer is finished, so all the published batches are visible
+    size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    for (size_t i = tail; i != head; i++) {
+	token_batch *b = &r->batches[i % RING_BATCHES];
+	unsigned int first = (b == r->current) ? r->next : 0;
+	for (unsigned int k = first; k < b->count; k++) {
+	    mem_free(b->toks[k].text);
+	}
+	mem_free(b->error);
+    }
+    mem_free(r);
+}
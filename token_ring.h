@@ -0,0 +1,37 @@
+#ifndef _TOKEN_RING_H
+#define _TOKEN_RING_H
+#include <stdio.h>
+#include <stdbool.h>
+#include "token.h"
+
+// A token ring lets the lexer run on its own thread (the producer)
+// while the parser reads its tokens (as the consumer), so lexing and
+// parsing overlap if there are at least two processors (with one,
+// the threads take turns, which is slower than not using a ring).
+// The lexer fills batches of tokens in a fixed ring and publishes
+// each full batch with an atomic store, so neither thread takes a lock.
+// If lexing stops at an error, its message is passed along after
+// the tokens before it, and is reported when the parser reaches
+// that point (as with a token array).
+typedef struct token_ring_s token_ring;
+
+// Requires: fp is open for reading
+// Start a thread lexing all of fp (using fname as the file name
+// in tokens and messages) into a fresh token ring, which closes fp.
+// If there is no space or no thread can be made, bail with an error message.
+extern token_ring *token_ring_start(FILE *fp, const char *fname);
+
+// Requires: !token_ring_done(r)
+// Return the next token from r, waiting for the lexer if needed.
+// If the lexer stopped with an error here, report that error instead
+// (so this does not return).
+extern token token_ring_next(token_ring *r);
+
+// Has the end-of-file token been read from r?
+extern bool token_ring_done(token_ring *r);
+
+// Stop the lexer of r (if it is still running), wait for its thread,
+// and free r, including the texts of the tokens that were not read
+extern void token_ring_stop(token_ring *r);
+
+#endif
@@ -0,0 +1,238 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include "utilities.h"
+#include "trace.h"
+#include "mem.h"
+
+// Initial number of spans (or open spans) a thread's buffer has room for
+#define INITIAL_TRACE_SPANS 1024
+// Maximum number of chars in a thread's name
+#define MAX_THREAD_NAME 32
+
+// A recorded span (end is 0 while the span is open)
+typedef struct {
+    const char *name;
+    char *detail;       // NULL if there is none
+    uint64_t start;     // nanoseconds since tracing started
+    uint64_t end;
+} trace_span;
+
+// The spans of one thread
+typedef struct trace_buffer_s {
+    unsigned int tid;
+    char name[MAX_THREAD_NAME];
+    trace_span *spans;
+    size_t nspans;
+    size_t cap;
+    size_t *open;       // indexes of open spans, innermost last
+    size_t nopen;
+    size_t open_cap;
+    struct trace_buffer_s *next;
+} trace_buffer;
+
+bool trace_active = false;
+
+// Time when tracing started
+static struct timespec trace_start;
+
+// All the threads' buffers, guarded by buffers_lock
+static trace_buffer *buffers = NULL;
+static unsigned int nbuffers = 0;
+static pthread_mutex_t buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// This thread's buffer (NULL until it records something)
+static _Thread_local trace_buffer *my_buffer = NULL;
+
+// Start recording spans (called before any threads are started)
+void trace_enable()
+{
+    clock_gettime(CLOCK_MONOTONIC, &trace_start);
+    trace_active = true;
+    trace_name_thread("main");
+}
+
+// Return the number of nanoseconds since tracing started
+static uint64_t trace_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) (ts.tv_sec - trace_start.tv_sec) * 1000000000u
+	+ (uint64_t) ts.tv_nsec - (uint64_t) trace_start.tv_nsec;
+}
+
+// Return this thread's buffer, making it if needed
+static trace_buffer *thread_buffer()
+{
+    if (my_buffer != NULL) {
+	return my_buffer;
+    }
+    trace_buffer *b = (trace_buffer *) mem_calloc(
+	mem_tools, 1, sizeof(trace_buffer));
+    if (b == NULL) {
+	bail_with_error("No space for a trace buffer!");
+    }
+    b->cap = INITIAL_TRACE_SPANS;
+    b->spans = (trace_span *) mem_alloc(mem_tools, b->cap * sizeof(trace_span));
+    b->open_cap = INITIAL_TRACE_SPANS;
+    b->open = (size_t *) mem_alloc(mem_tools, b->open_cap * sizeof(size_t));
+    if (b->spans == NULL || b->open == NULL) {
+	bail_with_error("No space for a trace buffer!");
+    }
+    pthread_mutex_lock(&buffers_lock);
+    b->tid = ++nbuffers;
+    snprintf(b->name, sizeof(b->name), "thread %u", b->tid);
+    b->next = buffers;
+    buffers = b;
+    pthread_mutex_unlock(&buffers_lock);
+    my_buffer = b;
+    return b;
+}
+
+// Name this thread's track in the trace (the name is copied)
+void trace_name_thread(const char *name)
+{
+    if (!trace_active) {
+	return;
+    }
+    trace_buffer *b = thread_buffer();
+    snprintf(b->name, sizeof(b->name), "%s", name);
+}
+
+// Requires: tracing is enabled
+// Begin a span named name in this thread
+// (with detail as an argument, if it is not NULL; it is copied)
+void trace_begin(const char *name, const char *detail)
+{
+    trace_buffer *b = thread_buffer();
+    if (b->nspans == b->cap) {
+	b->cap *= 2;
+	b->spans = (trace_span *) mem_realloc(mem_tools, b->spans,
+					  b->cap * sizeof(trace_span));
+	if (b->spans == NULL) {
+	    bail_with_error("No space to grow a trace buffer!");
+	}
+    }
+    if (b->nopen == b->open_cap) {
+	b->open_cap *= 2;
+	b->open = (size_t *) mem_realloc(
+	    mem_tools, b->open, b->open_cap * sizeof(size_t));
+	if (b->open == NULL) {
+	    bail_with_error("No space to grow a trace buffer!");
+	}
+    }
+    trace_span *s = &b->spans[b->nspans];
+    s->name = name;
+    s->detail = (detail == NULL) ? NULL : mem_strdup(mem_tools, detail);
+    s->end = 0;
+    b->open[b->nopen++] = b->nspans++;
+    s->start = trace_now();
+}
+
+// Requires: tracing is enabled and this thread has a span that has not ended
+// End the most recently begun span of this thread
+void trace_end()
+{
+    uint64_t now = trace_now();
+    trace_buffer *b = my_buffer;
+    assert(b != NULL && b->nopen > 0);
+    b->spans[b->open[--b->nopen]].end = now;
+}
+
+// Return the number of this thread's spans that have not ended
+unsigned int trace_depth()
+{
+    if (!trace_active || my_buffer == NULL) {
+	return 0;
+    }
+    return (unsigned int) my_buffer->nopen;
+}
+
+// End this thread's spans that have not ended until only depth are left
+// (e.g., after an error skipped their ends)
+void trace_unwind(unsigned int depth)
+{
+    while (trace_depth() > depth) {
+	trace_end();
+    }
+}
+
+// Write s to f as a JSON string
+static void write_json_string(FILE *f, const char *s)
+{
+    fputc('"', f);
+    for (; *s != '\0'; s++) {
+	unsigned char c = (unsigned char) *s;
+	if (c == '"' || c == '\\') {
+	    fprintf(f, "\\%c", c);
+	} else if (c < 0x20) {
+	    fprintf(f, "\\u%04x", c);
+	} else {
+	    fputc(c, f);
+	}
+    }
+    fputc('"', f);
+}
+
+// Stop tracing, and write all the recorded spans to the file named fname
+// and free them (see trace.h)
+void trace_write(const char *fname)
+{
+    if (!trace_active) {
+	return;
+    }
+    FILE *f = fopen(fname, "w");
+    if (f == NULL) {
+	bail_with_error("Cannot write trace file %s", fname);
+    }
+    uint64_t now = trace_now();
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    bool first = true;
+    pthread_mutex_lock(&buffers_lock);
+    for (trace_buffer *b = buffers; b != NULL; b = b->next) {
+	fprintf(f, "%s{\"name\": \"thread_name\", \"ph\": \"M\","
+		" \"pid\": 1, \"tid\": %u, \"args\": {\"name\": ",
+		first ? "" : ",\n", b->tid);
+	write_json_string(f, b->name);
+	fprintf(f, "}},\n{\"name\": \"thread_sort_index\", \"ph\": \"M\","
+		" \"pid\": 1, \"tid\": %u, \"args\": {\"sort_index\": %u}}",
+		b->tid, b->tid);
+	first = false;
+	for (size_t i = 0; i < b->nspans; i++) {
+	    trace_span *s = &b->spans[i];
+	    uint64_t end = (s->end == 0) ? now : s->end;
+	    fprintf(f, ",\n{\"name\": \"%s\", \"cat\": \"pl0\", \"ph\": \"X\","
+		    " \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f",
+		    s->name, b->tid, s->start / 1000.0,
+		    (end - s->start) / 1000.0);
+	    if (s->detail != NULL) {
+		fprintf(f, ", \"args\": {\"detail\": ");
+		write_json_string(f, s->detail);
+		fputc('}', f);
+	    }
+	    fputc('}', f);
+	}
+    }
+    pthread_mutex_unlock(&buffers_lock);
+    fprintf(f, "\n]}\n");
+    if (fclose(f) != 0) {
+	bail_with_error("Cannot write trace file %s", fname);
+    }
+    trace_active = false;
+    while (buffers != NULL) {
+	trace_buffer *b = buffers;
+	buffers = b->next;
+	for (size_t i = 0; i < b->nspans; i++) {
+	    mem_free(b->spans[i].detail);
+	}
+	mem_free(b->spans);
+	mem_free(b->open);
+	mem_free(b);
+    }
+    nbuffers = 0;
+    my_buffer = NULL;
+}
@@ -0,0 +1,59 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+#include <stdbool.h>
+#include "sampler.h"
+
+// Tracing records nested spans of time (e.g., one per call of parse_stmt)
+// and writes them as a Chrome trace-event JSON file, which can be viewed
+// in chrome://tracing or ui.perfetto.dev.
+// Each thread records its spans in its own buffer, and appears as its
+// own track in the file. Use the macros below around the code to trace:
+// when tracing is not enabled they only test one global flag.
+// The spans are also the names on the stacks of the sampling profiler
+// (see sampler.h), so the macros test its flag too.
+
+// Is tracing enabled? (only set before any spans are recorded)
+extern bool trace_active;
+
+// Begin a span named name (a string that lives as long as the program)
+#define TRACE_BEGIN(name) \
+    do { if (trace_active) { trace_begin((name), NULL); } \
+	 SAMPLE_BEGIN(name); } while (0)
+
+// Begin a span named name, with detail (e.g., a file name) as an argument
+#define TRACE_BEGIN_DETAIL(name, detail) \
+    do { if (trace_active) { trace_begin((name), (detail)); } \
+	 SAMPLE_BEGIN(name); } while (0)
+
+// End the most recently begun span of this thread that has not ended
+#define TRACE_END() \
+    do { if (trace_active) { trace_end(); } SAMPLE_END(); } while (0)
+
+// Start recording spans (called before any threads are started)
+extern void trace_enable();
+
+// Requires: tracing is enabled
+// Begin a span named name in this thread
+// (with detail as an argument, if it is not NULL; it is copied)
+extern void trace_begin(const char *name, const char *detail);
+
+// Requires: tracing is enabled and this thread has a span that has not ended
+// End the most recently begun span of this thread
+extern void trace_end();
+
+// Return the number of this thread's spans that have not ended
+extern unsigned int trace_depth();
+
+// End this thread's spans that have not ended until only depth are left
+// (e.g., after an error skipped their ends)
+extern void trace_unwind(unsigned int depth);
+
+// Name this thread's track in the trace (the name is copied)
+extern void trace_name_thread(const char *name);
+
+// Requires: no other thread is recording spans
+// Stop tracing, write all the recorded spans to the file named fname
+// and free them (if tracing is enabled)
+extern void trace_write(const char *fname);
+
+#endif
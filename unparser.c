@@ -1,43 +1,91 @@
 /* $Id: unparser.c,v 1.6 2023/02/20 03:55:32 leavens Exp $ */
-#include <stdio.h>
 #include "ast.h"
+#include "sink.h"
 #include "utilities.h"
+#include "sampler.h"
 #include "unparserInternal.h"
 
 // Amount of spaces to indent per nesting level
 #define SPACES_PER_LEVEL 2
 
+// Walker flag: add a semicolon to the end of the statement
+#define UNPARSE_SEMI 0x1
+
+// The unparser's table of callbacks (the output sink is the walk's context)
+static const ast_visitor unparse_visitor = {
+    .pre = {
+	[program_ast] = visitProgram,
+	[const_decl_ast] = visitConstDecl,
+	[var_decl_ast] = visitVarDecl,
+	[assign_ast] = visitAssignStmt,
+	[begin_ast] = visitBeginStmt,
+	[if_ast] = visitIfStmt,
+	[while_ast] = visitWhileStmt,
+	[read_ast] = visitReadStmt,
+	[write_ast] = visitWriteStmt,
+	[skip_ast] = visitSkipStmt,
+	[odd_cond_ast] = visitOddCond,
+	[bin_cond_ast] = visitBinRelCond,
+	[bin_expr_ast] = visitBinExpr,
+	[ident_ast] = visitIdent,
+	[number_ast] = visitNumber,
+    },
+    .post = {
+	[begin_ast] = finishBeginStmt,
+	[bin_expr_ast] = finishBinExpr,
+    },
+};
+
+// Return the walker flags that say whether to add a semicolon
+static unsigned int semiFlags(bool addSemiToEnd)
+{
+    return addSemiToEnd ? UNPARSE_SEMI : 0;
+}
+
 // Print SPACES_PER_LEVEL * level spaces to out
-static void indent(FILE *out, int level)
+static void indent(sink *out, int level)
 {
-    int num = SPACES_PER_LEVEL * level;
-    for (int i = 0; i < num; i++) {
-	fprintf(out, " ");
-    }
+    sink_spaces(out, SPACES_PER_LEVEL * level);
 }
 
 // Unparse the given program AST and then print a period and an newline
-void unparseProgram(FILE *out, AST *ast)
+void unparseProgram(sink *out, AST *ast)
 {
+    SAMPLE_BEGIN("unparseProgram");
     unparseBlock(out, ast, 0);
-    fprintf(out, ".\n");
+    sink_puts(out, ".\n");
+    SAMPLE_END();
 }
 
 // Unparse the given block, indented by the given level, to out
-void unparseBlock(FILE *out, AST *ast, int level)
+void unparseBlock(sink *out, AST *ast, int level)
 {
-    AST_list cds = ast->data.program.cds;
-    AST_list vds = ast->data.program.vds;
-    AST *stmt = ast->data.program.stmt;
-    unparseConstDecls(out, cds, level);
-    unparseVarDecls(out, vds, level);
-    unparseStmt(out, stmt, level, false);
+    SAMPLE_BEGIN("unparseBlock");
+    ast_walk(ast, &unparse_visitor, out, level, 0);
+    SAMPLE_END();
+}
+
+// Schedule the parts of the block prog, all at the same level
+static void visitProgram(ast_walker *w, AST *prog, int level,
+			 unsigned int flags)
+{
+    AST_list cds = prog->data.program.cds;
+    while (!ast_list_is_empty(cds)) {
+	ast_walk_visit(w, ast_list_first(cds), level, 0);
+	cds = ast_list_rest(cds);
+    }
+    AST_list vds = prog->data.program.vds;
+    while (!ast_list_is_empty(vds)) {
+	ast_walk_visit(w, ast_list_first(vds), level, 0);
+	vds = ast_list_rest(vds);
+    }
+    ast_walk_visit(w, prog->data.program.stmt, level, 0);
 }
 
 // Unparse the list of const-decls given by the AST cds to out
 // with the given nesting level
 // (note that if cds == NULL, then nothing is printed)
-void unparseConstDecls(FILE *out, AST_list cds, int level)
+void unparseConstDecls(sink *out, AST_list cds, int level)
 {
     while (!ast_list_is_empty(cds)) {
 	unparseConstDecl(out, ast_list_first(cds), level);
@@ -47,18 +95,26 @@ void unparseConstDecls(FILE *out, AST_list cds, int level)
 
 // Unparse a single const-def given by the AST cd to out,
 // indented for the given nesting level
-static void unparseConstDecl(FILE *out, AST *cd, int level)
+static void unparseConstDecl(sink *out, AST *cd, int level)
 {
     indent(out, level);
-    fprintf(out, "const ");
-    fprintf(out, "%s = ", cd->data.const_decl.name);
-    fprintf(out, "%d;\n", cd->data.const_decl.num_val);
+    sink_puts(out, "const ");
+    sink_puts(out, cd->data.const_decl.name);
+    sink_puts(out, " = ");
+    sink_put_int(out, cd->data.const_decl.num_val);
+    sink_puts(out, ";\n");
+}
+
+static void visitConstDecl(ast_walker *w, AST *cd, int level,
+			   unsigned int flags)
+{
+    unparseConstDecl((sink *) ast_walk_context(w), cd, level);
 }
 
 // Unparse the list of vart-decls given by the AST vds to out
 // with the given nesting level
 // (note that if vds == NULL, then nothing is printed)
-void unparseVarDecls(FILE *out, AST_list vds, int level)
+void unparseVarDecls(sink *out, AST_list vds, int level)
 {
     while (!ast_list_is_empty(vds)) {
 	unparseVarDecl(out, ast_list_first(vds), level);
@@ -68,209 +124,264 @@ void unparseVarDecls(FILE *out, AST_list vds, int level)
 
 // Unparse a single var-decl given by the AST vd to out,
 // indented for the given nesting level
-static void unparseVarDecl(FILE *out, AST *vd, int level)
+static void unparseVarDecl(sink *out, AST *vd, int level)
 {
     indent(out, level);
-    fprintf(out, "var ");
-    fprintf(out, "%s;\n", vd->data.var_decl.name);
+    sink_puts(out, "var ");
+    sink_puts(out, vd->data.var_decl.name);
+    sink_puts(out, ";\n");
+}
+
+static void visitVarDecl(ast_walker *w, AST *vd, int level,
+			 unsigned int flags)
+{
+    unparseVarDecl((sink *) ast_walk_context(w), vd, level);
 }
 
 // Print (to out) a semicolon, but only if addSemiToEnd is true,
 // and then print a newline.
-static void newlineAndOptionalSemi(FILE *out, bool addSemiToEnd)
+static void newlineAndOptionalSemi(sink *out, bool addSemiToEnd)
+{
+    if (addSemiToEnd) {
+	sink_putc(out, ';');
+    }
+    sink_putc(out, '\n');
+}
+
+// Finish a statement that fits on one line,
+// adding a semicolon if the UNPARSE_SEMI flag is set.
+static void finishSimpleStmt(ast_walker *w, AST *stmt, int level,
+			     unsigned int flags)
 {
-    fprintf(out, "%s\n", (addSemiToEnd ? ";" : ""));
+    newlineAndOptionalSemi((sink *) ast_walk_context(w),
+			   (flags & UNPARSE_SEMI) != 0);
 }
 
 // Unparse the statement given by the AST stmt to out,
 // indented for the given level,
 // adding a semicolon to the end if addSemiToENd is true.
-void unparseStmt(FILE *out, AST *stmt, int indentLevel, bool addSemiToEnd)
+void unparseStmt(sink *out, AST *stmt, int indentLevel, bool addSemiToEnd)
 {
+    SAMPLE_BEGIN("unparseStmt");
     switch (stmt->type_tag) {
     case assign_ast:
-	unparseAssignStmt(out, stmt, indentLevel, addSemiToEnd);
-	break;
     case begin_ast:
-	unparseBeginStmt(out, stmt, indentLevel, addSemiToEnd);
-	break;
     case if_ast:
-	unparseIfStmt(out, stmt, indentLevel, addSemiToEnd);
-	break;
     case while_ast:
-	unparseWhileStmt(out, stmt, indentLevel, addSemiToEnd);
-	break;
     case read_ast:
-	unparseReadStmt(out, stmt, indentLevel, addSemiToEnd);
-	break;
     case write_ast:
-	unparseWriteStmt(out, stmt, indentLevel, addSemiToEnd);
-	break;
     case skip_ast:
-	unparseSkipStmt(out, indentLevel, addSemiToEnd);
+	ast_walk(stmt, &unparse_visitor, out, indentLevel,
+		 semiFlags(addSemiToEnd));
 	break;
     default:
 	bail_with_error("Call to unparseStmt with an AST that is not a statement!");
 	break;
     }
+    SAMPLE_END();
 }
 
-// Unparse the assignment statment given by stmt to out
+// Unparse the assignment statment given by stmt
 // with indentation level given by level,
-// and add a semicolon at the end if addSemiToEnd is true.
-static void unparseAssignStmt(FILE *out, AST *stmt, int level,
-			      bool addSemiToEnd)
+// and add a semicolon at the end if the UNPARSE_SEMI flag is set.
+static void visitAssignStmt(ast_walker *w, AST *stmt, int level,
+			    unsigned int flags)
 {
+    sink *out = (sink *) ast_walk_context(w);
     indent(out, level);
-    fprintf(out, "%s := ", stmt->data.assign_stmt.name);
-    unparseExpr(out, stmt->data.assign_stmt.exp);
-    newlineAndOptionalSemi(out, addSemiToEnd);
+    sink_puts(out, stmt->data.assign_stmt.name);
+    sink_puts(out, " := ");
+    ast_walk_visit(w, stmt->data.assign_stmt.exp, level, 0);
+    ast_walk_action(w, finishSimpleStmt, stmt, level, flags);
 }
 
-// Unparse the sequential statment given by stmt to out
+// Unparse the sequential statment given by stmt
 // with indentation level given by level (indenting the body one more level)
-// and add a semicolon at the end if addSemiToEnd is true.
-static void unparseBeginStmt(FILE *out, AST *stmt, int level,
-			     bool addSemiToEnd)
+// and add a semicolon at the end if the UNPARSE_SEMI flag is set.
+static void visitBeginStmt(ast_walker *w, AST *stmt, int level,
+			   unsigned int flags)
 {
+    sink *out = (sink *) ast_walk_context(w);
     indent(out, level);
-    fprintf(out, "begin\n");
-    AST *stmt1 = ast_list_first(stmt->data.begin_stmt.stmts);
-    AST_list rest = ast_list_rest(stmt->data.begin_stmt.stmts);
-    unparseStmtList(out, stmt1, rest, level+1, false);
-    indent(out, level);
-    fprintf(out, "end");
-    newlineAndOptionalSemi(out, addSemiToEnd);
+    sink_puts(out, "begin\n");
+    AST_list stmts = stmt->data.begin_stmt.stmts;
+    while (!ast_list_is_empty(stmts)) {
+	AST_list nxt = ast_list_rest(stmts);
+	ast_walk_visit(w, ast_list_first(stmts), level+1,
+		       semiFlags(!ast_list_is_empty(nxt)));
+	stmts = nxt;
+    }
 }
 
-// Unparse the list of statments given by stmt to out
-// with indentation level given by level,
-// and add a semicolon at the end if addSemiToEnd is true.
-static void unparseStmtList(FILE *out, AST *stmt1, AST_list rest,
-			   int level, bool addSemiToEnd)
-{
-    unparseStmt(out, stmt1, level, !ast_list_is_empty(rest));
-    while (!ast_list_is_empty(rest)) {
-	AST_list nxt = ast_list_rest(rest);
-	unparseStmt(out, rest, level, !ast_list_is_empty(nxt));
-	rest = nxt;
-    }
+// Finish the sequential statement given by stmt (after its body)
+static void finishBeginStmt(ast_walker *w, AST *stmt, int level,
+			    unsigned int flags)
+{
+    sink *out = (sink *) ast_walk_context(w);
+    indent(out, level);
+    sink_puts(out, "end");
+    newlineAndOptionalSemi(out, (flags & UNPARSE_SEMI) != 0);
 }
 
-// Unparse the if-statment given by stmt to out
+// Unparse the if-statment given by stmt
 // with indentation level given by level (and each body indented one more),
-// and add a semicolon at the end if addSemiToEnd is true.
-static void unparseIfStmt(FILE *out, AST *stmt, int level, bool addSemiToEnd)
+// and add a semicolon at the end if the UNPARSE_SEMI flag is set.
+static void visitIfStmt(ast_walker *w, AST *stmt, int level,
+			unsigned int flags)
 {
+    sink *out = (sink *) ast_walk_context(w);
     indent(out, level);
-    fprintf(out, "if ");
-    unparseCondition(out, stmt->data.if_stmt.cond);
-    fprintf(out, "\n");
+    sink_puts(out, "if ");
+    ast_walk_visit(w, stmt->data.if_stmt.cond, level, 0);
+    ast_walk_action(w, visitThenPart, stmt, level, 0);
+    ast_walk_visit(w, stmt->data.if_stmt.thenstmt, level+1, 0);
+    ast_walk_action(w, visitElsePart, stmt, level, 0);
+    ast_walk_visit(w, stmt->data.if_stmt.elsestmt, level+1, flags);
+}
+
+// Print the line with the "then" of an if-statement
+static void visitThenPart(ast_walker *w, AST *stmt, int level,
+			  unsigned int flags)
+{
+    sink *out = (sink *) ast_walk_context(w);
+    sink_puts(out, "\n");
     indent(out, level);
-    fprintf(out, "then\n");
-    unparseStmt(out, stmt->data.if_stmt.thenstmt, level+1, false);
+    sink_puts(out, "then\n");
+}
+
+// Print the line with the "else" of an if-statement
+static void visitElsePart(ast_walker *w, AST *stmt, int level,
+			  unsigned int flags)
+{
+    sink *out = (sink *) ast_walk_context(w);
     indent(out, level);
-    fprintf(out, "else\n");
-    unparseStmt(out, stmt->data.if_stmt.elsestmt, level+1, addSemiToEnd);
+    sink_puts(out, "else\n");
 }
 
-// Unparse the while-statment given by stmt to out
+// Unparse the while-statment given by stmt
 // with indentation level given by level (and the body indented one more),
-// and add a semicolon at the end if addSemiToEnd is true.
-static void unparseWhileStmt(FILE *out, AST* stmt, int level, bool addSemiToEnd)
+// and add a semicolon at the end if the UNPARSE_SEMI flag is set.
+static void visitWhileStmt(ast_walker *w, AST* stmt, int level,
+			   unsigned int flags)
 {
+    sink *out = (sink *) ast_walk_context(w);
     indent(out, level);
-    fprintf(out, "while ");
-    unparseCondition(out, stmt->data.while_stmt.cond);
-    fprintf(out, "\n");
+    sink_puts(out, "while ");
+    ast_walk_visit(w, stmt->data.while_stmt.cond, level, 0);
+    ast_walk_action(w, visitDoPart, stmt, level, 0);
+    ast_walk_visit(w, stmt->data.while_stmt.stmt, level+1, flags);
+}
+
+// Print the line with the "do" of a while-statement
+static void visitDoPart(ast_walker *w, AST *stmt, int level,
+			unsigned int flags)
+{
+    sink *out = (sink *) ast_walk_context(w);
+    sink_puts(out, "\n");
     indent(out, level);
-    fprintf(out, "do\n");
-    unparseStmt(out, stmt->data.while_stmt.stmt, level+1, addSemiToEnd);
+    sink_puts(out, "do\n");
 }
 
-// Unparse the read statment given by stmt to out
-// and add a semicolon at the end if addSemiToEnd is true.
-static void unparseReadStmt(FILE *out, AST *stmt, int level, bool addSemiToEnd)
+// Unparse the read statment given by stmt
+// and add a semicolon at the end if the UNPARSE_SEMI flag is set.
+static void visitReadStmt(ast_walker *w, AST *stmt, int level,
+			  unsigned int flags)
 {
+    sink *out = (sink *) ast_walk_context(w);
     indent(out, level);
-    fprintf(out, "read %s", stmt->data.read_stmt.name);
-    newlineAndOptionalSemi(out, addSemiToEnd);
+    sink_puts(out, "read ");
+    sink_puts(out, stmt->data.read_stmt.name);
+    newlineAndOptionalSemi(out, (flags & UNPARSE_SEMI) != 0);
 }
 
-// Unparse the write statment given by stmt to out
-// and add a semicolon at the end if addSemiToEnd is true.
-static void unparseWriteStmt(FILE *out, AST *stmt, int level, bool addSemiToEnd)
+// Unparse the write statment given by stmt
+// and add a semicolon at the end if the UNPARSE_SEMI flag is set.
+static void visitWriteStmt(ast_walker *w, AST *stmt, int level,
+			   unsigned int flags)
 {
+    sink *out = (sink *) ast_walk_context(w);
     indent(out, level);
-    fprintf(out, "write ");
-    unparseExpr(out, stmt->data.write_stmt.exp);
-    newlineAndOptionalSemi(out, addSemiToEnd);
+    sink_puts(out, "write ");
+    ast_walk_visit(w, stmt->data.write_stmt.exp, level, 0);
+    ast_walk_action(w, finishSimpleStmt, stmt, level, flags);
 }
 
-// Unparse the write statment given by stmt to out
-// and add a semicolon at the end if addSemiToEnd is true.
-static void unparseSkipStmt(FILE *out, int level, bool addSemiToEnd)
+// Unparse the skip statment given by stmt
+// and add a semicolon at the end if the UNPARSE_SEMI flag is set.
+static void visitSkipStmt(ast_walker *w, AST *stmt, int level,
+			  unsigned int flags)
 {
+    sink *out = (sink *) ast_walk_context(w);
     indent(out, level);
-    fprintf(out, "skip");
-    newlineAndOptionalSemi(out, addSemiToEnd);
+    sink_puts(out, "skip");
+    newlineAndOptionalSemi(out, (flags & UNPARSE_SEMI) != 0);
 }
 
 // Unparse the condition given by cond to out
-void unparseCondition(FILE *out, AST *cond)
+void unparseCondition(sink *out, AST *cond)
 {
+    SAMPLE_BEGIN("unparseCondition");
     switch (cond->type_tag) {
     case odd_cond_ast:
-	unparseOddCond(out, cond);
-	break;
     case bin_cond_ast:
-	unparseBinRelCond(out, cond);
+	ast_walk(cond, &unparse_visitor, out, 0, 0);
 	break;
     default:
 	bail_with_error("Unexpected type tag %d in unparseCondition!",
 			cond->type_tag);
 	break;
     }
+    SAMPLE_END();
+}
+
+// Unparse the odd condition given by cond
+// (its expression is visited by the walker afterwards)
+static void visitOddCond(ast_walker *w, AST *cond, int level,
+			 unsigned int flags)
+{
+    sink_puts((sink *) ast_walk_context(w), "odd ");
 }
 
-// Unparse the odd condition given by cond to out
-static void unparseOddCond(FILE *out, AST *cond)
+// Unparse the binary relation condition given by cond
+static void visitBinRelCond(ast_walker *w, AST *cond, int level,
+			    unsigned int flags)
 {
-    fprintf(out, "odd ");
-    unparseExpr(out, cond->data.odd_cond.exp);
+    ast_walk_visit(w, cond->data.bin_cond.leftexp, level, 0);
+    ast_walk_action(w, visitRelOp, cond, level, 0);
+    ast_walk_visit(w, cond->data.bin_cond.rightexp, level, 0);
 }
 
-// Unparse the binary relation condition given by cond to out
-static void unparseBinRelCond(FILE *out, AST *cond)
+// Unparse the relational operator of cond, surrounded by spaces
+static void visitRelOp(ast_walker *w, AST *cond, int level,
+		       unsigned int flags)
 {
-    unparseExpr(out, cond->data.bin_cond.leftexp);
-    fprintf(out, " ");
+    sink *out = (sink *) ast_walk_context(w);
+    sink_putc(out, ' ');
     unparseRelOp(out, cond->data.bin_cond.relop);
-    fprintf(out, " ");
-    unparseExpr(out, cond->data.bin_cond.rightexp);
+    sink_putc(out, ' ');
 }
 
 // Unparse the given relational operator, relop, to out
-void unparseRelOp(FILE *out, rel_op relop)
+void unparseRelOp(sink *out, rel_op relop)
 {
     switch (relop) {
     case eqop:
-	fprintf(out, "=");
+	sink_putc(out, '=');
 	break;
     case neqop:
-	fprintf(out, "<>");
+	sink_puts(out, "<>");
 	break;
     case ltop:
-	fprintf(out, "<");
+	sink_putc(out, '<');
 	break;
     case leqop:
-	fprintf(out, "<=");
+	sink_puts(out, "<=");
 	break;
     case gtop:
-	fprintf(out, ">");
+	sink_putc(out, '>');
 	break;
     case geqop:
-	fprintf(out, ">=");
+	sink_puts(out, ">=");
 	break;
     default:
 	bail_with_error("Unknown rel_op %d", relop);
@@ -280,52 +391,65 @@ void unparseRelOp(FILE *out, rel_op relop)
 
 // Unparse the expression given by the AST exp to out
 // adding parentheses to indicate the nesting relationships
-void unparseExpr(FILE *out, AST *exp)
+void unparseExpr(sink *out, AST *exp)
 {
+    SAMPLE_BEGIN("unparseExpr");
     switch (exp->type_tag) {
     case bin_expr_ast:
-	unparseBinExpr(out, exp);
-	break;
     case ident_ast:
-	unparseIdent(out, exp);
-	break;
     case number_ast:
-	unparseNumber(out, exp);
+	ast_walk(exp, &unparse_visitor, out, 0, 0);
 	break;
     default:
 	bail_with_error("Unexpected type_tag %d in unparseExpr", exp->type_tag);
 	break;
     }
+    SAMPLE_END();
 }
 
-// Unparse the expression given by the AST exp to out
+// Unparse the expression given by the AST exp
 // adding parentheses (whether needed or not)
-static void unparseBinExpr(FILE *out, AST *exp)
+static void visitBinExpr(ast_walker *w, AST *exp, int level,
+			 unsigned int flags)
 {
-    fprintf(out, "(");
-    unparseExpr(out, exp->data.bin_expr.leftexp);
-    fprintf(out, " ");
+    sink_putc((sink *) ast_walk_context(w), '(');
+    ast_walk_visit(w, exp->data.bin_expr.leftexp, level, 0);
+    ast_walk_action(w, visitArithOp, exp, level, 0);
+    ast_walk_visit(w, exp->data.bin_expr.rightexp, level, 0);
+}
+
+// Unparse the arithmetic operator of exp, surrounded by spaces
+static void visitArithOp(ast_walker *w, AST *exp, int level,
+			 unsigned int flags)
+{
+    sink *out = (sink *) ast_walk_context(w);
+    sink_putc(out, ' ');
     unparseArithOp(out, exp->data.bin_expr.arith_op);
-    fprintf(out, " ");
-    unparseExpr(out, exp->data.bin_expr.rightexp);
-    fprintf(out, ")");
+    sink_putc(out, ' ');
+}
+
+// Close the parenthesis opened by visitBinExpr
+static void finishBinExpr(ast_walker *w, AST *exp, int level,
+			  unsigned int flags)
+{
+    sink_putc((sink *) ast_walk_context(w), ')');
 }
 
 // Unparse the given bin_arith_opo to out
-void unparseArithOp(FILE *out, bin_arith_op op)
+void unparseArithOp(sink *out, bin_arith_op op)
 {
     switch (op) {
     case addop:
-	fprintf(out, "+");
+	sink_putc(out, '+');
 	break;
     case subop:
-	fprintf(out, "-");
+	sink_putc(out, '-');
 	break;
     case multop:
-	fprintf(out, "*");
+	sink_putc(out, '*');
 	break;
     case divop:
-	fprintf(out, "/");
+	sink_putc(out, '/');
 	break;
     default:
 	bail_with_error("Unexpected bin_arith_op %d in unparseArithOp", op);
@@ -334,13 +458,23 @@ void unparseArithOp(FILE *out, bin_arith_op op)
 }
 
 // Unparse the given identifer reference (use) to out
-void unparseIdent(FILE *out, AST *id)
+void unparseIdent(sink *out, AST *id)
+{
+    sink_puts(out, id->data.ident.name);
+}
+
+static void visitIdent(ast_walker *w, AST *id, int level, unsigned int flags)
 {
-    fprintf(out, "%s", id->data.ident.name);
+    unparseIdent((sink *) ast_walk_context(w), id);
 }
 
 // Unparse the given number to out in decimal format
-void unparseNumber(FILE *out, AST *num)
+void unparseNumber(sink *out, AST *num)
+{
+    sink_put_int(out, num->data.number.value);
+}
+
+static void visitNumber(ast_walker *w, AST *num, int level, unsigned int flags)
 {
-    fprintf(out, "%d", num->data.number.value);
+    unparseNumber((sink *) ast_walk_context(w), num);
 }
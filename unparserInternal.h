@@ -1,32 +1,60 @@
 #ifndef _UNPARSERINTERNAL_H
 #define _UNPARSERINTERNAL_H
 #include "unparser.h"
+#include "ast_walk.h"
 
-static void unparseConstDecl(FILE *out, AST *cd, int level);
+static void unparseConstDecl(sink *out, AST *cd, int level);
 
-static void unparseVarDecl(FILE *out, AST *vd, int level);
+static void unparseVarDecl(sink *out, AST *vd, int level);
 
-static void unparseAssignStmt(FILE *out, AST *stmt, int level, bool addSemiToEnd);
+// Callbacks for the AST walker (see ast_walk.h),
+// the walker's level is the indentation level
+// and its flags are the UNPARSE_* flags below
 
-static void unparseBeginStmt(FILE *out, AST *stmt, int level, bool addSemiToEnd);
+static void visitProgram(ast_walker *w, AST *prog, int level, unsigned int flags);
 
-static void unparseStmtList(FILE *out, AST *stmt1, AST *rest,
-			   int level, bool addSemiToEnd);
+static void visitConstDecl(ast_walker *w, AST *cd, int level, unsigned int flags);
 
-static void unparseIfStmt(FILE *out, AST *stmt, int level, bool addSemiToEnd);
+static void visitVarDecl(ast_walker *w, AST *vd, int level, unsigned int flags);
 
-static void unparseWhileStmt(FILE *out, AST* stmt, int level, bool addSemiToEnd);
+static void visitAssignStmt(ast_walker *w, AST *stmt, int level, unsigned int flags);
 
-static void unparseReadStmt(FILE *out, AST *stmt, int level, bool addSemiToEnd);
+static void visitBeginStmt(ast_walker *w, AST *stmt, int level, unsigned int flags);
 
-static void unparseWriteStmt(FILE *out, AST *stmt, int level, bool addSemiToEnd);
+static void finishBeginStmt(ast_walker *w, AST *stmt, int level, unsigned int flags);
 
-static void unparseSkipStmt(FILE *out, int level, bool addSemiToEnd);
+static void visitIfStmt(ast_walker *w, AST *stmt, int level, unsigned int flags);
 
-static void unparseOddCond(FILE *out, AST *cond);
+static void visitThenPart(ast_walker *w, AST *stmt, int level, unsigned int flags);
 
-static void unparseBinRelCond(FILE *out, AST *cond);
+static void visitElsePart(ast_walker *w, AST *stmt, int level, unsigned int flags);
 
-static void unparseBinExpr(FILE *out, AST *exp);
+static void visitWhileStmt(ast_walker *w, AST* stmt, int level, unsigned int flags);
+
+static void visitDoPart(ast_walker *w, AST *stmt, int level, unsigned int flags);
+
+static void visitReadStmt(ast_walker *w, AST *stmt, int level, unsigned int flags);
+
+static void visitWriteStmt(ast_walker *w, AST *stmt, int level, unsigned int flags);
+
+static void visitSkipStmt(ast_walker *w, AST *stmt, int level, unsigned int flags);
+
+static void finishSimpleStmt(ast_walker *w, AST *stmt, int level, unsigned int flags);
+
+static void visitOddCond(ast_walker *w, AST *cond, int level, unsigned int flags);
+
+static void visitBinRelCond(ast_walker *w, AST *cond, int level, unsigned int flags);
+
+static void visitRelOp(ast_walker *w, AST *cond, int level, unsigned int flags);
+
+static void visitBinExpr(ast_walker *w, AST *exp, int level, unsigned int flags);
+
+static void visitArithOp(ast_walker *w, AST *exp, int level, unsigned int flags);
+
+static void finishBinExpr(ast_walker *w, AST *exp, int level, unsigned int flags);
+
+static void visitIdent(ast_walker *w, AST *id, int level, unsigned int flags);
+
+static void visitNumber(ast_walker *w, AST *num, int level, unsigned int flags);
 
 #endif
@@ -7,7 +7,65 @@
 #include <assert.h>
 #include "token.h"
 #include "file_location.h"
+#include "sink.h"
 #include "utilities.h"
+#include "mem.h"
+
+// The current thread's error trap (or NULL if there is none)
+static _Thread_local error_trap *current_trap = NULL;
+
+// Requires: setjmp(trap->env) has been called in a function that is active
+// Make trap the current thread's error trap
+void error_trap_set(error_trap *trap)
+{
+    current_trap = trap;
+}
+
+// Make the current thread have no error trap,
+// so errors go to stderr and exit the program again
+void error_trap_clear()
+{
+    current_trap = NULL;
+}
+
+// Return the current thread's error trap (or NULL if there is none)
+error_trap *error_trap_current()
+{
+    return current_trap;
+}
+
+// Print a message to where errors go:
+// the current error trap's diagnostics, if there is a trap,
+// and otherwise stderr.
+static void verror_print(const char *fmt, va_list args)
+{
+    if (current_trap == NULL) {
+	vfprintf(stderr, fmt, args);
+    } else {
+	char buff[2048];
+	vsnprintf(buff, sizeof(buff), fmt, args);
+	sink_puts(current_trap->diagnostics, buff);
+    }
+}
+
+// Print a message (formatted using fmt) to where errors go
+static void error_print(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    verror_print(fmt, args);
+    va_end(args);
+}
+
+// Print a message (formatted using fmt, like printf) to where errors go
+// (see utilities.h)
+void diagnostic_print(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    verror_print(fmt, args);
+    va_end(args);
+}
 
 // to turn off debugging support (assertions and debug_print)
 // define the symbol NDEBUG (by writing uncommenting the following)
@@ -60,7 +118,15 @@ static void vbail_with_error(const char* fmt, va_list args)
 {
     extern int errno;
     char buff[2048];
-    vsprintf(buff, fmt, args);
+    vsnprintf(buff, sizeof(buff), fmt, args);
+    if (current_trap != NULL) {
+	if (errno != 0) {
+	    error_print("%s: %s\n", buff, strerror(errno));
+	} else {
+	    error_print("%s\n", buff);
+	}
+	longjmp(current_trap->env, 1);
+    }
     if (errno != 0) {
 	perror(buff);
     } else {
@@ -70,11 +136,73 @@ static void vbail_with_error(const char* fmt, va_list args)
     exit(EXIT_FAILURE);
 }
 
+// Print msg, a complete error message caught earlier (e.g., by a trap),
+// to where errors go, then exit with a failure code
+// (or return to the current error trap), so this does not return.
+void error_reraise(const char *msg)
+{
+    fflush(stdout); // flush so output comes after what has happened already
+    error_print("%s", msg);
+    if (current_trap != NULL) {
+	longjmp(current_trap->env, 1);
+    }
+    fflush(stderr);
+    exit(EXIT_FAILURE);
+}
+
+// Print the messages collected in s, close s, then exit with a failure code
+// (or return to the current error trap), so this does not return.
+void error_reraise_sink(sink *s)
+{
+    fflush(stdout); // flush so output comes after what has happened already
+    error_print("%s", sink_contents(s));
+    sink_close(s);
+    if (current_trap != NULL) {
+	longjmp(current_trap->env, 1);
+    }
+    fflush(stderr);
+    exit(EXIT_FAILURE);
+}
+
+// Read the whole file named fname into a fresh (null-terminated) buffer,
+// putting the number of chars read into *len.
+// Return NULL if the file cannot be opened (with errno set).
+// If there is no space, bail with an error message.
+char *read_whole_file(const char *fname, size_t *len)
+{
+    FILE *fp = fopen(fname, "r");
+    if (fp == NULL) {
+	return NULL;
+    }
+    size_t cap = BUFSIZ;
+    size_t n = 0;
+    char *buf = (char *) mem_alloc(mem_driver, cap);
+    size_t got;
+    while (buf != NULL && (got = fread(buf + n, 1, cap - n - 1, fp)) > 0) {
+	n += got;
+	if (cap - n == 1) {
+	    cap *= 2;
+	    char *nb = (char *) mem_realloc(mem_driver, buf, cap);
+	    if (nb == NULL) {
+		mem_free(buf);
+	    }
+	    buf = nb;
+	}
+    }
+    fclose(fp);
+    if (buf == NULL) {
+	bail_with_error("No space to read the file %s", fname);
+    }
+    buf[n] = '\0';
+    *len = n;
+    return buf;
+}
+
 void lexical_error(const char *filename, unsigned int line,
 			  unsigned int column, const char *fmt, ...)
 {
     fflush(stdout); // flush so output comes after what has happened already
-    fprintf(stderr, "%s: line %d, column %d: ", filename, line, column);
+    error_print("%s: line %d, column %d: ", filename, line, column);
     va_list(args);
     va_start(args, fmt);
     vbail_with_error(fmt, args);
@@ -82,7 +210,7 @@ void lexical_error(const char *filename, unsigned int line,
 
 const char *token2string(token t)
 {
-    char *buf = (char *)malloc(sizeof(char)*BUFSIZ);
+    char *buf = (char *)mem_alloc(mem_driver, sizeof(char)*BUFSIZ);
     if (buf == NULL) {
 	bail_with_error("No space for buf in token2string!");
     }
@@ -107,7 +235,7 @@ void parse_error_unexpected(token_type *expected,
 {
     fflush(stdout); // flush so output comes after what has happened already
     // print file, line, column information
-    fprintf(stderr, "%s: line %d, column %d: syntax error, ",
+    error_print("%s: line %d, column %d: syntax error, ",
 	    saw.filename, saw.line, saw.column);
 
     // print what was expected and what was seen, then bail out!
@@ -117,14 +245,14 @@ void parse_error_unexpected(token_type *expected,
 			(saw.text != NULL ? saw.text : ""));
     } else {
 	// num_expected > 1
-	fprintf(stderr, "Expecting one of: ");
+	error_print("Expecting one of: ");
 	for (int i = 0; i < num_expected; i++) {
 	    if (0 < i && i < num_expected-1) {
-		fprintf(stderr, ", ");
+		error_print(", ");
 	    } else if (i == num_expected-1) {
-		fprintf(stderr, " or ");
+		error_print(" or ");
 	    }
-	    fprintf(stderr, "%s", ttyp2str(expected[i]));
+	    error_print("%s", ttyp2str(expected[i]));
 	}
 	bail_with_error(", but saw a %s token (\"%s\")",
 			ttyp2str(saw.typ),
@@ -140,7 +268,7 @@ void parse_error_general(token t, const char *fmt, ...)
 {
     fflush(stdout); // flush so output comes after what has happened already
     // print file, line, column information
-    fprintf(stderr, "%s: line %d, column %d: ",
+    error_print("%s: line %d, column %d: ",
 	    t.filename, t.line, t.column);
 
     va_list(args);
@@ -156,10 +284,26 @@ void general_error(file_location floc, const char *fmt, ...)
 {
     fflush(stdout); // flush so output comes after what has happened already
     // print file, line, column information
-    fprintf(stderr, "%s: line %d, column %d: ",
+    error_print("%s: line %d, column %d: ",
 	    floc.filename, floc.line, floc.column);
 
     va_list(args);
     va_start(args, fmt);
     vbail_with_error(fmt, args);
 }
+
+// Print a compiler warning message to where errors go
+// starting with the filename, a colon, the line number, a comma
+// the column number, a colon, "warning: ", and then the message
+// (adding a newline). This function returns normally.
+void general_warning(file_location floc, const char *fmt, ...)
+{
+    fflush(stdout); // flush so output comes after what has happened already
+    char buff[2048];
+    va_list(args);
+    va_start(args, fmt);
+    vsnprintf(buff, sizeof(buff), fmt, args);
+    va_end(args);
+    error_print("%s: line %d, column %d: warning: %s\n",
+		floc.filename, floc.line, floc.column, buff);
+}
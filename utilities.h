@@ -3,8 +3,40 @@
 #define _UTILITIES_H
 #include <stdbool.h>
 #include <assert.h>
+#include <setjmp.h>
 #include "token.h"
 #include "file_location.h"
+#include "sink.h"
+
+// An error trap lets a caller recover from the errors below
+// instead of having the program exit (e.g., to compile several files).
+// While a trap is set (in the current thread),
+// error messages are written to its diagnostics sink
+// and the error functions longjmp to its env (with the value 1).
+typedef struct {
+    jmp_buf env;
+    sink *diagnostics;
+} error_trap;
+
+// Requires: setjmp(trap->env) has been called in a function that is active
+// Make trap the current thread's error trap
+extern void error_trap_set(error_trap *trap);
+
+// Make the current thread have no error trap,
+// so errors go to stderr and exit the program again
+extern void error_trap_clear();
+
+// Return the current thread's error trap (or NULL if there is none)
+extern error_trap *error_trap_current();
+
+// Print msg, a complete error message caught earlier (e.g., by a trap),
+// to where errors go, then exit with a failure code
+// (or return to the current error trap), so this does not return.
+extern void error_reraise(const char *msg);
+
+// Like error_reraise, but for the messages collected in the sink s,
+// which is closed once they are printed, so this does not return.
+extern void error_reraise_sink(sink *s);
 
 // If NDEBUG is defined, do nothing, otherwise (when debugging)
 // flush stderr and stdout, then print the message given on stderr,
@@ -16,6 +48,12 @@ void debug_print(const char *fmt, ...);
 // then exit with a failure code, so a call to this does not return.
 extern void bail_with_error(const char *fmt, ...);
 
+// Read the whole file named fname into a fresh (null-terminated) buffer,
+// putting the number of chars read into *len.
+// Return NULL if the file cannot be opened (with errno set).
+// If there is no space, bail with an error message.
+extern char *read_whole_file(const char *fname, size_t *len);
+
 // Print a lexical error message to stderr
 // starting with the filename, a colon, the line number, a comma
 // the column number, a colon, and then the message.
@@ -47,4 +85,15 @@ extern void parse_error_general(token t, const char *fmt, ...);
 // Then exit with a failure code, so this function does not return.
 extern void general_error(file_location floc, const char *fmt, ...);
 
+// Print a message (formatted using fmt, like printf) to where errors go:
+// the current error trap's diagnostics, if there is a trap,
+// and otherwise stderr. This function returns normally.
+extern void diagnostic_print(const char *fmt, ...);
+
+// Print a compiler warning message to where errors go
+// starting with the filename, a colon, the line number, a comma
+// the column number, a colon, "warning: ", and then the message
+// (adding a newline). This function returns normally.
+extern void general_warning(file_location floc, const char *fmt, ...);
+
 #endif